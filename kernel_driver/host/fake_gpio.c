@@ -0,0 +1,35 @@
+#include "fake_gpio.h"
+
+#include <string.h>
+
+static void fake_write_register(void * context, unsigned int offset, unsigned int value) {
+    struct fake_gpio * gpio = (struct fake_gpio *) context;
+    gpio->registers[(offset / sizeof(unsigned int)) % FAKE_GPIO_REGISTER_WORDS] = value;
+    gpio->register_writes++;
+    if (offset == LAMP_GPSET0_OFFSET) {
+        gpio->level |= value;
+        gpio->set_writes++;
+    } else if (offset == LAMP_GPCLR0_OFFSET) {
+        gpio->level &= ~value;
+        gpio->clear_writes++;
+    }
+}
+
+static void fake_sleep_ms(void * context, unsigned int ms) {
+    struct fake_gpio * gpio = (struct fake_gpio *) context;
+    gpio->slept_ms += ms;
+}
+
+const struct lamp_gpio_ops fake_gpio_ops = {
+    .write_register = fake_write_register,
+    .sleep_ms = fake_sleep_ms
+};
+
+void fake_gpio_reset(struct fake_gpio * gpio) {
+    memset(gpio, 0, sizeof(*gpio));
+}
+
+void fake_gpio_init_state_machine(struct fake_gpio * gpio, struct lamp_state_machine * sm, bool mask_writes) {
+    fake_gpio_reset(gpio);
+    lamp_sm_init(sm, &fake_gpio_ops, gpio, 100, mask_writes);
+}
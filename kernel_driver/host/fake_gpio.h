@@ -0,0 +1,32 @@
+#ifndef FAKE_GPIO_H
+#define FAKE_GPIO_H
+
+#include <stdbool.h>
+
+#include "lamp_state_machine.h"
+
+/* size of the GPIO register bank of the BCM2711 in 32 bit words */
+#define FAKE_GPIO_REGISTER_WORDS 64
+
+/*
+Fake GPIO register bank for the host library. GPSET0/GPCLR0 writes are applied to the output
+level like the GPIO controller would do it, every write is counted and the sleeps of the
+lightplays only add up the simulated time instead of sleeping.
+*/
+struct fake_gpio {
+    unsigned int registers [FAKE_GPIO_REGISTER_WORDS]; // last value written per register
+    unsigned int level; // output level of GPIO 0-31
+    unsigned long register_writes;
+    unsigned long set_writes;
+    unsigned long clear_writes;
+    unsigned long slept_ms;
+};
+
+extern const struct lamp_gpio_ops fake_gpio_ops;
+
+void fake_gpio_reset(struct fake_gpio * gpio);
+
+/* initializes the state machine on top of the fake register bank */
+void fake_gpio_init_state_machine(struct fake_gpio * gpio, struct lamp_state_machine * sm, bool mask_writes);
+
+#endif /* FAKE_GPIO_H */
@@ -0,0 +1,72 @@
+/*
+Microbenchmark of the lamp command state machine on the fake GPIO register bank: the number of
+GPSET0/GPCLR0 writes per command - averaged over all 8 LED states the command can start from -
+with one write per pin and with mask writes, and the CPU time per command without the sleeps of
+the lightplays.
+
+    $ make bench [ITERATIONS=N]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "fake_gpio.h"
+
+#define NUM_LED_STATES 8
+
+static double average_writes(unsigned int command, bool mask_writes) {
+    unsigned long writes = 0;
+    unsigned int led_state;
+    for (led_state = 0; led_state < NUM_LED_STATES; led_state++) {
+        struct fake_gpio gpio;
+        struct lamp_state_machine sm;
+        unsigned int idx;
+        fake_gpio_init_state_machine(&gpio, &sm, mask_writes);
+        for (idx = 0; idx < LAMP_NUM_LEDS; idx++) {
+            if (led_state & (1u << idx)) {
+                lamp_sm_execute(&sm, idx);
+            }
+        }
+        gpio.register_writes = 0;
+        lamp_sm_execute(&sm, command);
+        writes += gpio.register_writes;
+    }
+    return (double) writes / NUM_LED_STATES;
+}
+
+static double ns_per_command(unsigned int command, bool mask_writes, long iterations) {
+    struct fake_gpio gpio;
+    struct lamp_state_machine sm;
+    struct timespec start;
+    struct timespec end;
+    long iteration;
+    fake_gpio_init_state_machine(&gpio, &sm, mask_writes);
+    lamp_sm_execute(&sm, 1); // one LED on, so the lightplays have something to restore
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (iteration = 0; iteration < iterations; iteration++) {
+        lamp_sm_execute(&sm, command);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / iterations;
+}
+
+int main(int argc, char * argv[]) {
+    long iterations = (argc > 1) ? atol(argv[1]) : 1000000;
+    unsigned int command;
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    printf("command  writes/pin  writes/mask  ns/pin  ns/mask\n");
+    for (command = 0; command <= LAMP_MAX_COMMAND; command++) {
+        printf("%7u  %10.2f  %11.2f  %6.1f  %7.1f\n",
+            command,
+            average_writes(command, false),
+            average_writes(command, true),
+            ns_per_command(command, false, iterations),
+            ns_per_command(command, true, iterations));
+    }
+    return 0;
+}
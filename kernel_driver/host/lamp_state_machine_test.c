@@ -0,0 +1,214 @@
+/*
+Tests of the lamp command state machine on the fake GPIO register bank. Besides the single
+commands, every command sequence up to SEQUENCE_LENGTH commands (including invalid ones) is
+checked against a reference model, with per pin and with mask writes.
+
+    $ make test
+*/
+#include <stdio.h>
+#include <errno.h>
+
+#include "fake_gpio.h"
+
+#define SEQUENCE_LENGTH 5
+#define NUM_TEST_COMMANDS 10 // 0-8 and the invalid command 9
+
+#define PIN_16 (1u << 16)
+#define PIN_20 (1u << 20)
+#define PIN_21 (1u << 21)
+#define ALL_PINS (PIN_16 | PIN_20 | PIN_21)
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+/* the LED bitmask of the userspace service - bit n is lamp_state[n] */
+static unsigned int reference_command(unsigned int led_mask, unsigned int command) {
+    if (command <= 2) {
+        return led_mask | (1u << command);
+    }
+    if (command <= 5) {
+        return led_mask & ~(1u << (command - 3));
+    }
+    if (command == 8) {
+        return 0;
+    }
+    return led_mask; // lightplays and invalid commands keep the state
+}
+
+static unsigned int led_mask_to_pins(unsigned int led_mask) {
+    unsigned int pins = 0;
+    int idx;
+    for (idx = 0; idx < LAMP_NUM_LEDS; idx++) {
+        if (led_mask & (1u << idx)) {
+            pins |= (1u << lamp_sm_pins[idx]);
+        }
+    }
+    return pins;
+}
+
+static unsigned int reported_led_mask(const struct lamp_state_machine * sm) {
+    unsigned int led_mask = 0;
+    int idx;
+    for (idx = 0; idx < LAMP_NUM_LEDS; idx++) {
+        if (sm->lamp_state[idx]) {
+            led_mask |= (1u << idx);
+        }
+    }
+    return led_mask;
+}
+
+static void test_single_commands(bool mask_writes) {
+    struct fake_gpio gpio;
+    struct lamp_state_machine sm;
+    fake_gpio_init_state_machine(&gpio, &sm, mask_writes);
+
+    CHECK(lamp_sm_execute(&sm, 0) == 0);
+    CHECK(gpio.level == PIN_16);
+    CHECK(gpio.registers[LAMP_GPSET0_OFFSET / 4] == PIN_16);
+    CHECK(lamp_sm_execute(&sm, 2) == 0);
+    CHECK(gpio.level == (PIN_16 | PIN_21));
+    CHECK(lamp_sm_execute(&sm, 3) == 0);
+    CHECK(gpio.level == PIN_21);
+    CHECK(gpio.registers[LAMP_GPCLR0_OFFSET / 4] == PIN_16);
+    CHECK(reported_led_mask(&sm) == 0x4);
+    CHECK(gpio.register_writes == 3);
+}
+
+static void test_invalid_commands_do_not_touch_the_registers(bool mask_writes) {
+    struct fake_gpio gpio;
+    struct lamp_state_machine sm;
+    fake_gpio_init_state_machine(&gpio, &sm, mask_writes);
+
+    CHECK(lamp_sm_execute(&sm, 9) == -EINVAL);
+    CHECK(lamp_sm_execute(&sm, (unsigned int) -1) == -EINVAL);
+    CHECK(gpio.register_writes == 0);
+    CHECK(reported_led_mask(&sm) == 0);
+}
+
+static void test_lightplay_order(void) {
+    struct fake_gpio gpio;
+    struct lamp_state_machine sm;
+    fake_gpio_init_state_machine(&gpio, &sm, true);
+
+    lamp_sm_lightplay(&sm, true);
+    CHECK(gpio.set_writes == 3);
+    CHECK(gpio.clear_writes == 3);
+    CHECK(gpio.registers[LAMP_GPSET0_OFFSET / 4] == PIN_16); // the reverse lightplay ends at the white LED
+    CHECK(gpio.slept_ms == 3 * sm.lightplay_time);
+    CHECK(gpio.level == 0);
+}
+
+static void test_lightplay_restores_the_leds(void) {
+    struct fake_gpio gpio;
+    struct lamp_state_machine sm;
+    fake_gpio_init_state_machine(&gpio, &sm, true);
+    lamp_sm_execute(&sm, 0);
+    lamp_sm_execute(&sm, 1);
+    gpio.register_writes = 0;
+
+    CHECK(lamp_sm_execute(&sm, 6) == 0);
+    CHECK(gpio.level == (PIN_16 | PIN_20));
+    CHECK(reported_led_mask(&sm) == 0x3);
+    // lightplay, a single clear of all pins and a single set of the lit pins
+    CHECK(gpio.register_writes == 6 + 1 + 1);
+    CHECK(gpio.registers[LAMP_GPCLR0_OFFSET / 4] == ALL_PINS);
+    CHECK(gpio.registers[LAMP_GPSET0_OFFSET / 4] == (PIN_16 | PIN_20));
+}
+
+static void test_reset_is_a_single_write_with_mask_writes(void) {
+    struct fake_gpio gpio;
+    struct lamp_state_machine sm;
+    fake_gpio_init_state_machine(&gpio, &sm, true);
+    lamp_sm_execute(&sm, 0);
+    lamp_sm_execute(&sm, 2);
+    gpio.register_writes = 0;
+
+    CHECK(lamp_sm_execute(&sm, 8) == 0);
+    CHECK(gpio.register_writes == 1);
+    CHECK(gpio.level == 0);
+    CHECK(reported_led_mask(&sm) == 0);
+
+    fake_gpio_init_state_machine(&gpio, &sm, false);
+    CHECK(lamp_sm_execute(&sm, 8) == 0);
+    CHECK(gpio.register_writes == 3);
+}
+
+static void test_clear_all_keeps_the_state_unless_rewritten(void) {
+    struct fake_gpio gpio;
+    struct lamp_state_machine sm;
+    fake_gpio_init_state_machine(&gpio, &sm, true);
+    lamp_sm_execute(&sm, 1);
+
+    lamp_sm_clear_all(&sm, false);
+    CHECK(gpio.level == 0);
+    CHECK(reported_led_mask(&sm) == 0x2);
+    CHECK(lamp_sm_pin_mask(&sm) == PIN_20);
+    lamp_sm_clear_all(&sm, true);
+    CHECK(reported_led_mask(&sm) == 0);
+}
+
+/* runs every command sequence of the given length and compares both write modes against the reference model */
+static void test_all_command_sequences(void) {
+    unsigned long sequences = 1;
+    unsigned long sequence;
+    int idx;
+    for (idx = 0; idx < SEQUENCE_LENGTH; idx++) {
+        sequences *= NUM_TEST_COMMANDS;
+    }
+
+    for (sequence = 0; sequence < sequences; sequence++) {
+        struct fake_gpio per_pin_gpio;
+        struct fake_gpio mask_gpio;
+        struct lamp_state_machine per_pin_sm;
+        struct lamp_state_machine mask_sm;
+        unsigned int expected = 0;
+        unsigned long remaining = sequence;
+        int failures_before = failures;
+        fake_gpio_init_state_machine(&per_pin_gpio, &per_pin_sm, false);
+        fake_gpio_init_state_machine(&mask_gpio, &mask_sm, true);
+
+        for (idx = 0; idx < SEQUENCE_LENGTH; idx++) {
+            unsigned int command = (unsigned int) (remaining % NUM_TEST_COMMANDS);
+            remaining /= NUM_TEST_COMMANDS;
+            expected = reference_command(expected, command);
+            lamp_sm_execute(&per_pin_sm, command);
+            lamp_sm_execute(&mask_sm, command);
+
+            CHECK(reported_led_mask(&per_pin_sm) == expected);
+            CHECK(reported_led_mask(&mask_sm) == expected);
+            CHECK(per_pin_gpio.level == led_mask_to_pins(expected));
+            CHECK(mask_gpio.level == led_mask_to_pins(expected));
+            CHECK(mask_gpio.register_writes <= per_pin_gpio.register_writes);
+        }
+        if (failures != failures_before) {
+            printf("Failing command sequence: %lu (base %d, least significant digit first)\n", sequence, NUM_TEST_COMMANDS);
+            return;
+        }
+    }
+}
+
+int main(void) {
+    test_single_commands(false);
+    test_single_commands(true);
+    test_invalid_commands_do_not_touch_the_registers(false);
+    test_invalid_commands_do_not_touch_the_registers(true);
+    test_lightplay_order();
+    test_lightplay_restores_the_leds();
+    test_reset_is_a_single_write_with_mask_writes();
+    test_clear_all_keeps_the_state_unless_rewritten();
+    test_all_command_sequences();
+
+    if (failures != 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All lamp state machine tests passed\n");
+    return 0;
+}
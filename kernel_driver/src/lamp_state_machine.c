@@ -0,0 +1,108 @@
+#include "lamp_state_machine.h"
+
+#ifdef __KERNEL__
+#include <linux/errno.h>
+#else
+#include <errno.h>
+#endif
+
+const unsigned int lamp_sm_pins [LAMP_NUM_LEDS] = {16, 20, 21};
+
+static unsigned int all_pins_mask(void) {
+    return (1u << lamp_sm_pins[0]) | (1u << lamp_sm_pins[1]) | (1u << lamp_sm_pins[2]);
+}
+
+/* writes the pin mask to GPSET0 or GPCLR0 - as a single write or one write per pin */
+static void write_pins(struct lamp_state_machine * sm, unsigned int offset, unsigned int pin_mask) {
+    int idx;
+    if (pin_mask == 0) {
+        return;
+    }
+    if (sm->mask_writes) {
+        sm->ops->write_register(sm->context, offset, pin_mask);
+        return;
+    }
+    for (idx = 0; idx < LAMP_NUM_LEDS; idx++) {
+        if (pin_mask & (1u << lamp_sm_pins[idx])) {
+            sm->ops->write_register(sm->context, offset, 1u << lamp_sm_pins[idx]);
+        }
+    }
+}
+
+static void set_led(struct lamp_state_machine * sm, unsigned int led_idx, bool turn_on) {
+    write_pins(sm, turn_on ? LAMP_GPSET0_OFFSET : LAMP_GPCLR0_OFFSET, 1u << lamp_sm_pins[led_idx]);
+    sm->lamp_state[led_idx] = turn_on;
+}
+
+/* turns the LEDs of lamp_state back on after a lightplay */
+static void recreate_state(struct lamp_state_machine * sm) {
+    write_pins(sm, LAMP_GPSET0_OFFSET, lamp_sm_pin_mask(sm));
+}
+
+void lamp_sm_init(struct lamp_state_machine * sm, const struct lamp_gpio_ops * ops, void * context, unsigned int lightplay_time, bool mask_writes) {
+    int idx;
+    for (idx = 0; idx < LAMP_NUM_LEDS; idx++) {
+        sm->lamp_state[idx] = false;
+    }
+    sm->lightplay_time = lightplay_time;
+    sm->mask_writes = mask_writes;
+    sm->ops = ops;
+    sm->context = context;
+}
+
+int lamp_sm_execute(struct lamp_state_machine * sm, unsigned int command) {
+    switch (command) {
+        case 0:
+        case 1:
+        case 2:
+            set_led(sm, command, true);
+            return 0;
+        case 3:
+        case 4:
+        case 5:
+            set_led(sm, command - 3, false);
+            return 0;
+        case 6:
+        case 7:
+            lamp_sm_lightplay(sm, command == 7);
+            lamp_sm_clear_all(sm, false);
+            recreate_state(sm);
+            return 0;
+        case 8:
+            lamp_sm_clear_all(sm, true);
+            return 0;
+        default:
+            return -EINVAL;
+    }
+}
+
+void lamp_sm_lightplay(struct lamp_state_machine * sm, bool reverse) {
+    int step;
+    for (step = 0; step < LAMP_NUM_LEDS; step++) {
+        unsigned int pin = lamp_sm_pins[reverse ? (LAMP_NUM_LEDS - 1 - step) : step];
+        sm->ops->write_register(sm->context, LAMP_GPSET0_OFFSET, 1u << pin);
+        sm->ops->sleep_ms(sm->context, sm->lightplay_time);
+        sm->ops->write_register(sm->context, LAMP_GPCLR0_OFFSET, 1u << pin);
+    }
+}
+
+void lamp_sm_clear_all(struct lamp_state_machine * sm, bool rewrite_state) {
+    int idx;
+    write_pins(sm, LAMP_GPCLR0_OFFSET, all_pins_mask());
+    if (rewrite_state) {
+        for (idx = 0; idx < LAMP_NUM_LEDS; idx++) {
+            sm->lamp_state[idx] = false;
+        }
+    }
+}
+
+unsigned int lamp_sm_pin_mask(const struct lamp_state_machine * sm) {
+    unsigned int pin_mask = 0;
+    int idx;
+    for (idx = 0; idx < LAMP_NUM_LEDS; idx++) {
+        if (sm->lamp_state[idx]) {
+            pin_mask |= (1u << lamp_sm_pins[idx]);
+        }
+    }
+    return pin_mask;
+}
@@ -0,0 +1,63 @@
+#ifndef LAMP_STATE_MACHINE_H
+#define LAMP_STATE_MACHINE_H
+
+/*
+Command state machine of the printer lamp without any kernel dependency. It is compiled into the
+kernel module as well as into the host library (see ../host), where the GPIO registers are a
+fake register bank - so the command semantics can be tested and benchmarked without a Raspberry Pi.
+The state machine does not lock, the caller has to serialize the calls.
+*/
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LAMP_NUM_LEDS 3
+#define LAMP_MAX_COMMAND 8
+
+/* register offsets (in bytes) of the GPIO controller */
+#define LAMP_GPSET0_OFFSET 0x1c
+#define LAMP_GPCLR0_OFFSET 0x28
+
+/* GPIO pins of the white, green and blue LED */
+extern const unsigned int lamp_sm_pins [LAMP_NUM_LEDS];
+
+/* register access of the state machine - the module writes to the mapped GPIO registers, the host library to a fake register bank */
+struct lamp_gpio_ops {
+    void (*write_register)(void * context, unsigned int offset, unsigned int value);
+    void (*sleep_ms)(void * context, unsigned int ms);
+};
+
+struct lamp_state_machine {
+    bool lamp_state [LAMP_NUM_LEDS]; // LED state as it is reported to the user space
+    unsigned int lightplay_time; // ms per lightplay step
+    bool mask_writes; // set or clear several pins with a single GPSET0/GPCLR0 write instead of one write per pin
+    const struct lamp_gpio_ops * ops;
+    void * context;
+};
+
+void lamp_sm_init(struct lamp_state_machine * sm, const struct lamp_gpio_ops * ops, void * context, unsigned int lightplay_time, bool mask_writes);
+
+/* executes one user space command (0-8), returns -EINVAL without touching the registers for any other value */
+int lamp_sm_execute(struct lamp_state_machine * sm, unsigned int command);
+
+/* lightplay 1 runs from the white to the blue LED, lightplay 2 (reverse) the other way around - every LED is off afterwards */
+void lamp_sm_lightplay(struct lamp_state_machine * sm, bool reverse);
+
+/* turns all LEDs off, the reported state is only reset with rewrite_state */
+void lamp_sm_clear_all(struct lamp_state_machine * sm, bool rewrite_state);
+
+/* pin mask (bit n = GPIO n) of the LEDs that are on according to lamp_state */
+unsigned int lamp_sm_pin_mask(const struct lamp_state_machine * sm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAMP_STATE_MACHINE_H */
@@ -17,6 +17,8 @@
 
 #include <linux/atomic.h>
 
+#include "lamp_state_machine.h"
+
 #define IRQ_PIN_INPUT_NO 26
 #define IRQ_PIN_INPUT_NO_SHUTDOWN 13
 #define IRQ_PIN_OUTPUT_NO 19
@@ -59,8 +61,9 @@ struct mutex user_buffer_mutex;
 unsigned int access_counter = 0;
 atomic_t last_printer_command = ATOMIC_INIT(-1);
 
+/* command state machine, see lamp_state_machine.h - every access is serialized by the lamp_state_mutex, except for the greeting lightplays of the IRQ threads */
 struct mutex lamp_state_mutex;
-bool lamp_state [3] = {false, false, false};
+static struct lamp_state_machine lamp_sm;
 
 /* Direct register access to enlight the LEDs */
 #ifdef RPi4 
@@ -71,7 +74,6 @@ bool lamp_state [3] = {false, false, false};
 #endif
 
 static unsigned int * gpio_registers_addr = NULL;
-unsigned int lamp_pins [3] = {16, 20, 21};
 
 unsigned int lightplay_time = 100;
 
@@ -90,68 +92,52 @@ unsigned long calc_last_irq_invocation(unsigned long * old_jiff_ptr) {
     return diff_down;
 }
 
-static void gpio_pin_off(unsigned int pin){
-  unsigned int * gpio_off_register = (unsigned int*)((char *)gpio_registers_addr +0x28);
-  *gpio_off_register = (1 << pin);
-  return;
+/* register access of the state machine - the GPSET0 and GPCLR0 writes (offset in bytes) */
+static void gpio_write_register(void * context, unsigned int offset, unsigned int value) {
+    unsigned int * gpio_register = (unsigned int *)((char *) gpio_registers_addr + offset);
+    *gpio_register = value;
 }
 
-static void gpio_pin_on(unsigned int pin) {
-  /* Set the gpio register gpset_n to on */
-  unsigned int * gpset_register = (unsigned int *)((char *) gpio_registers_addr + 0x1c);
-  *gpset_register = (1 << pin);
+static void gpio_sleep_ms(void * context, unsigned int ms) {
+    msleep(ms);
 }
 
+static const struct lamp_gpio_ops lamp_gpio = {
+    .write_register = gpio_write_register,
+    .sleep_ms = gpio_sleep_ms
+};
 
 void lightplay_1(void) {
     #ifdef DEBUG
     printk("DEBUG: lightplay_1 invoked\n");
     #endif
-    gpio_pin_on(16);
-    msleep(lightplay_time);
-    gpio_pin_off(16);
-    gpio_pin_on(20);    
-    msleep(lightplay_time);
-    gpio_pin_off(20);
-    gpio_pin_on(21);
-    msleep(lightplay_time);
-    gpio_pin_off(21);
+    lamp_sm_lightplay(&lamp_sm, false);
 }
 
 void lightplay_2(void) {
     #ifdef DEBUG
     printk("DEBUG: lightplay_2 invoked\n");
     #endif
-    gpio_pin_on(21);
-    msleep(lightplay_time);
-    gpio_pin_off(21);
-    gpio_pin_on(20);
-    msleep(lightplay_time);
-    gpio_pin_off(20);
-    gpio_pin_on(16);
-    msleep(lightplay_time);
-    gpio_pin_off(16);
+    lamp_sm_lightplay(&lamp_sm, true);
 }
 
 void init_direct_register_leds(void) {
     /* Setting the registers to make the lamp pins GPIO output pins */
     int idx;
-    for (idx = 0; idx < 3; idx++) {
-        printk("INFO: Setting pin %d to its initial lamp state", lamp_pins[idx]);
+    for (idx = 0; idx < LAMP_NUM_LEDS; idx++) {
+        printk("INFO: Setting pin %d to its initial lamp state", lamp_sm_pins[idx]);
         /* Getting the demanded bits of the GPIO registers - I found this code on the internet */
-        unsigned int gpfsel_index_n = lamp_pins[idx]/10;
-        unsigned int fsel_bit_pos = lamp_pins[idx]%10;
+        unsigned int gpfsel_index_n = lamp_sm_pins[idx]/10;
+        unsigned int fsel_bit_pos = lamp_sm_pins[idx]%10;
         unsigned int * gpfsel_n = gpio_registers_addr + gpfsel_index_n; // Get the correct GPFSEL register
     
         // setting all of the pin function selection bits to zeros
         *gpfsel_n &= ~(7 << (fsel_bit_pos*3)); // 7 is 111 in binary, 111 is left shifted by the bit position and then inverted, so 000; The &= is a bitwise comparison and therefore sets every bit to zero
         // setting the new value to the gpio (001 but with LSB)
         *gpfsel_n |= (1 << (fsel_bit_pos*3));
-
-        // reset the gpioset and gpioclr registers
-        unsigned int * gpio_off_register = (unsigned int*)((char *)gpio_registers_addr +0x28);
-        *gpio_off_register = (1 << lamp_pins[idx]);
     }
+    // reset all lamp pins with a single GPCLR0 write
+    lamp_sm_clear_all(&lamp_sm, true);
 }
 
 /* Interrupt service routine - this is executed when the interrupt is triggered */
@@ -295,99 +281,17 @@ static ssize_t syscall_read(struct file *filp, char __user *userp, size_t size,
     #ifdef DEBUG
         printk("DEBUG: printer_lamp read was called!\n");
     #endif
-    return simple_read_from_buffer(userp, size, off, &lamp_state, sizeof(lamp_state));
-}
-
-void transform_state(unsigned int aimed_state, bool change_state);
-
-void clear_all_leds_temp(bool rewrite_state) {
-    int idx;
-    for (idx = 0; idx < 3; idx++) {
-        printk("DEBUG: idx + 3 = %d", (idx + 3));
-        if (rewrite_state)
-            transform_state(idx + 3, true);
-        else
-            transform_state(idx + 3, false);
-    }
+    return simple_read_from_buffer(userp, size, off, &lamp_sm.lamp_state, sizeof(lamp_sm.lamp_state));
 }
 
-void recreate_state(void) {
-    int idx;
-    bool turn_on = false;
-    for (idx = 0; idx < 3; idx++) {
-        if (lamp_state[idx] == true) {
-            transform_state(idx, false); // we have a dualism between the index and the user space command within transform_state
-        }
-    }
-}
-
-void transform_state(unsigned int aimed_state, bool change_state) {
+void transform_state(unsigned int aimed_state) {
+    printk("INFO: Lamp executes command %d\n", aimed_state);
+    // the lightplays keep the mutex for their whole duration, so other writers wait until the LED state is restored
     mutex_lock(&lamp_state_mutex);
-    switch (aimed_state) {
-        case 0:
-            printk("INFO: Lamp executes command 0\n");
-            gpio_pin_on(16);
-            if (change_state)
-                lamp_state[0] = true;
-            break;
-        case 1:
-            printk("INFO: Lamp executes command 1\n");
-            gpio_pin_on(20);
-            if (change_state)
-                lamp_state[1] = true;
-            break;
-        case 2:
-            printk("INFO: Lamp executes command 2\n");
-            gpio_pin_on(21);
-            if (change_state)
-                lamp_state[2] = true;
-            break;
-        case 3:
-            printk("INFO: Lamp executes command 3\n");
-            gpio_pin_off(16);
-            if (change_state)
-                lamp_state[0] = false;
-            break;
-        case 4:
-            printk("INFO: Lamp executes command 4\n");
-            gpio_pin_off(20);
-            if (change_state)
-                lamp_state[1] = false;
-            break;
-        case 5:
-            printk("INFO: Lamp executes command 5\n");
-            gpio_pin_off(21);
-            if (change_state)
-                lamp_state[2] = false;
-            break;
-        case 6:
-            printk("INFO: Lamp executes command 6\n");
-            lightplay_1();
-            mutex_unlock(&lamp_state_mutex);
-            clear_all_leds_temp(false);
-            if (aimed_state != UINT_MAX) {
-                recreate_state();
-            }
-            break;
-        case 7:
-            printk("INFO: Lamp executes command 7\n");
-            lightplay_2();
-            mutex_unlock(&lamp_state_mutex);
-            clear_all_leds_temp(false);
-            if (aimed_state != UINT_MAX) {
-                recreate_state();
-            }
-            break;
-        case 8:
-            printk("INFO: Lamp executes command 8 - reset all\n");
-            mutex_unlock(&lamp_state_mutex);
-            clear_all_leds_temp(true);
-            break;
-        default:
-            printk("ERROR: Received invalid state!\n");
-            break;
-        }
-        mutex_unlock(&lamp_state_mutex);
+    if (lamp_sm_execute(&lamp_sm, aimed_state) != 0) {
+        printk("ERROR: Received invalid state!\n");
+    }
+    mutex_unlock(&lamp_state_mutex);
 }
 
 static ssize_t syscall_write(struct file *filp, const char __user *userp, size_t size, loff_t *off)
@@ -420,7 +324,7 @@ static ssize_t syscall_write(struct file *filp, const char __user *userp, size_t
         }
 
         atomic_set(&last_printer_command, (int) requested_lamp_command);
-        transform_state(requested_lamp_command, true);
+        transform_state(requested_lamp_command);
 
         #ifdef DEBUG
         printk("DEBUG: Finished LED setting\n");
@@ -449,6 +353,8 @@ static int __init gpio_lamp_init(void) {
       printk("Failed to map GPIO memory to driver");
       return -1;
     }
+    // GPSET0/GPCLR0 get the pin mask of all affected pins in a single write
+    lamp_sm_init(&lamp_sm, &lamp_gpio, NULL, lightplay_time, true);
 
     /* setup the GPIO - using the linux provided GPIO abstraction (NOT direct register programming) */
     // input pin for the interrupt
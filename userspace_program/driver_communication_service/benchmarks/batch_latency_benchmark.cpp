@@ -0,0 +1,107 @@
+/*
+End-to-end latency of a lamp scene applied with one set_lamp_commands call compared to the same
+command sequence sent as single set_lamp_state calls. Service and client run in this process on
+two separate connections to a private dbus-daemon, the lamp device is the in-memory backend.
+
+    $ ./build/bin/batch_benchmark [--iterations=N] [--output=results.json]
+*/
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sdbus-c++/sdbus-c++.h>
+
+#include "benchmark_utils.hpp"
+#include "dbus_interaction.hpp"
+#include "utils.hpp"
+
+namespace {
+    using namespace printer_lamp::benchmark;
+
+    // every sequence ends with a command that does not appear in the other one, so its signal marks the end of the iteration
+    const std::vector<std::vector<int>> SEQUENCES = {{8, 0, 4, 2}, {8, 1, 5}};
+
+    bool call_bool_method(sdbus::IProxy& proxy, sdbus::MethodCall& method) {
+        auto reply = proxy.callMethod(method);
+        bool accepted = false;
+        reply >> accepted;
+        return accepted;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const benchmark_options options = parse_options(argc, argv, 2000);
+    const int iterations = options.iterations;
+
+    PrivateSessionBus bus;
+    if (!bus.start()) {
+        std::cerr << "Could not start a private dbus-daemon\n";
+        return 1;
+    }
+
+    const auto config = std::make_shared<printer_lamp::bridge_config>();
+    config->object_path = OBJECT_PATH;
+    config->interface_name = INTERFACE_NAME;
+    config->device.backend = "memory";
+    config->queue_capacity = 256;
+    config->signal_min_interval_ms = 0; // every state change is signalled
+
+    auto service_connection = sdbus::createSessionBusConnection(SERVICE_NAME);
+    printer_lamp::DriverDbusBridge bridge(service_connection, config);
+    service_connection->enterEventLoopAsync();
+
+    StateWaiter signal_waiter;
+    auto client_connection = sdbus::createSessionBusConnection();
+    auto proxy = sdbus::createProxy(*client_connection, SERVICE_NAME, OBJECT_PATH);
+    proxy->registerSignalHandler(INTERFACE_NAME, "current_lamp_state", [&signal_waiter](sdbus::Signal& signal) {
+        int state = -1;
+        signal >> state;
+        signal_waiter.on_state(state);
+    });
+    proxy->finishRegistration();
+    client_connection->enterEventLoopAsync();
+
+    LatencyRecorder single_reply(iterations);
+    LatencyRecorder single_applied(iterations);
+    LatencyRecorder batch_reply(iterations);
+    LatencyRecorder batch_applied(iterations);
+    for (int iteration = 0; iteration < 2 * iterations; iteration++) {
+        const bool batch = (iteration % 2) != 0;
+        const std::vector<int>& sequence = SEQUENCES[(iteration / 2) % SEQUENCES.size()];
+
+        signal_waiter.expect(sequence.back());
+        const auto start = clock_type::now();
+        bool accepted = true;
+        if (batch) {
+            auto method = proxy->createMethodCall(INTERFACE_NAME, "set_lamp_commands");
+            method << sequence;
+            accepted = call_bool_method(*proxy, method);
+        } else {
+            for (int command : sequence) {
+                auto method = proxy->createMethodCall(INTERFACE_NAME, "set_lamp_state");
+                method << command;
+                accepted = call_bool_method(*proxy, method) && accepted;
+            }
+        }
+        const auto replied = clock_type::now();
+        if (!accepted || !signal_waiter.wait()) {
+            std::cerr << "Iteration " << iteration << " was not applied\n";
+            return 1;
+        }
+        const auto applied = clock_type::now();
+
+        (batch ? batch_reply : single_reply).add(elapsed_us(start, replied));
+        (batch ? batch_applied : single_applied).add(elapsed_us(start, applied));
+    }
+
+    client_connection->leaveEventLoop();
+    service_connection->leaveEventLoop();
+
+    // the runs are interleaved, so the throughput is left out of the comparison
+    JsonReport report("batch", options.output_path);
+    report.add("dbus.single_calls.reply", single_reply);
+    report.add("dbus.single_calls.applied", single_applied);
+    report.add("dbus.batch_call.reply", batch_reply);
+    report.add("dbus.batch_call.applied", batch_applied);
+    return 0;
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "lamp_state.hpp"
+
+namespace printer_lamp {
+namespace benchmark {
+
+    using clock_type = std::chrono::steady_clock;
+
+    inline double elapsed_us(clock_type::time_point start, clock_type::time_point end) {
+        return std::chrono::duration<double, std::micro>(end - start).count();
+    }
+
+    // toggling a single LED makes every command a real device write (nothing can be coalesced away)
+    inline int toggle_command(int led_idx, int iteration) {
+        return (iteration % 2 == 0) ? printer_lamp::led_on_command(led_idx) : printer_lamp::led_off_command(led_idx);
+    }
+
+    // command line options shared by all benchmark binaries: --iterations=N --output=<json file>
+    struct benchmark_options {
+        int iterations;
+        std::string output_path;
+    };
+
+    inline benchmark_options parse_options(int argc, char* argv[], int default_iterations) {
+        benchmark_options options {default_iterations, ""};
+        for (int idx = 1; idx < argc; idx++) {
+            const std::string arg = argv[idx];
+            if (arg.rfind("--iterations=", 0) == 0) {
+                options.iterations = std::max(1, std::atoi(arg.c_str() + 13));
+            } else if (arg.rfind("--output=", 0) == 0) {
+                options.output_path = arg.substr(9);
+            }
+        }
+        return options;
+    }
+
+    // lets the benchmark thread wait until a state has been reported (signal or write callback)
+    class StateWaiter {
+        public:
+            void expect(int state) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_expected = state;
+                m_received = false;
+            }
+
+            void on_state(int state) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (state == m_expected) {
+                    m_received = true;
+                    m_cv.notify_all();
+                }
+            }
+
+            bool wait() {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                return m_cv.wait_for(lock, std::chrono::seconds(5), [this] { return m_received; });
+            }
+
+        private:
+            std::mutex m_mutex;
+            std::condition_variable m_cv;
+            int m_expected {-1};
+            bool m_received {false};
+    };
+
+    /*
+    Latency samples of one measurement together with the wall time of the whole run, so the
+    summary can report the percentiles and the throughput next to each other.
+    */
+    class LatencyRecorder {
+        public:
+            explicit LatencyRecorder(std::size_t expected_samples) {
+                m_samples_us.reserve(expected_samples);
+            }
+
+            void start() {
+                m_start = clock_type::now();
+            }
+
+            void stop() {
+                m_wall_time_us = elapsed_us(m_start, clock_type::now());
+            }
+
+            void add(double sample_us) {
+                m_samples_us.push_back(sample_us);
+            }
+
+            // nearest rank percentile
+            double percentile(double quantile) {
+                if (m_samples_us.empty()) {
+                    return 0.0;
+                }
+                std::sort(m_samples_us.begin(), m_samples_us.end());
+                const std::size_t idx = std::min(m_samples_us.size() - 1, static_cast<std::size_t>(quantile * m_samples_us.size()));
+                return m_samples_us[idx];
+            }
+
+            std::size_t count() const {
+                return m_samples_us.size();
+            }
+
+            double throughput_per_s() const {
+                return (m_wall_time_us > 0.0) ? m_samples_us.size() * 1e6 / m_wall_time_us : 0.0;
+            }
+
+        private:
+            std::vector<double> m_samples_us;
+            clock_type::time_point m_start;
+            double m_wall_time_us {0.0};
+    };
+
+    /*
+    Writes the results as one JSON object: {"benchmark": ..., "results": {"<transport>.<name>": {...}}}.
+    The service logs to stdout, so the results should go to a file (--output) to keep them parseable.
+    */
+    class JsonReport {
+        public:
+            JsonReport(const std::string& benchmark_name, const std::string& output_path) {
+                m_file = output_path.empty() ? stdout : std::fopen(output_path.c_str(), "w");
+                if (m_file == nullptr) {
+                    std::perror("Could not open the benchmark output file");
+                    m_file = stdout;
+                }
+                std::fprintf(m_file, "{\n  \"benchmark\": \"%s\",\n  \"results\": {", benchmark_name.c_str());
+            }
+
+            ~JsonReport() {
+                std::fprintf(m_file, "\n  }\n}\n");
+                if (m_file != stdout) {
+                    std::fclose(m_file);
+                } else {
+                    std::fflush(m_file);
+                }
+            }
+
+            void add(const std::string& name, LatencyRecorder& recorder) {
+                std::fprintf(m_file, "%s\n    \"%s\": {\"iterations\": %zu, \"p50_us\": %.2f, \"p99_us\": %.2f, \"p999_us\": %.2f, \"max_us\": %.2f, \"throughput_per_s\": %.1f}",
+                    m_first ? "" : ",", name.c_str(), recorder.count(),
+                    recorder.percentile(0.5), recorder.percentile(0.99), recorder.percentile(0.999), recorder.percentile(1.0),
+                    recorder.throughput_per_s());
+                m_first = false;
+            }
+
+            // a single number next to the latencies, e.g. the size of the input
+            void add_value(const std::string& name, double value) {
+                std::fprintf(m_file, "%s\n    \"%s\": %.9g", m_first ? "" : ",", name.c_str(), value);
+                m_first = false;
+            }
+
+        private:
+            std::FILE* m_file;
+            bool m_first {true};
+    };
+
+    // names of the service the dbus benchmarks register on their private dbus-daemon
+    inline const std::string SERVICE_NAME = "jens.printerlamp.driver_interaction.benchmark";
+    inline const std::string OBJECT_PATH = "/3DP/printerlamp";
+    inline const std::string INTERFACE_NAME = "jens.printerlamp";
+
+    /*
+    Private dbus-daemon for the benchmarks, so they neither need the system bus configuration nor
+    interfere with the session of the user. The daemon is started with its own session config and
+    DBUS_SESSION_BUS_ADDRESS is pointed to it until the object goes out of scope.
+    */
+    class PrivateSessionBus {
+        public:
+            PrivateSessionBus() = default;
+            PrivateSessionBus(const PrivateSessionBus&) = delete;
+            PrivateSessionBus& operator=(const PrivateSessionBus&) = delete;
+
+            ~PrivateSessionBus() {
+                if (m_pid > 0) {
+                    kill(m_pid, SIGTERM);
+                    waitpid(m_pid, nullptr, 0);
+                }
+            }
+
+            bool start() {
+                int address_pipe[2];
+                if (pipe(address_pipe) != 0) {
+                    return false;
+                }
+                m_pid = fork();
+                if (m_pid == 0) {
+                    close(address_pipe[0]);
+                    const std::string print_address = "--print-address=" + std::to_string(address_pipe[1]);
+                    execlp("dbus-daemon", "dbus-daemon", "--session", "--nofork", "--nopidfile", print_address.c_str(), static_cast<char*>(nullptr));
+                    _exit(127);
+                }
+                close(address_pipe[1]);
+                if (m_pid < 0) {
+                    close(address_pipe[0]);
+                    return false;
+                }
+
+                // the daemon prints its address followed by a newline once it accepts connections
+                std::string address;
+                char character;
+                while (read(address_pipe[0], &character, 1) == 1 && character != '\n') {
+                    address.push_back(character);
+                }
+                close(address_pipe[0]);
+                if (address.empty()) {
+                    return false;
+                }
+                return setenv("DBUS_SESSION_BUS_ADDRESS", address.c_str(), 1) == 0;
+            }
+
+        private:
+            pid_t m_pid {-1};
+    };
+
+} /* namespace benchmark */
+} /* namespace printer_lamp */
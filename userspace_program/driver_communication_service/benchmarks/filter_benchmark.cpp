@@ -0,0 +1,286 @@
+/*
+Cost and accuracy of the temperature filter of the OctoPrint poller (ClippedMovingAverage from
+streaming_filters.hpp) compared to the MovingAvgRingbuffer of the Python printer communication
+service. The Python algorithm is ported line by line, including the all() scans of enqueue and the
+incremental average that divides by the changing fill level.
+
+    $ ./build/bin/filter_benchmark [--iterations=N] [--trace=<csv time_s,bed,tool>] [--output=results.json]
+
+Every iteration filters the whole trace (bed and tool, window 3 like the poller and 32 to show how
+the cost grows with the window). The trace is a recorded one from --trace or a synthetic print
+(heat up, hold with sensor noise and glitches, cool down) - benchmarks/python_filter_benchmark.py
+generates the same one, so the numbers of both languages can be compared.
+The accuracy is the largest difference to the exact mean of the window (without clipping).
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "benchmark_utils.hpp"
+#include "streaming_filters.hpp"
+
+namespace {
+    using namespace printer_lamp::benchmark;
+
+    constexpr double HEATING_CLIP = 5.0;
+
+    struct temperature_sample {
+        double bed;
+        double tool;
+    };
+
+    // same generator as python_filter_benchmark.py
+    class TraceNoise {
+        public:
+            double next() {
+                m_state = m_state * 6364136223846793005ULL + 1442695040888963407ULL;
+                return static_cast<double>(m_state >> 11) / 9007199254740992.0 - 0.5;
+            }
+
+        private:
+            std::uint64_t m_state {2023};
+    };
+
+    double approach(double start, double target, double progress) {
+        return target + (start - target) * std::exp(-progress);
+    }
+
+    // 2.5 s polls: 5 min idle, heat up, a 2 h print, cool down
+    std::vector<temperature_sample> synthetic_trace() {
+        std::vector<temperature_sample> trace;
+        TraceNoise noise;
+        for (int idx = 0; idx < 3600; idx++) {
+            double bed = 21.0;
+            double tool = 22.0;
+            if (idx >= 120 && idx < 3240) {
+                bed = approach(21.0, 60.0, (idx - 120) / 40.0);
+                tool = approach(22.0, 210.0, (idx - 120) / 25.0);
+            } else if (idx >= 3240) {
+                bed = approach(60.0, 21.0, (idx - 3240) / 150.0);
+                tool = approach(210.0, 22.0, (idx - 3240) / 60.0);
+            }
+            bed += 0.6 * noise.next();
+            tool += 1.6 * noise.next();
+            if (idx % 500 == 250) {
+                tool += 15.0; // glitch of the thermistor reading
+            }
+            trace.push_back({bed, tool});
+        }
+        return trace;
+    }
+
+    std::vector<temperature_sample> read_trace(const std::string& path) {
+        std::vector<temperature_sample> trace;
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream fields(line);
+            std::string time;
+            std::string bed;
+            std::string tool;
+            if (std::getline(fields, time, ',') && std::getline(fields, bed, ',') && std::getline(fields, tool, ',')) {
+                char* end = nullptr;
+                const double bed_value = std::strtod(bed.c_str(), &end);
+                if (end != bed.c_str()) {
+                    trace.push_back({bed_value, std::strtod(tool.c_str(), nullptr)});
+                }
+            }
+        }
+        return trace;
+    }
+
+    // moving_avg_buffer.py: MovingAvgRingbuffer
+    class PythonMovingAvgRingbuffer {
+        public:
+            PythonMovingAvgRingbuffer(std::size_t capacity, double heating_clip) : m_queue(capacity), m_capacity{capacity}, m_max_heating_delta{heating_clip} {}
+
+            void enqueue(double value) {
+                bool first_element = false;
+                if (std::all_of(m_queue.begin(), m_queue.end(), [](const std::optional<double>& stored) { return !stored; })) {
+                    m_queue[m_head] = value;
+                    m_moving_avg = value;
+                    first_element = true;
+                } else {
+                    m_head = (m_head + 1) % m_capacity;
+                    m_queue[m_head] = value;
+                }
+                if (m_head == m_tail && !first_element) {
+                    m_tail = (m_tail + 1) % m_capacity;
+                } else {
+                    m_currently_used++;
+                }
+                if (std::all_of(m_queue.begin(), m_queue.end(), [](const std::optional<double>& stored) { return stored.has_value(); })) {
+                    this->check_heating_finished();
+                }
+                this->calc_moving_avg(*m_queue[m_head], *m_queue[m_tail]);
+            }
+
+            double get_moving_avg() const {
+                return m_moving_avg;
+            }
+
+        private:
+            void calc_moving_avg(double x_t, double x_t_n) {
+                if (m_currently_used == 0) {
+                    m_moving_avg = 0.0;
+                } else {
+                    m_moving_avg = m_moving_avg + x_t / m_currently_used - x_t_n / m_currently_used;
+                }
+            }
+
+            void check_heating_finished() {
+                bool do_clipping = false;
+                const double current = *m_queue[m_head];
+                for (const std::optional<double>& stored : m_queue) {
+                    if (std::abs(*stored - current) > m_max_heating_delta) {
+                        do_clipping = true;
+                    }
+                }
+                if (do_clipping) {
+                    m_moving_avg = **std::min_element(m_queue.begin(), m_queue.end());
+                }
+            }
+
+            std::vector<std::optional<double>> m_queue;
+            const std::size_t m_capacity;
+            const double m_max_heating_delta;
+            std::size_t m_head {0};
+            std::size_t m_tail {0};
+            std::size_t m_currently_used {0};
+            double m_moving_avg {0.0};
+    };
+
+    // largest distance of a filter to the exact window mean, only where the filter did not clip
+    template <std::size_t Window>
+    class AccuracyProbe {
+        public:
+            void add(double value, double filtered) {
+                m_window.add(value);
+                if (m_window.values().full()) {
+                    bool clipped = false;
+                    for (std::size_t idx = 0; idx < Window; idx++) {
+                        clipped = clipped || std::abs(m_window.values()[idx] - value) > HEATING_CLIP;
+                    }
+                    if (!clipped) {
+                        m_max_error = std::max(m_max_error, std::abs(filtered - m_window.mean()));
+                    }
+                }
+            }
+
+            double get_max_error() const {
+                return m_max_error;
+            }
+
+        private:
+            printer_lamp::RunningMean<double, Window> m_window;
+            double m_max_error {0.0};
+    };
+
+    template <std::size_t Window>
+    double python_accuracy(const std::vector<temperature_sample>& trace) {
+        PythonMovingAvgRingbuffer filter(Window, HEATING_CLIP);
+        AccuracyProbe<Window> probe;
+        for (const temperature_sample& sample : trace) {
+            filter.enqueue(sample.tool);
+            probe.add(sample.tool, filter.get_moving_avg());
+        }
+        return probe.get_max_error();
+    }
+
+    template <std::size_t Window>
+    double streaming_accuracy(const std::vector<temperature_sample>& trace) {
+        printer_lamp::ClippedMovingAverage<double, Window> filter(HEATING_CLIP);
+        AccuracyProbe<Window> probe;
+        for (const temperature_sample& sample : trace) {
+            filter.add(sample.tool);
+            probe.add(sample.tool, filter.get());
+        }
+        return probe.get_max_error();
+    }
+
+    // keeps the compiler from dropping the filtered values
+    volatile double g_sink = 0.0;
+
+    template <std::size_t Window>
+    void run_python(const std::vector<temperature_sample>& trace, LatencyRecorder& recorder, int iterations) {
+        recorder.start();
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            const auto start = clock_type::now();
+            PythonMovingAvgRingbuffer bed(Window, HEATING_CLIP);
+            PythonMovingAvgRingbuffer tool(Window, HEATING_CLIP);
+            double sum = 0.0;
+            for (const temperature_sample& sample : trace) {
+                bed.enqueue(sample.bed);
+                tool.enqueue(sample.tool);
+                sum += bed.get_moving_avg() + tool.get_moving_avg();
+            }
+            g_sink = sum;
+            recorder.add(elapsed_us(start, clock_type::now()));
+        }
+        recorder.stop();
+    }
+
+    template <std::size_t Window>
+    void run_streaming(const std::vector<temperature_sample>& trace, LatencyRecorder& recorder, int iterations) {
+        recorder.start();
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            const auto start = clock_type::now();
+            printer_lamp::ClippedMovingAverage<double, Window> bed(HEATING_CLIP);
+            printer_lamp::ClippedMovingAverage<double, Window> tool(HEATING_CLIP);
+            double sum = 0.0;
+            for (const temperature_sample& sample : trace) {
+                bed.add(sample.bed);
+                tool.add(sample.tool);
+                sum += bed.get() + tool.get();
+            }
+            g_sink = sum;
+            recorder.add(elapsed_us(start, clock_type::now()));
+        }
+        recorder.stop();
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const benchmark_options options = parse_options(argc, argv, 200);
+    std::string trace_path;
+    for (int idx = 1; idx < argc; idx++) {
+        const std::string arg = argv[idx];
+        if (arg.rfind("--trace=", 0) == 0) {
+            trace_path = arg.substr(8);
+        }
+    }
+    const std::vector<temperature_sample> trace = trace_path.empty() ? synthetic_trace() : read_trace(trace_path);
+    if (trace.empty()) {
+        std::cerr << "The temperature trace is empty\n";
+        return 1;
+    }
+
+    LatencyRecorder python_3(options.iterations);
+    LatencyRecorder streaming_3(options.iterations);
+    LatencyRecorder python_32(options.iterations);
+    LatencyRecorder streaming_32(options.iterations);
+    run_python<3>(trace, python_3, options.iterations);
+    run_streaming<3>(trace, streaming_3, options.iterations);
+    run_python<32>(trace, python_32, options.iterations);
+    run_streaming<32>(trace, streaming_32, options.iterations);
+
+    // the recorded durations are per pass over the whole trace
+    JsonReport report("filter", options.output_path);
+    report.add_value("trace.samples", static_cast<double>(trace.size()));
+    report.add("python_port.window_3.trace_pass", python_3);
+    report.add("streaming.window_3.trace_pass", streaming_3);
+    report.add("python_port.window_32.trace_pass", python_32);
+    report.add("streaming.window_32.trace_pass", streaming_32);
+    report.add_value("python_port.window_3.max_error", python_accuracy<3>(trace));
+    report.add_value("streaming.window_3.max_error", streaming_accuracy<3>(trace));
+    report.add_value("python_port.window_32.max_error", python_accuracy<32>(trace));
+    report.add_value("streaming.window_32.max_error", streaming_accuracy<32>(trace));
+    return 0;
+}
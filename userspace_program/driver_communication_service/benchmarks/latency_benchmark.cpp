@@ -0,0 +1,229 @@
+/*
+Latency and throughput of the hot paths of the driver interaction service against the in-memory
+lamp device. Every measurement reports p50/p99/p999 and the throughput as JSON.
+
+    inprocess: the components behind the dbus handlers without any bus in between
+        set_driver_state        validation and hand over to the driver I/O worker
+        get_current_lamp_state  read of the state cache
+        write_path              hand over until the worker reported the written state
+    dbus: a client proxy talking to the bridge through a private dbus-daemon started by the benchmark
+        set_driver_state        set_lamp_state round trip (replies once the command was written)
+        set_driver_state_nowait set_lamp_state_nowait round trip (replies once the command was queued)
+        get_current_lamp_state  get_lamp_state round trip
+        signal                  emission of current_lamp_state until the client received it
+        write_path              set_lamp_state call until the current_lamp_state signal arrived
+
+    $ ./build/bin/latency_benchmark [--transport=inprocess|dbus|all] [--iterations=N] [--output=results.json]
+*/
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sdbus-c++/sdbus-c++.h>
+
+#include "benchmark_utils.hpp"
+#include "dbus_interaction.hpp"
+#include "driver_io_worker.hpp"
+#include "lamp_device.hpp"
+#include "lamp_state_cache.hpp"
+#include "lamp_state.hpp"
+#include "metrics.hpp"
+#include "utils.hpp"
+
+namespace {
+    using namespace printer_lamp::benchmark;
+
+    bool run_inprocess(int iterations, JsonReport& report) {
+        printer_lamp::MemoryDevice device;
+        printer_lamp::LampStateCache cache;
+        printer_lamp::ServiceMetrics metrics;
+        StateWaiter write_waiter;
+        printer_lamp::DeviceHealth health(std::chrono::milliseconds(10), std::chrono::milliseconds(10), 3);
+        printer_lamp::DriverIoWorker worker(device, cache, metrics, iterations + 1, health, std::chrono::seconds(60), [&write_waiter](int state, std::uint64_t) { write_waiter.on_state(state); });
+
+        LatencyRecorder set_state(iterations);
+        set_state.start();
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            const int command = toggle_command(0, iteration);
+            const auto start = clock_type::now();
+            if (!printer_lamp::is_valid_command(command) || !worker.enqueue(command)) {
+                std::cerr << "In-process command " << command << " was rejected\n";
+                return false;
+            }
+            set_state.add(elapsed_us(start, clock_type::now()));
+        }
+        set_state.stop();
+
+        LatencyRecorder get_state(iterations);
+        int state = -1;
+        get_state.start();
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            const auto start = clock_type::now();
+            state = cache.get_int_state();
+            get_state.add(elapsed_us(start, clock_type::now()));
+        }
+        get_state.stop();
+        if (state == -2) { // keeps the reads from being optimized away
+            return false;
+        }
+
+        LatencyRecorder write_path(iterations);
+        write_path.start();
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            const int command = toggle_command(1, iteration);
+            write_waiter.expect(command);
+            const auto start = clock_type::now();
+            if (!worker.enqueue(command) || !write_waiter.wait()) {
+                std::cerr << "In-process command " << command << " was not applied\n";
+                return false;
+            }
+            write_path.add(elapsed_us(start, clock_type::now()));
+        }
+        write_path.stop();
+        worker.stop();
+
+        report.add("inprocess.set_driver_state", set_state);
+        report.add("inprocess.get_current_lamp_state", get_state);
+        report.add("inprocess.write_path", write_path);
+        return true;
+    }
+
+    bool call_bool_method(sdbus::IProxy& proxy, const std::string& method_name, int value) {
+        auto method = proxy.createMethodCall(INTERFACE_NAME, method_name);
+        method << value;
+        auto reply = proxy.callMethod(method);
+        bool accepted = false;
+        reply >> accepted;
+        return accepted;
+    }
+
+    int call_get_lamp_state(sdbus::IProxy& proxy, int expected_state) {
+        auto method = proxy.createMethodCall(INTERFACE_NAME, "get_lamp_state");
+        method << expected_state;
+        auto reply = proxy.callMethod(method);
+        int state = -1;
+        reply >> state;
+        return state;
+    }
+
+    bool run_dbus(int iterations, JsonReport& report) {
+        PrivateSessionBus bus;
+        if (!bus.start()) {
+            std::cerr << "Could not start a private dbus-daemon\n";
+            return false;
+        }
+
+        const auto config = std::make_shared<printer_lamp::bridge_config>();
+        config->object_path = OBJECT_PATH;
+        config->interface_name = INTERFACE_NAME;
+        config->device.backend = "memory";
+        config->queue_capacity = iterations + 1;
+        config->signal_min_interval_ms = 0; // every state change is signalled
+
+        auto service_connection = sdbus::createSessionBusConnection(SERVICE_NAME);
+        printer_lamp::DriverDbusBridge bridge(service_connection, config);
+        service_connection->enterEventLoopAsync();
+
+        StateWaiter signal_waiter;
+        auto client_connection = sdbus::createSessionBusConnection();
+        auto proxy = sdbus::createProxy(*client_connection, SERVICE_NAME, OBJECT_PATH);
+        proxy->registerSignalHandler(INTERFACE_NAME, "current_lamp_state", [&signal_waiter](sdbus::Signal& signal) {
+            int state = -1;
+            signal >> state;
+            signal_waiter.on_state(state);
+        });
+        proxy->finishRegistration();
+        client_connection->enterEventLoopAsync();
+
+        bool success = true;
+        LatencyRecorder set_state(iterations);
+        set_state.start();
+        for (int iteration = 0; iteration < iterations && success; iteration++) {
+            const auto start = clock_type::now();
+            success = call_bool_method(*proxy, "set_lamp_state", toggle_command(0, iteration));
+            set_state.add(elapsed_us(start, clock_type::now()));
+        }
+        set_state.stop();
+
+        LatencyRecorder set_state_nowait(iterations);
+        set_state_nowait.start();
+        for (int iteration = 0; iteration < iterations && success; iteration++) {
+            const auto start = clock_type::now();
+            success = call_bool_method(*proxy, "set_lamp_state_nowait", toggle_command(0, iteration));
+            set_state_nowait.add(elapsed_us(start, clock_type::now()));
+        }
+        set_state_nowait.stop();
+
+        LatencyRecorder get_state(iterations);
+        int state = call_get_lamp_state(*proxy, -1);
+        get_state.start();
+        for (int iteration = 0; iteration < iterations && success; iteration++) {
+            const auto start = clock_type::now();
+            state = call_get_lamp_state(*proxy, state);
+            get_state.add(elapsed_us(start, clock_type::now()));
+        }
+        get_state.stop();
+
+        // a different LED than above, so late signals of the set_driver_state run cannot end an iteration
+        LatencyRecorder write_path(iterations);
+        write_path.start();
+        for (int iteration = 0; iteration < iterations && success; iteration++) {
+            const int command = toggle_command(1, iteration);
+            signal_waiter.expect(command);
+            const auto start = clock_type::now();
+            success = call_bool_method(*proxy, "set_lamp_state", command) && signal_waiter.wait();
+            write_path.add(elapsed_us(start, clock_type::now()));
+        }
+        write_path.stop();
+
+        // re-emits the last written state, which is the only state still in flight after the write path run
+        LatencyRecorder signal(iterations);
+        signal.start();
+        for (int iteration = 0; iteration < iterations && success; iteration++) {
+            signal_waiter.expect(toggle_command(1, iterations - 1));
+            const auto start = clock_type::now();
+            bridge.send_state_change_signal();
+            success = signal_waiter.wait();
+            signal.add(elapsed_us(start, clock_type::now()));
+        }
+        signal.stop();
+
+        client_connection->leaveEventLoop();
+        service_connection->leaveEventLoop();
+        if (!success) {
+            std::cerr << "A dbus request was rejected or its signal did not arrive\n";
+            return false;
+        }
+
+        report.add("dbus.set_driver_state", set_state);
+        report.add("dbus.set_driver_state_nowait", set_state_nowait);
+        report.add("dbus.get_current_lamp_state", get_state);
+        report.add("dbus.signal", signal);
+        report.add("dbus.write_path", write_path);
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const benchmark_options options = parse_options(argc, argv, 5000);
+    std::string transport = "all";
+    for (int idx = 1; idx < argc; idx++) {
+        const std::string arg = argv[idx];
+        if (arg.rfind("--transport=", 0) == 0) {
+            transport = arg.substr(12);
+        }
+    }
+    if (transport != "all" && transport != "inprocess" && transport != "dbus") {
+        std::cerr << "Unknown transport " << transport << " (inprocess, dbus or all)\n";
+        return 1;
+    }
+
+    JsonReport report("latency", options.output_path);
+    if ((transport == "all" || transport == "inprocess") && !run_inprocess(options.iterations, report)) {
+        return 1;
+    }
+    if ((transport == "all" || transport == "dbus") && !run_dbus(options.iterations, report)) {
+        return 1;
+    }
+    return 0;
+}
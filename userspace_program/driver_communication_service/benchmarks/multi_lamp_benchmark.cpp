@@ -0,0 +1,197 @@
+/*
+Scaling of one service instance with many lamps. N simulated lamps (in-memory device with an
+injected latency per access) are registered as separate dbus objects on one connection, which is
+driven by the event loop of the service. Next to them a slow lamp (50 ms per write) is kept busy
+during the whole run, so the numbers also show whether it holds back the other lamps.
+
+    lamps_<N>.fanout      set_lamp_state_nowait to all N lamps until the current_lamp_state signals of all of them arrived
+    lamps_<N>.round_trip  set_lamp_state round trips to one lamp after the other (replies once the command was written)
+
+    $ ./build/bin/multi_lamp_benchmark [--iterations=N] [--max-lamps=64] [--device-latency-us=1000] [--output=results.json]
+*/
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sdbus-c++/sdbus-c++.h>
+
+#include "benchmark_utils.hpp"
+#include "dbus_interaction.hpp"
+#include "event_loop.hpp"
+#include "lamp_state.hpp"
+#include "metrics.hpp"
+#include "utils.hpp"
+
+namespace {
+    using namespace printer_lamp::benchmark;
+
+    constexpr long SLOW_LAMP_LATENCY_US = 50000;
+
+    // waits until a state has been signalled by a given number of lamps
+    class FanoutWaiter {
+        public:
+            void expect(int state, std::size_t lamps) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_expected = state;
+                m_missing = lamps;
+            }
+
+            void on_state(int state) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (state == m_expected && m_missing > 0 && --m_missing == 0) {
+                    m_cv.notify_all();
+                }
+            }
+
+            bool wait() {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                return m_cv.wait_for(lock, std::chrono::seconds(5), [this] { return m_missing == 0; });
+            }
+
+        private:
+            std::mutex m_mutex;
+            std::condition_variable m_cv;
+            int m_expected {-1};
+            std::size_t m_missing {0};
+    };
+
+    printer_lamp::lamp_config simulated_lamp(const std::string& name, long latency_us) {
+        printer_lamp::lamp_config lamp;
+        lamp.name = name;
+        lamp.object_path = OBJECT_PATH + "/" + name;
+        lamp.device.backend = "memory";
+        lamp.device.latency_us = latency_us;
+        return lamp;
+    }
+
+    bool call_bool_method(sdbus::IProxy& proxy, const std::string& method_name, int value) {
+        auto method = proxy.createMethodCall(INTERFACE_NAME, method_name);
+        method << value;
+        auto reply = proxy.callMethod(method);
+        bool accepted = false;
+        reply >> accepted;
+        return accepted;
+    }
+
+    // keeps the worker of the slow lamp busy - a queued burst is coalesced into one write, so every call toggles its LED
+    void load_slow_lamp(sdbus::IProxy& proxy, int& toggles) {
+        call_bool_method(proxy, "set_lamp_state_nowait", toggle_command(2, toggles++));
+    }
+
+    bool run_lamps(std::size_t num_lamps, int iterations, long device_latency_us, std::unique_ptr<sdbus::IConnection>& service_connection, JsonReport& report) {
+        const auto config = std::make_shared<printer_lamp::bridge_config>();
+        config->interface_name = INTERFACE_NAME;
+        config->queue_capacity = 256;
+        config->signal_min_interval_ms = 0; // every state change is signalled
+
+        std::vector<std::unique_ptr<printer_lamp::DriverDbusBridge>> bridges;
+        bridges.push_back(std::make_unique<printer_lamp::DriverDbusBridge>(service_connection, config, simulated_lamp("slow", SLOW_LAMP_LATENCY_US)));
+        for (std::size_t lamp_idx = 0; lamp_idx < num_lamps; lamp_idx++) {
+            bridges.push_back(std::make_unique<printer_lamp::DriverDbusBridge>(service_connection, config, simulated_lamp("lamp" + std::to_string(lamp_idx), device_latency_us)));
+        }
+
+        printer_lamp::LatencyHistogram loop_iterations;
+        printer_lamp::EventLoop event_loop(loop_iterations);
+        printer_lamp::DbusConnectionDispatcher dispatcher(*service_connection, event_loop);
+        for (auto& bridge : bridges) {
+            bridge->attach_to(event_loop);
+        }
+        std::thread loop_thread([&event_loop] { event_loop.run(); });
+
+        FanoutWaiter fanout_waiter;
+        auto client_connection = sdbus::createSessionBusConnection();
+        auto slow_proxy = sdbus::createProxy(*client_connection, SERVICE_NAME, OBJECT_PATH + "/slow");
+        std::vector<std::unique_ptr<sdbus::IProxy>> proxies;
+        for (std::size_t lamp_idx = 0; lamp_idx < num_lamps; lamp_idx++) {
+            auto proxy = sdbus::createProxy(*client_connection, SERVICE_NAME, OBJECT_PATH + "/lamp" + std::to_string(lamp_idx));
+            proxy->registerSignalHandler(INTERFACE_NAME, "current_lamp_state", [&fanout_waiter](sdbus::Signal& signal) {
+                int state = -1;
+                signal >> state;
+                fanout_waiter.on_state(state);
+            });
+            proxy->finishRegistration();
+            proxies.push_back(std::move(proxy));
+        }
+        client_connection->enterEventLoopAsync();
+
+        bool success = true;
+        int slow_lamp_toggles = 0;
+        LatencyRecorder fanout(iterations);
+        fanout.start();
+        for (int iteration = 0; iteration < iterations && success; iteration++) {
+            load_slow_lamp(*slow_proxy, slow_lamp_toggles);
+            const int command = toggle_command(0, iteration);
+            fanout_waiter.expect(command, num_lamps);
+            const auto start = clock_type::now();
+            for (auto& proxy : proxies) {
+                success = call_bool_method(*proxy, "set_lamp_state_nowait", command) && success;
+            }
+            success = success && fanout_waiter.wait();
+            fanout.add(elapsed_us(start, clock_type::now()));
+        }
+        fanout.stop();
+
+        LatencyRecorder round_trip(iterations);
+        round_trip.start();
+        for (int iteration = 0; iteration < iterations && success; iteration++) {
+            if (iteration % static_cast<int>(num_lamps) == 0) {
+                load_slow_lamp(*slow_proxy, slow_lamp_toggles);
+            }
+            const auto start = clock_type::now();
+            success = call_bool_method(*proxies[iteration % num_lamps], "set_lamp_state", toggle_command(1, iteration / static_cast<int>(num_lamps)));
+            round_trip.add(elapsed_us(start, clock_type::now()));
+        }
+        round_trip.stop();
+
+        client_connection->leaveEventLoop();
+        event_loop.stop();
+        loop_thread.join();
+        for (auto& bridge : bridges) {
+            bridge->detach();
+        }
+        if (!success) {
+            std::cerr << "A request to one of " << num_lamps << " lamps was rejected or its signal did not arrive\n";
+            return false;
+        }
+
+        const std::string prefix = "lamps_" + std::to_string(num_lamps);
+        report.add(prefix + ".fanout", fanout);
+        report.add(prefix + ".round_trip", round_trip);
+        report.add_value(prefix + ".event_loop_iteration_p99_us", loop_iterations.get_quantile_ns(0.99) * 1e-3);
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const benchmark_options options = parse_options(argc, argv, 200);
+    std::size_t max_lamps = 64;
+    long device_latency_us = 1000;
+    for (int idx = 1; idx < argc; idx++) {
+        const std::string arg = argv[idx];
+        if (arg.rfind("--max-lamps=", 0) == 0) {
+            max_lamps = static_cast<std::size_t>(std::max(1, std::atoi(arg.c_str() + 12)));
+        } else if (arg.rfind("--device-latency-us=", 0) == 0) {
+            device_latency_us = std::atol(arg.c_str() + 20);
+        }
+    }
+
+    PrivateSessionBus bus;
+    if (!bus.start()) {
+        std::cerr << "Could not start a private dbus-daemon\n";
+        return 1;
+    }
+
+    auto service_connection = sdbus::createSessionBusConnection(SERVICE_NAME);
+    JsonReport report("multi_lamp", options.output_path);
+    report.add_value("device_latency_us", static_cast<double>(device_latency_us));
+    for (std::size_t num_lamps = 1; num_lamps <= max_lamps; num_lamps *= 2) {
+        if (!run_lamps(num_lamps, options.iterations, device_latency_us, service_connection, report)) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+/*
+Scaling of the per-lamp driver I/O workers without dbus: the part of the multi_lamp_benchmark
+that does not depend on the bus daemon. N lamps (in-memory device with an injected latency per
+access) each get their own DriverIoWorker like the bridges of the service do. Next to them a slow
+lamp (50 ms per write) is either idle or kept busy during the whole run, so the numbers show
+whether it holds back the other lamps.
+
+    lamps_<N>.fanout_slow_lamp_idle  one command to all N lamps until all of them committed it, slow lamp idle
+    lamps_<N>.fanout                 the same while the slow lamp is busy
+    lamps_<N>.round_trip             one command to one lamp after the other until it was committed, slow lamp busy
+    lamps_<N>.slow_lamp_writes       writes of the slow lamp during the busy runs
+
+    $ ./build/bin/multi_lamp_worker_benchmark [--iterations=N] [--max-lamps=64] [--device-latency-us=1000] [--output=results.json]
+*/
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark_utils.hpp"
+#include "device_health.hpp"
+#include "driver_io_worker.hpp"
+#include "lamp_device.hpp"
+#include "lamp_state_cache.hpp"
+#include "lamp_state.hpp"
+#include "metrics.hpp"
+
+namespace {
+    using namespace printer_lamp::benchmark;
+
+    constexpr long SLOW_LAMP_LATENCY_US = 50000;
+    constexpr std::size_t QUEUE_CAPACITY = 256;
+
+    // lets the benchmark thread wait until the worker of a lamp committed a sequence number
+    class SequenceWaiter {
+        public:
+            void on_committed(std::uint64_t sequence) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_committed = std::max(m_committed, sequence);
+                m_cv.notify_all();
+            }
+
+            bool wait(std::uint64_t sequence) {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                return m_cv.wait_for(lock, std::chrono::seconds(5), [this, sequence] { return m_committed >= sequence; });
+            }
+
+        private:
+            std::mutex m_mutex;
+            std::condition_variable m_cv;
+            std::uint64_t m_committed {0};
+    };
+
+    // the per-lamp part of a bridge: device, state cache, metrics and driver I/O worker
+    struct simulated_lamp {
+        printer_lamp::FaultInjectingDevice device;
+        printer_lamp::LampStateCache cache;
+        printer_lamp::ServiceMetrics metrics;
+        printer_lamp::DeviceHealth health;
+        SequenceWaiter waiter;
+        printer_lamp::DriverIoWorker worker;
+
+        explicit simulated_lamp(long latency_us) :
+            device{std::make_unique<printer_lamp::MemoryDevice>(), latency_us, 0.0},
+            health{std::chrono::milliseconds(10), std::chrono::milliseconds(10), 3},
+            worker{device, cache, metrics, QUEUE_CAPACITY, health, std::chrono::seconds(60), [this](int, std::uint64_t sequence) { waiter.on_committed(sequence); }}
+        {}
+
+        bool apply(int command) {
+            std::uint64_t sequence = 0;
+            return worker.enqueue(command, sequence, "benchmark", printer_lamp::command_priority::status) && waiter.wait(sequence);
+        }
+    };
+
+    bool measure_fanout(std::vector<std::unique_ptr<simulated_lamp>>& lamps, int iterations, LatencyRecorder& fanout) {
+        std::vector<std::uint64_t> sequences(lamps.size());
+        fanout.start();
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            const int command = toggle_command(0, iteration);
+            const auto start = clock_type::now();
+            for (std::size_t lamp_idx = 0; lamp_idx < lamps.size(); lamp_idx++) {
+                if (!lamps[lamp_idx]->worker.enqueue(command, sequences[lamp_idx], "benchmark", printer_lamp::command_priority::status)) {
+                    return false;
+                }
+            }
+            for (std::size_t lamp_idx = 0; lamp_idx < lamps.size(); lamp_idx++) {
+                if (!lamps[lamp_idx]->waiter.wait(sequences[lamp_idx])) {
+                    return false;
+                }
+            }
+            fanout.add(elapsed_us(start, clock_type::now()));
+        }
+        fanout.stop();
+        return true;
+    }
+
+    bool run_lamps(std::size_t num_lamps, int iterations, long device_latency_us, JsonReport& report) {
+        simulated_lamp slow_lamp(SLOW_LAMP_LATENCY_US);
+        std::vector<std::unique_ptr<simulated_lamp>> lamps;
+        for (std::size_t lamp_idx = 0; lamp_idx < num_lamps; lamp_idx++) {
+            lamps.push_back(std::make_unique<simulated_lamp>(device_latency_us));
+        }
+
+        LatencyRecorder idle_fanout(iterations);
+        bool success = measure_fanout(lamps, iterations, idle_fanout);
+
+        // one write of the slow lamp always waits in its queue, so its worker never idles
+        const std::uint64_t slow_writes_before = slow_lamp.worker.get_stats().writes;
+        std::atomic<bool> slow_lamp_busy {true};
+        std::thread slow_load([&slow_lamp, &slow_lamp_busy] {
+            for (int toggles = 0; slow_lamp_busy.load(); ) {
+                if (slow_lamp.worker.get_stats().queue_depth == 0) {
+                    slow_lamp.worker.enqueue(toggle_command(2, toggles++));
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+
+        LatencyRecorder busy_fanout(iterations);
+        success = success && measure_fanout(lamps, iterations, busy_fanout);
+
+        LatencyRecorder round_trip(iterations);
+        round_trip.start();
+        for (int iteration = 0; iteration < iterations && success; iteration++) {
+            const auto start = clock_type::now();
+            success = lamps[iteration % num_lamps]->apply(toggle_command(1, iteration / static_cast<int>(num_lamps)));
+            round_trip.add(elapsed_us(start, clock_type::now()));
+        }
+        round_trip.stop();
+
+        slow_lamp_busy.store(false);
+        slow_load.join();
+        const std::uint64_t slow_writes = slow_lamp.worker.get_stats().writes - slow_writes_before;
+        if (!success) {
+            std::cerr << "A command to one of " << num_lamps << " lamps was rejected or not written\n";
+            return false;
+        }
+
+        const std::string prefix = "lamps_" + std::to_string(num_lamps);
+        report.add(prefix + ".fanout_slow_lamp_idle", idle_fanout);
+        report.add(prefix + ".fanout", busy_fanout);
+        report.add(prefix + ".round_trip", round_trip);
+        report.add_value(prefix + ".slow_lamp_writes", static_cast<double>(slow_writes));
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const benchmark_options options = parse_options(argc, argv, 200);
+    std::size_t max_lamps = 64;
+    long device_latency_us = 1000;
+    for (int idx = 1; idx < argc; idx++) {
+        const std::string arg = argv[idx];
+        if (arg.rfind("--max-lamps=", 0) == 0) {
+            max_lamps = static_cast<std::size_t>(std::max(1, std::atoi(arg.c_str() + 12)));
+        } else if (arg.rfind("--device-latency-us=", 0) == 0) {
+            device_latency_us = std::atol(arg.c_str() + 20);
+        }
+    }
+
+    JsonReport report("multi_lamp_worker", options.output_path);
+    report.add_value("device_latency_us", static_cast<double>(device_latency_us));
+    for (std::size_t num_lamps = 1; num_lamps <= max_lamps; num_lamps *= 2) {
+        if (!run_lamps(num_lamps, options.iterations, device_latency_us, report)) {
+            return 1;
+        }
+    }
+    return 0;
+}
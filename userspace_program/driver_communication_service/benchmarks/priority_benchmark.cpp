@@ -0,0 +1,145 @@
+/*
+Time-to-apply of status commands while effects run continuously. An effect thread keeps the
+driver I/O worker busy with lightplays (the in-memory device blocks for --lightplay-ms per
+lightplay like the msleep of the kernel driver) and LED steps, next to it a status command is
+sent every few milliseconds and timed until the worker reported it as written.
+
+    fifo.status_apply      every command with the same priority, applied in arrival order
+    priority.status_apply  effects with effect priority, the status commands cancel and preempt them
+
+    $ ./build/bin/priority_benchmark [--iterations=N] [--lightplay-ms=300] [--output=results.json]
+*/
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark_utils.hpp"
+#include "driver_io_worker.hpp"
+#include "lamp_device.hpp"
+#include "lamp_state_cache.hpp"
+#include "lamp_state.hpp"
+#include "metrics.hpp"
+
+namespace {
+    using namespace printer_lamp::benchmark;
+
+    constexpr std::size_t MAX_QUEUED_EFFECT_COMMANDS = 6;
+
+    // in-memory device whose lightplays block the writing thread like the kernel driver does
+    class LightplayDevice : public printer_lamp::LampDevice {
+        public:
+            explicit LightplayDevice(std::chrono::milliseconds lightplay_duration) : m_lightplay_duration{lightplay_duration} {}
+
+            bool write_command(int command) override {
+                if (command == printer_lamp::COMMAND_LIGHTPLAY_1 || command == printer_lamp::COMMAND_LIGHTPLAY_2) {
+                    std::this_thread::sleep_for(m_lightplay_duration);
+                }
+                return m_device.write_command(command);
+            }
+
+            bool read_state(std::array<char, 3>& lamp_state) override {
+                return m_device.read_state(lamp_state);
+            }
+
+            void close() override {}
+
+        private:
+            const std::chrono::milliseconds m_lightplay_duration;
+            printer_lamp::MemoryDevice m_device;
+    };
+
+    // lets the benchmark thread wait until the worker committed a sequence number
+    class SequenceWaiter {
+        public:
+            void on_committed(std::uint64_t sequence) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_committed = std::max(m_committed, sequence);
+                m_cv.notify_all();
+            }
+
+            bool wait(std::uint64_t sequence) {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                return m_cv.wait_for(lock, std::chrono::seconds(30), [this, sequence] { return m_committed >= sequence; });
+            }
+
+        private:
+            std::mutex m_mutex;
+            std::condition_variable m_cv;
+            std::uint64_t m_committed {0};
+    };
+
+    bool run_mode(const std::string& mode, bool with_priorities, int iterations, std::chrono::milliseconds lightplay_duration, JsonReport& report) {
+        LightplayDevice device(lightplay_duration);
+        printer_lamp::LampStateCache cache;
+        printer_lamp::ServiceMetrics metrics;
+        SequenceWaiter waiter;
+        printer_lamp::DeviceHealth health(std::chrono::milliseconds(10), std::chrono::milliseconds(10), 3);
+        printer_lamp::DriverIoWorker worker(device, cache, metrics, 256, health, std::chrono::seconds(60), [&waiter](int, std::uint64_t sequence) { waiter.on_committed(sequence); });
+        const printer_lamp::command_priority effect_priority = with_priorities ? printer_lamp::command_priority::effect : printer_lamp::command_priority::status;
+
+        // a lightplay followed by a blink of the blue LED, the status commands only toggle the white one
+        const std::vector<int> effect_burst = {printer_lamp::COMMAND_LIGHTPLAY_1, printer_lamp::led_on_command(0), printer_lamp::led_off_command(0)};
+        std::atomic<bool> effects_running {true};
+        std::thread effect_thread([&worker, &effects_running, &effect_burst, effect_priority] {
+            while (effects_running.load()) {
+                if (worker.get_stats().queue_depth < MAX_QUEUED_EFFECT_COMMANDS) {
+                    worker.enqueue_batch(effect_burst, "effect", effect_priority);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        });
+
+        bool success = true;
+        LatencyRecorder status_apply(iterations);
+        status_apply.start();
+        for (int iteration = 0; iteration < iterations && success; iteration++) {
+            // a little off the rhythm of the effects, so the status commands hit the worker at different points of a burst
+            std::this_thread::sleep_for(std::chrono::milliseconds(20 + (iteration * 37) % 100));
+            const int command = toggle_command(2, iteration);
+            std::uint64_t sequence = 0;
+            const auto start = clock_type::now();
+            success = worker.enqueue(command, sequence, "status", printer_lamp::command_priority::status) && waiter.wait(sequence);
+            status_apply.add(elapsed_us(start, clock_type::now()));
+        }
+        status_apply.stop();
+
+        effects_running.store(false);
+        effect_thread.join();
+        worker.stop();
+        if (!success) {
+            std::cerr << "A status command of the " << mode << " run was rejected or not written\n";
+            return false;
+        }
+
+        const printer_lamp::io_stats stats = worker.get_stats();
+        report.add(mode + ".status_apply", status_apply);
+        report.add_value(mode + ".cancelled_commands", static_cast<double>(stats.cancelled));
+        report.add_value(mode + ".preempted_batches", static_cast<double>(stats.preempted_batches));
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const benchmark_options options = parse_options(argc, argv, 30);
+    long lightplay_ms = 300;
+    for (int idx = 1; idx < argc; idx++) {
+        const std::string arg = argv[idx];
+        if (arg.rfind("--lightplay-ms=", 0) == 0) {
+            lightplay_ms = std::max(0L, std::atol(arg.c_str() + 15));
+        }
+    }
+
+    JsonReport report("priority", options.output_path);
+    report.add_value("lightplay_ms", static_cast<double>(lightplay_ms));
+    if (!run_mode("fifo", false, options.iterations, std::chrono::milliseconds(lightplay_ms), report)) {
+        return 1;
+    }
+    if (!run_mode("priority", true, options.iterations, std::chrono::milliseconds(lightplay_ms), report)) {
+        return 1;
+    }
+    return 0;
+}
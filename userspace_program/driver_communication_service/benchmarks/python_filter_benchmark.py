@@ -0,0 +1,115 @@
+#!/usr/bin/python3
+"""
+Counterpart of filter_benchmark for the MovingAvgRingbuffer of the Python printer communication
+service. Filters the same synthetic trace (or --trace=<csv time_s,bed,tool>) and writes the
+results in the format of the C++ benchmarks.
+
+    $ python3 benchmarks/python_filter_benchmark.py [--iterations=N] [--trace=<csv>] [--output=results.json]
+"""
+import argparse
+import json
+import logging
+import math
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "printer_communication_service"))
+from src.moving_avg_buffer import MovingAvgRingbuffer  # noqa: E402
+
+HEATING_CLIP = 5.0
+MASK_64 = (1 << 64) - 1
+
+
+class TraceNoise:
+    # same generator as filter_benchmark.cpp
+    def __init__(self):
+        self.state = 2023
+
+    def next(self):
+        self.state = (self.state * 6364136223846793005 + 1442695040888963407) & MASK_64
+        return (self.state >> 11) / 9007199254740992.0 - 0.5
+
+
+def approach(start, target, progress):
+    return target + (start - target) * math.exp(-progress)
+
+
+def synthetic_trace():
+    trace = []
+    noise = TraceNoise()
+    for idx in range(3600):
+        bed, tool = 21.0, 22.0
+        if 120 <= idx < 3240:
+            bed = approach(21.0, 60.0, (idx - 120) / 40.0)
+            tool = approach(22.0, 210.0, (idx - 120) / 25.0)
+        elif idx >= 3240:
+            bed = approach(60.0, 21.0, (idx - 3240) / 150.0)
+            tool = approach(210.0, 22.0, (idx - 3240) / 60.0)
+        bed += 0.6 * noise.next()
+        tool += 1.6 * noise.next()
+        if idx % 500 == 250:
+            tool += 15.0
+        trace.append((bed, tool))
+    return trace
+
+
+def read_trace(path):
+    trace = []
+    with open(path) as trace_file:
+        for line in trace_file:
+            fields = line.strip().split(",")
+            try:
+                trace.append((float(fields[1]), float(fields[2])))
+            except (IndexError, ValueError):
+                continue  # header
+    return trace
+
+
+def percentile(samples, quantile):
+    ordered = sorted(samples)
+    return ordered[min(len(ordered) - 1, int(quantile * len(ordered)))]
+
+
+def measure(trace, window, iterations):
+    samples_us = []
+    start_all = time.perf_counter()
+    for _ in range(iterations):
+        start = time.perf_counter()
+        bed = MovingAvgRingbuffer(window, HEATING_CLIP)
+        tool = MovingAvgRingbuffer(window, HEATING_CLIP)
+        for bed_temp, tool_temp in trace:
+            bed.enqueue(bed_temp)
+            tool.enqueue(tool_temp)
+            bed.get_moving_avg() + tool.get_moving_avg()
+        samples_us.append((time.perf_counter() - start) * 1e6)
+    wall_us = (time.perf_counter() - start_all) * 1e6
+    return {"iterations": iterations, "p50_us": round(percentile(samples_us, 0.5), 2), "p99_us": round(percentile(samples_us, 0.99), 2),
+            "p999_us": round(percentile(samples_us, 0.999), 2), "max_us": round(max(samples_us), 2),
+            "throughput_per_s": round(iterations * 1e6 / wall_us, 1)}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="MovingAvgRingbuffer benchmark")
+    parser.add_argument("--iterations", type=int, default=20)
+    parser.add_argument("--trace", type=str, default="")
+    parser.add_argument("--output", type=str, default="")
+    args = parser.parse_args()
+
+    logging.basicConfig(level=logging.ERROR)  # the buffer logs every sample on debug and every clip as a warning
+    trace = read_trace(args.trace) if args.trace else synthetic_trace()
+    results = {
+        "trace.samples": len(trace),
+        "python.window_3.trace_pass": measure(trace, 3, args.iterations),
+        "python.window_32.trace_pass": measure(trace, 32, args.iterations),
+    }
+    report = json.dumps({"benchmark": "python_filter", "results": results}, indent=2)
+    if args.output:
+        with open(args.output, "w") as output_file:
+            output_file.write(report + "\n")
+    else:
+        print(report)
+
+
+if __name__ == "__main__":
+    main()
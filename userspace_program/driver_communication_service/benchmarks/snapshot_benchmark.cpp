@@ -0,0 +1,143 @@
+/*
+Readers of the shared lamp state (state_snapshot_path) against its writer. The writer publishes
+--iterations state updates like the driver I/O worker does after every write, once without any
+reader and once while --readers threads poll the segment as fast as they can through the client
+header (lamp_state_snapshot.hpp).
+
+    writer.publish.readers_0   one publish, without readers
+    writer.publish.readers_N   one publish, while N readers poll
+    reader.read                one consistent read (mean of a batch of reads, since a single read
+                               is shorter than the resolution of the clock), while the writer publishes
+    reader.reads_per_s         reads of all readers together
+    reader.observed_updates_per_reader  distinct states one reader saw, at most --iterations
+
+The get_lamp_state round trip over dbus for comparison is the dbus.get_current_lamp_state result
+of the latency_benchmark.
+
+    $ ./build/bin/snapshot_benchmark [--iterations=N] [--readers=8] [--output=results.json]
+*/
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "benchmark_utils.hpp"
+#include "lamp_state_snapshot.hpp"
+#include "state_publisher.hpp"
+
+namespace {
+    using namespace printer_lamp::benchmark;
+
+    constexpr int READ_BATCH = 1000;
+
+    int parse_readers(int argc, char* argv[]) {
+        for (int idx = 1; idx < argc; idx++) {
+            const std::string arg = argv[idx];
+            if (arg.rfind("--readers=", 0) == 0) {
+                return std::max(1, std::atoi(arg.c_str() + 10));
+            }
+        }
+        return 8;
+    }
+
+    struct reader_results {
+        LatencyRecorder reads {1024};
+        std::uint64_t count {0};
+        std::uint64_t version_changes {0};
+    };
+
+    void publish_updates(printer_lamp::StatePublisher& publisher, int iterations, LatencyRecorder& recorder) {
+        recorder.start();
+        for (int idx = 1; idx <= iterations; idx++) {
+            const printer_lamp::lamp_state_update update {idx % 9, static_cast<std::uint64_t>(idx), static_cast<std::uint8_t>(idx & 0x7)};
+            const auto start = clock_type::now();
+            publisher.publish(update);
+            recorder.add(elapsed_us(start, clock_type::now()));
+            // the worker publishes once per device write - a few us apart even with the in-memory device
+            const auto next = start + std::chrono::microseconds(2);
+            while (clock_type::now() < next) {}
+        }
+        recorder.stop();
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const benchmark_options options = parse_options(argc, argv, 200000);
+    const int reader_count = parse_readers(argc, argv);
+    JsonReport report("snapshot_benchmark", options.output_path);
+
+    char path_template[] = "/dev/shm/printer_lamp_benchmark_XXXXXX";
+    int fd = mkstemp(path_template);
+    if (fd < 0) {
+        std::cerr << "Could not create the shared lamp state in /dev/shm" << std::endl;
+        return 1;
+    }
+    close(fd);
+    unlink(path_template);
+    const std::string path = path_template;
+
+    {
+        printer_lamp::StatePublisher publisher(path);
+
+        LatencyRecorder idle_writer(static_cast<std::size_t>(options.iterations));
+        publish_updates(publisher, options.iterations, idle_writer);
+        report.add("writer.publish.readers_0", idle_writer);
+
+        std::atomic<bool> running {true};
+        std::atomic<int> ready {0};
+        std::vector<reader_results> results(static_cast<std::size_t>(reader_count));
+        std::vector<std::thread> readers;
+        for (int idx = 0; idx < reader_count; idx++) {
+            readers.emplace_back([&path, &running, &ready, &result = results[static_cast<std::size_t>(idx)]] {
+                printer_lamp::LampStateSnapshotReader reader(path);
+                printer_lamp::lamp_state_snapshot snapshot;
+                std::uint64_t last_sequence = 0;
+                ready.fetch_add(1);
+                result.reads.start();
+                while (running.load(std::memory_order_relaxed)) {
+                    const auto start = clock_type::now();
+                    for (int read = 0; read < READ_BATCH; read++) {
+                        reader.read(snapshot);
+                        if (snapshot.sequence != last_sequence) {
+                            last_sequence = snapshot.sequence;
+                            result.version_changes++;
+                        }
+                    }
+                    result.reads.add(elapsed_us(start, clock_type::now()) / READ_BATCH);
+                    result.count += READ_BATCH;
+                }
+                result.reads.stop();
+            });
+        }
+        while (ready.load() < reader_count) {
+            std::this_thread::yield();
+        }
+
+        LatencyRecorder busy_writer(static_cast<std::size_t>(options.iterations));
+        const auto start = clock_type::now();
+        publish_updates(publisher, options.iterations, busy_writer);
+        const double wall_time_us = elapsed_us(start, clock_type::now());
+        running.store(false);
+        for (std::thread& reader : readers) {
+            reader.join();
+        }
+        report.add("writer.publish.readers_" + std::to_string(reader_count), busy_writer);
+
+        std::uint64_t total_reads = 0;
+        for (reader_results& result : results) {
+            total_reads += result.count;
+        }
+        // per read latency of the first reader, the others behave the same
+        report.add("reader.read", results.front().reads);
+        report.add_value("reader.count", reader_count);
+        report.add_value("reader.reads_per_s", wall_time_us > 0.0 ? total_reads * 1e6 / wall_time_us : 0.0);
+        report.add_value("reader.observed_updates_per_reader", static_cast<double>(results.front().version_changes));
+    }
+    unlink(path.c_str());
+    return 0;
+}
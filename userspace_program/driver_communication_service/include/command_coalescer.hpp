@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+#include "lamp_state.hpp"
+
+namespace printer_lamp {
+
+    // what we know about the LEDs of the lamp - bits outside of `known` have an undefined value
+    struct known_lamp_state {
+        lamp_mask value {0};
+        lamp_mask known {0};
+
+        bool operator==(const known_lamp_state& other) const {
+            return value == other.value && known == other.known;
+        }
+    };
+
+    /*
+    Folds a burst of pending commands into the minimal sequence of device writes.
+
+    On/off commands and the reset (8) only define a target bitmask, so they are folded and only
+    the commands needed to move from `current` to that target are emitted (nothing at all if the
+    target is already reached). Lightplays (6, 7) act as barriers: everything queued before them
+    is applied first, they are forwarded in order, and folding continues afterwards.
+
+    `writes` is cleared and filled with the commands to send; the returned state is the one the
+    lamp is in after all of them have been written.
+    */
+    known_lamp_state coalesce_commands(const std::vector<int>& pending, known_lamp_state current, std::vector<int>& writes);
+
+} /* namespace printer_lamp */
@@ -12,11 +12,18 @@ namespace printer_lamp {
             CommandLineParser(int & argc, const char * argv []);
             CommandLineParser() = delete;
         
+            // exits if the config file can not be used
             bridge_config get_config();
+            std::string get_config_path() const;
+            // --session_bus, the service is registered on the system bus otherwise
+            bool use_session_bus() const;
         private:
             variables_map m_variables_map;
             bridge_config m_bridge_config;
 
     };
 
+    // parses and validates the config file, throws std::invalid_argument if it can not be used
+    bridge_config read_config_file(const std::string& path_to_config);
+
 } /* namespace printer_lamp */
\ No newline at end of file
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "metrics.hpp"
+#include "utils.hpp"
+
+namespace printer_lamp {
+
+    /*
+    Immutable snapshots of the configuration. A reload publishes a new snapshot with a single
+    std::atomic_store and readers copy the current one with std::atomic_load, so they never wait
+    for a reload. Every reader shares the ownership of the snapshot it got and can keep using it,
+    a replaced snapshot is freed as soon as its last reader drops it - the store itself only
+    holds the current one.
+    */
+    class ConfigStore {
+        public:
+            explicit ConfigStore(bridge_config initial);
+            ConfigStore() = delete;
+            ConfigStore(const ConfigStore&) = delete;
+            ConfigStore& operator=(const ConfigStore&) = delete;
+
+            config_snapshot get() const;
+            // thread-safe, returns the published snapshot
+            config_snapshot publish(bridge_config config);
+            // number of published snapshots, 1 for the initial one
+            std::uint64_t get_version() const;
+
+        private:
+            std::mutex m_publish_mutex; // only taken by publish()
+            config_snapshot m_current; // only accessed through std::atomic_load/std::atomic_store
+            std::atomic<std::uint64_t> m_version;
+    };
+
+    /*
+    Reloads the config file on its own thread, so reading and validating it never runs on the
+    event loop. A valid file is published to the config store and the event loop is told through
+    an eventfd to apply the new snapshot. An invalid file is rejected and the running config stays
+    as it is. Requests that arrive while a reload is running (an editor usually causes several
+    inotify events) are folded into one more reload.
+    The reload latency is measured from the request until the owner applied the snapshot.
+    */
+    class ConfigReloader {
+        public:
+            using apply_callback = std::function<void(const config_snapshot& config)>;
+
+            ConfigReloader(std::string config_path, ConfigStore& store, ServiceMetrics& metrics, apply_callback on_apply);
+            ConfigReloader() = delete;
+            ConfigReloader(const ConfigReloader&) = delete;
+            ConfigReloader& operator=(const ConfigReloader&) = delete;
+            ~ConfigReloader();
+
+            // thread-safe
+            void request();
+            void stop();
+
+            int get_event_fd() const;
+            // applies the latest published snapshot, called by the event loop when the event fd is readable
+            void on_event();
+
+        private:
+            void run();
+
+            const std::string m_config_path;
+            ConfigStore& m_store;
+            ServiceMetrics& m_metrics;
+            apply_callback m_on_apply;
+            int m_event_fd;
+
+            std::mutex m_mutex;
+            std::condition_variable m_cv;
+            bool m_running;
+            bool m_requested;
+            std::chrono::steady_clock::time_point m_requested_at;
+            std::chrono::steady_clock::time_point m_published_request; // request time of the latest published snapshot
+            std::thread m_thread;
+    };
+
+} /* namespace printer_lamp */
@@ -1,11 +1,27 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <array>
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <sdbus-c++/sdbus-c++.h>
 
 #include "utils.hpp"
+#include "lamp_device.hpp"
+#include "device_health.hpp"
+#include "driver_io_worker.hpp"
+#include "effect_engine.hpp"
+#include "event_loop.hpp"
+#include "history_journal.hpp"
+#include "lamp_state_cache.hpp"
+#include "lamp_state.hpp"
+#include "metrics.hpp"
+#include "pending_replies.hpp"
+#include "signal_throttle.hpp"
+#include "state_publisher.hpp"
 
 namespace printer_lamp {
     
@@ -14,27 +30,117 @@ namespace printer_lamp {
         bool green;
         bool white;      
     };
-    
+
+    /*
+    Drives one dbus connection from the event loop. All lamp objects of the service share the
+    connection, so it is attached once, independent of the number of lamps.
+    */
+    class DbusConnectionDispatcher {
+        public:
+            DbusConnectionDispatcher(sdbus::IConnection& connection, EventLoop& loop);
+            DbusConnectionDispatcher() = delete;
+            DbusConnectionDispatcher(const DbusConnectionDispatcher&) = delete;
+            DbusConnectionDispatcher& operator=(const DbusConnectionDispatcher&) = delete;
+            ~DbusConnectionDispatcher();
+
+        private:
+            int prepare();
+
+            sdbus::IConnection& m_connection;
+            EventLoop& m_loop;
+            const int m_fd;
+    };
+
+    /*
+    The dbus object of one lamp. Every lamp has its own device, driver I/O worker and effect
+    engine, so a slow or absent lamp only delays its own commands.
+    Commands without an explicit priority are status changes, lightplays and effect steps are
+    effects. A status command preempts a running effect - or suspends it until the command was
+    written if resume_preempted_effects is set - an effect command replaces it, and maintenance
+    commands are queued behind its steps.
+    The health of the device is the device_health property ("healthy", "degraded" or "absent"),
+    its changes are announced with PropertiesChanged.
+    */
     class DriverDbusBridge {
         public:
-            DriverDbusBridge(std::unique_ptr<sdbus::IConnection>& connection, const bridge_config& dbus_config);
+            // the lamp of the [DRIVERSERVICE] section
+            DriverDbusBridge(std::unique_ptr<sdbus::IConnection>& connection, const config_snapshot& dbus_config);
+            // the metrics are owned by the bridge without shared_metrics
+            DriverDbusBridge(std::unique_ptr<sdbus::IConnection>& connection, const config_snapshot& dbus_config, const lamp_config& lamp, ServiceMetrics* shared_metrics = nullptr);
             DriverDbusBridge() = delete;
+            ~DriverDbusBridge();
 
             void set_driver_state(sdbus::MethodCall call);
+            void set_driver_state_nowait(sdbus::MethodCall call);
+            void set_driver_state_with_priority(sdbus::MethodCall call);
+            void set_driver_commands(sdbus::MethodCall call);
+            void set_driver_commands_with_priority(sdbus::MethodCall call);
+            void set_driver_mask(sdbus::MethodCall call);
+            void set_driver_scene(sdbus::MethodCall call);
             void get_current_lamp_state(sdbus::MethodCall call);
-            int send_state_change_signal() const;
-            bool write_to_driver(int state) const;
-            int lamp_state_to_int_state(char* driver_state);
+            void get_io_stats(sdbus::MethodCall call);
+            void get_metrics(sdbus::MethodCall call);
+            void get_state_snapshot(sdbus::MethodCall call);
+            void start_effect(sdbus::MethodCall call);
+            void stop_effect(sdbus::MethodCall call);
+            void get_history(sdbus::MethodCall call);
+            // emits the latest state right away, bypassing the signal throttle
+            void send_state_change_signal();
+            // registers the effect timer and the device watch with the loop, the connection is attached by a DbusConnectionDispatcher
+            void attach_to(EventLoop& loop);
+            // has to be called before an attached loop is destroyed
+            void detach();
+            // takes the scenes and effects of a new config snapshot - everything else needs a new bridge
+            void update_config(config_snapshot dbus_config);
+            ServiceMetrics& get_service_metrics();
 
         private:
-            int m_lamp_state;
+            void on_state_written(int state, std::uint64_t committed_sequence);
+            // replies once the command was written or the reply deadline expired
+            void set_state_and_reply(sdbus::MethodCall& call, int demanded_state, command_priority priority);
+            void send_deferred_reply(sdbus::MethodCall& call, bool committed);
+            bool enqueue_state(int demanded_state, std::uint64_t& sequence, const char* caller, command_priority priority);
+            // preempts or suspends a running effect for a command of the priority, true if it is suspended
+            bool give_way_to(command_priority priority);
+            // the suspended effect continues once the command with the sequence was written
+            void resume_effect_after(std::uint64_t sequence);
+            void resume_effect();
+            void emit_state_signal(const lamp_state_update& update);
+            void get_device_health(sdbus::PropertyGetReply& reply);
+            void on_device_health_changed(device_health health);
+            lamp_state_update get_last_update() const;
+            bool enqueue_transaction(const std::vector<int>& commands, const char* caller, command_priority priority);
+            void send_bool_reply(sdbus::MethodCall& call, bool value);
+            void wakeup_event_loop();
+            config_snapshot get_config() const;
+
+            lamp_state_update m_last_update;
+            mutable std::mutex m_last_update_mutex;
+
+            std::mutex m_resume_mutex;
+            std::uint64_t m_resume_after_sequence {0}; // 0 while no suspended effect waits for a command
+            std::uint64_t m_written_sequence {0};
 
             std::unique_ptr<sdbus::IConnection>& m_dbus_connection_ref;
             std::unique_ptr<sdbus::IObject> m_dbus_object;
             std::array<int, 9> m_possible_states = {0, 1, 2, 3, 4, 5, 6, 7, 8};
-            int m_lamp_state_translated = -1;
 
-            const bridge_config & m_dbus_config;
+            config_snapshot m_dbus_config; // swapped by update_config with std::atomic_store, the handlers never lock it
+            const lamp_config m_lamp;
+            std::unique_ptr<LampDevice> m_device;
+            std::unique_ptr<ServiceMetrics> m_owned_metrics;
+            ServiceMetrics& m_metrics;
+            LampStateCache m_state_cache;
+            PendingReplies<sdbus::MethodCall> m_pending_replies; // the worker commits them, so it has to outlive the worker
+            SignalThrottle m_signal_throttle; // same for the state updates the worker publishes
+            std::unique_ptr<HistoryJournal> m_history; // only with a configured history_path, appended by the worker
+            std::unique_ptr<StatePublisher> m_state_publisher; // only with a configured state_snapshot_path, written by the worker
+            DeviceHealth m_device_health; // fed by the worker
+            DriverIoWorker m_io_worker;
+            EffectEngine m_effect_engine; // hands its steps over to the worker
+            std::unique_ptr<PrometheusTextfileWriter> m_metrics_writer; // only with a configured metrics_textfile_path
+            std::atomic<EventLoop*> m_event_loop {nullptr}; // woken up after signals and replies were sent from other threads
+            std::unique_ptr<DeviceWatch> m_device_watch;
 
     };
 } /* namespace printer_lamp */
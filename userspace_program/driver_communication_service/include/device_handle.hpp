@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <array>
+
+#include "lamp_device.hpp"
+
+namespace printer_lamp {
+
+    /*
+    Persistent handle to the lamp device file. The file is opened once and kept open; every
+    command is written with a single pwrite(2) of a preformatted buffer. If the kernel module
+    destroys the device file (shutdown IRQ), the handle notices it, closes the descriptor and
+    reopens the file lazily on the next access once it has been recreated.
+    This is the "chardev" backend of the service.
+    */
+    class DeviceHandle : public LampDevice {
+        public:
+            explicit DeviceHandle(std::string device_path);
+            DeviceHandle() = delete;
+            DeviceHandle(const DeviceHandle&) = delete;
+            DeviceHandle& operator=(const DeviceHandle&) = delete;
+            ~DeviceHandle() override;
+
+            bool write_command(int command) override;
+            bool read_state(std::array<char, 3>& lamp_state) override;
+            bool is_open() const;
+            void close() override;
+
+        private:
+            bool ensure_open();
+            bool device_node_removed() const;
+            void handle_io_error(int error_number);
+
+            std::string m_device_path;
+            int m_fd;
+    };
+
+} /* namespace printer_lamp */
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <random>
+
+namespace printer_lamp {
+
+    enum class device_health : std::uint8_t {
+        healthy = 0,
+        degraded = 1, // the last device accesses failed, retried with a growing backoff
+        absent = 2 // failed absent_after_failures times in a row, new commands only update the target state
+    };
+
+    constexpr std::size_t DEVICE_HEALTH_COUNT = 3;
+    constexpr std::array<const char*, DEVICE_HEALTH_COUNT> DEVICE_HEALTH_NAMES = {"healthy", "degraded", "absent"};
+
+    /*
+    Health state machine of one lamp device, fed with the outcome of every device access by the
+    driver I/O worker. The first failure makes a healthy device degraded, absent_after_failures
+    consecutive failures make it absent and the first successful access makes it healthy again.
+    The delay before the next retry starts at the initial backoff and doubles with every failure
+    up to the maximum. Half of it is drawn at random (equal jitter), so the lamps of a service
+    that lost their devices at the same time do not retry in lockstep.
+    Only the worker thread reports accesses, the state can be read from any thread.
+    */
+    class DeviceHealth {
+        public:
+            // called by the worker thread whenever the state changed
+            using change_callback = std::function<void(device_health health)>;
+
+            DeviceHealth(std::chrono::milliseconds initial_backoff, std::chrono::milliseconds max_backoff, unsigned absent_after_failures, change_callback on_change = nullptr);
+            DeviceHealth() = delete;
+            DeviceHealth(const DeviceHealth&) = delete;
+            DeviceHealth& operator=(const DeviceHealth&) = delete;
+
+            void on_access_succeeded();
+            // returns the delay until the next retry
+            std::chrono::milliseconds on_access_failed();
+            // the device file changed, the next retry starts again with the initial backoff
+            void reset_backoff();
+
+            device_health get() const;
+            std::uint32_t get_consecutive_failures() const;
+
+        private:
+            void set(device_health health);
+
+            const std::chrono::milliseconds m_initial_backoff;
+            const std::chrono::milliseconds m_max_backoff;
+            const unsigned m_absent_after_failures;
+            const change_callback m_on_change;
+
+            std::atomic<device_health> m_health {device_health::healthy};
+            std::atomic<std::uint32_t> m_consecutive_failures {0};
+            std::chrono::milliseconds m_backoff;
+            std::minstd_rand m_random;
+    };
+
+} /* namespace printer_lamp */
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lamp_device.hpp"
+#include "command_coalescer.hpp"
+#include "device_health.hpp"
+#include "history_journal.hpp"
+#include "lamp_state.hpp"
+#include "lamp_state_cache.hpp"
+#include "metrics.hpp"
+
+namespace printer_lamp {
+
+    struct io_stats {
+        std::uint64_t queue_depth {0};
+        std::uint64_t max_queue_depth {0};
+        std::uint64_t enqueued {0};
+        std::uint64_t rejected {0};
+        std::uint64_t writes {0};
+        std::uint64_t write_retries {0};
+        std::uint64_t coalesced {0};
+        std::uint64_t skipped_batches {0};
+        std::uint64_t cancelled {0};
+        std::uint64_t preempted_batches {0};
+    };
+
+    // "status", "effect" or "maintenance", false for anything else
+    bool parse_command_priority(const std::string& name, command_priority& priority);
+
+    /*
+    Dedicated driver I/O thread. The dbus handlers only put commands into a bounded queue, the
+    worker owns the device, performs the writes and retries failed ones with the backoff of the
+    DeviceHealth, which it feeds with the outcome of every device access.
+    Whenever the worker wakes up it takes the whole burst of queued commands and coalesces it
+    into the minimal device writes (see coalesce_commands). Once a burst has been applied, its
+    last command is reported through the on_state_written callback (from the worker thread)
+    together with the sequence number of the last committed command. Commands are numbered in
+    enqueue order, starting with 1.
+    The worker keeps the LampStateCache up to date and reconciles it with the state read back
+    from the driver whenever it has been idle for the reconcile interval. Device syscall durations,
+    retries and the time the device was absent are recorded into the ServiceMetrics.
+    A pending retry is cut short by notify_device_change(), e.g. once the device file appeared; the
+    backoff starts over then. While the device is absent, commands that arrive are folded into the
+    pending writes right away, so the queue stays free: only the latest target state is kept, the
+    lightplays before it are dropped and counted as cancelled. Bursts folded that way are not
+    recorded in the apply latencies. A device change while the worker is idle reconciles at once.
+    With a history journal every applied burst is appended to it together with the caller of its
+    last command, the time it took until it was written and the number of retries.
+    Every command has a priority (see command_priority). A status command cancels the queued ones
+    of a lower priority, and if the burst that is being written has a lower priority, its remaining
+    writes are dropped after the current one - a write that is already in the driver (e.g. the
+    msleep of a lightplay) can not be interrupted. Only commands that reached the device are
+    committed - of a burst that was cut short that are the commands up to its last segment whose
+    writes all finished, since the coalescer writes each segment between two lightplays as a unit.
+    Every other dropped command is reported through on_command_cancelled (from the worker thread)
+    before a commit covers its sequence number. A burst ends with
+    the last queued command of the highest priority, the ones of a lower priority behind it are
+    left for the next burst, so they do not delay its commit.
+    */
+    class DriverIoWorker {
+        public:
+            using state_written_callback = std::function<void(int state, std::uint64_t committed_sequence)>;
+            using command_cancelled_callback = std::function<void(std::uint64_t sequence)>;
+
+            // the device health and the history journal (optional) have to outlive the worker
+            DriverIoWorker(LampDevice& device, LampStateCache& state_cache, ServiceMetrics& metrics, std::size_t queue_capacity, DeviceHealth& health, std::chrono::milliseconds reconcile_interval,
+                state_written_callback on_state_written, command_cancelled_callback on_command_cancelled = nullptr, HistoryJournal* history = nullptr);
+            DriverIoWorker() = delete;
+            DriverIoWorker(const DriverIoWorker&) = delete;
+            DriverIoWorker& operator=(const DriverIoWorker&) = delete;
+            ~DriverIoWorker();
+
+            bool enqueue(int state);
+            // sequence receives the number of the queued command, the caller (bus name) is recorded in the history
+            bool enqueue(int state, std::uint64_t& sequence, const char* caller = nullptr, command_priority priority = command_priority::status);
+            bool enqueue_batch(const std::vector<int>& commands, const char* caller = nullptr, command_priority priority = command_priority::status);
+            bool enqueue_batch(const std::vector<int>& commands, std::uint64_t& sequence, const char* caller, command_priority priority);
+            io_stats get_stats() const;
+            // the device file appeared, disappeared or changed its permissions - retries the write right away
+            void notify_device_change();
+            void stop();
+
+        private:
+            using caller_name = std::array<char, history_record::MAX_CALLER>;
+
+            struct queued_command {
+                std::uint64_t sequence;
+                int command;
+                command_priority priority;
+                std::chrono::steady_clock::time_point enqueued;
+                caller_name caller;
+            };
+
+            bool enqueue_commands(const int* commands, std::size_t count, std::uint64_t& sequence, const char* caller, command_priority priority);
+            void run();
+            // moves the queue up to its last command of the highest priority behind the commands of m_batch, expects m_queue_mutex to be held
+            void take_queue();
+            bool apply_batch();
+            // drops the writes of m_batch from first_write on and the commands behind its last written segment, returns the sequence up to which it was written
+            std::uint64_t cut_short(std::size_t first_write);
+            // drops the lightplays of m_batch except for its last command, which is the latest request
+            void drop_effects();
+            // reports the cancelled sequence numbers collected so far, without m_queue_mutex
+            void resolve_cancelled();
+            void coalesce_batch();
+            void reconcile_with_device();
+            bool write_to_device(int command);
+            void record_access(bool succeeded);
+
+            LampDevice& m_device;
+            LampStateCache& m_state_cache;
+            ServiceMetrics& m_metrics;
+            DeviceHealth& m_health;
+
+            const std::size_t m_queue_capacity;
+            const std::chrono::milliseconds m_reconcile_interval;
+            state_written_callback m_on_state_written;
+            command_cancelled_callback m_on_command_cancelled;
+            HistoryJournal* m_history;
+
+            std::vector<queued_command> m_queue; // reserved for the capacity, the worker takes it from the front
+            mutable std::mutex m_queue_mutex;
+            std::condition_variable m_queue_cv;
+            bool m_running;
+            bool m_device_changed {false};
+            bool m_applying {false}; // a burst is taken from the queue and written
+            command_priority m_batch_priority {command_priority::maintenance}; // highest priority within that burst
+            std::atomic<bool> m_preempt_requested {false}; // a status command is queued behind a burst of a lower priority
+            std::uint64_t m_next_sequence {0}; // sequence of the last queued command
+            std::vector<std::uint64_t> m_cancelled_sequences; // dropped from the queue, handed to the worker with the next burst
+
+            // only touched by the worker thread
+            std::vector<int> m_batch;
+            std::vector<queued_command> m_batch_entries; // the commands taken from the queue for m_batch
+            std::vector<int> m_write_commands;
+            std::uint64_t m_batch_sequence {0}; // sequence of the last command in m_batch
+            std::uint64_t m_written_sequence {0}; // the commands up to it reached the device
+            std::uint64_t m_resolved_sequence {0}; // the commands up to it are committed or cancelled
+            std::vector<std::uint64_t> m_batch_lightplays; // sequences of the lightplays that are still to be written, in write order
+            std::vector<std::uint64_t> m_resolving; // cancelled sequences that still have to be reported
+            caller_name m_batch_caller {};
+            std::chrono::steady_clock::time_point m_batch_start;
+            known_lamp_state m_known_state;
+            std::chrono::steady_clock::time_point m_absent_since;
+            std::chrono::milliseconds m_retry_delay {0}; // backoff after the last failed access
+
+            std::atomic<std::uint64_t> m_max_queue_depth {0};
+            std::atomic<std::uint64_t> m_enqueued {0};
+            std::atomic<std::uint64_t> m_rejected {0};
+            std::atomic<std::uint64_t> m_writes {0};
+            std::atomic<std::uint64_t> m_coalesced {0};
+            std::atomic<std::uint64_t> m_skipped_batches {0};
+            std::atomic<std::uint64_t> m_cancelled {0};
+            std::atomic<std::uint64_t> m_preempted_batches {0};
+
+            std::thread m_thread;
+    };
+
+} /* namespace printer_lamp */
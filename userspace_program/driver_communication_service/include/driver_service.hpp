@@ -0,0 +1,56 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sdbus-c++/sdbus-c++.h>
+
+#include "dbus_interaction.hpp"
+#include "event_loop.hpp"
+#include "metrics.hpp"
+#include "utils.hpp"
+
+namespace printer_lamp {
+
+    /*
+    All lamps of the service, one DriverDbusBridge per lamp on the one dbus connection. A reloaded
+    config is applied on the event loop thread without touching the lamps it does not change:
+        - lamps whose object path, device or driver limits changed are recreated, so they lose
+          their queued commands but keep their metrics
+        - removed lamps are unregistered, new ones registered
+        - all other lamps only switch to the scenes and effects of the new snapshot
+    Every lamp holds the snapshot it uses, so the ones it replaced are freed (see ConfigStore).
+    */
+    class DriverService {
+        public:
+            DriverService(std::unique_ptr<sdbus::IConnection>& connection, config_snapshot config);
+            DriverService() = delete;
+            DriverService(const DriverService&) = delete;
+            DriverService& operator=(const DriverService&) = delete;
+            ~DriverService();
+
+            void attach_to(EventLoop& loop);
+            // has to be called before an attached loop is destroyed
+            void detach();
+            void apply(config_snapshot config);
+            // metrics of the first lamp, which also record the event loop and the config reloads
+            ServiceMetrics& get_service_metrics();
+
+        private:
+            struct lamp_entry {
+                lamp_config lamp;
+                std::unique_ptr<DriverDbusBridge> bridge;
+            };
+
+            std::unique_ptr<DriverDbusBridge> create_bridge(const config_snapshot& config, const lamp_config& lamp);
+
+            std::unique_ptr<sdbus::IConnection>& m_connection;
+            config_snapshot m_config;
+            std::map<std::string, std::unique_ptr<ServiceMetrics>> m_metrics; // lamp name -> metrics, kept over recreations and outliving the bridges
+            std::vector<lamp_entry> m_lamps;
+            ServiceMetrics* m_service_metrics;
+            EventLoop* m_event_loop {nullptr};
+    };
+
+} /* namespace printer_lamp */
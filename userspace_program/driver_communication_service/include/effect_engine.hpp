@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "lamp_state.hpp"
+#include "lighting_effect.hpp"
+#include "metrics.hpp"
+
+namespace printer_lamp {
+
+    /*
+    Plays lighting effects in userspace instead of the blocking lightplays of the kernel driver.
+    Every step is scheduled on a timerfd with an absolute deadline (relative to the start of the
+    effect, so late steps do not shift the ones behind them) and handed over to the command sink
+    as individual on/off commands of effect priority. The delay between a deadline and the moment its commands were
+    handed over is recorded as scheduling jitter.
+    Once an effect is over or preempted, the LED state it was started with is restored. A running
+    effect is replaced by a newly started one and preempted right away - between two steps - by
+    preempt(), which is called for every new state command. A status command can suspend() it
+    instead; resume() continues with the remaining steps (shifted by the suspended time) and
+    restores the LED state the status command left behind.
+    The engine has no thread of its own: the owner registers the timer fd with the event loop
+    and calls on_timer() whenever it is readable.
+    */
+    class EffectEngine {
+        public:
+            // takes the commands of one step, returns false if they were rejected (e.g. the queue is full)
+            using command_sink = std::function<bool(const std::vector<int>& commands, command_priority priority)>;
+
+            EffectEngine(command_sink sink, ServiceMetrics& metrics);
+            EffectEngine() = delete;
+            EffectEngine(const EffectEngine&) = delete;
+            EffectEngine& operator=(const EffectEngine&) = delete;
+            ~EffectEngine();
+
+            // restore_leds is the LED state that is restored afterwards, nothing is restored without it
+            bool start(const lighting_effect& effect, std::optional<lamp_mask> restore_leds);
+            // stops a running effect and restores the LED state with the priority of the command that preempted it, returns false if no effect was running
+            bool preempt(command_priority priority = command_priority::effect);
+            // stops stepping without restoring anything, true if an effect is suspended afterwards
+            bool suspend();
+            // continues a suspended effect, restore_leds replaces the LED state that is restored at its end
+            bool resume(std::optional<lamp_mask> restore_leds);
+            bool is_running() const;
+            bool is_suspended() const;
+            void stop();
+
+            int get_timer_fd() const;
+            // hands over the due steps, called by the event loop when the timer fd is readable
+            void on_timer();
+
+        private:
+            void apply_due_steps();
+            void arm_timer();
+            void finish_effect(command_priority priority);
+
+            command_sink m_sink;
+            ServiceMetrics& m_metrics;
+            int m_timer_fd;
+
+            mutable std::mutex m_mutex;
+            bool m_running;
+            bool m_active;
+            bool m_suspended {false};
+            std::chrono::steady_clock::time_point m_suspended_at;
+            lighting_effect m_effect;
+            std::size_t m_next_step;
+            std::chrono::steady_clock::time_point m_start;
+            std::optional<lamp_mask> m_restore_leds;
+            std::vector<int> m_step_commands;
+    };
+
+} /* namespace printer_lamp */
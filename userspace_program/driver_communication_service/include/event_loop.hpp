@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "metrics.hpp"
+
+namespace printer_lamp {
+
+    /*
+    Single epoll event loop of the service. File descriptors (the dbus connection, timerfds,
+    inotify, signalfd, ...) are registered together with a callback for their events. Before every
+    wait the prepare callbacks run - they can update the registered events and return how long the
+    loop may sleep at most, e.g. for the timeouts of the dbus connection. Other threads wake the
+    loop through an eventfd with wakeup() whenever it has to run its prepare callbacks again.
+    The time from the end of a wait until the loop waits again is recorded per iteration.
+    Registration is only allowed before run() or from callbacks of the loop itself, a fd that was
+    removed can be registered again right away (e.g. the reused number of a closed fd).
+    */
+    class EventLoop {
+        public:
+            using fd_callback = std::function<void(std::uint32_t events)>;
+            // returns the maximum time in ms the loop may sleep, -1 for no limit
+            using prepare_callback = std::function<int()>;
+
+            explicit EventLoop(LatencyHistogram& iteration_latency);
+            EventLoop() = delete;
+            EventLoop(const EventLoop&) = delete;
+            EventLoop& operator=(const EventLoop&) = delete;
+            ~EventLoop();
+
+            // events are EPOLLIN, EPOLLOUT, ...
+            void add_fd(int fd, std::uint32_t events, fd_callback on_ready);
+            void modify_fd(int fd, std::uint32_t events);
+            void remove_fd(int fd);
+            void add_prepare(prepare_callback prepare);
+
+            // dispatches events until stop() is called
+            void run();
+            // thread-safe
+            void stop();
+            // thread-safe
+            void wakeup();
+
+        private:
+            int m_epoll_fd;
+            int m_wakeup_fd;
+            LatencyHistogram& m_iteration_latency;
+            struct registration {
+                fd_callback on_ready;
+                bool active; // false once removed, its events of the current iteration are skipped
+            };
+
+            std::map<int, std::unique_ptr<registration>> m_callbacks;
+            std::vector<std::unique_ptr<registration>> m_retired_callbacks; // removed within the current iteration
+            std::vector<prepare_callback> m_prepare_callbacks;
+            std::atomic<bool> m_running;
+    };
+
+    /*
+    Watches the directory of the device file with inotify, so the service learns within
+    milliseconds that the device file appeared, disappeared or got its permissions (udev) -
+    instead of waiting for the next write retry. The service watches its config file the same way.
+    */
+    class DeviceWatch {
+        public:
+            // present: the device file exists after the change
+            using change_callback = std::function<void(bool present)>;
+
+            // watch_writes also reports finished writes to the file, e.g. for a config file that is edited in place
+            DeviceWatch(EventLoop& loop, std::string device_path, change_callback on_change, bool watch_writes = false);
+            DeviceWatch() = delete;
+            DeviceWatch(const DeviceWatch&) = delete;
+            DeviceWatch& operator=(const DeviceWatch&) = delete;
+            ~DeviceWatch();
+
+        private:
+            void on_events();
+
+            EventLoop& m_loop;
+            const std::string m_device_path;
+            std::string m_file_name;
+            change_callback m_on_change;
+            int m_inotify_fd;
+    };
+
+} /* namespace printer_lamp */
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace printer_lamp {
+
+    // one applied state change as stored in the journal file
+    struct history_record {
+        static constexpr std::size_t MAX_CALLER = 68;
+
+        std::atomic<std::uint64_t> sequence; // index + 1 once the record is complete, 0 while it is written
+        std::int64_t timestamp_ns; // CLOCK_REALTIME when the state change was applied
+        std::uint32_t write_latency_us; // from taking the commands until they were written, including the retries
+        std::int32_t command; // last requested command
+        std::uint16_t retries;
+        std::uint8_t mask; // resulting LED bitmask, 0xFF if unknown
+        std::uint8_t reserved;
+        char caller[MAX_CALLER]; // unique bus name of the caller, "effect" for effect steps, null-terminated
+    };
+    static_assert(sizeof(history_record) == 96, "the record layout is part of the file format");
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "the records are shared through a file mapping");
+
+    // a record copied out of the journal
+    struct history_entry {
+        std::uint64_t sequence; // starts at 1, a gap means the records in between were overwritten
+        std::int64_t timestamp_ns;
+        std::uint32_t write_latency_us;
+        int command;
+        std::uint8_t mask;
+        std::uint32_t retries;
+        std::string caller;
+    };
+
+    /*
+    Append-only journal of the state changes of one lamp in a memory mapped file with fixed size
+    records. Once the file reached its maximum size it rolls over and the oldest records are
+    overwritten. An existing journal with the same layout is continued after a restart, so the
+    history survives crashes and restarts of the service (the page cache writes it back, it is
+    never synced explicitly).
+    Appending claims a slot with an atomic increment and publishes the record like a seqlock - no
+    lock and no syscall. Readers copy the records straight from the mapping and skip the ones
+    that are written or overwritten while they read them.
+    */
+    class HistoryJournal {
+        public:
+            // throws std::runtime_error if the file can not be created or mapped
+            HistoryJournal(const std::string& path, std::size_t max_bytes);
+            HistoryJournal() = delete;
+            HistoryJournal(const HistoryJournal&) = delete;
+            HistoryJournal& operator=(const HistoryJournal&) = delete;
+            ~HistoryJournal();
+
+            void append(int command, std::uint8_t mask, const char* caller, std::chrono::nanoseconds write_latency, std::uint32_t retries);
+            // the records applied at or after since (unix time), oldest first, at most max_records
+            std::vector<history_entry> read_since(std::chrono::system_clock::time_point since, std::size_t max_records) const;
+
+            // number of records ever appended, including the ones that were overwritten
+            std::uint64_t get_appended() const;
+            std::size_t get_capacity() const;
+
+        private:
+            struct file_header;
+
+            history_record& slot(std::uint64_t index) const;
+
+            int m_fd;
+            void* m_mapping;
+            std::size_t m_mapping_size;
+            file_header* m_header;
+            history_record* m_records;
+            std::size_t m_capacity;
+    };
+
+} /* namespace printer_lamp */
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "utils.hpp"
+#include "lamp_state.hpp"
+
+namespace printer_lamp {
+
+    /*
+    Backend interface for the lamp device. The driver I/O worker only talks to this interface, so
+    the service can run against the real char device as well as against emulations of it.
+    */
+    class LampDevice {
+        public:
+            virtual ~LampDevice() = default;
+
+            // executes one lamp command (0-8); false if the device is absent or the write failed
+            virtual bool write_command(int command) = 0;
+            // reads the 3-byte lamp_state array of the driver
+            virtual bool read_state(std::array<char, 3>& lamp_state) = 0;
+            virtual void close() = 0;
+    };
+
+    // "memory" backend: keeps the lamp state in memory and is always present
+    class MemoryDevice : public LampDevice {
+        public:
+            bool write_command(int command) override;
+            bool read_state(std::array<char, 3>& lamp_state) override;
+            void close() override {}
+
+            lamp_mask get_mask() const;
+            std::uint64_t get_write_count() const;
+
+        private:
+            lamp_mask m_mask {0};
+            std::uint64_t m_write_count {0};
+    };
+
+    /*
+    "emulated" backend: speaks the text protocol of the kernel driver ("<command>\n") into a
+    regular file (appended, so the file is a log of the protocol) or a FIFO, and answers reads
+    with the 3-byte lamp_state the kernel driver would report - taken from <path>.state if a
+    simulator publishes it there. The device counts as absent while the path does not exist or,
+    for a FIFO, while nobody reads from it.
+    */
+    class EmulatedDevice : public LampDevice {
+        public:
+            explicit EmulatedDevice(std::string path);
+            EmulatedDevice() = delete;
+            EmulatedDevice(const EmulatedDevice&) = delete;
+            EmulatedDevice& operator=(const EmulatedDevice&) = delete;
+            ~EmulatedDevice() override;
+
+            bool write_command(int command) override;
+            bool read_state(std::array<char, 3>& lamp_state) override;
+            void close() override;
+
+        private:
+            bool ensure_open();
+
+            std::string m_path;
+            std::string m_state_path; // <path>.state of a simulator
+            int m_fd;
+            lamp_mask m_mask;
+    };
+
+    // wraps any backend and injects latency and random failures into every device access
+    class FaultInjectingDevice : public LampDevice {
+        public:
+            FaultInjectingDevice(std::unique_ptr<LampDevice> device, long latency_us, double failure_rate);
+            FaultInjectingDevice() = delete;
+
+            bool write_command(int command) override;
+            bool read_state(std::array<char, 3>& lamp_state) override;
+            void close() override;
+
+        private:
+            bool inject();
+
+            std::unique_ptr<LampDevice> m_device;
+            const long m_latency_us;
+            std::bernoulli_distribution m_failure;
+            std::minstd_rand m_random;
+    };
+
+    // creates the backend selected by device_config::backend, nullptr for an unknown backend
+    std::unique_ptr<LampDevice> create_lamp_device(const device_config& config);
+
+} /* namespace printer_lamp */
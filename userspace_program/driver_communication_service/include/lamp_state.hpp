@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace printer_lamp {
+
+    /*
+    Bitmask representation of the lamp. Bit n mirrors lamp_state[n] of the kernel driver, which
+    is switched on by command n and switched off by command n + 3 (n = 0, 1, 2).
+    */
+    using lamp_mask = std::uint8_t;
+
+    constexpr lamp_mask ALL_LEDS = 0b111;
+    constexpr int NUM_LEDS = 3;
+
+    constexpr int COMMAND_LIGHTPLAY_1 = 6;
+    constexpr int COMMAND_LIGHTPLAY_2 = 7;
+    constexpr int COMMAND_RESET_ALL = 8;
+
+    constexpr bool is_valid_command(int command) {
+        return command >= 0 && command <= COMMAND_RESET_ALL;
+    }
+
+    // lightplays run an animation and restore the previous LED state afterwards
+    constexpr bool is_effect_command(int command) {
+        return command == COMMAND_LIGHTPLAY_1 || command == COMMAND_LIGHTPLAY_2;
+    }
+
+    /*
+    Scheduling class of a command. A command only waits behind commands of its own or a higher
+    priority - queued and in-flight work of a lower priority is cancelled for it.
+        status       state changes of the printer, e.g. from the poller
+        effect       lightplays and the steps of userspace effects, e.g. from a dashboard
+        maintenance  everything that can wait, e.g. tests of the LEDs
+    */
+    enum class command_priority : std::uint8_t {
+        maintenance = 0,
+        effect = 1,
+        status = 2
+    };
+
+    constexpr std::size_t COMMAND_PRIORITY_COUNT = 3;
+    constexpr std::array<const char*, COMMAND_PRIORITY_COUNT> COMMAND_PRIORITY_NAMES = {"maintenance", "effect", "status"};
+
+    // priority of the commands sent without one: lightplays are effects, everything else a status change
+    constexpr command_priority default_priority(int command) {
+        return is_effect_command(command) ? command_priority::effect : command_priority::status;
+    }
+
+    constexpr int led_on_command(int led_idx) {
+        return led_idx;
+    }
+
+    constexpr int led_off_command(int led_idx) {
+        return led_idx + NUM_LEDS;
+    }
+
+    // LEDs whose state is defined by the command (none for effects, all for the reset)
+    constexpr lamp_mask command_leds(int command) {
+        if (command >= 0 && command < 2 * NUM_LEDS) {
+            return static_cast<lamp_mask>(1u << (command % NUM_LEDS));
+        }
+        return command == COMMAND_RESET_ALL ? ALL_LEDS : 0;
+    }
+
+    // state of the lamp after the kernel driver executed the command
+    constexpr lamp_mask apply_command(lamp_mask mask, int command) {
+        if (command >= 0 && command < NUM_LEDS) {
+            return static_cast<lamp_mask>(mask | command_leds(command));
+        }
+        if (command >= NUM_LEDS && command < 2 * NUM_LEDS) {
+            return static_cast<lamp_mask>(mask & ~command_leds(command));
+        }
+        return command == COMMAND_RESET_ALL ? 0 : mask;
+    }
+
+    /*
+    Documented integer encoding of the lamp state (triple = lamp_state[0], [1], [2]):
+        blue green white
+        000 0
+        100 1
+        110 2
+        111 3
+        011 4
+        001 5
+        010 6
+        101 7
+    */
+    constexpr std::array<lamp_mask, 8> INT_STATE_TO_MASK = {0b000, 0b001, 0b011, 0b111, 0b110, 0b100, 0b010, 0b101};
+
+    constexpr std::array<int, 8> make_mask_to_int_state_table() {
+        std::array<int, 8> table {};
+        for (int state = 0; state < static_cast<int>(INT_STATE_TO_MASK.size()); state++) {
+            table[INT_STATE_TO_MASK[state]] = state;
+        }
+        return table;
+    }
+
+    constexpr std::array<int, 8> MASK_TO_INT_STATE = make_mask_to_int_state_table();
+
+    static_assert(MASK_TO_INT_STATE[0b000] == 0 && MASK_TO_INT_STATE[0b111] == 3 && MASK_TO_INT_STATE[0b101] == 7, "lamp state encoding table is broken");
+
+    constexpr int mask_to_int_state(lamp_mask mask) {
+        return MASK_TO_INT_STATE[mask & ALL_LEDS];
+    }
+
+    // the kernel driver answers a read with its bool lamp_state[3] array
+    inline lamp_mask mask_from_lamp_state(const std::array<char, 3>& lamp_state) {
+        lamp_mask mask = 0;
+        for (int idx = 0; idx < NUM_LEDS; idx++) {
+            if (lamp_state[idx] != 0) {
+                mask |= static_cast<lamp_mask>(1u << idx);
+            }
+        }
+        return mask;
+    }
+
+} /* namespace printer_lamp */
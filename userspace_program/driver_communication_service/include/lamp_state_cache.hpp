@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "lamp_state.hpp"
+
+namespace printer_lamp {
+
+    /*
+    Authoritative in-memory copy of the lamp state. The driver I/O worker updates it after every
+    successful write and periodically reconciles it against the 3-byte lamp_state read of the
+    kernel driver. Queries are answered from memory without any syscall.
+    */
+    class LampStateCache {
+        public:
+            LampStateCache() = default;
+            LampStateCache(const LampStateCache&) = delete;
+            LampStateCache& operator=(const LampStateCache&) = delete;
+
+            void update(lamp_mask mask);
+            void invalidate();
+            bool reconcile(lamp_mask device_mask);
+
+            bool is_valid() const;
+            lamp_mask get_mask() const;
+            int get_int_state() const;
+
+            std::uint64_t get_reconciliations() const;
+            std::uint64_t get_mismatches() const;
+
+        private:
+            static constexpr std::uint16_t VALID_FLAG = 0x100;
+
+            std::atomic<std::uint16_t> m_state {0}; // VALID_FLAG | mask
+            std::atomic<std::uint64_t> m_reconciliations {0};
+            std::atomic<std::uint64_t> m_mismatches {0};
+    };
+
+} /* namespace printer_lamp */
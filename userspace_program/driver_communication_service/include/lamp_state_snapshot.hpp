@@ -0,0 +1,125 @@
+#pragma once
+
+/*
+Lock-free view of the lamp state published by the driver service (state_snapshot_path), for
+clients that poll the lamp state without a dbus round trip. Header-only and without any other
+header of the service, so clients can copy it into their own tree:
+
+    printer_lamp::LampStateSnapshotReader reader("/dev/shm/printer_lamp_state");
+    printer_lamp::lamp_state_snapshot snapshot;
+    if (reader.read(snapshot) && snapshot.mask != 0xFF) { ... }
+
+A read is a handful of loads from a shared mapping - no syscall and nothing the service notices.
+*/
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace printer_lamp {
+
+    constexpr char LAMP_STATE_SNAPSHOT_MAGIC[8] = {'L', 'A', 'M', 'P', 'S', 'T', 'A', 'T'};
+    constexpr std::uint32_t LAMP_STATE_SNAPSHOT_VERSION = 1;
+
+    /*
+    The whole shared segment, one cache line. The service is the only writer and guards the
+    fields with a seqlock: seqlock is odd while they are changed and increases by two with every
+    update, so a reader that saw the same even value before and after copying them has a
+    consistent copy. The fields are atomics so the concurrent copy is well defined.
+    */
+    struct shared_lamp_state {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t reserved_header;
+        std::atomic<std::uint64_t> seqlock;
+        std::atomic<std::uint64_t> sequence; // sequence number of current_lamp_state, 0 before the first state change, continues across restarts
+        std::atomic<std::int64_t> changed_ns; // CLOCK_REALTIME of the last update
+        std::atomic<std::int32_t> command; // last applied lamp command, -1 before the first state change
+        std::atomic<std::uint8_t> mask; // LED bitmask (bit n = lamp_state[n] of the driver), 0xFF while unknown
+        std::atomic<std::uint8_t> health; // 0 healthy, 1 degraded, 2 absent (device_health property)
+        std::uint8_t reserved[18];
+    };
+    static_assert(sizeof(shared_lamp_state) == 64, "the layout is shared with the clients");
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::int32_t>::is_always_lock_free &&
+        std::atomic<std::uint8_t>::is_always_lock_free, "the state is shared through a file mapping");
+
+    // a consistent copy of the shared state
+    struct lamp_state_snapshot {
+        std::uint64_t sequence {0};
+        std::int64_t changed_ns {0};
+        int command {-1};
+        std::uint8_t mask {0xFF};
+        std::uint8_t health {0};
+    };
+
+    /*
+    Maps the state segment read-only. The service keeps the file (and its inode) across restarts,
+    so a reader stays valid while the service restarts.
+    */
+    class LampStateSnapshotReader {
+        public:
+            // throws std::runtime_error if the file can not be mapped or is not a lamp state segment
+            explicit LampStateSnapshotReader(const std::string& path) {
+                const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0) {
+                    throw std::runtime_error("could not open the lamp state " + path);
+                }
+                struct stat file_stat {};
+                if (::fstat(fd, &file_stat) != 0 || static_cast<std::size_t>(file_stat.st_size) < sizeof(shared_lamp_state)) {
+                    ::close(fd);
+                    throw std::runtime_error("the lamp state " + path + " is not published yet");
+                }
+                void* mapping = ::mmap(nullptr, sizeof(shared_lamp_state), PROT_READ, MAP_SHARED, fd, 0);
+                ::close(fd); // the mapping keeps the file
+                if (mapping == MAP_FAILED) {
+                    throw std::runtime_error("could not map the lamp state " + path);
+                }
+                m_state = static_cast<const shared_lamp_state*>(mapping);
+                if (std::memcmp(m_state->magic, LAMP_STATE_SNAPSHOT_MAGIC, sizeof(LAMP_STATE_SNAPSHOT_MAGIC)) != 0 || m_state->version != LAMP_STATE_SNAPSHOT_VERSION) {
+                    ::munmap(mapping, sizeof(shared_lamp_state));
+                    throw std::runtime_error("the lamp state " + path + " has an unknown layout");
+                }
+            }
+
+            LampStateSnapshotReader(const LampStateSnapshotReader&) = delete;
+            LampStateSnapshotReader& operator=(const LampStateSnapshotReader&) = delete;
+
+            ~LampStateSnapshotReader() {
+                ::munmap(const_cast<shared_lamp_state*>(m_state), sizeof(shared_lamp_state));
+            }
+
+            // false only if every attempt overlapped an update, e.g. if the service died within one
+            bool read(lamp_state_snapshot& snapshot, int max_attempts = 1000) const {
+                for (int attempt = 0; attempt < max_attempts; attempt++) {
+                    const std::uint64_t before = m_state->seqlock.load(std::memory_order_acquire);
+                    if (before & 1) {
+                        continue;
+                    }
+                    snapshot.sequence = m_state->sequence.load(std::memory_order_relaxed);
+                    snapshot.changed_ns = m_state->changed_ns.load(std::memory_order_relaxed);
+                    snapshot.command = m_state->command.load(std::memory_order_relaxed);
+                    snapshot.mask = m_state->mask.load(std::memory_order_relaxed);
+                    snapshot.health = m_state->health.load(std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (m_state->seqlock.load(std::memory_order_relaxed) == before) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            // number of updates since the segment was created, cheap to poll for changes
+            std::uint64_t get_version() const {
+                return m_state->seqlock.load(std::memory_order_acquire) / 2;
+            }
+
+        private:
+            const shared_lamp_state* m_state {nullptr};
+    };
+
+} /* namespace printer_lamp */
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "lamp_state.hpp"
+
+namespace printer_lamp {
+
+    // one on/off command at its offset from the start of the effect
+    struct effect_step {
+        std::chrono::milliseconds offset;
+        int command;
+    };
+
+    // steps sorted by their offset, steps with the same offset are written in their order
+    using lighting_effect = std::vector<effect_step>;
+
+    // blinks the LEDs of the mask repeats times
+    lighting_effect make_blink_effect(lamp_mask leds, std::chrono::milliseconds on_time, std::chrono::milliseconds off_time, int repeats);
+    // runs a single lit LED from white to blue, rounds times
+    lighting_effect make_chase_effect(std::chrono::milliseconds step_time, int rounds);
+    // trains of pulses of the LEDs of the mask with a pause between two trains
+    lighting_effect make_pulse_train_effect(lamp_mask leds, std::chrono::milliseconds pulse_time, std::chrono::milliseconds gap_time, int pulses, std::chrono::milliseconds pause_time, int trains);
+
+    /*
+    Parses an effect definition of the [EFFECTS] config section:
+        blink, <led mask>, <on ms>, <off ms>, <repeats>
+        chase, <step ms>, <rounds>
+        pulse_train, <led mask>, <pulse ms>, <gap ms>, <pulses>, <pause ms>, <trains>
+        timeline, <offset ms>:<command>, <offset ms>:<command>, ...
+    A timeline may only use the on/off commands 0-5 and the reset 8 - the lightplays would block
+    the driver for their whole duration. Throws std::invalid_argument for invalid definitions.
+    */
+    lighting_effect parse_lighting_effect(const std::string& definition);
+
+} /* namespace printer_lamp */
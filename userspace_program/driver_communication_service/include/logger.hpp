@@ -0,0 +1,250 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <unistd.h>
+
+#include "metrics.hpp"
+
+// records below this level are compiled out, e.g. -DPRINTER_LAMP_MIN_LOG_LEVEL=1 drops all debug records
+#ifndef PRINTER_LAMP_MIN_LOG_LEVEL
+#define PRINTER_LAMP_MIN_LOG_LEVEL 0
+#endif
+
+namespace printer_lamp {
+
+    enum class log_level : int {
+        debug = 0,
+        info = 1,
+        warning = 2,
+        error = 3,
+        off = 4
+    };
+
+    enum class log_target {
+        stdout_lines, // one "[level] message" line per record
+        journal // native journald protocol, one datagram per record with its PRIORITY
+    };
+
+    // "debug", "info", "warning", "error" or "off", throws std::invalid_argument otherwise
+    log_level parse_log_level(const std::string& name);
+    // "stdout" or "journal", throws std::invalid_argument otherwise
+    log_target parse_log_target(const std::string& name);
+    const char* log_level_name(log_level level);
+
+    // one formatted record, the text is truncated to the fixed size
+    struct log_entry {
+        static constexpr std::size_t MAX_TEXT = 240;
+
+        log_level level;
+        std::uint16_t length;
+        char text[MAX_TEXT];
+    };
+
+    /*
+    Lock-free single producer single consumer ring of log entries. The producer formats a record
+    directly into the claimed slot and publishes it with one release store, the consumer releases
+    the slots it has written out the same way. Nothing is allocated after construction.
+    */
+    class LogRing {
+        public:
+            // the capacity is rounded up to a power of two
+            explicit LogRing(std::size_t capacity);
+            LogRing() = delete;
+            LogRing(const LogRing&) = delete;
+            LogRing& operator=(const LogRing&) = delete;
+
+            // producer: a free slot or nullptr if the ring is full
+            log_entry* try_claim();
+            // producer: publishes the claimed slot
+            void commit();
+            // producer: number of published entries the consumer did not take yet
+            std::size_t size() const;
+
+            // consumer: number of published entries
+            std::size_t readable() const;
+            // consumer: published entry, 0 is the oldest one
+            const log_entry& peek(std::size_t idx) const;
+            // consumer: releases the oldest entries
+            void pop(std::size_t count);
+
+            // the producing thread exited, the ring is dropped once it is empty
+            void close();
+            bool is_closed() const;
+
+            std::size_t capacity() const;
+
+        private:
+            std::vector<log_entry> m_entries;
+            const std::size_t m_mask;
+            alignas(64) std::atomic<std::size_t> m_head {0}; // next slot of the producer
+            std::size_t m_cached_tail {0}; // producer's view of the tail, refreshed when the ring looks full
+            alignas(64) std::atomic<std::size_t> m_tail {0}; // next slot of the consumer
+            std::atomic<bool> m_closed {false};
+    };
+
+    /*
+    Asynchronous logger of the service. Every producing thread gets its own LogRing on its first
+    record, so logging from the event loop, the driver I/O workers and the reloader never takes a
+    lock and never blocks on stdout or journald. A background thread collects the records of all
+    rings and writes them in batches - one write() for stdout, one sendmmsg() for the journal.
+    If a ring is full the record is dropped and counted instead of waiting.
+    A disabled level costs one relaxed load at runtime, levels below PRINTER_LAMP_MIN_LOG_LEVEL
+    are not compiled at all.
+    */
+    class Logger {
+        public:
+            static constexpr std::size_t DEFAULT_RING_CAPACITY = 256;
+
+            // output_fd is used by the stdout target, the journal target falls back to it if journald is not reachable
+            Logger(log_target target = log_target::stdout_lines, std::size_t ring_capacity = DEFAULT_RING_CAPACITY, int output_fd = STDOUT_FILENO);
+            Logger(const Logger&) = delete;
+            Logger& operator=(const Logger&) = delete;
+            ~Logger();
+
+            // the logger of the service, writes to stdout until it is configured
+            static Logger& get();
+
+            bool is_enabled(log_level level) const {
+                return static_cast<int>(level) >= m_level.load(std::memory_order_relaxed);
+            }
+            // runtime level, e.g. from the config
+            void set_level(log_level level);
+            log_level get_level() const;
+            // thread-safe, later records go to the new target
+            void set_target(log_target target);
+
+            // a slot of the ring of the calling thread or nullptr if it is full (counted as dropped)
+            log_entry* claim();
+            // publishes the slot returned by claim()
+            void commit(const log_entry& entry);
+            // blocks until everything that was committed before has been written
+            void flush();
+
+            std::uint64_t get_dropped() const;
+
+        private:
+            struct thread_ring;
+
+            LogRing& ring_of_this_thread();
+            void run();
+            // writes the pending entries of all rings, returns the number of written entries
+            std::size_t write_pending();
+            void write_batch();
+            void write_lines();
+            void write_journal();
+            bool connect_journal();
+
+            const std::uint64_t m_id; // tells the rings of different loggers apart within a thread
+            const std::size_t m_ring_capacity;
+            const int m_output_fd;
+            std::atomic<int> m_level {static_cast<int>(log_level::info)};
+            Counter m_dropped;
+
+            std::mutex m_rings_mutex; // taken on the first record of a thread and by the writer thread
+            std::vector<std::shared_ptr<LogRing>> m_rings;
+
+            // only used by the writer thread
+            std::atomic<log_target> m_target;
+            int m_journal_fd {-1};
+            std::vector<std::shared_ptr<LogRing>> m_pending_rings;
+            std::vector<const log_entry*> m_pending;
+            std::string m_batch;
+
+            std::mutex m_mutex;
+            std::condition_variable m_cv;
+            std::condition_variable m_flushed_cv;
+            bool m_running {true};
+            bool m_wakeup_requested {false};
+            std::uint64_t m_flush_requests {0};
+            std::uint64_t m_flushes_done {0};
+            std::thread m_thread;
+    };
+
+    /*
+    Formats one record into a slot of the ring without allocating and publishes it when it goes
+    out of scope. Used through the LAMP_LOG_* macros.
+    */
+    class LogRecord {
+        public:
+            LogRecord(Logger& logger, log_level level) : m_logger{logger}, m_entry{logger.claim()} {
+                if (m_entry != nullptr) {
+                    m_entry->level = level;
+                    m_entry->length = 0;
+                }
+            }
+            ~LogRecord() {
+                if (m_entry != nullptr) {
+                    m_logger.commit(*m_entry);
+                }
+            }
+            LogRecord(const LogRecord&) = delete;
+            LogRecord& operator=(const LogRecord&) = delete;
+
+            LogRecord& operator<<(std::string_view text) {
+                if (m_entry != nullptr) {
+                    const std::size_t free = log_entry::MAX_TEXT - m_entry->length;
+                    const std::size_t length = text.size() < free ? text.size() : free;
+                    text.copy(m_entry->text + m_entry->length, length);
+                    m_entry->length = static_cast<std::uint16_t>(m_entry->length + length);
+                }
+                return *this;
+            }
+
+            LogRecord& operator<<(const char* text) {
+                return *this << std::string_view(text != nullptr ? text : "(null)");
+            }
+
+            LogRecord& operator<<(const std::string& text) {
+                return *this << std::string_view(text);
+            }
+
+            LogRecord& operator<<(char character) {
+                return *this << std::string_view(&character, 1);
+            }
+
+            LogRecord& operator<<(bool value) {
+                return *this << (value ? "true" : "false");
+            }
+
+            template <typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value && !std::is_same<T, char>::value, int>::type = 0>
+            LogRecord& operator<<(T value) {
+                char buffer[24];
+                const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+                return *this << std::string_view(buffer, static_cast<std::size_t>(result.ptr - buffer));
+            }
+
+            LogRecord& operator<<(double value);
+
+        private:
+            Logger& m_logger;
+            log_entry* m_entry;
+    };
+
+} /* namespace printer_lamp */
+
+#define LAMP_LOG(level, message) \
+    do { \
+        if constexpr (static_cast<int>(level) >= PRINTER_LAMP_MIN_LOG_LEVEL) { \
+            if (::printer_lamp::Logger::get().is_enabled(level)) { \
+                ::printer_lamp::LogRecord log_record_(::printer_lamp::Logger::get(), level); \
+                log_record_ << message; \
+            } \
+        } \
+    } while (false)
+
+#define LAMP_LOG_DEBUG(message) LAMP_LOG(::printer_lamp::log_level::debug, message)
+#define LAMP_LOG_INFO(message) LAMP_LOG(::printer_lamp::log_level::info, message)
+#define LAMP_LOG_WARNING(message) LAMP_LOG(::printer_lamp::log_level::warning, message)
+#define LAMP_LOG_ERROR(message) LAMP_LOG(::printer_lamp::log_level::error, message)
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "lamp_state.hpp"
+
+namespace printer_lamp {
+
+    /*
+    Lock-free monotonic counter. Recording is a single relaxed atomic add, readers only need an
+    approximately consistent view.
+    */
+    class Counter {
+        public:
+            void increment(std::uint64_t value = 1) {
+                m_value.fetch_add(value, std::memory_order_relaxed);
+            }
+
+            std::uint64_t get() const {
+                return m_value.load(std::memory_order_relaxed);
+            }
+
+        private:
+            std::atomic<std::uint64_t> m_value {0};
+    };
+
+    /*
+    Lock-free latency histogram with power of two buckets: bucket n counts the durations in
+    [2^(n-1), 2^n) nanoseconds, the last bucket everything above. Recording costs one bucket and
+    one sum increment plus a load for the maximum (the compare-exchange only runs on a new max).
+    Each histogram has its own cache lines, so the event loop and the worker do not share them.
+    */
+    class alignas(64) LatencyHistogram {
+        public:
+            static constexpr std::size_t NUM_BUCKETS = 40; // the last finite bound is 2^38 ns (~4.6 minutes)
+
+            void record(std::chrono::nanoseconds duration) {
+                const std::uint64_t ns = duration.count() > 0 ? static_cast<std::uint64_t>(duration.count()) : 0;
+                m_buckets[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+                m_sum_ns.fetch_add(ns, std::memory_order_relaxed);
+                std::uint64_t max_ns = m_max_ns.load(std::memory_order_relaxed);
+                while (ns > max_ns && !m_max_ns.compare_exchange_weak(max_ns, ns, std::memory_order_relaxed)) {}
+            }
+
+            std::uint64_t get_count() const;
+            std::uint64_t get_sum_ns() const;
+            std::uint64_t get_max_ns() const;
+            std::uint64_t get_bucket(std::size_t idx) const;
+            // upper bound of the bucket that contains the quantile, 0 without samples
+            std::uint64_t get_quantile_ns(double quantile) const;
+
+            static constexpr std::uint64_t bucket_upper_bound_ns(std::size_t idx) {
+                return std::uint64_t{1} << idx;
+            }
+
+        private:
+            static std::size_t bucket_index(std::uint64_t ns) {
+                const std::size_t bit_width = (ns == 0) ? 0 : static_cast<std::size_t>(64 - __builtin_clzll(ns));
+                return bit_width < NUM_BUCKETS ? bit_width : NUM_BUCKETS - 1;
+            }
+
+            std::array<std::atomic<std::uint64_t>, NUM_BUCKETS> m_buckets {};
+            std::atomic<std::uint64_t> m_sum_ns {0};
+            std::atomic<std::uint64_t> m_max_ns {0};
+    };
+
+    // measures the scope it lives in
+    class ScopedLatency {
+        public:
+            explicit ScopedLatency(LatencyHistogram& histogram) : m_histogram{histogram}, m_start{std::chrono::steady_clock::now()} {}
+            ~ScopedLatency() {
+                m_histogram.record(std::chrono::steady_clock::now() - m_start);
+            }
+            ScopedLatency(const ScopedLatency&) = delete;
+            ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+        private:
+            LatencyHistogram& m_histogram;
+            std::chrono::steady_clock::time_point m_start;
+    };
+
+    enum class dbus_method : std::size_t {
+        set_lamp_state,
+        set_lamp_state_nowait,
+        get_lamp_state,
+        set_lamp_commands,
+        set_lamp_mask,
+        set_lamp_scene,
+        get_io_stats,
+        get_metrics,
+        get_state_snapshot,
+        start_lamp_effect,
+        stop_lamp_effect,
+        get_history,
+        set_lamp_state_with_priority,
+        set_lamp_commands_with_priority,
+        count
+    };
+
+    constexpr std::array<const char*, static_cast<std::size_t>(dbus_method::count)> DBUS_METHOD_NAMES = {
+        "set_lamp_state", "set_lamp_state_nowait", "get_lamp_state", "set_lamp_commands", "set_lamp_mask", "set_lamp_scene", "get_io_stats", "get_metrics", "get_state_snapshot",
+        "start_lamp_effect", "stop_lamp_effect", "get_history", "set_lamp_state_with_priority", "set_lamp_commands_with_priority"
+    };
+
+    /*
+    All metrics of the service. The dbus handlers record their durations, the driver I/O worker
+    the device syscalls, retries, the time the device file was absent and how long the commands
+    of each priority took until they were written, the effect engine the delay of its steps
+    behind their deadlines, the config reloader the reloads.
+    */
+    struct ServiceMetrics {
+        std::array<LatencyHistogram, static_cast<std::size_t>(dbus_method::count)> dbus_methods;
+        LatencyHistogram device_write;
+        LatencyHistogram device_read;
+        Counter device_write_failures;
+        Counter write_retries;
+        Counter device_absent_ns; // finished periods without a usable device
+        std::atomic<bool> device_absent {false};
+        std::atomic<std::uint8_t> device_health {0}; // see device_health: 0 healthy, 1 degraded, 2 absent
+        Counter signals_emitted;
+        Counter signals_suppressed; // intermediate states replaced by a newer one within the signal interval
+        Counter replies_committed; // set_lamp_state replies sent after the write
+        Counter replies_expired; // set_lamp_state replies sent when the deadline expired
+        LatencyHistogram effect_jitter; // time between the deadline of an effect step and its hand over to the worker
+        Counter effects_started;
+        Counter effects_preempted; // stopped by a new state command or effect before their last step
+        Counter effect_steps;
+        Counter effect_steps_rejected; // the command queue was full
+        Counter effects_resumed; // continued after the status command that suspended them was written
+        std::array<LatencyHistogram, COMMAND_PRIORITY_COUNT> command_apply; // from enqueueing a command until it was written, by priority
+        Counter commands_cancelled; // queued or in-flight commands dropped for a command of a higher priority, or lightplays requested while the device was absent
+        LatencyHistogram event_loop_iteration; // from the end of the wait until the event loop waits again
+        LatencyHistogram config_reload; // from the reload request until the new config was applied
+        Counter config_reloads; // applied
+        Counter config_reloads_rejected; // invalid config files, the running config was kept
+
+        LatencyHistogram& method(dbus_method name) {
+            return dbus_methods[static_cast<std::size_t>(name)];
+        }
+
+        LatencyHistogram& apply_latency(command_priority priority) {
+            return command_apply[static_cast<std::size_t>(priority)];
+        }
+
+        // flat name -> value map, e.g. dbus.set_lamp_state.count or device.write.p99_ns
+        std::map<std::string, std::uint64_t> snapshot() const;
+        // Prometheus text exposition format, the labels (e.g. lamp="bed") are added to every sample
+        std::string to_prometheus(const std::string& labels = "") const;
+    };
+
+    /*
+    Periodically rewrites a Prometheus textfile (e.g. for the node_exporter textfile collector).
+    The file is written next to its destination and renamed, so scrapers never see a partial file.
+    */
+    class PrometheusTextfileWriter {
+        public:
+            PrometheusTextfileWriter(const ServiceMetrics& metrics, std::string path, std::chrono::milliseconds interval, std::string labels = "");
+            PrometheusTextfileWriter() = delete;
+            PrometheusTextfileWriter(const PrometheusTextfileWriter&) = delete;
+            PrometheusTextfileWriter& operator=(const PrometheusTextfileWriter&) = delete;
+            ~PrometheusTextfileWriter();
+
+            bool write_once() const;
+            void stop();
+
+        private:
+            void run();
+
+            const ServiceMetrics& m_metrics;
+            const std::string m_path;
+            const std::chrono::milliseconds m_interval;
+            const std::string m_labels;
+
+            std::mutex m_mutex;
+            std::condition_variable m_cv;
+            bool m_running;
+            std::thread m_thread;
+    };
+
+} /* namespace printer_lamp */
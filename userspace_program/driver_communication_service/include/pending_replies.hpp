@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace printer_lamp {
+
+    /*
+    Method replies that wait for their command to be committed to the device. Every entry is
+    keyed by the sequence number the driver I/O worker assigned to the command. The worker
+    reports the highest committed sequence, which completes all entries up to it with true, and
+    the sequences of the commands it dropped, which complete their entry with false - even if the
+    entry is only added afterwards.
+    Entries that are still pending when their deadline expires are completed with false by the
+    internal deadline thread, so the dbus event loop never waits for the device.
+    Entries have to be added in the order of their sequence numbers (the worker assigns them in
+    enqueue order and all waiting requests are enqueued from the event loop thread), and commit()
+    and cancel() are only called by one thread at a time.
+    The replies (e.g. the method calls to answer) are stored by value next to their sequence and
+    handed to the completion callback of the constructor. All buffers are reserved for capacity
+    entries up front, so adding and completing a reply does not allocate.
+    */
+    template <typename Reply>
+    class PendingReplies {
+        public:
+            using completion_callback = std::function<void(Reply& reply, bool committed)>;
+
+            PendingReplies(std::chrono::milliseconds deadline, std::size_t capacity, completion_callback on_completion) :
+                m_deadline{deadline},
+                m_on_completion{std::move(on_completion)},
+                m_committed_sequence{0},
+                m_last_added{0},
+                m_running{true}
+            {
+                m_pending.reserve(capacity);
+                m_committed.reserve(capacity);
+                m_cancelled.reserve(1);
+                m_early_cancels.reserve(capacity);
+                m_expired.reserve(capacity);
+                m_thread = std::thread(&PendingReplies::run, this);
+            }
+
+            PendingReplies() = delete;
+            PendingReplies(const PendingReplies&) = delete;
+            PendingReplies& operator=(const PendingReplies&) = delete;
+
+            ~PendingReplies() {
+                this->stop();
+            }
+
+            void add(std::uint64_t sequence, Reply reply) {
+                bool committed = false;
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_last_added = sequence;
+                    const bool cancelled = std::find(m_early_cancels.begin(), m_early_cancels.end(), sequence) != m_early_cancels.end();
+                    m_early_cancels.erase(std::remove_if(m_early_cancels.begin(), m_early_cancels.end(), [sequence](std::uint64_t early) {
+                        return early <= sequence;
+                    }), m_early_cancels.end());
+                    // the worker may have committed or dropped the command before the request got here
+                    if (m_running && !cancelled && sequence > m_committed_sequence) {
+                        const bool was_empty = m_pending.empty();
+                        m_pending.push_back({sequence, std::chrono::steady_clock::now() + m_deadline, std::move(reply)});
+                        if (was_empty) {
+                            m_cv.notify_one();
+                        }
+                        return;
+                    }
+                    committed = m_running && !cancelled;
+                }
+                m_on_completion(reply, committed);
+            }
+
+            // completes the entry of a command that was dropped before it reached the device with false
+            void cancel(std::uint64_t sequence) {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    const auto pending = std::find_if(m_pending.begin(), m_pending.end(), [sequence](const pending_reply& reply) {
+                        return reply.sequence == sequence;
+                    });
+                    if (pending != m_pending.end()) {
+                        m_cancelled.push_back(std::move(pending->reply));
+                        m_pending.erase(pending);
+                    } else if (sequence > m_last_added) {
+                        // remembered for add(), the oldest one gives way if no request picked them up
+                        if (!m_early_cancels.empty() && m_early_cancels.size() == m_early_cancels.capacity()) {
+                            m_early_cancels.erase(m_early_cancels.begin());
+                        }
+                        m_early_cancels.push_back(sequence);
+                    }
+                }
+                this->complete(m_cancelled, false);
+            }
+
+            void commit(std::uint64_t sequence) {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (sequence > m_committed_sequence) {
+                        m_committed_sequence = sequence;
+                    }
+                    this->take_front(m_committed, [this](const pending_reply& reply) { return reply.sequence <= m_committed_sequence; });
+                }
+                this->complete(m_committed, true);
+            }
+
+            std::size_t size() const {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                return m_pending.size();
+            }
+
+            // completes everything that is still pending with false
+            void stop() {
+                std::vector<Reply> remaining;
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_running = false;
+                    this->take_front(remaining, [](const pending_reply&) { return true; });
+                }
+                m_cv.notify_all();
+                if (m_thread.joinable()) {
+                    m_thread.join();
+                }
+                this->complete(remaining, false);
+            }
+
+        private:
+            struct pending_reply {
+                std::uint64_t sequence;
+                std::chrono::steady_clock::time_point deadline;
+                Reply reply;
+            };
+
+            // moves the oldest entries as long as they match into target, expects m_mutex to be held
+            template <typename Predicate>
+            void take_front(std::vector<Reply>& target, Predicate matches) {
+                std::size_t taken = 0;
+                while (taken < m_pending.size() && matches(m_pending[taken])) {
+                    target.push_back(std::move(m_pending[taken].reply));
+                    taken++;
+                }
+                m_pending.erase(m_pending.begin(), m_pending.begin() + static_cast<std::ptrdiff_t>(taken));
+            }
+
+            void complete(std::vector<Reply>& replies, bool committed) {
+                for (Reply& reply : replies) {
+                    m_on_completion(reply, committed);
+                }
+                replies.clear();
+            }
+
+            void run() {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                while (m_running) {
+                    if (m_pending.empty()) {
+                        m_cv.wait(lock, [this] { return !m_running || !m_pending.empty(); });
+                        continue;
+                    }
+                    // all entries share the same deadline, so the oldest one expires first
+                    const auto next_deadline = m_pending.front().deadline;
+                    if (std::chrono::steady_clock::now() < next_deadline) {
+                        m_cv.wait_until(lock, next_deadline);
+                        continue;
+                    }
+                    const auto now = std::chrono::steady_clock::now();
+                    this->take_front(m_expired, [now](const pending_reply& reply) { return reply.deadline <= now; });
+                    lock.unlock();
+                    this->complete(m_expired, false);
+                    lock.lock();
+                }
+            }
+
+            const std::chrono::milliseconds m_deadline;
+            const completion_callback m_on_completion;
+
+            std::vector<pending_reply> m_pending; // oldest first
+            std::vector<Reply> m_committed; // only used by commit()
+            std::vector<Reply> m_cancelled; // only used by cancel()
+            std::vector<std::uint64_t> m_early_cancels; // cancelled sequences that were not added yet
+            std::vector<Reply> m_expired; // only used by the deadline thread
+            std::uint64_t m_committed_sequence;
+            std::uint64_t m_last_added;
+            mutable std::mutex m_mutex;
+            std::condition_variable m_cv;
+            bool m_running;
+            std::thread m_thread;
+    };
+
+} /* namespace printer_lamp */
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "metrics.hpp"
+
+namespace printer_lamp {
+
+    // payload of the current_lamp_state signal
+    struct lamp_state_update {
+        int state {-1}; // last applied lamp command
+        std::uint64_t sequence {0}; // starts at 1 and increases with every state change, gaps mean dropped intermediate states
+        std::uint8_t mask {0xFF}; // LED bitmask (bit n = lamp_state[n] of the driver), 0xFF while unknown
+    };
+
+    /*
+    Rate limits the state change signals. An update is emitted right away if the last emission
+    is at least the minimum interval ago, otherwise it replaces the previous pending update and
+    the latest one is emitted by an internal thread as soon as the interval is over - so the
+    final state of a burst is always delivered. Emissions never go backwards in sequence, no
+    matter which thread performs them. Replaced updates are counted in the suppressed counter.
+    */
+    class SignalThrottle {
+        public:
+            using emit_callback = std::function<void(const lamp_state_update& update)>;
+
+            SignalThrottle(std::chrono::milliseconds min_interval, Counter& suppressed, emit_callback emit);
+            SignalThrottle() = delete;
+            SignalThrottle(const SignalThrottle&) = delete;
+            SignalThrottle& operator=(const SignalThrottle&) = delete;
+            ~SignalThrottle();
+
+            void publish(const lamp_state_update& update);
+            // delivers a still pending update and stops the internal thread
+            void stop();
+
+        private:
+            void run();
+            void emit(const lamp_state_update& update);
+
+            const std::chrono::milliseconds m_min_interval;
+            Counter& m_suppressed;
+            emit_callback m_emit;
+
+            std::mutex m_mutex;
+            std::condition_variable m_cv;
+            lamp_state_update m_latest;
+            bool m_has_pending;
+            std::chrono::steady_clock::time_point m_next_allowed;
+            bool m_running;
+
+            std::mutex m_emit_mutex;
+            std::uint64_t m_last_emitted_sequence;
+
+            std::thread m_thread;
+    };
+
+} /* namespace printer_lamp */
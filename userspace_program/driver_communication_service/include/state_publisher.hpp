@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "device_health.hpp"
+#include "lamp_state_snapshot.hpp"
+#include "signal_throttle.hpp"
+
+namespace printer_lamp {
+
+    /*
+    Writer side of the shared lamp state (see lamp_state_snapshot.hpp): the applied state and the
+    device health of one lamp in a small file, usually on /dev/shm, that clients map read-only
+    and poll without a dbus round trip. Every update is a seqlock write of a few relaxed stores
+    into the mapping - no lock and no syscall.
+    There must be only one writer: the bridge publishes from the driver I/O worker thread only.
+    An existing file is reused (same inode), so the mappings of running readers survive a restart
+    of the service. Its state sequence number carries over as well, so the publishing bridge
+    continues counting from get_sequence().
+    */
+    class StatePublisher {
+        public:
+            // throws std::runtime_error if the file can not be created or mapped
+            explicit StatePublisher(const std::string& path);
+            StatePublisher() = delete;
+            StatePublisher(const StatePublisher&) = delete;
+            StatePublisher& operator=(const StatePublisher&) = delete;
+            ~StatePublisher();
+
+            // sequence number of the last published state, from a previous run right after the construction
+            std::uint64_t get_sequence() const;
+            void publish(const lamp_state_update& update);
+            void publish_health(device_health health);
+
+        private:
+            void begin_write();
+            void end_write();
+
+            int m_fd;
+            shared_lamp_state* m_state;
+    };
+
+} /* namespace printer_lamp */
@@ -1,12 +1,59 @@
 #pragma once
 
 #include <string>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "lighting_effect.hpp"
+#include "logger.hpp"
 
 namespace printer_lamp {
+    // lamp device backend - chardev (the kernel driver), memory or emulated (text protocol on a regular file or FIFO)
+    struct device_config {
+        std::string backend {"chardev"};
+        std::string path {"/dev/printer_lamp"};
+        long latency_us {0}; // injected before every device access
+        double failure_rate {0.0}; // probability that a device access fails
+    };
+
+    // one lamp of the service: its dbus object and its device
+    struct lamp_config {
+        std::string name {""}; // <name> of the [LAMP.<name>] section, empty for the lamp of the [DRIVERSERVICE] section
+        std::string object_path {""};
+        device_config device;
+        std::string metrics_textfile_path {""}; // Prometheus textfile of this lamp, disabled if empty
+        std::string history_path {""}; // state change journal of this lamp, disabled if empty
+        std::string state_snapshot_path {""}; // shared memory state for polling clients, disabled if empty
+    };
+
     // configuration_object
     struct bridge_config {
         std::string object_path {""};
         std::string interface_name {""};
+        device_config device;
+        std::size_t queue_capacity {64};
+        long retry_interval_ms {5000}; // maximum backoff between two write attempts
+        long retry_initial_ms {50}; // backoff after the first failed write, doubled with every further one
+        long absent_after_failures {3}; // consecutive failed writes until the device counts as absent
+        long reconcile_interval_ms {30000};
+        long reply_deadline_ms {1000}; // set_lamp_state replies false if the command was not written within this time
+        long signal_min_interval_ms {50}; // minimum time between two current_lamp_state signals, the final state is always sent
+        std::string metrics_textfile_path {""}; // Prometheus textfile, disabled if empty
+        long metrics_textfile_interval_ms {15000};
+        std::string history_path {""}; // state change journal, disabled if empty
+        std::string state_snapshot_path {""}; // shared memory state for polling clients (lamp_state_snapshot.hpp), disabled if empty
+        std::size_t history_max_bytes {1048576}; // size of every journal file, the oldest records are overwritten
+        bool resume_preempted_effects {false}; // effects suspended by a status command continue once it was written
+        log_level minimum_log_level {log_level::info};
+        log_target log_output {log_target::stdout_lines};
+        std::map<std::string, std::vector<int>> scenes; // scene name -> lamp commands applied as one transaction
+        std::map<std::string, lighting_effect> effects; // effect name -> steps played by the effect engine
+        std::vector<lamp_config> lamps; // [LAMP.<name>] sections, without any the lamp of the [DRIVERSERVICE] section
     };
 
+    // an immutable config, freed once neither the config store nor a lamp uses it any more
+    using config_snapshot = std::shared_ptr<const bridge_config>;
+
 } /* namespace printer_lamp */
\ No newline at end of file
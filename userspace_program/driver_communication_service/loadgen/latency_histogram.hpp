@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace printer_lamp {
+
+    /*
+    Latency histogram with the bucket layout of an HdrHistogram with two significant digits: the
+    values below 128 us have their own bucket, above that every power of two is split into 64
+    linear sub-buckets, so a reported value is never more than 1/64 (1.6 %) above the recorded
+    one. Recording is one bucket increment, the memory is fixed (about 16 kB) and histograms of
+    several threads are merged at the end of a run.
+    The client side counterpart of the LatencyHistogram of the service metrics (metrics.hpp),
+    which trades this resolution for lock-free recording from many threads.
+    */
+    class HdrLatencyHistogram {
+        public:
+            static constexpr std::size_t SUB_BUCKETS = 128;
+            static constexpr std::size_t HALF_SUB_BUCKETS = SUB_BUCKETS / 2;
+            static constexpr unsigned MAX_SHIFT = 30; // values up to ~2^37 us, larger ones are clamped
+            static constexpr std::size_t BUCKETS = SUB_BUCKETS + MAX_SHIFT * HALF_SUB_BUCKETS;
+
+            void record(std::uint64_t value_us) {
+                m_counts[bucket_of(value_us)]++;
+                m_total++;
+                m_sum_us += value_us;
+                m_min_us = std::min(m_min_us, value_us);
+                m_max_us = std::max(m_max_us, value_us);
+            }
+
+            void merge(const HdrLatencyHistogram& other) {
+                for (std::size_t idx = 0; idx < BUCKETS; idx++) {
+                    m_counts[idx] += other.m_counts[idx];
+                }
+                m_total += other.m_total;
+                m_sum_us += other.m_sum_us;
+                m_min_us = std::min(m_min_us, other.m_min_us);
+                m_max_us = std::max(m_max_us, other.m_max_us);
+            }
+
+            void clear() {
+                *this = HdrLatencyHistogram{};
+            }
+
+            // highest value that is equivalent to the recorded ones at the quantile (0.0 - 1.0), 0 if empty
+            std::uint64_t value_at_quantile(double quantile) const {
+                if (m_total == 0) {
+                    return 0;
+                }
+                const double clamped = std::min(std::max(quantile, 0.0), 1.0);
+                const std::uint64_t rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(clamped * static_cast<double>(m_total) + 0.5));
+                std::uint64_t seen = 0;
+                for (std::size_t idx = 0; idx < BUCKETS; idx++) {
+                    seen += m_counts[idx];
+                    if (seen >= rank) {
+                        return std::min(highest_equivalent(idx), m_max_us);
+                    }
+                }
+                return m_max_us;
+            }
+
+            std::uint64_t count() const {
+                return m_total;
+            }
+
+            std::uint64_t min() const {
+                return m_total == 0 ? 0 : m_min_us;
+            }
+
+            std::uint64_t max() const {
+                return m_max_us;
+            }
+
+            double mean() const {
+                return m_total == 0 ? 0.0 : static_cast<double>(m_sum_us) / static_cast<double>(m_total);
+            }
+
+            static std::size_t bucket_of(std::uint64_t value_us) {
+                if (value_us < SUB_BUCKETS) {
+                    return static_cast<std::size_t>(value_us);
+                }
+                // the position of the highest bit selects the power of two, the next 6 bits the sub-bucket
+                const unsigned shift = static_cast<unsigned>(63 - __builtin_clzll(value_us)) - 6;
+                if (shift > MAX_SHIFT) {
+                    return BUCKETS - 1;
+                }
+                return SUB_BUCKETS + (shift - 1) * HALF_SUB_BUCKETS + static_cast<std::size_t>((value_us >> shift) - HALF_SUB_BUCKETS);
+            }
+
+            static std::uint64_t highest_equivalent(std::size_t bucket) {
+                if (bucket < SUB_BUCKETS) {
+                    return bucket;
+                }
+                const unsigned shift = static_cast<unsigned>((bucket - SUB_BUCKETS) / HALF_SUB_BUCKETS) + 1;
+                const std::uint64_t sub_bucket = (bucket - SUB_BUCKETS) % HALF_SUB_BUCKETS + HALF_SUB_BUCKETS;
+                return ((sub_bucket + 1) << shift) - 1;
+            }
+
+        private:
+            std::array<std::uint64_t, BUCKETS> m_counts {};
+            std::uint64_t m_total {0};
+            std::uint64_t m_sum_us {0};
+            std::uint64_t m_min_us {UINT64_MAX};
+            std::uint64_t m_max_us {0};
+    };
+
+} /* namespace printer_lamp */
@@ -0,0 +1,199 @@
+#include "load_profile.hpp"
+
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+namespace printer_lamp {
+
+    namespace {
+        double parse_number(const std::string& name, const std::string& value) {
+            char* end = nullptr;
+            const double number = std::strtod(value.c_str(), &end);
+            if (value.empty() || *end != '\0') {
+                throw std::invalid_argument("invalid value for " + name + ": " + value);
+            }
+            return number;
+        }
+
+        unsigned parse_positive(const std::string& name, const std::string& value) {
+            const double number = parse_number(name, value);
+            if (number < 1.0 || number != static_cast<double>(static_cast<unsigned>(number))) {
+                throw std::invalid_argument(name + " must be a positive integer");
+            }
+            return static_cast<unsigned>(number);
+        }
+
+        std::vector<int> parse_commands(const std::string& value) {
+            std::vector<int> commands;
+            std::stringstream stream(value);
+            std::string item;
+            while (std::getline(stream, item, ',')) {
+                const double command = parse_number("--commands", item);
+                if (!is_valid_command(static_cast<int>(command)) || command != static_cast<double>(static_cast<int>(command))) {
+                    throw std::invalid_argument("invalid lamp command " + item);
+                }
+                commands.push_back(static_cast<int>(command));
+            }
+            if (commands.empty()) {
+                throw std::invalid_argument("--commands needs at least one command");
+            }
+            return commands;
+        }
+    } /* anonymous namespace */
+
+    load_options parse_load_options(int argc, const char* const argv[]) {
+        load_options options;
+        for (int idx = 1; idx < argc; idx++) {
+            const std::string arg = argv[idx];
+            const std::size_t separator = arg.find('=');
+            const std::string name = arg.substr(0, separator);
+            const std::string value = (separator == std::string::npos) ? "" : arg.substr(separator + 1);
+            if (name == "--service") {
+                options.service_name = value;
+            } else if (name == "--object-path") {
+                options.object_path = value;
+            } else if (name == "--interface") {
+                options.interface_name = value;
+            } else if (name == "--session-bus") {
+                options.session_bus = true;
+            } else if (name == "--connections") {
+                options.connections = parse_positive(name, value);
+            } else if (name == "--mix") {
+                // <set weight>:<get weight>, e.g. 9:1
+                const std::size_t colon = value.find(':');
+                if (colon == std::string::npos) {
+                    throw std::invalid_argument("--mix needs <set weight>:<get weight>");
+                }
+                const double set_weight = parse_number(name, value.substr(0, colon));
+                const double get_weight = parse_number(name, value.substr(colon + 1));
+                if (set_weight < 0.0 || get_weight < 0.0 || static_cast<unsigned>(set_weight) + static_cast<unsigned>(get_weight) < 1) {
+                    throw std::invalid_argument("--mix needs non-negative integer weights and at least one call type");
+                }
+                options.set_weight = static_cast<unsigned>(set_weight);
+                options.get_weight = static_cast<unsigned>(get_weight);
+            } else if (name == "--loop") {
+                if (value == "closed") {
+                    options.loop = load_loop::closed;
+                } else if (value == "open") {
+                    options.loop = load_loop::open;
+                } else {
+                    throw std::invalid_argument("--loop is closed or open");
+                }
+            } else if (name == "--rate") {
+                options.rate_per_s = parse_number(name, value);
+                if (options.rate_per_s <= 0.0) {
+                    throw std::invalid_argument("--rate must be positive");
+                }
+            } else if (name == "--shape") {
+                if (value == "constant") {
+                    options.shape = arrival_shape::constant;
+                } else if (value == "poisson") {
+                    options.shape = arrival_shape::poisson;
+                } else if (value == "burst") {
+                    options.shape = arrival_shape::burst;
+                } else {
+                    throw std::invalid_argument("--shape is constant, poisson or burst");
+                }
+            } else if (name == "--burst-size") {
+                options.burst_size = parse_positive(name, value);
+            } else if (name == "--duration-s") {
+                options.duration_s = parse_number(name, value);
+                if (options.duration_s <= 0.0) {
+                    throw std::invalid_argument("--duration-s must be positive");
+                }
+            } else if (name == "--commands") {
+                options.commands = parse_commands(value);
+            } else if (name == "--timeout-ms") {
+                options.call_timeout_ms = static_cast<long>(parse_positive(name, value));
+            } else if (name == "--seed") {
+                options.seed = static_cast<std::uint32_t>(parse_number(name, value));
+            } else if (name == "--output") {
+                options.output_path = value;
+            } else {
+                throw std::invalid_argument("unknown option " + arg);
+            }
+        }
+        return options;
+    }
+
+    ArrivalSchedule::ArrivalSchedule(arrival_shape shape, double rate_per_s, unsigned burst_size, std::uint32_t seed) :
+        m_shape{shape},
+        m_interval_ns{1e9 / rate_per_s},
+        m_burst_size{burst_size > 0 ? burst_size : 1},
+        m_random{seed},
+        m_gaps{1.0}
+    {}
+
+    std::chrono::nanoseconds ArrivalSchedule::next() {
+        const std::uint64_t call = m_calls++;
+        double offset_ns = 0.0;
+        switch (m_shape) {
+            case arrival_shape::constant:
+                offset_ns = static_cast<double>(call) * m_interval_ns;
+                break;
+            case arrival_shape::poisson:
+                offset_ns = m_poisson_offset_ns;
+                m_poisson_offset_ns += m_gaps(m_random) * m_interval_ns;
+                break;
+            case arrival_shape::burst:
+                // same mean rate as constant, the calls of a burst share their send time
+                offset_ns = static_cast<double>(call / m_burst_size) * m_burst_size * m_interval_ns;
+                break;
+        }
+        return std::chrono::nanoseconds(static_cast<std::int64_t>(offset_ns));
+    }
+
+    RequestMix::RequestMix(const load_options& options, std::uint32_t seed) :
+        m_commands{options.commands},
+        m_set_weight{options.set_weight},
+        m_total_weight{options.set_weight + options.get_weight},
+        m_random{seed}
+    {}
+
+    bool RequestMix::next_is_set() {
+        return m_random() % m_total_weight < m_set_weight;
+    }
+
+    int RequestMix::next_command() {
+        const int command = m_commands[m_next_command];
+        m_next_command = (m_next_command + 1) % m_commands.size();
+        return command;
+    }
+
+    void SignalLatencyTracker::sent(int command, clock_type::time_point when) {
+        if (!is_valid_command(command)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pending[command] == clock_type::time_point{}) {
+            m_pending[command] = when;
+        }
+    }
+
+    bool SignalLatencyTracker::on_signal(int command, clock_type::time_point when, std::chrono::nanoseconds& latency) {
+        if (!is_valid_command(command)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const clock_type::time_point sent = m_pending[command];
+        if (sent == clock_type::time_point{}) {
+            return false;
+        }
+        for (clock_type::time_point& pending : m_pending) {
+            if (pending != clock_type::time_point{} && pending < sent) {
+                pending = clock_type::time_point{};
+                m_superseded++;
+            }
+        }
+        m_pending[command] = clock_type::time_point{};
+        latency = when - sent;
+        return true;
+    }
+
+    std::uint64_t SignalLatencyTracker::get_superseded() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_superseded;
+    }
+
+} /* namespace printer_lamp */
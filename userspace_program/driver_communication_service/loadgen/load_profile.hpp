@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "lamp_state.hpp"
+
+namespace printer_lamp {
+
+    enum class load_loop {
+        closed, // every connection sends its next call once the previous one was answered
+        open // the calls are sent at the scheduled rate, whether the earlier ones were answered or not
+    };
+
+    enum class arrival_shape {
+        constant, // evenly spaced
+        poisson, // exponentially distributed gaps with the same mean rate
+        burst // burst_size calls at once, the bursts evenly spaced
+    };
+
+    struct load_options {
+        std::string service_name {"jens.printerlamp.driver_interaction"};
+        std::string object_path {"/3DP/printerlamp"};
+        std::string interface_name {"jens.printerlamp"};
+        bool session_bus {false};
+        unsigned connections {4};
+        unsigned set_weight {9}; // set_lamp_state : get_lamp_state
+        unsigned get_weight {1};
+        load_loop loop {load_loop::closed};
+        double rate_per_s {200.0}; // open loop, all connections together
+        arrival_shape shape {arrival_shape::constant};
+        unsigned burst_size {10};
+        double duration_s {10.0};
+        std::vector<int> commands {0, 1, 2, 3, 4, 5}; // sent round robin by set_lamp_state
+        long call_timeout_ms {5000};
+        std::uint32_t seed {1};
+        std::string output_path {""};
+    };
+
+    // --name=value options of the load generator, throws std::invalid_argument for unknown or invalid ones
+    load_options parse_load_options(int argc, const char* const argv[]);
+
+    /*
+    Send times of one connection relative to the start of the run. The open loop measures the
+    latency from these intended times instead of the actual send times, so a stalled service is
+    not hidden by the generator waiting for it (coordinated omission).
+    */
+    class ArrivalSchedule {
+        public:
+            ArrivalSchedule(arrival_shape shape, double rate_per_s, unsigned burst_size, std::uint32_t seed);
+            ArrivalSchedule() = delete;
+
+            // offset of the next call from the start, never decreasing
+            std::chrono::nanoseconds next();
+
+        private:
+            const arrival_shape m_shape;
+            const double m_interval_ns; // mean gap between two calls
+            const unsigned m_burst_size;
+            std::uint64_t m_calls {0};
+            double m_poisson_offset_ns {0.0};
+            std::mt19937 m_random;
+            std::exponential_distribution<double> m_gaps;
+    };
+
+    // picks set_lamp_state or get_lamp_state by the configured weights and the command of every set call
+    class RequestMix {
+        public:
+            RequestMix(const load_options& options, std::uint32_t seed);
+            RequestMix() = delete;
+
+            bool next_is_set();
+            int next_command();
+
+        private:
+            const std::vector<int> m_commands;
+            const unsigned m_set_weight;
+            const unsigned m_total_weight;
+            std::size_t m_next_command {0};
+            std::mt19937 m_random;
+    };
+
+    /*
+    Matches the current_lamp_state signals to the set_lamp_state calls for the command-to-signal
+    latency. Only the oldest unanswered call per command is tracked. The service applies the
+    commands in order and may throttle the signals, so a signal also answers every call that was
+    sent before the one it matches - those are counted as superseded instead of measured.
+    */
+    class SignalLatencyTracker {
+        public:
+            using clock_type = std::chrono::steady_clock;
+
+            void sent(int command, clock_type::time_point when);
+            // true and the latency of the matched call, false if no call waits for the command
+            bool on_signal(int command, clock_type::time_point when, std::chrono::nanoseconds& latency);
+            std::uint64_t get_superseded() const;
+
+        private:
+            mutable std::mutex m_mutex;
+            std::array<clock_type::time_point, COMMAND_RESET_ALL + 1> m_pending {}; // epoch = nothing pending
+            std::uint64_t m_superseded {0};
+    };
+
+} /* namespace printer_lamp */
@@ -0,0 +1,289 @@
+/*
+Load generator for the driver interaction service: drives set_lamp_state and get_lamp_state over
+several dbus connections and reports the latencies as HdrHistogram-style percentile tables.
+
+    $ ./build/bin/lamp_load_generator [--connections=4] [--mix=9:1] [--loop=closed|open]
+                                      [--rate=200] [--shape=constant|poisson|burst] [--burst-size=10]
+                                      [--duration-s=10] [--commands=0,1,2,3,4,5] [--timeout-ms=5000]
+                                      [--session-bus] [--object-path=/3DP/printerlamp]
+                                      [--interface=jens.printerlamp] [--service=<bus name>]
+                                      [--seed=1] [--output=<json file>]
+
+    --loop=closed  every connection sends its next call once the previous one was answered
+    --loop=open    the calls are sent at --rate (all connections together) in the --shape, the
+                   latency is measured from the scheduled send time
+    --mix          weights of set_lamp_state and get_lamp_state
+
+A separate connection subscribes to current_lamp_state and measures the command-to-signal
+latency of the set_lamp_state calls. Against a private bus, start the service with --session_bus
+on the same DBUS_SESSION_BUS_ADDRESS and pass --session-bus here.
+*/
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sdbus-c++/sdbus-c++.h>
+
+#include "latency_histogram.hpp"
+#include "load_profile.hpp"
+
+namespace {
+    using printer_lamp::HdrLatencyHistogram;
+    using clock_type = std::chrono::steady_clock;
+
+    constexpr double REPORTED_QUANTILES[] = {0.5, 0.75, 0.9, 0.99, 0.999, 0.9999, 1.0};
+
+    std::uint64_t elapsed_us(clock_type::time_point start, clock_type::time_point end) {
+        return static_cast<std::uint64_t>(std::max<std::int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()));
+    }
+
+    std::unique_ptr<sdbus::IConnection> connect_bus(bool session_bus) {
+        return session_bus ? sdbus::createSessionBusConnection() : sdbus::createSystemBusConnection();
+    }
+
+    struct load_result {
+        HdrLatencyHistogram set_latency;
+        HdrLatencyHistogram get_latency;
+        std::uint64_t sent {0};
+        std::uint64_t rejected {0}; // set_lamp_state answered with false
+        std::uint64_t errors {0}; // dbus errors and timeouts
+    };
+
+    /*
+    One client connection with its own proxy. In the closed loop the calls are made blocking on
+    the thread of the connection, in the open loop they are sent asynchronously and the replies
+    are recorded on the event loop thread of the connection - never both, so the result needs no
+    lock.
+    */
+    class LoadConnection {
+        public:
+            LoadConnection(const printer_lamp::load_options& options, unsigned idx, printer_lamp::SignalLatencyTracker& tracker) :
+                m_options{options},
+                m_idx{idx},
+                m_tracker{tracker},
+                m_connection{connect_bus(options.session_bus)},
+                m_proxy{sdbus::createProxy(*m_connection, options.service_name, options.object_path)},
+                m_mix{options, options.seed + idx}
+            {
+                m_proxy->finishRegistration();
+            }
+            LoadConnection() = delete;
+            LoadConnection(const LoadConnection&) = delete;
+            LoadConnection& operator=(const LoadConnection&) = delete;
+
+            void run(clock_type::time_point start, clock_type::time_point end) {
+                if (m_options.loop == printer_lamp::load_loop::closed) {
+                    this->run_closed(end);
+                } else {
+                    this->run_open(start, end);
+                }
+            }
+
+            const load_result& get_result() const {
+                return m_result;
+            }
+
+        private:
+            sdbus::MethodCall create_call(bool set_state, int& command) {
+                auto method = m_proxy->createMethodCall(m_options.interface_name, set_state ? "set_lamp_state" : "get_lamp_state");
+                command = set_state ? m_mix.next_command() : 0;
+                method << command;
+                return method;
+            }
+
+            std::uint64_t timeout_us() const {
+                return static_cast<std::uint64_t>(m_options.call_timeout_ms) * 1000;
+            }
+
+            void run_closed(clock_type::time_point end) {
+                while (clock_type::now() < end) {
+                    const bool set_state = m_mix.next_is_set();
+                    int command = 0;
+                    auto method = this->create_call(set_state, command);
+                    const auto sent = clock_type::now();
+                    if (set_state) {
+                        m_tracker.sent(command, sent);
+                    }
+                    m_result.sent++;
+                    try {
+                        auto reply = m_proxy->callMethod(method, this->timeout_us());
+                        this->record_reply(set_state, reply, sent);
+                    } catch (const sdbus::Error&) {
+                        m_result.errors++;
+                    }
+                }
+            }
+
+            void run_open(clock_type::time_point start, clock_type::time_point end) {
+                // the connections share the rate and are shifted against each other
+                const double connections = static_cast<double>(m_options.connections);
+                printer_lamp::ArrivalSchedule schedule(m_options.shape, m_options.rate_per_s / connections, m_options.burst_size, m_options.seed + m_idx);
+                const auto phase = std::chrono::nanoseconds(static_cast<std::int64_t>(1e9 / m_options.rate_per_s * m_idx));
+                m_connection->enterEventLoopAsync();
+                while (true) {
+                    const auto intended = start + phase + schedule.next();
+                    if (intended >= end) {
+                        break;
+                    }
+                    std::this_thread::sleep_until(intended);
+                    const bool set_state = m_mix.next_is_set();
+                    int command = 0;
+                    auto method = this->create_call(set_state, command);
+                    if (set_state) {
+                        m_tracker.sent(command, clock_type::now());
+                    }
+                    m_result.sent++;
+                    m_outstanding.fetch_add(1, std::memory_order_relaxed);
+                    m_proxy->callMethod(method, [this, set_state, intended](sdbus::MethodReply& reply, const sdbus::Error* error) {
+                        if (error != nullptr) {
+                            m_result.errors++;
+                        } else {
+                            this->record_reply(set_state, reply, intended);
+                        }
+                        m_outstanding.fetch_sub(1, std::memory_order_release);
+                    }, this->timeout_us());
+                }
+                // the replies of the last calls, a call that is not answered times out on its own
+                const auto deadline = clock_type::now() + std::chrono::milliseconds(m_options.call_timeout_ms) + std::chrono::milliseconds(100);
+                while (m_outstanding.load(std::memory_order_acquire) > 0 && clock_type::now() < deadline) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                m_connection->leaveEventLoop();
+            }
+
+            void record_reply(bool set_state, sdbus::MethodReply& reply, clock_type::time_point since) {
+                const std::uint64_t latency_us = elapsed_us(since, clock_type::now());
+                if (set_state) {
+                    bool accepted = false;
+                    reply >> accepted;
+                    m_result.set_latency.record(latency_us);
+                    m_result.rejected += accepted ? 0 : 1;
+                } else {
+                    m_result.get_latency.record(latency_us);
+                }
+            }
+
+            const printer_lamp::load_options& m_options;
+            const unsigned m_idx;
+            printer_lamp::SignalLatencyTracker& m_tracker;
+            std::unique_ptr<sdbus::IConnection> m_connection;
+            std::unique_ptr<sdbus::IProxy> m_proxy;
+            printer_lamp::RequestMix m_mix;
+            std::atomic<std::uint64_t> m_outstanding {0};
+            load_result m_result;
+    };
+
+    void print_histogram(const std::string& name, const HdrLatencyHistogram& histogram) {
+        std::printf("%s: %llu samples, mean %.1f us, min %llu us\n", name.c_str(), static_cast<unsigned long long>(histogram.count()),
+            histogram.mean(), static_cast<unsigned long long>(histogram.min()));
+        std::printf("    %12s %12s\n", "percentile", "value (us)");
+        for (const double quantile : REPORTED_QUANTILES) {
+            std::printf("    %12.4f %12llu\n", quantile * 100.0, static_cast<unsigned long long>(histogram.value_at_quantile(quantile)));
+        }
+    }
+
+    void write_histogram_json(std::FILE* file, const std::string& name, const HdrLatencyHistogram& histogram, bool last) {
+        std::fprintf(file, "    \"%s\": {\"count\": %llu, \"mean_us\": %.2f, \"min_us\": %llu", name.c_str(),
+            static_cast<unsigned long long>(histogram.count()), histogram.mean(), static_cast<unsigned long long>(histogram.min()));
+        for (const double quantile : REPORTED_QUANTILES) {
+            std::fprintf(file, ", \"p%g_us\": %llu", quantile * 100.0, static_cast<unsigned long long>(histogram.value_at_quantile(quantile)));
+        }
+        std::fprintf(file, "}%s\n", last ? "" : ",");
+    }
+}
+
+int main(int argc, const char* argv[]) {
+    printer_lamp::load_options options;
+    try {
+        options = printer_lamp::parse_load_options(argc, argv);
+    } catch (const std::invalid_argument& exc) {
+        std::cerr << exc.what() << "\n";
+        return 1;
+    }
+
+    printer_lamp::SignalLatencyTracker tracker;
+    HdrLatencyHistogram signal_latency; // only touched by the event loop thread of the observer
+    std::unique_ptr<sdbus::IConnection> observer_connection;
+    std::unique_ptr<sdbus::IProxy> observer;
+    std::vector<std::unique_ptr<LoadConnection>> connections;
+    try {
+        observer_connection = connect_bus(options.session_bus);
+        observer = sdbus::createProxy(*observer_connection, options.service_name, options.object_path);
+        observer->registerSignalHandler(options.interface_name, "current_lamp_state", [&tracker, &signal_latency](sdbus::Signal& signal) {
+            const auto received = clock_type::now();
+            int state = 0;
+            std::uint64_t sequence = 0;
+            std::uint8_t mask = 0;
+            signal >> state >> sequence >> mask;
+            std::chrono::nanoseconds latency {0};
+            if (tracker.on_signal(state, received, latency)) {
+                signal_latency.record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(latency).count()));
+            }
+        });
+        observer->finishRegistration();
+        observer_connection->enterEventLoopAsync();
+        for (unsigned idx = 0; idx < options.connections; idx++) {
+            connections.push_back(std::make_unique<LoadConnection>(options, idx, tracker));
+        }
+    } catch (const sdbus::Error& exc) {
+        std::cerr << "Could not connect to " << options.service_name << ": " << exc.what() << "\n";
+        return 1;
+    }
+
+    std::cout << "Driving " << options.object_path << " with " << options.connections << " connections for " << options.duration_s << " s ("
+        << (options.loop == printer_lamp::load_loop::closed ? "closed loop" : "open loop") << ")\n";
+    const auto start = clock_type::now() + std::chrono::milliseconds(10);
+    const auto end = start + std::chrono::nanoseconds(static_cast<std::int64_t>(options.duration_s * 1e9));
+    std::vector<std::thread> threads;
+    for (const auto& connection : connections) {
+        threads.emplace_back([&connection, start, end] { connection->run(start, end); });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    const double wall_time_s = std::chrono::duration<double>(clock_type::now() - start).count();
+    // the last signals are throttled by the service, give them a moment
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    observer_connection->leaveEventLoop();
+
+    load_result total;
+    for (const auto& connection : connections) {
+        const load_result& result = connection->get_result();
+        total.set_latency.merge(result.set_latency);
+        total.get_latency.merge(result.get_latency);
+        total.sent += result.sent;
+        total.rejected += result.rejected;
+        total.errors += result.errors;
+    }
+    const double throughput = wall_time_s > 0.0 ? static_cast<double>(total.set_latency.count() + total.get_latency.count()) / wall_time_s : 0.0;
+
+    std::printf("%llu calls sent, %.1f replies/s, %llu rejected, %llu errors, %llu signals superseded\n",
+        static_cast<unsigned long long>(total.sent), throughput, static_cast<unsigned long long>(total.rejected),
+        static_cast<unsigned long long>(total.errors), static_cast<unsigned long long>(tracker.get_superseded()));
+    print_histogram("set_lamp_state", total.set_latency);
+    print_histogram("get_lamp_state", total.get_latency);
+    print_histogram("command to current_lamp_state", signal_latency);
+
+    if (!options.output_path.empty()) {
+        std::FILE* file = std::fopen(options.output_path.c_str(), "w");
+        if (file == nullptr) {
+            std::perror("Could not open the output file");
+            return 1;
+        }
+        std::fprintf(file, "{\n  \"sent\": %llu,\n  \"rejected\": %llu,\n  \"errors\": %llu,\n  \"superseded_signals\": %llu,\n  \"throughput_per_s\": %.1f,\n  \"latencies\": {\n",
+            static_cast<unsigned long long>(total.sent), static_cast<unsigned long long>(total.rejected), static_cast<unsigned long long>(total.errors),
+            static_cast<unsigned long long>(tracker.get_superseded()), throughput);
+        write_histogram_json(file, "set_lamp_state", total.set_latency, false);
+        write_histogram_json(file, "get_lamp_state", total.get_latency, false);
+        write_histogram_json(file, "signal", signal_latency, true);
+        std::fprintf(file, "  }\n}\n");
+        std::fclose(file);
+    }
+    return total.errors == 0 ? 0 : 2;
+}
@@ -0,0 +1,296 @@
+#include "http_connection.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+namespace printer_lamp {
+
+    namespace {
+        constexpr std::size_t RECEIVE_SIZE = 4096;
+        // a status line or header of the OctoPrint API is far shorter
+        constexpr std::size_t MAX_LINE_LENGTH = 8192;
+
+        std::string to_lower(std::string value) {
+            std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            return value;
+        }
+
+        std::string trim(const std::string& value) {
+            const std::size_t begin = value.find_first_not_of(" \t");
+            if (begin == std::string::npos) {
+                return "";
+            }
+            return value.substr(begin, value.find_last_not_of(" \t") - begin + 1);
+        }
+
+        bool wait_for(int socket, short events, std::chrono::milliseconds timeout) {
+            pollfd poll_fd {socket, events, 0};
+            int result = 0;
+            while ((result = ::poll(&poll_fd, 1, static_cast<int>(timeout.count()))) < 0 && errno == EINTR) {}
+            return result > 0;
+        }
+    } /* anonymous namespace */
+
+    HttpConnection::HttpConnection(std::string host, std::string port, std::chrono::milliseconds timeout) :
+        m_host{std::move(host)},
+        m_port{std::move(port)},
+        m_timeout{timeout},
+        m_socket{-1},
+        m_connects{0},
+        m_received_any{false},
+        m_buffer_pos{0}
+    {
+        m_buffer.reserve(RECEIVE_SIZE);
+    }
+
+    HttpConnection::~HttpConnection() {
+        this->close();
+    }
+
+    void HttpConnection::close() {
+        if (m_socket >= 0) {
+            ::close(m_socket);
+            m_socket = -1;
+        }
+        m_buffer.clear();
+        m_buffer_pos = 0;
+    }
+
+    std::uint64_t HttpConnection::get_connects() const {
+        return m_connects;
+    }
+
+    int HttpConnection::get(const std::string& target, const header_list& headers, const body_callback& on_body) {
+        m_request.clear();
+        m_request.append("GET ").append(target).append(" HTTP/1.1\r\nHost: ").append(m_host).append("\r\nConnection: keep-alive\r\n");
+        for (const auto& header : headers) {
+            m_request.append(header.first).append(": ").append(header.second).append("\r\n");
+        }
+        m_request.append("\r\n");
+
+        int status = -1;
+        const bool reused = m_socket >= 0;
+        request_result result = this->send_request(m_request, status, on_body);
+        if (result == request_result::closed_before_response && reused) {
+            // the server closed the idle connection - nothing of the request was processed
+            result = this->send_request(m_request, status, on_body);
+        }
+        return result == request_result::complete ? status : -1;
+    }
+
+    HttpConnection::request_result HttpConnection::send_request(const std::string& request, int& status, const body_callback& on_body) {
+        if (m_socket < 0 && !this->connect()) {
+            return request_result::failed;
+        }
+        m_received_any = false;
+        std::string line;
+        if (!this->send_all(request) || !this->read_line(line)) {
+            const bool closed_before_response = !m_received_any;
+            this->close();
+            return closed_before_response ? request_result::closed_before_response : request_result::failed;
+        }
+
+        // status line, e.g. HTTP/1.1 200 OK
+        const std::size_t status_begin = line.find(' ');
+        if (line.compare(0, 5, "HTTP/") != 0 || status_begin == std::string::npos) {
+            this->close();
+            return request_result::failed;
+        }
+        status = std::atoi(line.c_str() + status_begin + 1);
+        bool keep_alive = line.compare(0, 8, "HTTP/1.0") != 0;
+
+        bool chunked = false;
+        long long content_length = -1;
+        while (true) {
+            if (!this->read_line(line)) {
+                this->close();
+                return request_result::failed;
+            }
+            if (line.empty()) {
+                break;
+            }
+            const std::size_t separator = line.find(':');
+            if (separator == std::string::npos) {
+                continue;
+            }
+            const std::string name = to_lower(trim(line.substr(0, separator)));
+            const std::string value = to_lower(trim(line.substr(separator + 1)));
+            if (name == "content-length") {
+                content_length = std::atoll(value.c_str());
+            } else if (name == "transfer-encoding") {
+                chunked = value.find("chunked") != std::string::npos;
+            } else if (name == "connection") {
+                keep_alive = value.find("close") == std::string::npos && (keep_alive || value.find("keep-alive") != std::string::npos);
+            }
+        }
+
+        bool complete = true;
+        if (chunked) {
+            complete = this->read_chunked_body(on_body);
+        } else if (content_length >= 0) {
+            complete = this->read_body(static_cast<std::size_t>(content_length), on_body);
+        } else {
+            this->read_until_close(on_body);
+            keep_alive = false;
+        }
+        if (!complete || !keep_alive) {
+            this->close();
+        }
+        return complete ? request_result::complete : request_result::failed;
+    }
+
+    bool HttpConnection::connect() {
+        addrinfo hints {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses = nullptr;
+        if (::getaddrinfo(m_host.c_str(), m_port.c_str(), &hints, &addresses) != 0) {
+            std::cerr << "Could not resolve " << m_host << ":" << m_port << "\n";
+            return false;
+        }
+        for (addrinfo* address = addresses; address != nullptr && m_socket < 0; address = address->ai_next) {
+            const int fd = ::socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, address->ai_protocol);
+            if (fd < 0) {
+                continue;
+            }
+            // non blocking, so an unreachable host does not block for the TCP connect timeout
+            bool connected = ::connect(fd, address->ai_addr, address->ai_addrlen) == 0;
+            if (!connected && errno == EINPROGRESS && wait_for(fd, POLLOUT, m_timeout)) {
+                int error = 0;
+                socklen_t length = sizeof(error);
+                connected = ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0;
+            }
+            if (!connected) {
+                ::close(fd);
+                continue;
+            }
+            const int no_delay = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+            m_socket = fd;
+        }
+        ::freeaddrinfo(addresses);
+        if (m_socket < 0) {
+            std::cerr << "Could not connect to " << m_host << ":" << m_port << "\n";
+            return false;
+        }
+        m_connects++;
+        m_buffer.clear();
+        m_buffer_pos = 0;
+        return true;
+    }
+
+    bool HttpConnection::send_all(const std::string& data) {
+        std::size_t sent = 0;
+        while (sent < data.size()) {
+            const ssize_t result = ::send(m_socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (result > 0) {
+                sent += static_cast<std::size_t>(result);
+            } else if (result < 0 && errno == EINTR) {
+                continue;
+            } else if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && wait_for(m_socket, POLLOUT, m_timeout)) {
+                continue;
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool HttpConnection::receive_more() {
+        if (m_buffer_pos == m_buffer.size()) {
+            m_buffer.clear();
+            m_buffer_pos = 0;
+        }
+        char data[RECEIVE_SIZE];
+        while (true) {
+            const ssize_t received = ::recv(m_socket, data, sizeof(data), 0);
+            if (received > 0) {
+                m_buffer.append(data, static_cast<std::size_t>(received));
+                m_received_any = true;
+                return true;
+            }
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && wait_for(m_socket, POLLIN, m_timeout)) {
+                continue;
+            }
+            return false; // closed by the server, failed or timed out
+        }
+    }
+
+    bool HttpConnection::read_line(std::string& line) {
+        while (true) {
+            const std::size_t line_end = m_buffer.find("\r\n", m_buffer_pos);
+            if (line_end != std::string::npos) {
+                line.assign(m_buffer, m_buffer_pos, line_end - m_buffer_pos);
+                m_buffer_pos = line_end + 2;
+                return true;
+            }
+            if (m_buffer.size() - m_buffer_pos > MAX_LINE_LENGTH || !this->receive_more()) {
+                return false;
+            }
+        }
+    }
+
+    bool HttpConnection::read_body(std::size_t size, const body_callback& on_body) {
+        while (size > 0) {
+            if (m_buffer_pos == m_buffer.size() && !this->receive_more()) {
+                return false;
+            }
+            const std::size_t available = std::min(size, m_buffer.size() - m_buffer_pos);
+            on_body(m_buffer.data() + m_buffer_pos, available);
+            m_buffer_pos += available;
+            size -= available;
+        }
+        return true;
+    }
+
+    bool HttpConnection::read_chunked_body(const body_callback& on_body) {
+        std::string line;
+        while (true) {
+            if (!this->read_line(line)) {
+                return false;
+            }
+            // chunk size in hex, optionally followed by extensions
+            char* end = nullptr;
+            const unsigned long long size = std::strtoull(line.c_str(), &end, 16);
+            if (end == line.c_str()) {
+                return false;
+            }
+            if (size == 0) {
+                break;
+            }
+            if (!this->read_body(static_cast<std::size_t>(size), on_body) || !this->read_line(line) || !line.empty()) {
+                return false;
+            }
+        }
+        // trailers up to the empty line
+        do {
+            if (!this->read_line(line)) {
+                return false;
+            }
+        } while (!line.empty());
+        return true;
+    }
+
+    void HttpConnection::read_until_close(const body_callback& on_body) {
+        do {
+            if (m_buffer_pos < m_buffer.size()) {
+                on_body(m_buffer.data() + m_buffer_pos, m_buffer.size() - m_buffer_pos);
+                m_buffer_pos = m_buffer.size();
+            }
+        } while (this->receive_more());
+    }
+
+} /* namespace printer_lamp */
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace printer_lamp {
+
+    /*
+    Minimal HTTP/1.1 client on a persistent (keep-alive) connection, meant for polling a single
+    server. The body of a response is handed over in the pieces it arrives in, so it can be
+    parsed while it is received (Content-Length, chunked and close delimited bodies). Every
+    connect, send and receive is bounded by the timeout. The connection is reopened on the next
+    request once the server closed it, failed or asked for Connection: close - a request on a
+    kept-alive connection that the server closed in the meantime is sent again on a new one.
+    */
+    class HttpConnection {
+        public:
+            using header_list = std::vector<std::pair<std::string, std::string>>;
+            using body_callback = std::function<void(const char* data, std::size_t size)>;
+
+            HttpConnection(std::string host, std::string port, std::chrono::milliseconds timeout);
+            HttpConnection() = delete;
+            HttpConnection(const HttpConnection&) = delete;
+            HttpConnection& operator=(const HttpConnection&) = delete;
+            ~HttpConnection();
+
+            // returns the status code of the response or -1 if no complete response was received
+            int get(const std::string& target, const header_list& headers, const body_callback& on_body);
+            void close();
+
+            // number of TCP connections opened so far
+            std::uint64_t get_connects() const;
+
+        private:
+            enum class request_result { complete, failed, closed_before_response };
+
+            request_result send_request(const std::string& request, int& status, const body_callback& on_body);
+            bool connect();
+            bool send_all(const std::string& data);
+            bool receive_more();
+            bool read_line(std::string& line);
+            bool read_body(std::size_t size, const body_callback& on_body);
+            bool read_chunked_body(const body_callback& on_body);
+            void read_until_close(const body_callback& on_body);
+
+            const std::string m_host;
+            const std::string m_port;
+            const std::chrono::milliseconds m_timeout;
+            int m_socket;
+            std::uint64_t m_connects;
+            bool m_received_any; // part of the current response has been received
+            std::string m_buffer; // received but not yet consumed, starting at m_buffer_pos
+            std::size_t m_buffer_pos;
+            std::string m_request;
+    };
+
+} /* namespace printer_lamp */
@@ -0,0 +1,72 @@
+#include "octoprint_poller.hpp"
+
+#include <chrono>
+#include <iostream>
+
+namespace printer_lamp {
+
+    namespace {
+        const std::string PRINTER_STATE_RESOURCE = "/api/printer";
+    } /* anonymous namespace */
+
+    OctoPrintPoller::OctoPrintPoller(const poller_config& config) :
+        m_connection{config.host, config.port, std::chrono::milliseconds(config.request_timeout_ms)},
+        m_headers{{"X-Api-Key", config.api_key}, {"Accept", "application/json"}},
+        m_rules{config.heating_threshold, config.heating_clip_bed, config.heating_clip_tool},
+        m_error_reported{false}
+    {}
+
+    std::vector<int> OctoPrintPoller::poll() {
+        m_extractor.reset();
+        const int status = m_connection.get(PRINTER_STATE_RESOURCE, m_headers, [this](const char* data, std::size_t size) {
+            m_extractor.feed(data, size);
+        });
+        if (status < 0) {
+            std::cout << "Could not poll the printer state from OctoPrint\n";
+            return {};
+        }
+
+        const bool valid_json = m_extractor.finish();
+        const printer_status& printer = m_extractor.get_status();
+        if (status != 200 || printer.error) {
+            std::cout << "Invalid response from OctoPrint (HTTP status " << status << ")\n";
+            m_state.reset();
+            if (m_error_reported) {
+                return {};
+            }
+            m_error_reported = true;
+            return {8}; // all lights off while OctoPrint can not tell the printer state
+        }
+        m_error_reported = false;
+        if (!valid_json) {
+            std::cout << "Invalid json for distilling the printer state received - skipping\n";
+            return {};
+        }
+        if (!printer.is_complete()) {
+            std::cout << "Could not get the needed printer attributes for distilling the printer state\n";
+            return {};
+        }
+
+        const printer_state state = m_rules.apply(printer);
+        if (m_state == state) {
+            return {};
+        }
+        m_state = state;
+        std::cout << "Printer state has changed to " << to_string(state) << "\n";
+        return lamp_commands_for(state);
+    }
+
+    void OctoPrintPoller::forget_state() {
+        m_state.reset();
+        m_error_reported = false;
+    }
+
+    std::optional<printer_state> OctoPrintPoller::get_state() const {
+        return m_state;
+    }
+
+    const HttpConnection& OctoPrintPoller::get_connection() const {
+        return m_connection;
+    }
+
+} /* namespace printer_lamp */
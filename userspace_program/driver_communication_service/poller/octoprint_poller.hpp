@@ -0,0 +1,55 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "http_connection.hpp"
+#include "printer_status.hpp"
+
+namespace printer_lamp {
+
+    // [PRINTERSERVICE] section of the printer service config (lamp_config.ini)
+    struct poller_config {
+        std::string host {""};
+        std::string port {"80"};
+        std::string api_key {""};
+        double heating_threshold {5.0};
+        double heating_clip_bed {5.0};
+        double heating_clip_tool {5.0};
+        long poll_interval_ms {2500};
+        long request_timeout_ms {2000};
+        std::string object_path {"/3DP/printerlamp"};
+        std::string interface_name {"jens.printerlamp"};
+    };
+
+    /*
+    Polls /api/printer of OctoPrint on a persistent connection and derives the lamp state from
+    the streamed response. A poll returns the lamp commands to send whenever the printer state
+    changed, and a reset once OctoPrint answers with an error - after that the next valid state
+    is sent again, whatever it was before.
+    */
+    class OctoPrintPoller {
+        public:
+            explicit OctoPrintPoller(const poller_config& config);
+            OctoPrintPoller() = delete;
+            OctoPrintPoller(const OctoPrintPoller&) = delete;
+            OctoPrintPoller& operator=(const OctoPrintPoller&) = delete;
+
+            // empty if there is nothing to send
+            std::vector<int> poll();
+            // the commands of the last state were not delivered, the next poll sends the state again
+            void forget_state();
+            std::optional<printer_state> get_state() const;
+            const HttpConnection& get_connection() const;
+
+        private:
+            HttpConnection m_connection;
+            HttpConnection::header_list m_headers;
+            PrinterStatusExtractor m_extractor;
+            PrinterStateRules m_rules;
+            std::optional<printer_state> m_state;
+            bool m_error_reported;
+    };
+
+} /* namespace printer_lamp */
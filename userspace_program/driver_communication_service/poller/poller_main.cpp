@@ -0,0 +1,135 @@
+/*
+Native replacement of the Python printer communication service: polls the printer state from
+OctoPrint and sends the resulting lamp commands to the driver interaction service.
+
+    $ ./build/bin/octoprint_poller --config /etc/octolamp/lamp_config.ini
+
+The config is the [PRINTERSERVICE] section of the Python service (ip_adress, port, api_key,
+heating_threshold, heating_clip_bed, heating_clip_tool) with the optional poll_interval_ms,
+request_timeout_ms, object_path and interface_name.
+*/
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+
+#include <boost/program_options.hpp>
+#include <INIReader.h>
+#include <sdbus-c++/sdbus-c++.h>
+
+#include "octoprint_poller.hpp"
+
+static inline const std::string DRIVER_SERVICE_NAME = "jens.printerlamp.driver_interaction";
+
+namespace {
+    bool read_config(const std::string& path, printer_lamp::poller_config& config) {
+        INIReader reader(path);
+        if (reader.ParseError() < 0) {
+            return false;
+        }
+        config.host = reader.Get("PRINTERSERVICE", "ip_adress", "");
+        config.port = reader.Get("PRINTERSERVICE", "port", "80");
+        config.api_key = reader.Get("PRINTERSERVICE", "api_key", "");
+        config.heating_threshold = reader.GetReal("PRINTERSERVICE", "heating_threshold", 5.0);
+        config.heating_clip_bed = reader.GetReal("PRINTERSERVICE", "heating_clip_bed", 5.0);
+        config.heating_clip_tool = reader.GetReal("PRINTERSERVICE", "heating_clip_tool", 5.0);
+        config.poll_interval_ms = reader.GetInteger("PRINTERSERVICE", "poll_interval_ms", 2500);
+        config.request_timeout_ms = reader.GetInteger("PRINTERSERVICE", "request_timeout_ms", 2000);
+        config.object_path = reader.Get("PRINTERSERVICE", "object_path", "/3DP/printerlamp");
+        config.interface_name = reader.Get("PRINTERSERVICE", "interface_name", "jens.printerlamp");
+        return !config.host.empty() && config.poll_interval_ms > 0 && config.request_timeout_ms > 0;
+    }
+
+    bool send_lamp_commands(sdbus::IProxy& proxy, const std::string& interface_name, const std::vector<int>& commands) {
+        try {
+            // one transaction, so the lightplay, the reset and the new state are applied in one go
+            auto method = proxy.createMethodCall(interface_name, "set_lamp_commands");
+            method << commands;
+            auto reply = proxy.callMethod(method);
+            bool accepted = false;
+            reply >> accepted;
+            return accepted;
+        } catch (const sdbus::Error& exc) {
+            std::cerr << "Could not send the lamp commands to the driver service\n";
+            std::cerr << "message = " << exc.what() << "\n";
+            return false;
+        }
+    }
+}
+
+int main(int argc, const char* argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc{"Options"};
+    desc.add_options()
+        ("help,h", "Help screen")
+        ("config", po::value<std::string>()->required(), "Path to the config file (INI) of the OctoPrint poller");
+    po::variables_map variables;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), variables);
+        if (variables.count("help")) {
+            std::cout << desc << "\n";
+            return 0;
+        }
+        po::notify(variables);
+    } catch (const po::error& exc) {
+        std::cerr << exc.what() << "\n" << desc << "\n";
+        return 1;
+    }
+
+    printer_lamp::poller_config config;
+    if (!read_config(variables["config"].as<std::string>(), config)) {
+        std::cout << "Invalid config file received. Program is unable to start\n";
+        return 1;
+    }
+
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+    const int signal_fd = signalfd(-1, &stop_signals, SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        std::perror("Could not create the signalfd");
+        return 1;
+    }
+
+    auto connection = sdbus::createSystemBusConnection();
+    auto proxy = sdbus::createProxy(*connection, DRIVER_SERVICE_NAME, config.object_path);
+    printer_lamp::OctoPrintPoller poller(config);
+    std::cout << "Polling the printer state from " << config.host << ":" << config.port << " every " << config.poll_interval_ms << " ms\n";
+
+    const std::chrono::milliseconds interval(config.poll_interval_ms);
+    auto next_poll = std::chrono::steady_clock::now();
+    while (true) {
+        const std::vector<int> commands = poller.poll();
+        if (!commands.empty() && !send_lamp_commands(*proxy, config.interface_name, commands)) {
+            poller.forget_state(); // sent again with the next poll
+        }
+
+        // fixed rate - a slow response does not shift the polls behind it
+        next_poll += interval;
+        const auto now = std::chrono::steady_clock::now();
+        if (next_poll < now) {
+            next_poll = now;
+        }
+        const auto wait_ms = std::chrono::duration_cast<std::chrono::milliseconds>(next_poll - now).count();
+        pollfd poll_fd {signal_fd, POLLIN, 0};
+        const int result = ::poll(&poll_fd, 1, static_cast<int>(wait_ms));
+        if (result < 0 && errno != EINTR) {
+            std::perror("poll");
+            break;
+        }
+        if (result > 0) {
+            std::cout << "Stopping the OctoPrint poller\n";
+            break;
+        }
+    }
+    ::close(signal_fd);
+    return 0;
+}
@@ -0,0 +1,286 @@
+#include "printer_status.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace printer_lamp {
+
+    namespace {
+        // /api/printer nests 4 levels deep, this leaves room for the optional sections
+        constexpr std::size_t MAX_DEPTH = 32;
+        // no number or literal of the response comes close to this
+        constexpr std::size_t MAX_LITERAL_LENGTH = 64;
+
+        bool is_whitespace(char c) {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        bool is_literal_char(char c) {
+            return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '.' || c == '+' || c == '-';
+        }
+
+        bool parse_number(const std::string& token, double& value) {
+            char* end = nullptr;
+            value = std::strtod(token.c_str(), &end);
+            return end == token.c_str() + token.size() && std::isfinite(value);
+        }
+    } /* anonymous namespace */
+
+    PrinterStatusExtractor::PrinterStatusExtractor() {
+        m_containers.reserve(MAX_DEPTH);
+        m_keys.reserve(MAX_DEPTH);
+        m_token.reserve(MAX_LITERAL_LENGTH);
+        this->reset();
+    }
+
+    void PrinterStatusExtractor::reset() {
+        m_state = parse_state::value;
+        m_containers.clear();
+        m_keys.clear();
+        m_token.clear();
+        m_string_is_key = false;
+        m_escaped = false;
+        m_container_empty = false;
+        m_status = printer_status{};
+    }
+
+    bool PrinterStatusExtractor::feed(const char* data, std::size_t size) {
+        for (std::size_t idx = 0; idx < size; idx++) {
+            if (!this->process(data[idx])) {
+                m_state = parse_state::error;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool PrinterStatusExtractor::finish() {
+        if (m_state == parse_state::literal && m_containers.empty()) {
+            // a top-level literal ends with the document
+            if (!this->finish_literal()) {
+                m_state = parse_state::error;
+            }
+        }
+        return m_state == parse_state::done;
+    }
+
+    const printer_status& PrinterStatusExtractor::get_status() const {
+        return m_status;
+    }
+
+    bool PrinterStatusExtractor::process(char c) {
+        switch (m_state) {
+            case parse_state::value:
+                if (is_whitespace(c)) {
+                    return true;
+                }
+                if (c == '{' || c == '[') {
+                    return this->open_container(c == '{');
+                }
+                if (c == ']' && m_container_empty && !m_containers.empty() && !m_containers.back()) {
+                    return this->close_container(false);
+                }
+                if (c == '"') {
+                    m_token.clear();
+                    m_string_is_key = false;
+                    m_state = parse_state::string;
+                    return true;
+                }
+                if (is_literal_char(c)) {
+                    m_token.assign(1, c);
+                    m_state = parse_state::literal;
+                    return true;
+                }
+                return false;
+
+            case parse_state::object_key:
+                if (is_whitespace(c)) {
+                    return true;
+                }
+                if (c == '"') {
+                    m_token.clear();
+                    m_string_is_key = true;
+                    m_state = parse_state::string;
+                    return true;
+                }
+                return c == '}' && m_container_empty && this->close_container(true);
+
+            case parse_state::colon:
+                if (is_whitespace(c)) {
+                    return true;
+                }
+                if (c != ':') {
+                    return false;
+                }
+                m_state = parse_state::value;
+                return true;
+
+            case parse_state::string:
+                if (m_escaped || c != '"') {
+                    // escapes are kept as they are, none of the extracted keys contains one - string values are not needed at all
+                    m_escaped = !m_escaped && c == '\\';
+                    if (m_string_is_key && m_token.size() < MAX_LITERAL_LENGTH) {
+                        m_token.push_back(c);
+                    }
+                    return true;
+                }
+                if (m_string_is_key) {
+                    m_keys.back() = m_token;
+                    m_state = parse_state::colon;
+                    return true;
+                }
+                this->on_value(m_token, true);
+                m_state = m_containers.empty() ? parse_state::done : parse_state::after_value;
+                return true;
+
+            case parse_state::literal:
+                if (is_literal_char(c)) {
+                    if (m_token.size() >= MAX_LITERAL_LENGTH) {
+                        return false;
+                    }
+                    m_token.push_back(c);
+                    return true;
+                }
+                // the character behind the literal belongs to the next token
+                return this->finish_literal() && this->process(c);
+
+            case parse_state::after_value:
+                if (is_whitespace(c)) {
+                    return true;
+                }
+                if (c == ',') {
+                    m_container_empty = false;
+                    m_state = m_containers.back() ? parse_state::object_key : parse_state::value;
+                    return true;
+                }
+                if (c == '}' || c == ']') {
+                    return this->close_container(c == '}');
+                }
+                return false;
+
+            case parse_state::done:
+                return is_whitespace(c);
+
+            case parse_state::error:
+                return false;
+        }
+        return false;
+    }
+
+    bool PrinterStatusExtractor::open_container(bool is_object) {
+        if (m_containers.size() >= MAX_DEPTH) {
+            return false;
+        }
+        m_containers.push_back(is_object);
+        m_keys.emplace_back();
+        m_container_empty = true;
+        m_state = is_object ? parse_state::object_key : parse_state::value;
+        return true;
+    }
+
+    bool PrinterStatusExtractor::close_container(bool is_object) {
+        if (m_containers.empty() || m_containers.back() != is_object) {
+            return false;
+        }
+        m_containers.pop_back();
+        m_keys.pop_back();
+        m_container_empty = false;
+        m_state = m_containers.empty() ? parse_state::done : parse_state::after_value;
+        return true;
+    }
+
+    bool PrinterStatusExtractor::finish_literal() {
+        double number = 0.0;
+        if (m_token != "true" && m_token != "false" && m_token != "null" && !parse_number(m_token, number)) {
+            return false;
+        }
+        this->on_value(m_token, false);
+        m_state = m_containers.empty() ? parse_state::done : parse_state::after_value;
+        return true;
+    }
+
+    void PrinterStatusExtractor::on_value(const std::string& token, bool is_string) {
+        if (m_containers.size() == 1 && m_containers[0] && m_keys[0] == "error") {
+            m_status.error = true;
+            return;
+        }
+        if (is_string || token == "null") {
+            return; // OctoPrint reports a missing target as null
+        }
+        if (this->path_is("state", "flags", "printing")) {
+            if (token == "true" || token == "false") {
+                m_status.printing = (token == "true");
+            }
+            return;
+        }
+        std::optional<double>* field = nullptr;
+        if (this->path_is("temperature", "bed", "actual")) {
+            field = &m_status.bed_actual;
+        } else if (this->path_is("temperature", "bed", "target")) {
+            field = &m_status.bed_target;
+        } else if (this->path_is("temperature", "tool0", "actual")) {
+            field = &m_status.tool_actual;
+        } else if (this->path_is("temperature", "tool0", "target")) {
+            field = &m_status.tool_target;
+        }
+        double number = 0.0;
+        if (field != nullptr && parse_number(token, number)) {
+            *field = number;
+        }
+    }
+
+    bool PrinterStatusExtractor::path_is(const char* first, const char* second, const char* third) const {
+        return m_containers.size() == 3 && m_containers[0] && m_containers[1] && m_containers[2] &&
+            m_keys[0] == first && m_keys[1] == second && m_keys[2] == third;
+    }
+
+    const char* to_string(printer_state state) {
+        switch (state) {
+            case printer_state::standby:
+                return "standby";
+            case printer_state::heating:
+                return "heating";
+            case printer_state::printing:
+                return "printing";
+        }
+        return "unknown";
+    }
+
+    PrinterStateRules::PrinterStateRules(double heating_threshold, double heating_clip_bed, double heating_clip_tool) :
+        m_heating_threshold{heating_threshold},
+        m_bed_average{heating_clip_bed},
+        m_tool_average{heating_clip_tool}
+    {}
+
+    printer_state PrinterStateRules::apply(const printer_status& status) {
+        m_bed_average.add(*status.bed_actual);
+        m_tool_average.add(*status.tool_actual);
+
+        const bool is_target_temp_set = (*status.bed_target != 0.0) || (*status.tool_target != 0.0);
+        const bool delta_t_bed_exists = std::abs(*status.bed_target - m_bed_average.get()) > m_heating_threshold;
+        const bool delta_t_tool_exists = std::abs(*status.tool_target - m_tool_average.get()) > m_heating_threshold;
+        const bool is_delta_t_existing = delta_t_bed_exists || delta_t_tool_exists;
+
+        if (*status.printing && !is_delta_t_existing) {
+            return printer_state::printing;
+        }
+        if (is_delta_t_existing && is_target_temp_set) {
+            return printer_state::heating;
+        }
+        return printer_state::standby;
+    }
+
+    std::vector<int> lamp_commands_for(printer_state state) {
+        switch (state) {
+            case printer_state::heating:
+                return {6, 8, 1};
+            case printer_state::printing:
+                return {6, 8, 2};
+            case printer_state::standby:
+                break;
+        }
+        return {6, 8, 0};
+    }
+
+} /* namespace printer_lamp */
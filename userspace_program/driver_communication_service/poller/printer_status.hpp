@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "streaming_filters.hpp"
+
+namespace printer_lamp {
+
+    // the fields of the OctoPrint /api/printer response the lamp state is derived from
+    struct printer_status {
+        std::optional<double> bed_actual;
+        std::optional<double> bed_target;
+        std::optional<double> tool_actual;
+        std::optional<double> tool_target;
+        std::optional<bool> printing;
+        bool error {false}; // OctoPrint answered with {"error": ...}, e.g. while the printer is not operational
+
+        bool is_complete() const {
+            return bed_actual && bed_target && tool_actual && tool_target && printing;
+        }
+    };
+
+    /*
+    Streaming extractor for the /api/printer response. The body is fed in the pieces it arrives
+    in from the socket and only temperature.bed/tool0.actual/target, state.flags.printing and a
+    top-level error are kept - everything else is tokenized and dropped without building a
+    document. Malformed JSON is reported by feed() and finish(); the pieces behind the first
+    error are ignored.
+    */
+    class PrinterStatusExtractor {
+        public:
+            PrinterStatusExtractor();
+            PrinterStatusExtractor(const PrinterStatusExtractor&) = delete;
+            PrinterStatusExtractor& operator=(const PrinterStatusExtractor&) = delete;
+
+            // starts a new document
+            void reset();
+            bool feed(const char* data, std::size_t size);
+            // true if a complete JSON document was fed
+            bool finish();
+            const printer_status& get_status() const;
+
+        private:
+            enum class parse_state { value, object_key, colon, after_value, string, literal, done, error };
+
+            bool process(char c);
+            bool open_container(bool is_object);
+            bool close_container(bool is_object);
+            bool finish_literal();
+            void on_value(const std::string& token, bool is_string);
+            bool path_is(const char* first, const char* second, const char* third) const;
+
+            parse_state m_state;
+            std::vector<bool> m_containers; // true for objects, one entry per open container
+            std::vector<std::string> m_keys; // current key of every open container, empty for arrays
+            std::string m_token;
+            bool m_string_is_key;
+            bool m_escaped;
+            bool m_container_empty;
+            printer_status m_status;
+    };
+
+    enum class printer_state {
+        standby,
+        heating,
+        printing
+    };
+
+    const char* to_string(printer_state state);
+
+    // the temperatures are smoothed over the last 3 polls
+    constexpr std::size_t TEMPERATURE_WINDOW = 3;
+    using TemperatureAverage = ClippedMovingAverage<double, TEMPERATURE_WINDOW>;
+
+    /*
+    The lamp state rules of the printer communication service: printing without a temperature
+    difference above the heating threshold is PRINTING, a temperature difference while a target
+    temperature is set is HEATING, everything else STANDBY. The actual temperatures are smoothed
+    by a TemperatureAverage.
+    */
+    class PrinterStateRules {
+        public:
+            PrinterStateRules(double heating_threshold, double heating_clip_bed, double heating_clip_tool);
+            PrinterStateRules() = delete;
+
+            // the state after the status of one poll, which has to be complete
+            printer_state apply(const printer_status& status);
+
+        private:
+            const double m_heating_threshold;
+            TemperatureAverage m_bed_average;
+            TemperatureAverage m_tool_average;
+    };
+
+    // lightplay, reset and the LED of the state - sent as one set_lamp_commands transaction
+    std::vector<int> lamp_commands_for(printer_state state);
+
+} /* namespace printer_lamp */
@@ -0,0 +1,311 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+
+namespace printer_lamp {
+
+    /*
+    Streaming filters for the temperature samples of the printer. All of them keep their state in
+    fixed size members (the window is a template parameter), so adding a sample never allocates
+    and costs O(1) - amortized O(1) for the sliding minimum/maximum.
+    */
+
+    // fixed capacity FIFO that overwrites its oldest value once it is full
+    template <typename T, std::size_t Capacity>
+    class RingBuffer {
+        static_assert(Capacity > 0, "a ring buffer needs a capacity");
+
+        public:
+            // returns true if the buffer was full and the oldest value was moved to evicted
+            bool push(const T& value, T& evicted) {
+                const bool full = this->full();
+                if (full) {
+                    evicted = m_values[m_head];
+                } else {
+                    m_size++;
+                }
+                m_values[m_head] = value;
+                m_head = (m_head + 1 == Capacity) ? 0 : m_head + 1;
+                return full;
+            }
+
+            void push(const T& value) {
+                T evicted;
+                this->push(value, evicted);
+            }
+
+            // 0 is the oldest value
+            const T& operator[](std::size_t idx) const {
+                return m_values[(m_head + Capacity - m_size + idx) % Capacity];
+            }
+
+            const T& newest() const {
+                return m_values[(m_head == 0) ? Capacity - 1 : m_head - 1];
+            }
+
+            const T& oldest() const {
+                return (*this)[0];
+            }
+
+            std::size_t size() const {
+                return m_size;
+            }
+
+            bool empty() const {
+                return m_size == 0;
+            }
+
+            bool full() const {
+                return m_size == Capacity;
+            }
+
+            void clear() {
+                m_head = 0;
+                m_size = 0;
+            }
+
+            static constexpr std::size_t capacity() {
+                return Capacity;
+            }
+
+        private:
+            std::array<T, Capacity> m_values {};
+            std::size_t m_head {0}; // next slot to write
+            std::size_t m_size {0};
+    };
+
+    /*
+    Sum and mean over the last Window values. Floating point sums are compensated (Neumaier), so
+    the error stays at the rounding of the window sum itself instead of growing with every value
+    that enters and leaves the window.
+    */
+    template <typename T, std::size_t Window>
+    class RunningMean {
+        static_assert(std::is_arithmetic<T>::value, "the running mean needs an arithmetic type");
+
+        public:
+            void add(T value) {
+                T evicted {};
+                if (m_values.push(value, evicted)) {
+                    this->accumulate(-evicted);
+                }
+                this->accumulate(value);
+            }
+
+            T sum() const {
+                return m_sum + m_compensation;
+            }
+
+            // 0 without values
+            T mean() const {
+                return m_values.empty() ? T{} : this->sum() / static_cast<T>(m_values.size());
+            }
+
+            const RingBuffer<T, Window>& values() const {
+                return m_values;
+            }
+
+            void clear() {
+                m_values.clear();
+                m_sum = T{};
+                m_compensation = T{};
+            }
+
+        private:
+            void accumulate(T value) {
+                if constexpr (std::is_floating_point<T>::value) {
+                    // the lost low order bits of the smaller summand, selected without a branch
+                    const T sum = m_sum + value;
+                    const bool sum_is_larger = std::abs(m_sum) >= std::abs(value);
+                    const T larger = sum_is_larger ? m_sum : value;
+                    const T smaller = sum_is_larger ? value : m_sum;
+                    m_compensation += (larger - sum) + smaller;
+                    m_sum = sum;
+                } else {
+                    m_sum += value;
+                }
+            }
+
+            RingBuffer<T, Window> m_values;
+            T m_sum {};
+            T m_compensation {};
+    };
+
+    /*
+    Minimum (std::less) or maximum (std::greater) of the last Window values with a monotonic
+    queue: a value that can never become the extremum again is dropped right away, so every value
+    enters and leaves the queue once.
+    */
+    template <typename T, std::size_t Window, typename Compare>
+    class SlidingExtremum {
+        static_assert(Window > 0, "a sliding window needs a size");
+
+        public:
+            void add(T value) {
+                // drop the value that leaves the window from the front - at most one per new value
+                if (m_size > 0 && m_entries[m_front].index + Window <= m_next_index) {
+                    m_front = (m_front + 1 == Window) ? 0 : m_front + 1;
+                    m_size--;
+                }
+                // and the values that are not better than the new one from the back
+                while (m_size > 0 && !m_compare(this->back().value, value)) {
+                    m_size--;
+                }
+                m_entries[wrap(m_front + m_size)] = entry{m_next_index, value};
+                m_size++;
+                m_next_index++;
+            }
+
+            // undefined without values
+            T get() const {
+                return m_entries[m_front].value;
+            }
+
+            bool empty() const {
+                return m_size == 0;
+            }
+
+            void clear() {
+                m_front = 0;
+                m_size = 0;
+                m_next_index = 0;
+            }
+
+        private:
+            struct entry {
+                std::size_t index;
+                T value;
+            };
+
+            // positions are below 2 * Window
+            static std::size_t wrap(std::size_t position) {
+                return (position >= Window) ? position - Window : position;
+            }
+
+            const entry& back() const {
+                return m_entries[wrap(m_front + m_size - 1)];
+            }
+
+            std::array<entry, Window> m_entries {};
+            std::size_t m_front {0};
+            std::size_t m_size {0};
+            std::size_t m_next_index {0};
+            Compare m_compare {};
+    };
+
+    template <typename T, std::size_t Window>
+    using SlidingMin = SlidingExtremum<T, Window, std::less<T>>;
+
+    template <typename T, std::size_t Window>
+    using SlidingMax = SlidingExtremum<T, Window, std::greater<T>>;
+
+    // exponential moving average, the first value initializes it
+    template <typename T>
+    class ExponentialMovingAverage {
+        public:
+            // weight of a new value, 0 < alpha <= 1
+            explicit ExponentialMovingAverage(T alpha) : m_alpha{alpha} {}
+
+            void add(T value) {
+                m_average = m_initialized ? m_average + m_alpha * (value - m_average) : value;
+                m_initialized = true;
+            }
+
+            T get() const {
+                return m_average;
+            }
+
+            bool empty() const {
+                return !m_initialized;
+            }
+
+            void clear() {
+                m_initialized = false;
+                m_average = T{};
+            }
+
+        private:
+            const T m_alpha;
+            T m_average {};
+            bool m_initialized {false};
+    };
+
+    /*
+    Two threshold switch: it turns on once a value rises above the on threshold and only turns
+    off again once a value falls below the off threshold, so noise around a single threshold does
+    not toggle it.
+    */
+    template <typename T>
+    class Hysteresis {
+        public:
+            Hysteresis(T on_threshold, T off_threshold) : m_on_threshold{on_threshold}, m_off_threshold{off_threshold} {}
+
+            // returns the state after the value
+            bool update(T value) {
+                if (!m_active && value > m_on_threshold) {
+                    m_active = true;
+                } else if (m_active && value < m_off_threshold) {
+                    m_active = false;
+                }
+                return m_active;
+            }
+
+            bool is_active() const {
+                return m_active;
+            }
+
+            void reset(bool active = false) {
+                m_active = active;
+            }
+
+        private:
+            const T m_on_threshold;
+            const T m_off_threshold;
+            bool m_active {false};
+    };
+
+    /*
+    Moving average over the last Window temperatures that smooths the state transitions. Once the
+    window is full and a value differs more than the clip from the newest one, the minimum of the
+    window is used instead - the temperature is still ramping up or down.
+    */
+    template <typename T, std::size_t Window>
+    class ClippedMovingAverage {
+        public:
+            explicit ClippedMovingAverage(T clip) : m_clip{clip} {}
+
+            void add(T value) {
+                m_mean.add(value);
+                m_min.add(value);
+                m_max.add(value);
+            }
+
+            T get() const {
+                const RingBuffer<T, Window>& values = m_mean.values();
+                if (values.full()) {
+                    const T newest = values.newest();
+                    if (m_max.get() - newest > m_clip || newest - m_min.get() > m_clip) {
+                        return m_min.get();
+                    }
+                }
+                return m_mean.mean();
+            }
+
+            void clear() {
+                m_mean.clear();
+                m_min.clear();
+                m_max.clear();
+            }
+
+        private:
+            const T m_clip;
+            RunningMean<T, Window> m_mean;
+            SlidingMin<T, Window> m_min;
+            SlidingMax<T, Window> m_max;
+    };
+
+} /* namespace printer_lamp */
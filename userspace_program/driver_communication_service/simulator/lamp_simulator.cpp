@@ -0,0 +1,145 @@
+#include "lamp_simulator.hpp"
+
+#include <cinttypes>
+#include <cstdio>
+#include <thread>
+
+namespace printer_lamp {
+
+    namespace {
+        // the module sleeps this long before it checks the detection GPIO again
+        constexpr std::chrono::milliseconds DETECTION_DEBOUNCE {100};
+    } /* anonymous namespace */
+
+    GpioTimeline::GpioTimeline(std::FILE* output) :
+        m_output{output},
+        m_start{std::chrono::steady_clock::now()}
+    {
+        if (m_output != nullptr) {
+            std::fprintf(m_output, "time_us,event,value,gpio_level\n");
+            std::fflush(m_output);
+        }
+    }
+
+    void GpioTimeline::record(const std::string& event, std::uint32_t value, std::uint32_t gpio_level) {
+        const std::uint64_t time_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_output == nullptr) {
+            m_entries.push_back({time_us, event, value, gpio_level});
+            return;
+        }
+        std::fprintf(m_output, "%" PRIu64 ",%s,0x%08" PRIx32 ",0x%08" PRIx32 "\n", time_us, event.c_str(), value, gpio_level);
+        std::fflush(m_output);
+    }
+
+    std::vector<timeline_entry> GpioTimeline::get_entries() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries;
+    }
+
+    const lamp_gpio_ops SimulatedLampDriver::GPIO_OPS = {&SimulatedLampDriver::write_register, &SimulatedLampDriver::sleep_ms};
+
+    SimulatedLampDriver::SimulatedLampDriver(GpioTimeline& timeline, std::chrono::milliseconds lightplay_step, device_callback on_device_change) :
+        m_timeline{timeline},
+        m_on_device_change{std::move(on_device_change)},
+        m_lamp_activated{false},
+        m_gpfsel{0, 0, 0},
+        m_gpio_level{0}
+    {
+        lamp_sm_init(&m_state_machine, &GPIO_OPS, this, static_cast<unsigned int>(lightplay_step.count()), true);
+        this->init_direct_register_leds();
+    }
+
+    bool SimulatedLampDriver::write(const std::string& data) {
+        int requested_lamp_command = -1;
+        if (std::sscanf(data.c_str(), "%d", &requested_lamp_command) != 1) {
+            this->record_event("INVALID_FORMAT", 0);
+            return false;
+        }
+        if (requested_lamp_command < 0 || requested_lamp_command > LAMP_MAX_COMMAND) {
+            this->record_event("INVALID_COMMAND", static_cast<std::uint32_t>(requested_lamp_command));
+            return false;
+        }
+        this->record_event("COMMAND", static_cast<std::uint32_t>(requested_lamp_command));
+        // like transform_state: the lightplays keep the mutex until the LED state is restored
+        std::lock_guard<std::mutex> lock(m_lamp_state_mutex);
+        return lamp_sm_execute(&m_state_machine, static_cast<unsigned int>(requested_lamp_command)) == 0;
+    }
+
+    std::array<char, 3> SimulatedLampDriver::read() const {
+        std::lock_guard<std::mutex> lock(m_lamp_state_mutex);
+        return {m_state_machine.lamp_state[0], m_state_machine.lamp_state[1], m_state_machine.lamp_state[2]};
+    }
+
+    void SimulatedLampDriver::detection_irq() {
+        std::lock_guard<std::mutex> lock(m_dev_file_mutex);
+        if (m_lamp_activated) {
+            return;
+        }
+        std::this_thread::sleep_for(DETECTION_DEBOUNCE);
+        m_on_device_change(true);
+        m_lamp_activated = true;
+        this->record_event("DEVICE_CREATED", 0);
+        // greeting - the module does not take the lamp state mutex for it, so writes can interleave
+        lamp_sm_lightplay(&m_state_machine, false);
+    }
+
+    void SimulatedLampDriver::shutdown_irq() {
+        std::lock_guard<std::mutex> lock(m_dev_file_mutex);
+        if (!m_lamp_activated) {
+            return;
+        }
+        lamp_sm_lightplay(&m_state_machine, true);
+        m_on_device_change(false);
+        m_lamp_activated = false;
+        this->record_event("DEVICE_REMOVED", 0);
+    }
+
+    bool SimulatedLampDriver::is_activated() const {
+        std::lock_guard<std::mutex> lock(m_dev_file_mutex);
+        return m_lamp_activated;
+    }
+
+    std::uint32_t SimulatedLampDriver::get_gpio_level() const {
+        std::lock_guard<std::mutex> lock(m_register_mutex);
+        return m_gpio_level;
+    }
+
+    void SimulatedLampDriver::write_register(void* context, unsigned int offset, unsigned int value) {
+        auto* driver = static_cast<SimulatedLampDriver*>(context);
+        std::uint32_t level = 0;
+        {
+            std::lock_guard<std::mutex> lock(driver->m_register_mutex);
+            if (offset == LAMP_GPSET0_OFFSET) {
+                driver->m_gpio_level |= value;
+            } else if (offset == LAMP_GPCLR0_OFFSET) {
+                driver->m_gpio_level &= ~value;
+            }
+            level = driver->m_gpio_level;
+        }
+        driver->m_timeline.record(offset == LAMP_GPSET0_OFFSET ? "GPSET0" : "GPCLR0", value, level);
+    }
+
+    void SimulatedLampDriver::sleep_ms(void* /*context*/, unsigned int ms) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    }
+
+    void SimulatedLampDriver::init_direct_register_leds() {
+        for (unsigned int pin : lamp_sm_pins) {
+            const unsigned int gpfsel_index = pin / 10;
+            const unsigned int fsel_bit_pos = pin % 10;
+            {
+                std::lock_guard<std::mutex> lock(m_register_mutex);
+                m_gpfsel[gpfsel_index] &= ~(7u << (fsel_bit_pos * 3));
+                m_gpfsel[gpfsel_index] |= (1u << (fsel_bit_pos * 3)); // output
+            }
+            this->record_event("GPFSEL" + std::to_string(gpfsel_index), m_gpfsel[gpfsel_index]);
+        }
+        lamp_sm_clear_all(&m_state_machine, true);
+    }
+
+    void SimulatedLampDriver::record_event(const std::string& event, std::uint32_t value) {
+        m_timeline.record(event, value, this->get_gpio_level());
+    }
+
+} /* namespace printer_lamp */
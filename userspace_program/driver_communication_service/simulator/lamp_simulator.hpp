@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "lamp_state_machine.h"
+
+namespace printer_lamp {
+
+    struct timeline_entry {
+        std::uint64_t time_us;
+        std::string event; // GPFSELn, GPSET0, GPCLR0 or a driver event (COMMAND, DEVICE_CREATED, ...)
+        std::uint32_t value;
+        std::uint32_t gpio_level; // output level of all GPIOs after the event
+    };
+
+    /*
+    Timeline of the simulated GPIO register writes and driver events as CSV
+    (time_us,event,value,gpio_level). Without an output file the entries are kept in memory,
+    which is meant for tests only.
+    */
+    class GpioTimeline {
+        public:
+            explicit GpioTimeline(std::FILE* output);
+            GpioTimeline(const GpioTimeline&) = delete;
+            GpioTimeline& operator=(const GpioTimeline&) = delete;
+
+            void record(const std::string& event, std::uint32_t value, std::uint32_t gpio_level);
+            std::vector<timeline_entry> get_entries() const;
+
+        private:
+            std::FILE* m_output;
+            const std::chrono::steady_clock::time_point m_start;
+            mutable std::mutex m_mutex;
+            std::vector<timeline_entry> m_entries;
+    };
+
+    /*
+    Userspace model of the led_lamp_driver kernel module (kernel_driver/src/led_lamp_main.c).
+    The commands run through the same state machine as in the module (lamp_state_machine.c), so
+    the timeline shows the register writes of the module. It mirrors the protocol and the timing
+    of the module:
+        - writes are parsed with sscanf("%d") into the commands 0-8, everything else is ignored
+        - 0-2 set and 3-5 clear a lamp pin through GPSET0/GPCLR0, 8 clears all pins and the state
+          with a single GPCLR0 write
+        - the lightplays 6 and 7 take 3 lightplay steps under the lamp state mutex and restore
+          the LED state afterwards
+        - reads return the 3-byte lamp_state array
+        - the detection IRQ waits 100 ms, creates the device file and greets with lightplay 1,
+          the shutdown IRQ says goodbye with lightplay 2 and removes the device file
+    Like in the module, lamp_state survives a shutdown even though all pins end up cleared.
+    The device file itself is managed by the owner through the device callback.
+    */
+    class SimulatedLampDriver {
+        public:
+            using device_callback = std::function<void(bool present)>;
+
+            SimulatedLampDriver(GpioTimeline& timeline, std::chrono::milliseconds lightplay_step, device_callback on_device_change);
+            SimulatedLampDriver() = delete;
+            SimulatedLampDriver(const SimulatedLampDriver&) = delete;
+            SimulatedLampDriver& operator=(const SimulatedLampDriver&) = delete;
+
+            // syscall_write - one command per write, returns false if nothing was executed
+            bool write(const std::string& data);
+            // syscall_read
+            std::array<char, 3> read() const;
+
+            void detection_irq();
+            void shutdown_irq();
+
+            bool is_activated() const;
+            std::uint32_t get_gpio_level() const;
+
+        private:
+            static void write_register(void* context, unsigned int offset, unsigned int value);
+            static void sleep_ms(void* context, unsigned int ms);
+            static const lamp_gpio_ops GPIO_OPS;
+
+            void init_direct_register_leds();
+            void record_event(const std::string& event, std::uint32_t value);
+
+            GpioTimeline& m_timeline;
+            device_callback m_on_device_change;
+
+            mutable std::mutex m_lamp_state_mutex;
+            lamp_state_machine m_state_machine;
+            mutable std::mutex m_dev_file_mutex;
+            bool m_lamp_activated;
+
+            mutable std::mutex m_register_mutex;
+            std::array<std::uint32_t, 3> m_gpfsel;
+            std::uint32_t m_gpio_level;
+    };
+
+} /* namespace printer_lamp */
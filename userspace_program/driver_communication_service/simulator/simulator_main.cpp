@@ -0,0 +1,295 @@
+/*
+Userspace simulator of the led_lamp_driver kernel module for soak and latency tests of the
+driver interaction service without a Raspberry Pi. The device file is a FIFO that speaks the
+text protocol of the module ("<command>\n"), the 3-byte lamp_state is published next to it in
+<device>.state, and every simulated GPIO register write is written to the timeline (CSV).
+
+    $ ./build/bin/lamp_simulator [--device=/tmp/printer_lamp] [--timeline=<csv file>] [--lightplay-ms=100]
+                                 [--present-ms=N --absent-ms=M] [--start-absent]
+
+    --present-ms/--absent-ms  appear/disappear cycle of the device file (shutdown and detection IRQ)
+    SIGUSR1 / SIGUSR2         trigger the shutdown / detection IRQ by hand
+    SIGINT / SIGTERM          remove the device file and exit
+
+Point the service to it with device_backend = emulated and device_path = <device>. Unlike the
+char device, a write into the FIFO returns before a lightplay is over - the commands behind it
+are delayed by the simulator instead.
+*/
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+
+#include "lamp_simulator.hpp"
+
+namespace {
+    struct simulator_options {
+        std::string device_path {"/tmp/printer_lamp"};
+        std::string timeline_path {""};
+        long lightplay_ms {100};
+        long present_ms {0};
+        long absent_ms {0};
+        bool start_absent {false};
+    };
+
+    simulator_options parse_options(int argc, char* argv[]) {
+        simulator_options options;
+        for (int idx = 1; idx < argc; idx++) {
+            const std::string arg = argv[idx];
+            const std::size_t separator = arg.find('=');
+            const std::string name = arg.substr(0, separator);
+            const std::string value = (separator == std::string::npos) ? "" : arg.substr(separator + 1);
+            if (name == "--device") {
+                options.device_path = value;
+            } else if (name == "--timeline") {
+                options.timeline_path = value;
+            } else if (name == "--lightplay-ms") {
+                options.lightplay_ms = std::atol(value.c_str());
+            } else if (name == "--present-ms") {
+                options.present_ms = std::atol(value.c_str());
+            } else if (name == "--absent-ms") {
+                options.absent_ms = std::atol(value.c_str());
+            } else if (name == "--start-absent") {
+                options.start_absent = true;
+            } else {
+                std::cerr << "Unknown option " << arg << "\n";
+                std::exit(1);
+            }
+        }
+        return options;
+    }
+
+    /*
+    The device file of the simulator: a FIFO for the commands and <path>.state for the lamp
+    state. The generation counter tells the reading thread that the FIFO was replaced.
+    */
+    class SimulatedDeviceFile {
+        public:
+            explicit SimulatedDeviceFile(std::string path) : m_path{std::move(path)}, m_state_path{m_path + ".state"} {}
+
+            void set_present(bool present) {
+                if (present) {
+                    ::unlink(m_path.c_str());
+                    if (::mkfifo(m_path.c_str(), 0666) != 0) {
+                        std::perror("Could not create the device FIFO");
+                    }
+                } else {
+                    ::unlink(m_path.c_str());
+                    ::unlink(m_state_path.c_str());
+                }
+                m_present = present;
+                m_generation.fetch_add(1);
+            }
+
+            void publish_state(const std::array<char, 3>& lamp_state) const {
+                if (!m_present) {
+                    return;
+                }
+                // written next to the file and renamed, so readers never see a partial state
+                const std::string tmp_path = m_state_path + ".tmp";
+                const int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if (fd < 0) {
+                    return;
+                }
+                const bool written = ::write(fd, lamp_state.data(), lamp_state.size()) == static_cast<ssize_t>(lamp_state.size());
+                ::close(fd);
+                if (written) {
+                    ::rename(tmp_path.c_str(), m_state_path.c_str());
+                }
+            }
+
+            const std::string& get_path() const {
+                return m_path;
+            }
+
+            std::uint64_t get_generation() const {
+                return m_generation.load();
+            }
+
+        private:
+            const std::string m_path;
+            const std::string m_state_path;
+            std::atomic<bool> m_present {false};
+            std::atomic<std::uint64_t> m_generation {0};
+    };
+
+    // runs the (blocking) IRQ handlers, either on request or on the appear/disappear cycle
+    class IrqThread {
+        public:
+            IrqThread(printer_lamp::SimulatedLampDriver& driver, const simulator_options& options) :
+                m_driver{driver},
+                m_present_interval{options.present_ms},
+                m_absent_interval{options.absent_ms},
+                m_thread{&IrqThread::run, this}
+            {}
+
+            ~IrqThread() {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_running = false;
+                }
+                m_cv.notify_all();
+                m_thread.join();
+            }
+
+            void request(bool detection) {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    (detection ? m_detection_requested : m_shutdown_requested) = true;
+                }
+                m_cv.notify_all();
+            }
+
+        private:
+            void run() {
+                const bool cycle = m_present_interval.count() > 0 && m_absent_interval.count() > 0;
+                std::unique_lock<std::mutex> lock(m_mutex);
+                while (m_running) {
+                    const auto interval = m_driver.is_activated() ? m_present_interval : m_absent_interval;
+                    const bool requested = m_cv.wait_for(lock, cycle ? interval : std::chrono::hours(24), [this] {
+                        return !m_running || m_detection_requested || m_shutdown_requested;
+                    });
+                    if (!m_running) {
+                        return;
+                    }
+                    bool detection = m_detection_requested;
+                    bool shutdown = m_shutdown_requested;
+                    m_detection_requested = false;
+                    m_shutdown_requested = false;
+                    if (!requested && cycle) {
+                        detection = !m_driver.is_activated();
+                        shutdown = !detection;
+                    }
+                    lock.unlock();
+                    if (shutdown) {
+                        m_driver.shutdown_irq();
+                    }
+                    if (detection) {
+                        m_driver.detection_irq();
+                    }
+                    lock.lock();
+                }
+            }
+
+            printer_lamp::SimulatedLampDriver& m_driver;
+            const std::chrono::milliseconds m_present_interval;
+            const std::chrono::milliseconds m_absent_interval;
+            std::mutex m_mutex;
+            std::condition_variable m_cv;
+            bool m_running {true};
+            bool m_detection_requested {false};
+            bool m_shutdown_requested {false};
+            std::thread m_thread;
+    };
+
+    int create_signal_fd() {
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        sigaddset(&signals, SIGUSR1);
+        sigaddset(&signals, SIGUSR2);
+        // blocked before any thread is started, so only the signalfd receives them
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+        return signalfd(-1, &signals, SFD_CLOEXEC);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const simulator_options options = parse_options(argc, argv);
+    const int signal_fd = create_signal_fd();
+    if (signal_fd < 0) {
+        std::perror("Could not create the signalfd");
+        return 1;
+    }
+
+    std::FILE* timeline_file = options.timeline_path.empty() ? stdout : std::fopen(options.timeline_path.c_str(), "w");
+    if (timeline_file == nullptr) {
+        std::perror("Could not open the timeline file");
+        return 1;
+    }
+    printer_lamp::GpioTimeline timeline(timeline_file);
+    SimulatedDeviceFile device_file(options.device_path);
+    printer_lamp::SimulatedLampDriver driver(timeline, std::chrono::milliseconds(options.lightplay_ms), [&device_file, &driver](bool present) {
+        device_file.set_present(present);
+        device_file.publish_state(driver.read());
+    });
+    IrqThread irq_thread(driver, options);
+    if (!options.start_absent) {
+        irq_thread.request(true);
+    }
+    std::cerr << "Simulating the lamp driver on " << options.device_path << "\n";
+
+    int fifo_fd = -1;
+    std::uint64_t fifo_generation = 0;
+    std::string pending_input;
+    bool running = true;
+    while (running) {
+        // follow the device file - a removed FIFO takes the unread commands with it
+        if (fifo_generation != device_file.get_generation()) {
+            fifo_generation = device_file.get_generation();
+            if (fifo_fd >= 0) {
+                ::close(fifo_fd);
+                fifo_fd = -1;
+                pending_input.clear();
+            }
+            if (driver.is_activated()) {
+                // read-write, so the FIFO keeps a writer and never reports a hang up between two service connections
+                fifo_fd = ::open(device_file.get_path().c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+            }
+        }
+
+        pollfd poll_fds[2] = {{signal_fd, POLLIN, 0}, {fifo_fd, POLLIN, 0}};
+        if (::poll(poll_fds, fifo_fd >= 0 ? 2 : 1, 20) < 0 && errno != EINTR) {
+            std::perror("poll");
+            break;
+        }
+
+        if (poll_fds[0].revents & POLLIN) {
+            signalfd_siginfo info;
+            if (::read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                if (info.ssi_signo == SIGUSR1) {
+                    irq_thread.request(false);
+                } else if (info.ssi_signo == SIGUSR2) {
+                    irq_thread.request(true);
+                } else {
+                    running = false;
+                }
+            }
+        }
+
+        if (fifo_fd >= 0 && (poll_fds[1].revents & POLLIN)) {
+            char buffer[512];
+            const ssize_t received = ::read(fifo_fd, buffer, sizeof(buffer));
+            if (received > 0) {
+                pending_input.append(buffer, static_cast<std::size_t>(received));
+            }
+            // one command per line - the service writes "<command>\n" per write
+            std::size_t line_end = 0;
+            while ((line_end = pending_input.find('\n')) != std::string::npos) {
+                driver.write(pending_input.substr(0, line_end));
+                pending_input.erase(0, line_end + 1);
+                device_file.publish_state(driver.read());
+            }
+        }
+    }
+
+    if (fifo_fd >= 0) {
+        ::close(fifo_fd);
+    }
+    device_file.set_present(false);
+    return 0;
+}
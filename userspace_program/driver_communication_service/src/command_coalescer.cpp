@@ -0,0 +1,67 @@
+#include "command_coalescer.hpp"
+
+namespace printer_lamp {
+
+    namespace {
+        int count_leds(lamp_mask mask) {
+            return __builtin_popcount(mask);
+        }
+
+        // emits the writes that move the lamp from `current` to `target` for all LEDs in `touched`
+        known_lamp_state flush_segment(known_lamp_state current, lamp_mask target, lamp_mask touched, std::vector<int>& writes) {
+            // LEDs that have to be written: touched ones that are unknown or differ from the target
+            const lamp_mask to_write = touched & static_cast<lamp_mask>(~current.known | (current.value ^ target));
+
+            known_lamp_state result;
+            result.known = current.known | touched;
+            result.value = static_cast<lamp_mask>((target & touched) | (current.value & ~touched));
+
+            // alternative: one reset followed by switching on every LED that stays on - only
+            // possible if the final value of every LED is known
+            const bool reset_possible = (result.known == ALL_LEDS);
+            const int single_writes = count_leds(to_write);
+            const int reset_writes = 1 + count_leds(result.value);
+
+            if (reset_possible && reset_writes < single_writes) {
+                writes.push_back(COMMAND_RESET_ALL);
+                for (int idx = 0; idx < NUM_LEDS; idx++) {
+                    if (result.value & (1u << idx)) {
+                        writes.push_back(led_on_command(idx));
+                    }
+                }
+                return result;
+            }
+
+            for (int idx = 0; idx < NUM_LEDS; idx++) {
+                if (to_write & (1u << idx)) {
+                    writes.push_back((target & (1u << idx)) ? led_on_command(idx) : led_off_command(idx));
+                }
+            }
+            return result;
+        }
+    } /* anonymous namespace */
+
+    known_lamp_state coalesce_commands(const std::vector<int>& pending, known_lamp_state current, std::vector<int>& writes) {
+        writes.clear();
+
+        lamp_mask target = current.value;
+        lamp_mask touched = 0;
+        for (int command : pending) {
+            if (!is_valid_command(command)) {
+                continue;
+            }
+            if (is_effect_command(command)) {
+                // the lightplay restores the state the lamp has when it is invoked - apply everything before it first
+                current = flush_segment(current, target, touched, writes);
+                writes.push_back(command);
+                target = current.value;
+                touched = 0;
+                continue;
+            }
+            target = apply_command(target, command);
+            touched |= command_leds(command);
+        }
+        return flush_segment(current, target, touched, writes);
+    }
+
+} /* namespace printer_lamp */
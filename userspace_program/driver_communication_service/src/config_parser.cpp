@@ -1,11 +1,197 @@
 #include "config_parser.hpp"
 
 #include <boost/program_options.hpp>
+#include <algorithm>
+#include <cctype>
 #include <iostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
 #include <INIReader.h>
+#include <ini.h>
+
+#include "lamp_state.hpp"
+#include "logger.hpp"
 
 namespace printer_lamp {
 
+    namespace {
+        struct section_collector {
+            std::string section;
+            std::map<std::string, std::string> values;
+        };
+
+        // INIReader can not enumerate the keys of a section, so the scenes are collected with the plain inih parser
+        int collect_section_values(void* user, const char* section, const char* name, const char* value) {
+            auto* collector = static_cast<section_collector*>(user);
+            if (collector->section == section) {
+                collector->values[name] = value;
+            }
+            return 1;
+        }
+
+        constexpr const char* LAMP_SECTION_PREFIX = "LAMP.";
+
+        // names of the [LAMP.<name>] sections in the order of the file
+        int collect_lamp_sections(void* user, const char* section, const char* /*name*/, const char* /*value*/) {
+            auto* lamp_names = static_cast<std::vector<std::string>*>(user);
+            const std::string section_name = section;
+            if (section_name.rfind(LAMP_SECTION_PREFIX, 0) == 0) {
+                const std::string lamp_name = section_name.substr(std::char_traits<char>::length(LAMP_SECTION_PREFIX));
+                if (std::find(lamp_names->begin(), lamp_names->end(), lamp_name) == lamp_names->end()) {
+                    lamp_names->push_back(lamp_name);
+                }
+            }
+            return 1;
+        }
+
+        device_config read_device_config(const INIReader& reader, const std::string& section, const device_config& defaults) {
+            device_config device;
+            device.backend = reader.Get(section, "device_backend", defaults.backend);
+            device.path = reader.Get(section, "device_path", defaults.path);
+            device.latency_us = reader.GetInteger(section, "device_latency_us", defaults.latency_us);
+            device.failure_rate = reader.GetReal(section, "device_failure_rate", defaults.failure_rate);
+            if (device.backend != "chardev" && device.backend != "memory" && device.backend != "emulated") {
+                LAMP_LOG_ERROR("Unknown device backend " << device.backend);
+                throw std::invalid_argument("unknown device backend");
+            }
+            return device;
+        }
+
+        // the dbus rules: "/" or "/"-separated non-empty elements of [A-Za-z0-9_]
+        bool is_valid_object_path(const std::string& object_path) {
+            if (object_path.empty() || object_path[0] != '/') {
+                return false;
+            }
+            if (object_path.size() == 1) {
+                return true;
+            }
+            bool element_start = true;
+            for (std::size_t idx = 1; idx < object_path.size(); idx++) {
+                const char character = object_path[idx];
+                if (character == '/') {
+                    if (element_start) {
+                        return false;
+                    }
+                    element_start = true;
+                } else if (std::isalnum(static_cast<unsigned char>(character)) || character == '_') {
+                    element_start = false;
+                } else {
+                    return false;
+                }
+            }
+            return !element_start;
+        }
+
+        /*
+        Every [LAMP.<name>] section is one lamp with its own object path and device. The device keys
+        that are not set fall back to the ones of the [DRIVERSERVICE] section. Without any lamp
+        section, the service drives the single lamp of the [DRIVERSERVICE] section.
+        */
+        std::vector<lamp_config> parse_lamps(const std::string& path_to_config, const INIReader& reader, const bridge_config& service_config) {
+            std::vector<std::string> lamp_names;
+            ini_parse(path_to_config.c_str(), collect_lamp_sections, &lamp_names);
+            if (lamp_names.empty()) {
+                return {lamp_config{"", service_config.object_path, service_config.device, service_config.metrics_textfile_path, service_config.history_path, service_config.state_snapshot_path}};
+            }
+
+            std::vector<lamp_config> lamps;
+            std::set<std::string> object_paths;
+            std::set<std::string> device_paths;
+            std::set<std::string> history_paths;
+            std::set<std::string> state_snapshot_paths;
+            for (const std::string& lamp_name : lamp_names) {
+                const std::string section = LAMP_SECTION_PREFIX + lamp_name;
+                lamp_config lamp;
+                lamp.name = lamp_name;
+                lamp.object_path = reader.Get(section, "object_path", "");
+                lamp.device = read_device_config(reader, section, service_config.device);
+                lamp.metrics_textfile_path = reader.Get(section, "metrics_textfile_path", "");
+                lamp.history_path = reader.Get(section, "history_path", "");
+                lamp.state_snapshot_path = reader.Get(section, "state_snapshot_path", "");
+                if (lamp.name.empty() || lamp.object_path.empty()) {
+                    LAMP_LOG_ERROR("Lamp section [" << section << "] needs a name and an object_path");
+                    throw std::invalid_argument("incomplete lamp section");
+                }
+                // two lamps on one object or one device would steal each other's commands
+                if (!object_paths.insert(lamp.object_path).second) {
+                    LAMP_LOG_ERROR("Object path " << lamp.object_path << " of lamp " << lamp_name << " is already used by another lamp");
+                    throw std::invalid_argument("duplicate object path");
+                }
+                if (lamp.device.backend != "memory" && !device_paths.insert(lamp.device.path).second) {
+                    LAMP_LOG_ERROR("Device " << lamp.device.path << " of lamp " << lamp_name << " is already used by another lamp");
+                    throw std::invalid_argument("duplicate device path");
+                }
+                if (!lamp.history_path.empty() && !history_paths.insert(lamp.history_path).second) {
+                    LAMP_LOG_ERROR("History journal " << lamp.history_path << " of lamp " << lamp_name << " is already used by another lamp");
+                    throw std::invalid_argument("duplicate history path");
+                }
+                if (!lamp.state_snapshot_path.empty() && !state_snapshot_paths.insert(lamp.state_snapshot_path).second) {
+                    LAMP_LOG_ERROR("Shared lamp state " << lamp.state_snapshot_path << " of lamp " << lamp_name << " is already used by another lamp");
+                    throw std::invalid_argument("duplicate state snapshot path");
+                }
+                lamps.push_back(lamp);
+            }
+            return lamps;
+        }
+
+        std::vector<int> parse_command_list(const std::string& scene_name, const std::string& value) {
+            std::vector<int> commands;
+            std::stringstream stream(value);
+            std::string token;
+            while (std::getline(stream, token, ',')) {
+                const std::size_t begin = token.find_first_not_of(" \t");
+                const std::size_t end = token.find_last_not_of(" \t");
+                const std::string trimmed = (begin == std::string::npos) ? "" : token.substr(begin, end - begin + 1);
+
+                std::size_t parsed_chars = 0;
+                int command = -1;
+                try {
+                    command = std::stoi(trimmed, &parsed_chars);
+                } catch (const std::exception&) {
+                    parsed_chars = 0;
+                }
+                if (parsed_chars == 0 || parsed_chars != trimmed.size() || !is_valid_command(command)) {
+                    LAMP_LOG_ERROR("Invalid command '" << trimmed << "' in scene " << scene_name);
+                    throw std::invalid_argument("invalid scene");
+                }
+                commands.push_back(command);
+            }
+            if (commands.empty()) {
+                LAMP_LOG_ERROR("Scene " << scene_name << " does not contain any command");
+                throw std::invalid_argument("empty scene");
+            }
+            return commands;
+        }
+
+        std::map<std::string, std::vector<int>> parse_scenes(const std::string& path_to_config) {
+            section_collector collector {"SCENES", {}};
+            ini_parse(path_to_config.c_str(), collect_section_values, &collector);
+
+            std::map<std::string, std::vector<int>> scenes;
+            for (const auto& [scene_name, value] : collector.values) {
+                scenes[scene_name] = parse_command_list(scene_name, value);
+            }
+            return scenes;
+        }
+
+        std::map<std::string, lighting_effect> parse_effects(const std::string& path_to_config) {
+            section_collector collector {"EFFECTS", {}};
+            ini_parse(path_to_config.c_str(), collect_section_values, &collector);
+
+            std::map<std::string, lighting_effect> effects;
+            for (const auto& [effect_name, value] : collector.values) {
+                try {
+                    effects[effect_name] = parse_lighting_effect(value);
+                } catch (const std::invalid_argument& exc) {
+                    LAMP_LOG_ERROR("Invalid effect " << effect_name << ": " << exc.what());
+                    throw;
+                }
+            }
+            return effects;
+        }
+    } /* anonymous namespace */
+
     CommandLineParser::CommandLineParser(int & argc, const char * argv []) {
         try
         {
@@ -13,7 +199,8 @@ namespace printer_lamp {
           
             desc.add_options()
                 ("help,h", "Help screen")
-                ("config_path", value<std::string>()->default_value("/etc/octolamp/driver_service.ini"), "Path to the config file for the driver interaction service");
+                ("config_path", value<std::string>()->default_value("/etc/octolamp/driver_service.ini"), "Path to the config file for the driver interaction service")
+                ("session_bus", bool_switch(), "Register on the session bus instead of the system bus, e.g. on a private dbus-daemon for load tests");
 
           
             store(parse_command_line(argc, argv, desc), m_variables_map);
@@ -25,23 +212,83 @@ namespace printer_lamp {
         }
         catch (const error &ex)
         {
-          std::cerr << ex.what() << '\n';
+          LAMP_LOG_ERROR(ex.what());
         }
     }
 
     bridge_config CommandLineParser::get_config() {
         if (m_bridge_config.interface_name == "" && m_bridge_config.object_path == "") {
             try {
-                std::string path_to_config = m_variables_map["config_path"].as<std::string>();
-                INIReader reader(path_to_config);
-                m_bridge_config.interface_name =  reader.Get("DRIVERSERVICE", "interface_name", "UNKNOWN");
-                m_bridge_config.object_path = reader.Get("DRIVERSERVICE", "object_path", "UNKNOWN");
+                m_bridge_config = read_config_file(this->get_config_path());
             } catch (...) {
-                std::cout << "Could not parse config file\n";
+                LAMP_LOG_ERROR("Could not parse config file");
                 exit(1);
             }
         }
         
         return m_bridge_config;
     }
-}
\ No newline at end of file
+
+    std::string CommandLineParser::get_config_path() const {
+        return m_variables_map["config_path"].as<std::string>();
+    }
+
+    bool CommandLineParser::use_session_bus() const {
+        return m_variables_map.count("session_bus") != 0 && m_variables_map["session_bus"].as<bool>();
+    }
+
+    bridge_config read_config_file(const std::string& path_to_config) {
+        INIReader reader(path_to_config);
+        if (reader.ParseError() != 0) {
+            LAMP_LOG_ERROR("Could not read " << path_to_config << " (error " << reader.ParseError() << ")");
+            throw std::invalid_argument("unreadable config file");
+        }
+        bridge_config config;
+        config.interface_name =  reader.Get("DRIVERSERVICE", "interface_name", "UNKNOWN");
+        config.object_path = reader.Get("DRIVERSERVICE", "object_path", "UNKNOWN");
+        config.device = read_device_config(reader, "DRIVERSERVICE", device_config{});
+        config.queue_capacity = static_cast<std::size_t>(reader.GetInteger("DRIVERSERVICE", "queue_capacity", 64));
+        config.retry_interval_ms = reader.GetInteger("DRIVERSERVICE", "retry_interval_ms", 5000);
+        config.retry_initial_ms = reader.GetInteger("DRIVERSERVICE", "retry_initial_ms", 50);
+        config.absent_after_failures = reader.GetInteger("DRIVERSERVICE", "absent_after_failures", 3);
+        config.reconcile_interval_ms = reader.GetInteger("DRIVERSERVICE", "reconcile_interval_ms", 30000);
+        config.reply_deadline_ms = reader.GetInteger("DRIVERSERVICE", "reply_deadline_ms", 1000);
+        config.signal_min_interval_ms = reader.GetInteger("DRIVERSERVICE", "signal_min_interval_ms", 50);
+        config.metrics_textfile_path = reader.Get("DRIVERSERVICE", "metrics_textfile_path", "");
+        config.metrics_textfile_interval_ms = reader.GetInteger("DRIVERSERVICE", "metrics_textfile_interval_ms", 15000);
+        config.history_path = reader.Get("DRIVERSERVICE", "history_path", "");
+        config.state_snapshot_path = reader.Get("DRIVERSERVICE", "state_snapshot_path", "");
+        config.history_max_bytes = static_cast<std::size_t>(reader.GetInteger("DRIVERSERVICE", "history_max_bytes", 1048576));
+        config.resume_preempted_effects = reader.GetBoolean("DRIVERSERVICE", "resume_preempted_effects", false);
+        try {
+            config.minimum_log_level = parse_log_level(reader.Get("DRIVERSERVICE", "log_level", "info"));
+            config.log_output = parse_log_target(reader.Get("DRIVERSERVICE", "log_target", "stdout"));
+        } catch (const std::invalid_argument& exc) {
+            LAMP_LOG_ERROR("Invalid logging config: " << exc.what());
+            throw;
+        }
+        if (reader.GetInteger("DRIVERSERVICE", "queue_capacity", 64) < 1 || reader.GetInteger("DRIVERSERVICE", "history_max_bytes", 1048576) < 1 || config.retry_interval_ms < 1 || config.retry_initial_ms < 1 || config.reconcile_interval_ms < 1 ||
+            config.reply_deadline_ms < 0 || config.signal_min_interval_ms < 0 || config.metrics_textfile_interval_ms < 1 || config.absent_after_failures < 1) {
+            LAMP_LOG_ERROR("The queue capacity, the history size, absent_after_failures and the intervals of [DRIVERSERVICE] must be positive");
+            throw std::invalid_argument("invalid limits");
+        }
+        config.scenes = parse_scenes(path_to_config);
+        config.effects = parse_effects(path_to_config);
+        config.lamps = parse_lamps(path_to_config, reader, config);
+        const bool unknown_object_path = std::any_of(config.lamps.begin(), config.lamps.end(), [](const lamp_config& lamp) {
+            return lamp.object_path == "UNKNOWN";
+        });
+        if (config.interface_name == "UNKNOWN" || unknown_object_path) {
+            LAMP_LOG_ERROR("The interface_name and an object_path for every lamp are required");
+            throw std::invalid_argument("incomplete config");
+        }
+        for (const lamp_config& lamp : config.lamps) {
+            if (!is_valid_object_path(lamp.object_path)) {
+                LAMP_LOG_ERROR("Invalid object path " << lamp.object_path);
+                throw std::invalid_argument("invalid object path");
+            }
+        }
+        return config;
+    }
+
+} /* namespace printer_lamp */
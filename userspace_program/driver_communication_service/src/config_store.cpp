@@ -0,0 +1,133 @@
+#include "config_store.hpp"
+
+#include <stdexcept>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "config_parser.hpp"
+#include "logger.hpp"
+
+namespace printer_lamp {
+
+    ConfigStore::ConfigStore(bridge_config initial) :
+        m_version{0}
+    {
+        this->publish(std::move(initial));
+    }
+
+    config_snapshot ConfigStore::get() const {
+        return std::atomic_load_explicit(&m_current, std::memory_order_acquire);
+    }
+
+    config_snapshot ConfigStore::publish(bridge_config config) {
+        std::lock_guard<std::mutex> lock(m_publish_mutex);
+        config_snapshot snapshot = std::make_shared<const bridge_config>(std::move(config));
+        // the replaced snapshot is freed here unless a reader still holds it
+        std::atomic_store_explicit(&m_current, snapshot, std::memory_order_release);
+        m_version.fetch_add(1, std::memory_order_relaxed);
+        return snapshot;
+    }
+
+    std::uint64_t ConfigStore::get_version() const {
+        return m_version.load(std::memory_order_relaxed);
+    }
+
+    ConfigReloader::ConfigReloader(std::string config_path, ConfigStore& store, ServiceMetrics& metrics, apply_callback on_apply) :
+        m_config_path{std::move(config_path)},
+        m_store{store},
+        m_metrics{metrics},
+        m_on_apply{std::move(on_apply)},
+        m_event_fd{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)},
+        m_running{true},
+        m_requested{false}
+    {
+        if (m_event_fd < 0) {
+            throw std::runtime_error("could not create the eventfd of the config reloader");
+        }
+        m_thread = std::thread(&ConfigReloader::run, this);
+    }
+
+    ConfigReloader::~ConfigReloader() {
+        this->stop();
+        ::close(m_event_fd);
+    }
+
+    void ConfigReloader::request() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_requested) {
+                m_requested_at = std::chrono::steady_clock::now();
+            }
+            m_requested = true;
+        }
+        m_cv.notify_all();
+    }
+
+    void ConfigReloader::stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = false;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    int ConfigReloader::get_event_fd() const {
+        return m_event_fd;
+    }
+
+    void ConfigReloader::on_event() {
+        std::uint64_t published = 0;
+        if (::read(m_event_fd, &published, sizeof(published)) != sizeof(published)) {
+            return;
+        }
+        // several snapshots published in the meantime - only the latest one is applied
+        m_on_apply(m_store.get());
+        std::chrono::steady_clock::time_point requested_at;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            requested_at = m_published_request;
+        }
+        m_metrics.config_reload.record(std::chrono::steady_clock::now() - requested_at);
+        m_metrics.config_reloads.increment();
+    }
+
+    void ConfigReloader::run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_cv.wait(lock, [this] { return !m_running || m_requested; });
+            if (!m_running) {
+                return;
+            }
+            const auto requested_at = m_requested_at;
+            m_requested = false;
+            lock.unlock();
+
+            bool valid = true;
+            bridge_config config;
+            try {
+                config = read_config_file(m_config_path);
+            } catch (const std::exception&) {
+                valid = false; // read_config_file tells what is wrong
+            }
+
+            lock.lock();
+            if (!valid) {
+                LAMP_LOG_WARNING("Rejected the reload of " << m_config_path << ", keeping the running config");
+                m_metrics.config_reloads_rejected.increment();
+                continue;
+            }
+            m_published_request = requested_at;
+            m_store.publish(std::move(config));
+            LAMP_LOG_INFO("Reloaded " << m_config_path);
+            const std::uint64_t value = 1;
+            if (::write(m_event_fd, &value, sizeof(value)) != sizeof(value)) {
+                LAMP_LOG_ERROR("Could not hand the reloaded config over to the event loop");
+            }
+        }
+    }
+
+} /* namespace printer_lamp */
@@ -1,169 +1,633 @@
 #include "dbus_interaction.hpp"
 
-#include <iostream>
 #include <chrono>
-#include <thread>
+#include <map>
 #include <algorithm>
-#include <fstream>
-#include <filesystem>
 #include <cstdint>
 #include <cstring>
+#include <stdexcept>
+#include <ctime>
+#include <limits>
+#include <poll.h>
+#include <sys/epoll.h>
 
-//static inline const std::string DEVICE_FILE_PATH = "/home/jens/Desktop/testfile"; // For debugging
-static inline const std::string DEVICE_FILE_PATH = "/dev/printer_lamp";
+#include "logger.hpp"
 
 namespace printer_lamp {
-    DriverDbusBridge::DriverDbusBridge(std::unique_ptr<sdbus::IConnection>& connection, const bridge_config& dbus_config) : m_dbus_connection_ref{connection}, m_dbus_config{dbus_config}, m_lamp_state{-1} {
-        
+
+    namespace {
+        // created once - longer than the small string buffer, so every emission would allocate a temporary otherwise
+        const std::string STATE_SIGNAL_NAME = "current_lamp_state";
+        const std::string DEVICE_HEALTH_PROPERTY = "device_health";
+
+        // the device backends with a device file that can appear and disappear
+        bool has_device_file(const device_config& config) {
+            return config.backend == "chardev" || config.backend == "emulated";
+        }
+
+        std::unique_ptr<LampDevice> create_device_or_throw(const device_config& config) {
+            std::unique_ptr<LampDevice> device = create_lamp_device(config);
+            if (!device) {
+                throw std::invalid_argument("unknown device backend " + config.backend);
+            }
+            return device;
+        }
+
+        lamp_config service_lamp(const bridge_config& config) {
+            return lamp_config{"", config.object_path, config.device, config.metrics_textfile_path, config.history_path, config.state_snapshot_path};
+        }
+
+        // a transaction with a state change is a status change, one of lightplays only an effect
+        command_priority transaction_priority(const std::vector<int>& commands) {
+            command_priority priority = command_priority::effect;
+            for (const int command : commands) {
+                priority = std::max(priority, default_priority(command));
+            }
+            return priority;
+        }
+
+        // the lamp works without its history, so a journal that can not be opened is only logged
+        std::unique_ptr<HistoryJournal> open_history(const std::string& path, std::size_t max_bytes) {
+            if (path.empty()) {
+                return nullptr;
+            }
+            try {
+                return std::make_unique<HistoryJournal>(path, max_bytes);
+            } catch (const std::runtime_error& exc) {
+                LAMP_LOG_ERROR("Recording no history: " << exc.what());
+                return nullptr;
+            }
+        }
+
+        // same for the shared state, the clients can still ask over dbus
+        std::unique_ptr<StatePublisher> open_state_publisher(const std::string& path) {
+            if (path.empty()) {
+                return nullptr;
+            }
+            try {
+                return std::make_unique<StatePublisher>(path);
+            } catch (const std::runtime_error& exc) {
+                LAMP_LOG_ERROR("Publishing no shared lamp state: " << exc.what());
+                return nullptr;
+            }
+        }
+    } /* anonymous namespace */
+
+    DbusConnectionDispatcher::DbusConnectionDispatcher(sdbus::IConnection& connection, EventLoop& loop) :
+        m_connection{connection},
+        m_loop{loop},
+        m_fd{connection.getEventLoopPollData().fd}
+    {
+        m_loop.add_fd(m_fd, EPOLLIN, [this](std::uint32_t) {
+            while (m_connection.processPendingRequest()) {}
+        });
+        m_loop.add_prepare([this] { return this->prepare(); });
+    }
+
+    DbusConnectionDispatcher::~DbusConnectionDispatcher() {
+        m_loop.remove_fd(m_fd);
+    }
+
+    int DbusConnectionDispatcher::prepare() {
+        // messages that are already read or queued for sending do not make the fd readable again
+        while (m_connection.processPendingRequest()) {}
+
+        const sdbus::IConnection::PollData poll_data = m_connection.getEventLoopPollData();
+        std::uint32_t events = 0;
+        if (poll_data.events & POLLIN) {
+            events |= EPOLLIN;
+        }
+        if (poll_data.events & POLLOUT) {
+            events |= EPOLLOUT;
+        }
+        m_loop.modify_fd(poll_data.fd, events);
+
+        if (poll_data.timeout_usec == std::numeric_limits<std::uint64_t>::max()) {
+            return -1;
+        }
+        // the timeout is an absolute CLOCK_MONOTONIC time, rounded up so the loop does not wake up too early
+        timespec now {};
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        const std::uint64_t now_usec = static_cast<std::uint64_t>(now.tv_sec) * 1000000 + static_cast<std::uint64_t>(now.tv_nsec) / 1000;
+        if (poll_data.timeout_usec <= now_usec) {
+            return 0;
+        }
+        const std::uint64_t timeout_ms = (poll_data.timeout_usec - now_usec + 999) / 1000;
+        return static_cast<int>(std::min<std::uint64_t>(timeout_ms, std::numeric_limits<int>::max()));
+    }
+
+    DriverDbusBridge::DriverDbusBridge(std::unique_ptr<sdbus::IConnection>& connection, const config_snapshot& dbus_config) :
+        DriverDbusBridge(connection, dbus_config, service_lamp(*dbus_config))
+    {}
+
+    DriverDbusBridge::DriverDbusBridge(std::unique_ptr<sdbus::IConnection>& connection, const config_snapshot& dbus_config, const lamp_config& lamp, ServiceMetrics* shared_metrics) :
+        m_dbus_connection_ref{connection},
+        m_dbus_config{dbus_config},
+        m_lamp{lamp},
+        m_device{create_device_or_throw(lamp.device)},
+        m_owned_metrics{shared_metrics == nullptr ? std::make_unique<ServiceMetrics>() : nullptr},
+        m_metrics{shared_metrics == nullptr ? *m_owned_metrics : *shared_metrics},
+        m_pending_replies{std::chrono::milliseconds(dbus_config->reply_deadline_ms), dbus_config->queue_capacity, std::bind(&DriverDbusBridge::send_deferred_reply, this, std::placeholders::_1, std::placeholders::_2)},
+        m_signal_throttle{std::chrono::milliseconds(dbus_config->signal_min_interval_ms), m_metrics.signals_suppressed, std::bind(&DriverDbusBridge::emit_state_signal, this, std::placeholders::_1)},
+        m_history{open_history(lamp.history_path, dbus_config->history_max_bytes)},
+        m_state_publisher{open_state_publisher(lamp.state_snapshot_path)},
+        m_device_health{std::chrono::milliseconds(dbus_config->retry_initial_ms), std::chrono::milliseconds(dbus_config->retry_interval_ms), static_cast<unsigned>(dbus_config->absent_after_failures), std::bind(&DriverDbusBridge::on_device_health_changed, this, std::placeholders::_1)},
+        m_io_worker{*m_device, m_state_cache, m_metrics, dbus_config->queue_capacity, m_device_health, std::chrono::milliseconds(dbus_config->reconcile_interval_ms), std::bind(&DriverDbusBridge::on_state_written, this, std::placeholders::_1, std::placeholders::_2),
+            std::bind(&PendingReplies<sdbus::MethodCall>::cancel, &m_pending_replies, std::placeholders::_1), m_history.get()},
+        m_effect_engine{[this](const std::vector<int>& commands, command_priority priority) { return m_io_worker.enqueue_batch(commands, "effect", priority); }, m_metrics}
+    {
         using namespace std::placeholders;
-        m_dbus_object = sdbus::createObject(*m_dbus_connection_ref, m_dbus_config.object_path);
+        if (m_state_publisher) {
+            // continues the sequence of the snapshot readers already mapped, so it stays monotonic together with the signal
+            std::lock_guard<std::mutex> lock(m_last_update_mutex);
+            m_last_update.sequence = m_state_publisher->get_sequence();
+        }
+        m_dbus_object = sdbus::createObject(*m_dbus_connection_ref, m_lamp.object_path);
 
-        m_dbus_object->registerMethod(m_dbus_config.interface_name, "set_lamp_state", "i", "b", std::bind(&DriverDbusBridge::set_driver_state, this, _1)); // signature of the method is i => int as input parameter and b => bool as output parameter
-        m_dbus_object->registerMethod(m_dbus_config.interface_name, "get_lamp_state", "i", "i", std::bind(&DriverDbusBridge::get_current_lamp_state, this, _1));
-        m_dbus_object->registerSignal(m_dbus_config.interface_name, "current_lamp_state", "i");
+        m_dbus_object->registerMethod(dbus_config->interface_name, "set_lamp_state", "i", "b", std::bind(&DriverDbusBridge::set_driver_state, this, _1)); // signature of the method is i => int as input parameter and b => bool as output parameter
+        m_dbus_object->registerMethod(dbus_config->interface_name, "set_lamp_state_nowait", "i", "b", std::bind(&DriverDbusBridge::set_driver_state_nowait, this, _1)); // replies as soon as the command is queued
+        m_dbus_object->registerMethod(dbus_config->interface_name, "get_lamp_state", "i", "i", std::bind(&DriverDbusBridge::get_current_lamp_state, this, _1));
+        m_dbus_object->registerMethod(dbus_config->interface_name, "set_lamp_state_with_priority", "is", "b", std::bind(&DriverDbusBridge::set_driver_state_with_priority, this, _1)); // priority "status", "effect" or "maintenance"
+        m_dbus_object->registerMethod(dbus_config->interface_name, "set_lamp_commands", "ai", "b", std::bind(&DriverDbusBridge::set_driver_commands, this, _1)); // whole command sequence as one transaction
+        m_dbus_object->registerMethod(dbus_config->interface_name, "set_lamp_commands_with_priority", "ais", "b", std::bind(&DriverDbusBridge::set_driver_commands_with_priority, this, _1));
+        m_dbus_object->registerMethod(dbus_config->interface_name, "set_lamp_mask", "y", "b", std::bind(&DriverDbusBridge::set_driver_mask, this, _1)); // target LED bitmask, bit n = lamp_state[n] of the driver
+        m_dbus_object->registerMethod(dbus_config->interface_name, "set_lamp_scene", "s", "b", std::bind(&DriverDbusBridge::set_driver_scene, this, _1)); // named scene from the [SCENES] config section
+        m_dbus_object->registerMethod(dbus_config->interface_name, "get_io_stats", "", "a{st}", std::bind(&DriverDbusBridge::get_io_stats, this, _1));
+        m_dbus_object->registerMethod(dbus_config->interface_name, "get_metrics", "", "a{st}", std::bind(&DriverDbusBridge::get_metrics, this, _1));
+        m_dbus_object->registerMethod(dbus_config->interface_name, "get_state_snapshot", "", "ity", std::bind(&DriverDbusBridge::get_state_snapshot, this, _1)); // same payload as current_lamp_state, e.g. after a reconnect
+        m_dbus_object->registerMethod(dbus_config->interface_name, "start_lamp_effect", "s", "b", std::bind(&DriverDbusBridge::start_effect, this, _1)); // named effect from the [EFFECTS] config section
+        m_dbus_object->registerMethod(dbus_config->interface_name, "stop_lamp_effect", "", "b", std::bind(&DriverDbusBridge::stop_effect, this, _1));
+        m_dbus_object->registerMethod(dbus_config->interface_name, "get_history", "xu", "a(txiysuu)", std::bind(&DriverDbusBridge::get_history, this, _1)); // state changes since a unix time in ms, at most the given number
+        m_dbus_object->registerSignal(dbus_config->interface_name, STATE_SIGNAL_NAME, "ity"); // last applied command, state sequence number, LED bitmask
+        m_dbus_object->registerProperty(dbus_config->interface_name, DEVICE_HEALTH_PROPERTY, "s", std::bind(&DriverDbusBridge::get_device_health, this, _1)); // "healthy", "degraded" or "absent", changes are signalled
 
         m_dbus_object->finishRegistration();
+
+        if (!m_lamp.metrics_textfile_path.empty()) {
+            // the samples of several lamps can be told apart in one textfile collector
+            const std::string labels = m_lamp.name.empty() ? "" : "lamp=\"" + m_lamp.name + "\"";
+            m_metrics_writer = std::make_unique<PrometheusTextfileWriter>(m_metrics, m_lamp.metrics_textfile_path, std::chrono::milliseconds(dbus_config->metrics_textfile_interval_ms), labels);
+        }
+    }
+
+    DriverDbusBridge::~DriverDbusBridge() {
+        this->detach();
+        // the effect engine feeds the worker and the worker calls back into this object, so both have to be joined before anything else is torn down
+        m_effect_engine.stop();
+        m_io_worker.stop();
+        m_signal_throttle.stop();
+        m_pending_replies.stop();
+        if (m_metrics_writer) {
+            m_metrics_writer->stop();
+        }
+    }
+
+    void DriverDbusBridge::attach_to(EventLoop& loop) {
+        m_event_loop.store(&loop); // first, so detach() also cleans up after a failed attach
+        loop.add_fd(m_effect_engine.get_timer_fd(), EPOLLIN, [this](std::uint32_t) { m_effect_engine.on_timer(); });
+        if (has_device_file(m_lamp.device)) {
+            m_device_watch = std::make_unique<DeviceWatch>(loop, m_lamp.device.path, [this](bool present) {
+                LAMP_LOG_INFO("Device file " << m_lamp.device.path << (present ? " appeared" : " disappeared"));
+                m_io_worker.notify_device_change();
+            });
+        }
+    }
+
+    void DriverDbusBridge::detach() {
+        EventLoop* loop = m_event_loop.exchange(nullptr);
+        if (loop == nullptr) {
+            return;
+        }
+        m_device_watch.reset();
+        loop->remove_fd(m_effect_engine.get_timer_fd());
+    }
+
+    void DriverDbusBridge::update_config(config_snapshot dbus_config) {
+        std::atomic_store_explicit(&m_dbus_config, std::move(dbus_config), std::memory_order_release);
+    }
+
+    config_snapshot DriverDbusBridge::get_config() const {
+        return std::atomic_load_explicit(&m_dbus_config, std::memory_order_acquire);
+    }
+
+    ServiceMetrics& DriverDbusBridge::get_service_metrics() {
+        return m_metrics;
+    }
+
+    void DriverDbusBridge::wakeup_event_loop() {
+        EventLoop* loop = m_event_loop.load();
+        if (loop != nullptr) {
+            loop->wakeup();
+        }
     }
 
     void DriverDbusBridge::set_driver_state(sdbus::MethodCall call) {
+        ScopedLatency latency(m_metrics.method(dbus_method::set_lamp_state));
         // get data from request
         int demanded_state = -1;
         call >> demanded_state;
-        
-        // answer the request
+        this->set_state_and_reply(call, demanded_state, default_priority(demanded_state));
+    }
+
+    void DriverDbusBridge::set_driver_state_with_priority(sdbus::MethodCall call) {
+        ScopedLatency latency(m_metrics.method(dbus_method::set_lamp_state_with_priority));
+        int demanded_state = -1;
+        std::string priority_name;
+        call >> demanded_state >> priority_name;
+
+        command_priority priority = command_priority::status;
+        if (!parse_command_priority(priority_name, priority)) {
+            LAMP_LOG_WARNING("Unknown priority " << priority_name << " requested. Sending error reply");
+            this->send_bool_reply(call, false);
+            return;
+        }
+        this->set_state_and_reply(call, demanded_state, priority);
+    }
+
+    void DriverDbusBridge::set_state_and_reply(sdbus::MethodCall& call, int demanded_state, command_priority priority) {
+        std::uint64_t sequence = 0;
+        if (!this->enqueue_state(demanded_state, sequence, call.getSender(), priority)) {
+            this->send_bool_reply(call, false);
+            return;
+        }
+        if (call.doesntExpectReply()) {
+            return;
+        }
+        // the reply is sent once the worker committed the command or the reply deadline expired - the event loop does not wait for it
+        m_pending_replies.add(sequence, std::move(call));
+    }
+
+    void DriverDbusBridge::send_deferred_reply(sdbus::MethodCall& call, bool committed) {
+        (committed ? m_metrics.replies_committed : m_metrics.replies_expired).increment();
+        try {
+            auto reply = call.createReply();
+            reply << committed;
+            reply.send();
+        } catch (const std::exception &exc) {
+            LAMP_LOG_ERROR("Could not send the deferred reply of set_lamp_state: " << exc.what());
+        }
+        this->wakeup_event_loop(); // sent from the worker or the pending replies thread, the loop flushes it
+    }
+
+    void DriverDbusBridge::set_driver_state_nowait(sdbus::MethodCall call) {
+        ScopedLatency latency(m_metrics.method(dbus_method::set_lamp_state_nowait));
+        int demanded_state = -1;
+        call >> demanded_state;
+
+        // fire and forget - the reply only tells that the command was queued
+        std::uint64_t sequence = 0;
+        this->send_bool_reply(call, this->enqueue_state(demanded_state, sequence, call.getSender(), default_priority(demanded_state)));
+    }
+
+    bool DriverDbusBridge::enqueue_state(int demanded_state, std::uint64_t& sequence, const char* caller, command_priority priority) {
+        // hand the command over to the driver I/O worker - the handlers never wait for the device
+        if ((demanded_state == -1) || (std::find(m_possible_states.begin(), m_possible_states.end(), demanded_state) == std::end(m_possible_states))) {
+            LAMP_LOG_WARNING("Invalid request detected. Sending error reply");
+            return false;
+        }
+        const bool suspended = this->give_way_to(priority);
+        if (!m_io_worker.enqueue(demanded_state, sequence, caller, priority)) {
+            LAMP_LOG_WARNING("Driver command queue is full. Rejecting state " << demanded_state);
+            if (suspended) {
+                this->resume_effect_after(0);
+            }
+            return false;
+        }
+        if (suspended) {
+            this->resume_effect_after(sequence);
+        }
+        return true;
+    }
+
+    bool DriverDbusBridge::give_way_to(command_priority priority) {
+        switch (priority) {
+            case command_priority::status:
+                if (this->get_config()->resume_preempted_effects) {
+                    return m_effect_engine.suspend();
+                }
+                // the restore belongs to the status command, so it is not cancelled by it
+                m_effect_engine.preempt(priority);
+                return false;
+            case command_priority::effect:
+                m_effect_engine.preempt();
+                return false;
+            default:
+                // maintenance commands are queued behind the steps of a running effect
+                return false;
+        }
+    }
+
+    void DriverDbusBridge::resume_effect_after(std::uint64_t sequence) {
+        {
+            std::lock_guard<std::mutex> lock(m_resume_mutex);
+            m_resume_after_sequence = std::max(m_resume_after_sequence, sequence);
+            if (m_resume_after_sequence > m_written_sequence) {
+                return; // resumed by on_state_written
+            }
+            m_resume_after_sequence = 0;
+        }
+        this->resume_effect();
+    }
+
+    void DriverDbusBridge::resume_effect() {
+        // the effect ends in the state the status command left behind
+        std::optional<lamp_mask> restore_leds;
+        if (m_state_cache.is_valid()) {
+            restore_leds = m_state_cache.get_mask();
+        }
+        m_effect_engine.resume(restore_leds);
+    }
+
+    void DriverDbusBridge::set_driver_commands(sdbus::MethodCall call) {
+        ScopedLatency latency(m_metrics.method(dbus_method::set_lamp_commands));
+        std::vector<int> commands;
+        call >> commands;
+
+        // validated once for the whole sequence - either all commands are applied or none
+        const bool valid = !commands.empty() && std::all_of(commands.begin(), commands.end(), is_valid_command);
+        if (!valid) {
+            LAMP_LOG_WARNING("Invalid command sequence detected. Sending error reply");
+        }
+        this->send_bool_reply(call, valid && this->enqueue_transaction(commands, call.getSender(), transaction_priority(commands)));
+    }
+
+    void DriverDbusBridge::set_driver_commands_with_priority(sdbus::MethodCall call) {
+        ScopedLatency latency(m_metrics.method(dbus_method::set_lamp_commands_with_priority));
+        std::vector<int> commands;
+        std::string priority_name;
+        call >> commands >> priority_name;
+
+        command_priority priority = command_priority::status;
+        const bool valid = !commands.empty() && std::all_of(commands.begin(), commands.end(), is_valid_command) && parse_command_priority(priority_name, priority);
+        if (!valid) {
+            LAMP_LOG_WARNING("Invalid command sequence or priority detected. Sending error reply");
+        }
+        this->send_bool_reply(call, valid && this->enqueue_transaction(commands, call.getSender(), priority));
+    }
+
+    void DriverDbusBridge::set_driver_mask(sdbus::MethodCall call) {
+        ScopedLatency latency(m_metrics.method(dbus_method::set_lamp_mask));
+        std::uint8_t mask = 0;
+        call >> mask;
+
+        if (mask & ~ALL_LEDS) {
+            LAMP_LOG_WARNING("Invalid lamp mask " << static_cast<int>(mask) << " detected. Sending error reply");
+            this->send_bool_reply(call, false);
+            return;
+        }
+        // one explicit command per LED - the worker coalesces them into the writes that are actually needed
+        std::vector<int> commands;
+        for (int led_idx = 0; led_idx < NUM_LEDS; led_idx++) {
+            commands.push_back((mask & (1u << led_idx)) ? led_on_command(led_idx) : led_off_command(led_idx));
+        }
+        this->send_bool_reply(call, this->enqueue_transaction(commands, call.getSender(), command_priority::status));
+    }
+
+    void DriverDbusBridge::set_driver_scene(sdbus::MethodCall call) {
+        ScopedLatency latency(m_metrics.method(dbus_method::set_lamp_scene));
+        std::string scene_name;
+        call >> scene_name;
+
+        const config_snapshot config = this->get_config(); // one snapshot, even if a reload swaps it meanwhile
+        const auto& scenes = config->scenes;
+        const auto scene = scenes.find(scene_name);
+        if (scene == scenes.end()) {
+            LAMP_LOG_WARNING("Unknown scene " << scene_name << " requested. Sending error reply");
+            this->send_bool_reply(call, false);
+            return;
+        }
+        this->send_bool_reply(call, this->enqueue_transaction(scene->second, call.getSender(), transaction_priority(scene->second)));
+    }
+
+    void DriverDbusBridge::start_effect(sdbus::MethodCall call) {
+        ScopedLatency latency(m_metrics.method(dbus_method::start_lamp_effect));
+        std::string effect_name;
+        call >> effect_name;
+
+        const config_snapshot config = this->get_config();
+        const auto& effects = config->effects;
+        const auto effect = effects.find(effect_name);
+        if (effect == effects.end()) {
+            LAMP_LOG_WARNING("Unknown effect " << effect_name << " requested. Sending error reply");
+            this->send_bool_reply(call, false);
+            return;
+        }
+        // the LED state is only restored afterwards if the service knows it
+        std::optional<lamp_mask> restore_leds;
+        if (m_state_cache.is_valid()) {
+            restore_leds = m_state_cache.get_mask();
+        }
+        this->send_bool_reply(call, m_effect_engine.start(effect->second, restore_leds));
+    }
+
+    void DriverDbusBridge::stop_effect(sdbus::MethodCall call) {
+        ScopedLatency latency(m_metrics.method(dbus_method::stop_lamp_effect));
+        this->send_bool_reply(call, m_effect_engine.preempt());
+    }
+
+    void DriverDbusBridge::get_history(sdbus::MethodCall call) {
+        ScopedLatency latency(m_metrics.method(dbus_method::get_history));
+        std::int64_t since_ms = 0;
+        std::uint32_t max_records = 0;
+        call >> since_ms >> max_records;
+
+        // sequence, unix time in ms, command, LED bitmask (0xFF = unknown), caller, write latency in us, retries
+        std::vector<sdbus::Struct<std::uint64_t, std::int64_t, std::int32_t, std::uint8_t, std::string, std::uint32_t, std::uint32_t>> records;
+        if (m_history) {
+            const auto since = std::chrono::system_clock::time_point(std::chrono::milliseconds(since_ms));
+            for (const history_entry& entry : m_history->read_since(since, max_records)) {
+                records.emplace_back(entry.sequence, entry.timestamp_ns / 1000000, entry.command, entry.mask, entry.caller, entry.write_latency_us, entry.retries);
+            }
+        }
         try {
             auto reply = call.createReply();
-            if ((demanded_state == -1) || (std::find(m_possible_states.begin(), m_possible_states.end(), demanded_state) == std::end(m_possible_states))) {
-                std::cout << "Invalid request detected. Sending error reply\n";
-                reply << false;
-                reply.send();
-                return;
+            reply << records;
+            reply.send();
+        } catch (const std::exception &exc) {
+            LAMP_LOG_ERROR("Could not send a reply from the get_history dbus method: " << exc.what());
+        }
+    }
+
+    bool DriverDbusBridge::enqueue_transaction(const std::vector<int>& commands, const char* caller, command_priority priority) {
+        // new state commands take over right away - a running effect restores its LED state before them or is suspended
+        const bool suspended = this->give_way_to(priority);
+        std::uint64_t sequence = 0;
+        if (!m_io_worker.enqueue_batch(commands, sequence, caller, priority)) {
+            LAMP_LOG_WARNING("Driver command queue can not take " << commands.size() << " more commands. Rejecting the request");
+            if (suspended) {
+                this->resume_effect_after(0);
             }
-            reply << true;
+            return false;
+        }
+        if (suspended) {
+            this->resume_effect_after(sequence);
+        }
+        return true;
+    }
+
+    void DriverDbusBridge::send_bool_reply(sdbus::MethodCall& call, bool value) {
+        try {
+            auto reply = call.createReply();
+            reply << value;
             reply.send();
         } catch (...) {
-            std::cerr << "Could not send reply\n";
+            LAMP_LOG_ERROR("Could not send reply");
             exit(1);
         }
-            
-        // setting state via driver and set signal
-        // std::size_t retry_counter = 0;
-        //while (retry_counter < 5) {
-        while(true) {
-            if (this->write_to_driver(demanded_state)) {
-                std::cout << "State change to " << demanded_state << " successful\n";
-                m_lamp_state = demanded_state;
-                this->send_state_change_signal();
-                break;
-            } else {
-                std::cout << "Could not write to driver properly. Retrying...\n";
-                //retry_counter++;
-                std::this_thread::sleep_for(std::chrono::seconds(5));
+    }
+
+    void DriverDbusBridge::on_state_written(int state, std::uint64_t committed_sequence) {
+        lamp_state_update update;
+        {
+            std::lock_guard<std::mutex> lock(m_last_update_mutex);
+            m_last_update.state = state;
+            m_last_update.sequence++;
+            m_last_update.mask = m_state_cache.is_valid() ? m_state_cache.get_mask() : 0xFF;
+            update = m_last_update;
+        }
+        if (m_state_publisher) {
+            m_state_publisher->publish(update);
+        }
+        m_signal_throttle.publish(update);
+        m_pending_replies.commit(committed_sequence);
+
+        bool resume = false;
+        {
+            std::lock_guard<std::mutex> lock(m_resume_mutex);
+            m_written_sequence = committed_sequence;
+            if (m_resume_after_sequence != 0 && committed_sequence >= m_resume_after_sequence) {
+                m_resume_after_sequence = 0;
+                resume = true;
             }
         }
-        /*
-        if (retry_counter == 5) {
-            std::cerr << "Could not write to driver after 5 retrys - something bigger might have went wrong\n";
-            exit(1);
+        if (resume) {
+            this->resume_effect();
         }
-        */
     }
-    
-    int DriverDbusBridge::send_state_change_signal() const {
-        std::cout << "Sending the signal via dbus\n";
-        auto signal = m_dbus_object.get()->createSignal(m_dbus_config.interface_name, "current_lamp_state");
-        signal << m_lamp_state;
-        m_dbus_object.get()->emitSignal(signal);
+
+    lamp_state_update DriverDbusBridge::get_last_update() const {
+        std::lock_guard<std::mutex> lock(m_last_update_mutex);
+        return m_last_update;
     }
 
-    bool DriverDbusBridge::write_to_driver(int state) const {
-        std::cout << "Setting driver to state " << state << "\n";
-        if (!std::filesystem::exists(DEVICE_FILE_PATH)) {
-            std::cout << "Driver file does not exist\n";
-            return false;
+    void DriverDbusBridge::send_state_change_signal() {
+        this->emit_state_signal(this->get_last_update());
+    }
+
+    void DriverDbusBridge::emit_state_signal(const lamp_state_update& update) {
+        try {
+            auto signal = m_dbus_object->createSignal(this->get_config()->interface_name, STATE_SIGNAL_NAME);
+            signal << update.state << update.sequence << update.mask;
+            m_dbus_object->emitSignal(signal);
+            m_metrics.signals_emitted.increment();
+            this->wakeup_event_loop(); // usually emitted from the throttle thread
+        } catch (const std::exception &exc) {
+            LAMP_LOG_ERROR("Could not emit the current_lamp_state signal: " << exc.what());
         }
+    }
 
-        std::ofstream driver_file (DEVICE_FILE_PATH);
-        if (driver_file.is_open())
-        {
-          driver_file << state;
-          driver_file.close();
-          return true;
+    void DriverDbusBridge::get_device_health(sdbus::PropertyGetReply& reply) {
+        reply << std::string(DEVICE_HEALTH_NAMES[static_cast<std::size_t>(m_device_health.get())]);
+    }
+
+    void DriverDbusBridge::on_device_health_changed(device_health health) {
+        const char* name = DEVICE_HEALTH_NAMES[static_cast<std::size_t>(health)];
+        if (health == device_health::healthy) {
+            LAMP_LOG_INFO("Device " << m_lamp.device.path << " is " << name << " again");
+        } else {
+            LAMP_LOG_WARNING("Device " << m_lamp.device.path << " is " << name);
+        }
+        if (m_state_publisher) {
+            m_state_publisher->publish_health(health);
+        }
+        try {
+            m_dbus_object->emitPropertiesChangedSignal(this->get_config()->interface_name, {DEVICE_HEALTH_PROPERTY});
+            this->wakeup_event_loop(); // emitted from the worker thread
+        } catch (const std::exception &exc) {
+            LAMP_LOG_ERROR("Could not emit the device_health change: " << exc.what());
+        }
+    }
+
+    void DriverDbusBridge::get_state_snapshot(sdbus::MethodCall call) {
+        ScopedLatency latency(m_metrics.method(dbus_method::get_state_snapshot));
+        const lamp_state_update update = this->get_last_update();
+        try {
+            auto reply = call.createReply();
+            reply << update.state << update.sequence << update.mask;
+            reply.send();
+        } catch (const std::exception &exc) {
+            LAMP_LOG_ERROR("Could not send a reply from the get_state_snapshot dbus method: " << exc.what());
+        }
+    }
+
+    void DriverDbusBridge::get_io_stats(sdbus::MethodCall call) {
+        ScopedLatency latency(m_metrics.method(dbus_method::get_io_stats));
+        const io_stats stats = m_io_worker.get_stats();
+        // totals over all handlers, the per method histograms are available through get_metrics
+        std::uint64_t handler_calls = 0;
+        std::uint64_t handler_total_ns = 0;
+        std::uint64_t handler_max_ns = 0;
+        for (const LatencyHistogram& histogram : m_metrics.dbus_methods) {
+            handler_calls += histogram.get_count();
+            handler_total_ns += histogram.get_sum_ns();
+            handler_max_ns = std::max(handler_max_ns, histogram.get_max_ns());
+        }
+        std::map<std::string, std::uint64_t> values {
+            {"queue_depth", stats.queue_depth},
+            {"max_queue_depth", stats.max_queue_depth},
+            {"enqueued", stats.enqueued},
+            {"rejected", stats.rejected},
+            {"writes", stats.writes},
+            {"write_retries", stats.write_retries},
+            {"coalesced", stats.coalesced},
+            {"skipped_batches", stats.skipped_batches},
+            {"cancelled", stats.cancelled},
+            {"preempted_batches", stats.preempted_batches},
+            {"cache_reconciliations", m_state_cache.get_reconciliations()},
+            {"cache_mismatches", m_state_cache.get_mismatches()},
+            {"handler_calls", handler_calls},
+            {"handler_total_ns", handler_total_ns},
+            {"handler_max_ns", handler_max_ns}
+        };
+        try {
+            auto reply = call.createReply();
+            reply << values;
+            reply.send();
+        } catch (const std::exception &exc) {
+            LAMP_LOG_ERROR("Could not send a reply from the get_io_stats dbus method: " << exc.what());
+        }
+    }
+
+    void DriverDbusBridge::get_metrics(sdbus::MethodCall call) {
+        ScopedLatency latency(m_metrics.method(dbus_method::get_metrics));
+        try {
+            auto reply = call.createReply();
+            reply << m_metrics.snapshot();
+            reply.send();
+        } catch (const std::exception &exc) {
+            LAMP_LOG_ERROR("Could not send a reply from the get_metrics dbus method: " << exc.what());
         }
-        return false;
     }
 
     void DriverDbusBridge::get_current_lamp_state(sdbus::MethodCall call) {
+        ScopedLatency latency(m_metrics.method(dbus_method::get_lamp_state));
         // Whatever you send to it, you always get the current state. It is recommended to send the expected state
         int expected_state;
         call >> expected_state;
-        if (expected_state != m_lamp_state) {
-            std::cout << "WARNING: Expected state " << expected_state << " is unequal to the actual state " << m_lamp_state << "\n";
-            // TODO: Maybe I will do something with this information in the future
-        }
-        // Make driver systemcall for the system state (read out the driver file)
-        std::streampos size;
-        char * memblock;
-        std::ifstream file (DEVICE_FILE_PATH, std::ios::in|std::ios::binary|std::ios::ate);
-        if (file.is_open())
-        {
-            size = file.tellg();
-            memblock = new char [size];
-            file.seekg (0, std::ios::beg);
-            file.read (memblock, size);
-            file.close();
-        }
-        // send the state
 
-        int driver_state_int = lamp_state_to_int_state(memblock);
+        // answered from the state cache - the driver I/O worker keeps it in sync with the driver
+        const int driver_state_int = m_state_cache.get_int_state();
+        if (expected_state != driver_state_int) {
+            LAMP_LOG_DEBUG("Expected state " << expected_state << " is unequal to the actual state " << driver_state_int);
+        }
 
         try {
             auto reply = call.createReply();
             reply << driver_state_int;
             reply.send();
         } catch (const std::exception &exc) {
-            std::cerr << "Could not send a reply from the get_current_lamp_state debus method\n";
-            std::cerr << "message = " << exc.what() << "\n";
-            delete[] memblock;
-            return;
+            LAMP_LOG_ERROR("Could not send a reply from the get_current_lamp_state debus method: " << exc.what());
         }
-        delete[] memblock;
-    }
-
-    int DriverDbusBridge::lamp_state_to_int_state(char* driver_state) {
-        /*
-        blue green white
-        000 0
-        100 1
-        110 2
-        111 3
-        011 4
-        001 5
-        010 6
-        101 7
-        */
-
-       std::cout << "DEBUG: driver_state[0] is " << driver_state << "\n";
-        // if ((driver_state[0] == false) && (driver_state[1] == false) && (driver_state[2] == false)) {
-        //     return 0;
-        // } else if ((driver_state[0] == true) && (driver_state[1] == false) && (driver_state[2] == false)) {
-        //     return 1;
-        // }  else if ((driver_state[0] == true) && (driver_state[1] == true) && (driver_state[2] == false)) {
-        //     return 2;
-        // } else if ((driver_state[0] == true) && (driver_state[1] == true) && (driver_state[2] == true)) {
-        //     return 3;
-        // }  else if ((driver_state[0] == false) && (driver_state[1] == true) && (driver_state[2] == true)) {
-        //     return 4;
-        // }  else if ((driver_state[0] == false) && (driver_state[1] == false) && (driver_state[2] == true)) {
-        //     return 5;
-        // } else if ((driver_state[0] == false) && (driver_state[1] == true) && (driver_state[2] == false)) {
-        //     return 6;
-        // }  else if ((driver_state[0] == true) && (driver_state[1] == false) && (driver_state[2] == true)) {
-        //     return 7;
-        // } else {
-        //     return -1;
-        // }
-        return -1;
     }
 
 } /* namespace printer_lamp */
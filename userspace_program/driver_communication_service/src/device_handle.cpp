@@ -0,0 +1,106 @@
+#include "device_handle.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "logger.hpp"
+
+namespace printer_lamp {
+
+    // the kernel driver parses a single digit with sscanf, so every command is exactly one preformatted byte
+    static constexpr std::array<char, 9> COMMAND_BYTES = {'0', '1', '2', '3', '4', '5', '6', '7', '8'};
+
+    DeviceHandle::DeviceHandle(std::string device_path) : m_device_path{std::move(device_path)}, m_fd{-1} {}
+
+    DeviceHandle::~DeviceHandle() {
+        this->close();
+    }
+
+    bool DeviceHandle::write_command(int command) {
+        if (command < 0 || command >= static_cast<int>(COMMAND_BYTES.size())) {
+            return false;
+        }
+        if (!this->ensure_open()) {
+            return false;
+        }
+
+        ssize_t written = -1;
+        do {
+            written = ::pwrite(m_fd, &COMMAND_BYTES[command], 1, 0);
+        } while (written < 0 && errno == EINTR);
+
+        if (written != 1) {
+            this->handle_io_error(written < 0 ? errno : EIO);
+            return false;
+        }
+        return true;
+    }
+
+    bool DeviceHandle::read_state(std::array<char, 3>& lamp_state) {
+        if (!this->ensure_open()) {
+            return false;
+        }
+
+        ssize_t received = -1;
+        do {
+            received = ::pread(m_fd, lamp_state.data(), lamp_state.size(), 0);
+        } while (received < 0 && errno == EINTR);
+
+        if (received != static_cast<ssize_t>(lamp_state.size())) {
+            this->handle_io_error(received < 0 ? errno : EIO);
+            return false;
+        }
+        return true;
+    }
+
+    bool DeviceHandle::is_open() const {
+        return m_fd >= 0;
+    }
+
+    void DeviceHandle::close() {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    bool DeviceHandle::ensure_open() {
+        if (m_fd >= 0) {
+            // device_destroy() only unlinks the node, the cdev stays registered and an old descriptor would still reach the GPIOs
+            if (!this->device_node_removed()) {
+                return true;
+            }
+            LAMP_LOG_INFO("Device file " << m_device_path << " was removed - closing the handle");
+            this->close();
+        }
+
+        m_fd = ::open(m_device_path.c_str(), O_RDWR | O_CLOEXEC);
+        if (m_fd < 0) {
+            if (errno != ENOENT && errno != ENODEV && errno != ENXIO) {
+                LAMP_LOG_ERROR("Could not open " << m_device_path << ": " << std::strerror(errno));
+            }
+            return false;
+        }
+        return true;
+    }
+
+    bool DeviceHandle::device_node_removed() const {
+        struct stat device_stat;
+        if (::fstat(m_fd, &device_stat) != 0) {
+            return true;
+        }
+        return device_stat.st_nlink == 0;
+    }
+
+    void DeviceHandle::handle_io_error(int error_number) {
+        LAMP_LOG_ERROR("I/O on " << m_device_path << " failed: " << std::strerror(error_number));
+        if (error_number == ENODEV || error_number == ENOENT || error_number == ENXIO || error_number == EBADF || error_number == EIO) {
+            // the device went away underneath us - reopen lazily on the next access
+            this->close();
+        }
+    }
+
+} /* namespace printer_lamp */
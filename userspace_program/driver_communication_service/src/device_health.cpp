@@ -0,0 +1,52 @@
+#include "device_health.hpp"
+
+#include <algorithm>
+
+namespace printer_lamp {
+
+    DeviceHealth::DeviceHealth(std::chrono::milliseconds initial_backoff, std::chrono::milliseconds max_backoff, unsigned absent_after_failures, change_callback on_change) :
+        m_initial_backoff{std::max(std::chrono::milliseconds(1), std::min(initial_backoff, max_backoff))},
+        m_max_backoff{std::max(std::chrono::milliseconds(1), max_backoff)},
+        m_absent_after_failures{std::max(1u, absent_after_failures)},
+        m_on_change{std::move(on_change)},
+        m_backoff{m_initial_backoff},
+        m_random{std::random_device{}()}
+    {}
+
+    void DeviceHealth::on_access_succeeded() {
+        m_consecutive_failures.store(0, std::memory_order_relaxed);
+        m_backoff = m_initial_backoff;
+        this->set(device_health::healthy);
+    }
+
+    std::chrono::milliseconds DeviceHealth::on_access_failed() {
+        const std::uint32_t failures = m_consecutive_failures.fetch_add(1, std::memory_order_relaxed) + 1;
+        this->set(failures >= m_absent_after_failures ? device_health::absent : device_health::degraded);
+
+        // equal jitter: the upper half of the current backoff is random
+        const std::chrono::milliseconds::rep half = m_backoff.count() / 2;
+        std::uniform_int_distribution<std::chrono::milliseconds::rep> jitter(0, m_backoff.count() - half);
+        const std::chrono::milliseconds delay(half + jitter(m_random));
+        m_backoff = std::min(m_backoff * 2, m_max_backoff);
+        return delay;
+    }
+
+    void DeviceHealth::reset_backoff() {
+        m_backoff = m_initial_backoff;
+    }
+
+    device_health DeviceHealth::get() const {
+        return m_health.load(std::memory_order_relaxed);
+    }
+
+    std::uint32_t DeviceHealth::get_consecutive_failures() const {
+        return m_consecutive_failures.load(std::memory_order_relaxed);
+    }
+
+    void DeviceHealth::set(device_health health) {
+        if (m_health.exchange(health, std::memory_order_relaxed) != health && m_on_change) {
+            m_on_change(health);
+        }
+    }
+
+} /* namespace printer_lamp */
@@ -0,0 +1,435 @@
+#include "driver_io_worker.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "logger.hpp"
+
+namespace printer_lamp {
+
+    namespace {
+        void copy_caller(std::array<char, history_record::MAX_CALLER>& target, const char* caller) {
+            std::strncpy(target.data(), caller != nullptr ? caller : "", target.size() - 1);
+            target.back() = '\0';
+        }
+    } /* anonymous namespace */
+
+    bool parse_command_priority(const std::string& name, command_priority& priority) {
+        for (std::size_t idx = 0; idx < COMMAND_PRIORITY_NAMES.size(); idx++) {
+            if (name == COMMAND_PRIORITY_NAMES[idx]) {
+                priority = static_cast<command_priority>(idx);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    DriverIoWorker::DriverIoWorker(LampDevice& device, LampStateCache& state_cache, ServiceMetrics& metrics, std::size_t queue_capacity, DeviceHealth& health, std::chrono::milliseconds reconcile_interval,
+        state_written_callback on_state_written, command_cancelled_callback on_command_cancelled, HistoryJournal* history) :
+        m_device{device},
+        m_state_cache{state_cache},
+        m_metrics{metrics},
+        m_health{health},
+        m_queue_capacity{queue_capacity},
+        m_reconcile_interval{reconcile_interval},
+        m_on_state_written{std::move(on_state_written)},
+        m_on_command_cancelled{std::move(on_command_cancelled)},
+        m_history{history},
+        m_running{true}
+    {
+        // nothing on the path of a command allocates once the buffers are sized for a full queue
+        m_queue.reserve(queue_capacity);
+        m_batch.reserve(queue_capacity);
+        m_batch_entries.reserve(queue_capacity);
+        m_write_commands.reserve(queue_capacity);
+        m_cancelled_sequences.reserve(queue_capacity);
+        m_batch_lightplays.reserve(queue_capacity);
+        m_resolving.reserve(queue_capacity);
+        m_thread = std::thread(&DriverIoWorker::run, this);
+    }
+
+    DriverIoWorker::~DriverIoWorker() {
+        this->stop();
+    }
+
+    void DriverIoWorker::stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_queue_mutex);
+            m_running = false;
+        }
+        m_queue_cv.notify_all();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    void DriverIoWorker::notify_device_change() {
+        {
+            std::lock_guard<std::mutex> lock(m_queue_mutex);
+            m_device_changed = true;
+        }
+        m_queue_cv.notify_all();
+    }
+
+    bool DriverIoWorker::enqueue(int state) {
+        std::uint64_t sequence = 0;
+        return this->enqueue_commands(&state, 1, sequence, nullptr, command_priority::status);
+    }
+
+    bool DriverIoWorker::enqueue(int state, std::uint64_t& sequence, const char* caller, command_priority priority) {
+        return this->enqueue_commands(&state, 1, sequence, caller, priority);
+    }
+
+    bool DriverIoWorker::enqueue_batch(const std::vector<int>& commands, const char* caller, command_priority priority) {
+        std::uint64_t sequence = 0;
+        return this->enqueue_commands(commands.data(), commands.size(), sequence, caller, priority);
+    }
+
+    bool DriverIoWorker::enqueue_batch(const std::vector<int>& commands, std::uint64_t& sequence, const char* caller, command_priority priority) {
+        return this->enqueue_commands(commands.data(), commands.size(), sequence, caller, priority);
+    }
+
+    bool DriverIoWorker::enqueue_commands(const int* commands, std::size_t count, std::uint64_t& sequence, const char* caller, command_priority priority) {
+        // all or nothing - a batch is queued as one unit so the worker takes it in one go
+        std::size_t depth = 0;
+        std::size_t cancelled = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_queue_mutex);
+            // status commands take over: queued commands of a lower priority give way to them, so they do not count against the capacity
+            const bool takes_over = priority == command_priority::status;
+            const std::size_t kept = !takes_over ? m_queue.size() : static_cast<std::size_t>(std::count_if(m_queue.begin(), m_queue.end(), [priority](const queued_command& queued) {
+                return queued.priority >= priority;
+            }));
+            if (count == 0 || kept + count > m_queue_capacity) {
+                m_rejected.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (kept < m_queue.size()) {
+                cancelled = m_queue.size() - kept;
+                for (const queued_command& queued : m_queue) {
+                    if (queued.priority < priority) {
+                        m_cancelled_sequences.push_back(queued.sequence);
+                    }
+                }
+                m_queue.erase(std::remove_if(m_queue.begin(), m_queue.end(), [priority](const queued_command& queued) {
+                    return queued.priority < priority;
+                }), m_queue.end());
+            }
+            if (takes_over && m_applying && m_batch_priority < priority) {
+                m_preempt_requested.store(true, std::memory_order_relaxed);
+            }
+            queued_command queued {0, 0, priority, std::chrono::steady_clock::now(), {}};
+            copy_caller(queued.caller, caller);
+            for (std::size_t idx = 0; idx < count; idx++) {
+                queued.sequence = m_next_sequence + idx + 1;
+                queued.command = commands[idx];
+                m_queue.push_back(queued);
+            }
+            m_next_sequence += count;
+            sequence = m_next_sequence;
+            depth = m_queue.size();
+        }
+        m_queue_cv.notify_one();
+
+        if (cancelled > 0) {
+            m_cancelled.fetch_add(cancelled, std::memory_order_relaxed);
+            m_metrics.commands_cancelled.increment(cancelled);
+        }
+        m_enqueued.fetch_add(count, std::memory_order_relaxed);
+        std::uint64_t max_depth = m_max_queue_depth.load(std::memory_order_relaxed);
+        while (depth > max_depth && !m_max_queue_depth.compare_exchange_weak(max_depth, depth, std::memory_order_relaxed)) {}
+        return true;
+    }
+
+    io_stats DriverIoWorker::get_stats() const {
+        io_stats stats;
+        {
+            std::lock_guard<std::mutex> lock(m_queue_mutex);
+            stats.queue_depth = m_queue.size();
+        }
+        stats.max_queue_depth = m_max_queue_depth.load(std::memory_order_relaxed);
+        stats.enqueued = m_enqueued.load(std::memory_order_relaxed);
+        stats.rejected = m_rejected.load(std::memory_order_relaxed);
+        stats.writes = m_writes.load(std::memory_order_relaxed);
+        stats.write_retries = m_metrics.write_retries.get();
+        stats.coalesced = m_coalesced.load(std::memory_order_relaxed);
+        stats.skipped_batches = m_skipped_batches.load(std::memory_order_relaxed);
+        stats.cancelled = m_cancelled.load(std::memory_order_relaxed);
+        stats.preempted_batches = m_preempted_batches.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void DriverIoWorker::reconcile_with_device() {
+        std::array<char, 3> lamp_state {};
+        bool read = false;
+        {
+            ScopedLatency latency(m_metrics.device_read);
+            read = m_device.read_state(lamp_state);
+        }
+        if (!read) {
+            return;
+        }
+        // only writes count as failures, a readable device is a healthy one
+        this->record_access(true);
+        const lamp_mask device_mask = mask_from_lamp_state(lamp_state);
+        m_state_cache.reconcile(device_mask);
+        m_known_state.value = device_mask;
+        m_known_state.known = ALL_LEDS;
+    }
+
+    bool DriverIoWorker::write_to_device(int command) {
+        const auto start = std::chrono::steady_clock::now();
+        const bool written = m_device.write_command(command);
+        const auto end = std::chrono::steady_clock::now();
+        m_metrics.device_write.record(end - start);
+
+        // the absent time is counted from the first failed write until the device accepts a write again
+        const bool absent = m_metrics.device_absent.load(std::memory_order_relaxed);
+        if (!written) {
+            m_metrics.device_write_failures.increment();
+            if (!absent) {
+                m_absent_since = start;
+                m_metrics.device_absent.store(true, std::memory_order_relaxed);
+            }
+        } else if (absent) {
+            m_metrics.device_absent_ns.increment(std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_absent_since).count());
+            m_metrics.device_absent.store(false, std::memory_order_relaxed);
+        }
+        this->record_access(written);
+        return written;
+    }
+
+    void DriverIoWorker::record_access(bool succeeded) {
+        if (succeeded) {
+            m_health.on_access_succeeded();
+        } else {
+            m_retry_delay = m_health.on_access_failed();
+        }
+        m_metrics.device_health.store(static_cast<std::uint8_t>(m_health.get()), std::memory_order_relaxed);
+    }
+
+    void DriverIoWorker::coalesce_batch() {
+        coalesce_commands(m_batch, m_known_state, m_write_commands);
+        if (m_write_commands.size() < m_batch.size()) {
+            m_coalesced.fetch_add(m_batch.size() - m_write_commands.size(), std::memory_order_relaxed);
+        }
+    }
+
+    void DriverIoWorker::take_queue() {
+        command_priority highest = command_priority::maintenance;
+        for (const queued_command& queued : m_queue) {
+            highest = std::max(highest, queued.priority);
+        }
+        std::size_t taken = 0;
+        for (std::size_t idx = 0; idx < m_queue.size(); idx++) {
+            if (m_queue[idx].priority == highest) {
+                taken = idx + 1;
+            }
+        }
+        for (std::size_t idx = 0; idx < taken; idx++) {
+            m_batch.push_back(m_queue[idx].command);
+            m_batch_entries.push_back(m_queue[idx]);
+            m_batch_priority = std::max(m_batch_priority, m_queue[idx].priority);
+            if (is_effect_command(m_queue[idx].command)) {
+                m_batch_lightplays.push_back(m_queue[idx].sequence);
+            }
+        }
+        m_batch_caller = m_queue[taken - 1].caller;
+        m_batch_sequence = m_queue[taken - 1].sequence;
+        m_queue.erase(m_queue.begin(), m_queue.begin() + static_cast<std::ptrdiff_t>(taken));
+        m_resolving.insert(m_resolving.end(), m_cancelled_sequences.begin(), m_cancelled_sequences.end());
+        m_cancelled_sequences.clear();
+        m_preempt_requested.store(false, std::memory_order_relaxed);
+    }
+
+    std::uint64_t DriverIoWorker::cut_short(std::size_t first_write) {
+        const std::size_t cancelled = m_write_commands.size() - first_write;
+        m_cancelled.fetch_add(cancelled, std::memory_order_relaxed);
+        m_metrics.commands_cancelled.increment(cancelled);
+        m_preempted_batches.fetch_add(1, std::memory_order_relaxed);
+
+        // the coalescer writes each segment between two lightplays as a unit, so with the next lightplay up all commands in front of it are written
+        if (first_write < m_write_commands.size() && is_effect_command(m_write_commands[first_write]) && !m_batch_lightplays.empty()) {
+            m_written_sequence = std::max(m_written_sequence, m_batch_lightplays.front() - 1);
+        }
+        // of the commands behind the last written segment nothing is certain
+        for (std::uint64_t sequence = std::max(m_written_sequence, m_resolved_sequence) + 1; sequence <= m_batch_sequence; sequence++) {
+            m_resolving.push_back(sequence);
+        }
+        m_resolved_sequence = m_batch_sequence;
+        m_batch_lightplays.clear();
+        return m_written_sequence;
+    }
+
+    void DriverIoWorker::drop_effects() {
+        const auto last = m_batch.end() - 1;
+        const auto kept_end = std::remove_if(m_batch.begin(), last, is_effect_command);
+        const std::size_t dropped = static_cast<std::size_t>(last - kept_end);
+        if (dropped > 0) {
+            m_batch.erase(kept_end, last);
+            m_cancelled.fetch_add(dropped, std::memory_order_relaxed);
+            m_metrics.commands_cancelled.increment(dropped);
+            // m_batch_lightplays holds the same lightplays in the same order
+            const auto cancelled_end = m_batch_lightplays.begin() + static_cast<std::ptrdiff_t>(dropped);
+            m_resolving.insert(m_resolving.end(), m_batch_lightplays.begin(), cancelled_end);
+            m_batch_lightplays.erase(m_batch_lightplays.begin(), cancelled_end);
+        }
+    }
+
+    void DriverIoWorker::resolve_cancelled() {
+        if (m_on_command_cancelled) {
+            for (std::uint64_t sequence : m_resolving) {
+                m_on_command_cancelled(sequence);
+            }
+        }
+        m_resolving.clear();
+    }
+
+    bool DriverIoWorker::apply_batch() {
+        int last_requested = m_batch.back();
+        bool cut_off = false;
+        std::uint64_t committed_sequence = 0;
+        std::uint32_t retries = 0;
+
+        if (m_known_state.known != ALL_LEDS) {
+            this->reconcile_with_device();
+        }
+        this->coalesce_batch();
+        if (m_write_commands.empty()) {
+            m_skipped_batches.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        std::size_t next_write = 0;
+        while (next_write < m_write_commands.size()) {
+            const int command = m_write_commands[next_write];
+            if (this->write_to_device(command)) {
+                m_known_state.value = apply_command(m_known_state.value, command);
+                m_known_state.known |= command_leds(command);
+                if (m_known_state.known == ALL_LEDS) {
+                    m_state_cache.update(m_known_state.value);
+                }
+                m_writes.fetch_add(1, std::memory_order_relaxed);
+                if (is_effect_command(command) && !m_batch_lightplays.empty()) {
+                    m_written_sequence = m_batch_lightplays.front();
+                    m_batch_lightplays.erase(m_batch_lightplays.begin());
+                }
+                next_write++;
+                if (next_write < m_write_commands.size() && m_preempt_requested.load(std::memory_order_relaxed)) {
+                    // a command of a higher priority is queued, the rest of this burst gives way to it
+                    // commands of a burst that was cut short are not recorded, the time until they were dropped says nothing
+                    cut_off = true;
+                    committed_sequence = this->cut_short(next_write);
+                    m_batch_entries.clear();
+                    last_requested = command;
+                    break;
+                }
+                continue;
+            }
+
+            // retry until the device accepts the command - only this thread waits for the device
+            LAMP_LOG_WARNING("Could not write to driver properly. Retrying in " << m_retry_delay.count() << " ms");
+            m_metrics.write_retries.increment();
+            retries++;
+            const auto retry_at = std::chrono::steady_clock::now() + m_retry_delay;
+            std::unique_lock<std::mutex> lock(m_queue_mutex);
+            while (true) {
+                const bool absent = m_health.get() == device_health::absent;
+                m_queue_cv.wait_until(lock, retry_at, [this, absent] {
+                    return !m_running || m_device_changed || m_preempt_requested.load(std::memory_order_relaxed) || (absent && !m_queue.empty());
+                });
+                if (!m_running) {
+                    return false;
+                }
+                const bool device_changed = m_device_changed;
+                if (device_changed) {
+                    m_device_changed = false;
+                    m_health.reset_backoff();
+                }
+                if (!m_queue.empty()) {
+                    // commands that arrived in the meantime are folded into the writes that are still missing - unless they preempt them
+                    if (m_preempt_requested.load(std::memory_order_relaxed)) {
+                        this->cut_short(next_write);
+                        m_batch.clear();
+                        m_batch_entries.clear();
+                        m_batch_priority = command_priority::maintenance;
+                    } else {
+                        m_batch.assign(m_write_commands.begin() + static_cast<std::ptrdiff_t>(next_write), m_write_commands.end());
+                    }
+                    this->take_queue();
+                    if (absent) {
+                        // the lamp is gone - keep the queue free and only remember where it has to end up
+                        while (!m_queue.empty()) {
+                            this->take_queue();
+                        }
+                        this->drop_effects();
+                        m_batch_entries.clear();
+                    }
+                    last_requested = m_batch.back();
+                    this->coalesce_batch();
+                    next_write = 0;
+                }
+                // while the device is absent new commands do not bring the retry forward
+                if (!absent || device_changed || std::chrono::steady_clock::now() >= retry_at) {
+                    break;
+                }
+            }
+            lock.unlock();
+            // the callers of dropped commands do not have to wait for the device to come back
+            this->resolve_cancelled();
+        }
+
+        const auto written = std::chrono::steady_clock::now();
+        for (const queued_command& queued : m_batch_entries) {
+            m_metrics.apply_latency(queued.priority).record(written - queued.enqueued);
+        }
+        LAMP_LOG_DEBUG("State change to " << last_requested << " successful");
+        if (m_history != nullptr) {
+            const std::uint8_t mask = (m_known_state.known == ALL_LEDS) ? static_cast<std::uint8_t>(m_known_state.value) : 0xFF;
+            m_history->append(last_requested, mask, m_batch_caller.data(), written - m_batch_start, retries);
+        }
+        if (!cut_off) {
+            committed_sequence = m_batch_sequence;
+            m_written_sequence = m_batch_sequence;
+            m_resolved_sequence = m_batch_sequence;
+            m_batch_lightplays.clear();
+        }
+        // cancelled commands are answered before the commit of the commands behind them
+        this->resolve_cancelled();
+        m_on_state_written(last_requested, committed_sequence);
+        return true;
+    }
+
+    void DriverIoWorker::run() {
+        std::unique_lock<std::mutex> lock(m_queue_mutex);
+        while (true) {
+            const bool woken = m_queue_cv.wait_for(lock, m_reconcile_interval, [this] { return !m_running || !m_queue.empty() || m_device_changed; });
+            if (!woken || (m_running && m_queue.empty())) {
+                // idle - compare the cache with what the driver actually reports, right away once the device changed
+                m_device_changed = false;
+                lock.unlock();
+                this->reconcile_with_device();
+                lock.lock();
+                continue;
+            }
+            if (!m_running) {
+                return;
+            }
+            // take the whole burst at once so it can be coalesced
+            m_batch.clear();
+            m_batch_entries.clear();
+            m_batch_priority = command_priority::maintenance;
+            this->take_queue();
+            m_applying = true;
+            m_batch_start = std::chrono::steady_clock::now();
+            lock.unlock();
+
+            const bool applied = this->apply_batch();
+            lock.lock();
+            m_applying = false;
+            if (!applied) {
+                return;
+            }
+        }
+    }
+
+} /* namespace printer_lamp */
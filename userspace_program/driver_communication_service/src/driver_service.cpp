@@ -0,0 +1,115 @@
+#include "driver_service.hpp"
+
+#include <algorithm>
+
+#include "logger.hpp"
+
+namespace printer_lamp {
+
+    namespace {
+        bool same_lamp(const lamp_config& lhs, const lamp_config& rhs) {
+            return lhs.name == rhs.name && lhs.object_path == rhs.object_path && lhs.metrics_textfile_path == rhs.metrics_textfile_path &&
+                lhs.history_path == rhs.history_path && lhs.state_snapshot_path == rhs.state_snapshot_path &&
+                lhs.device.backend == rhs.device.backend && lhs.device.path == rhs.device.path &&
+                lhs.device.latency_us == rhs.device.latency_us && lhs.device.failure_rate == rhs.device.failure_rate;
+        }
+
+        // the settings a bridge only reads when it is created
+        bool same_driver_limits(const bridge_config& lhs, const bridge_config& rhs) {
+            return lhs.interface_name == rhs.interface_name && lhs.queue_capacity == rhs.queue_capacity &&
+                lhs.retry_interval_ms == rhs.retry_interval_ms && lhs.retry_initial_ms == rhs.retry_initial_ms &&
+                lhs.absent_after_failures == rhs.absent_after_failures && lhs.reconcile_interval_ms == rhs.reconcile_interval_ms &&
+                lhs.reply_deadline_ms == rhs.reply_deadline_ms && lhs.signal_min_interval_ms == rhs.signal_min_interval_ms &&
+                lhs.metrics_textfile_interval_ms == rhs.metrics_textfile_interval_ms && lhs.history_max_bytes == rhs.history_max_bytes;
+        }
+
+        std::string display_name(const lamp_config& lamp) {
+            return lamp.name.empty() ? "default" : lamp.name;
+        }
+    } /* anonymous namespace */
+
+    DriverService::DriverService(std::unique_ptr<sdbus::IConnection>& connection, config_snapshot config) :
+        m_connection{connection},
+        m_config{std::move(config)}
+    {
+        for (const lamp_config& lamp : m_config->lamps) {
+            m_lamps.push_back({lamp, this->create_bridge(m_config, lamp)});
+            LAMP_LOG_INFO("Lamp " << display_name(lamp) << ": " << lamp.object_path << " -> " << lamp.device.path);
+        }
+        m_service_metrics = m_metrics.at(m_config->lamps.front().name).get();
+    }
+
+    DriverService::~DriverService() {
+        this->detach();
+        m_lamps.clear();
+    }
+
+    void DriverService::attach_to(EventLoop& loop) {
+        for (lamp_entry& entry : m_lamps) {
+            entry.bridge->attach_to(loop);
+        }
+        m_event_loop = &loop;
+    }
+
+    void DriverService::detach() {
+        for (lamp_entry& entry : m_lamps) {
+            entry.bridge->detach();
+        }
+        m_event_loop = nullptr;
+    }
+
+    void DriverService::apply(config_snapshot config) {
+        const bool same_limits = same_driver_limits(*m_config, *config);
+        // changed and removed lamps release their object path and device before any new bridge is created
+        for (lamp_entry& entry : m_lamps) {
+            const bool kept = same_limits && std::any_of(config->lamps.begin(), config->lamps.end(), [&entry](const lamp_config& lamp) {
+                return same_lamp(entry.lamp, lamp);
+            });
+            if (kept) {
+                entry.bridge->update_config(config);
+                continue;
+            }
+            LAMP_LOG_INFO("Stopping lamp " << display_name(entry.lamp) << " for the new config");
+            entry.bridge->detach();
+            entry.bridge.reset();
+        }
+
+        std::vector<lamp_entry> lamps;
+        for (const lamp_config& lamp : config->lamps) {
+            const auto running = std::find_if(m_lamps.begin(), m_lamps.end(), [&lamp](const lamp_entry& entry) {
+                return entry.bridge && entry.lamp.name == lamp.name;
+            });
+            if (running != m_lamps.end()) {
+                lamps.push_back(std::move(*running));
+                continue;
+            }
+            try {
+                std::unique_ptr<DriverDbusBridge> bridge = this->create_bridge(config, lamp);
+                if (m_event_loop != nullptr) {
+                    bridge->attach_to(*m_event_loop);
+                }
+                lamps.push_back({lamp, std::move(bridge)});
+            } catch (const std::exception& exc) {
+                // the other lamps keep running, the next reload tries again
+                LAMP_LOG_ERROR("Could not start lamp " << display_name(lamp) << ": " << exc.what());
+                continue;
+            }
+            LAMP_LOG_INFO("Started lamp " << display_name(lamp) << ": " << lamp.object_path << " -> " << lamp.device.path);
+        }
+        m_lamps = std::move(lamps);
+        m_config = std::move(config);
+    }
+
+    ServiceMetrics& DriverService::get_service_metrics() {
+        return *m_service_metrics;
+    }
+
+    std::unique_ptr<DriverDbusBridge> DriverService::create_bridge(const config_snapshot& config, const lamp_config& lamp) {
+        std::unique_ptr<ServiceMetrics>& metrics = m_metrics[lamp.name];
+        if (!metrics) {
+            metrics = std::make_unique<ServiceMetrics>();
+        }
+        return std::make_unique<DriverDbusBridge>(m_connection, config, lamp, metrics.get());
+    }
+
+} /* namespace printer_lamp */
@@ -0,0 +1,204 @@
+#include "effect_engine.hpp"
+
+#include <stdexcept>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "logger.hpp"
+
+namespace printer_lamp {
+
+    namespace {
+        // steady_clock is CLOCK_MONOTONIC on Linux, so its time points can be used as absolute timerfd deadlines
+        timespec to_timespec(std::chrono::steady_clock::time_point time_point) {
+            const auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(time_point.time_since_epoch());
+            timespec value {};
+            value.tv_sec = static_cast<time_t>(since_epoch.count() / 1000000000);
+            value.tv_nsec = static_cast<long>(since_epoch.count() % 1000000000);
+            return value;
+        }
+
+        // the timer is non blocking - a timer that was rearmed in the meantime has nothing to read
+        void drain(int fd) {
+            std::uint64_t value = 0;
+            while (::read(fd, &value, sizeof(value)) < 0 && errno == EINTR) {}
+        }
+    } /* anonymous namespace */
+
+    EffectEngine::EffectEngine(command_sink sink, ServiceMetrics& metrics) :
+        m_sink{std::move(sink)},
+        m_metrics{metrics},
+        m_timer_fd{timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)},
+        m_running{true},
+        m_active{false},
+        m_next_step{0}
+    {
+        if (m_timer_fd < 0) {
+            throw std::runtime_error("could not create the timer of the effect engine");
+        }
+        m_step_commands.reserve(2 * NUM_LEDS);
+    }
+
+    EffectEngine::~EffectEngine() {
+        this->stop();
+        ::close(m_timer_fd);
+    }
+
+    void EffectEngine::stop() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+        m_active = false;
+        m_suspended = false;
+        this->arm_timer();
+    }
+
+    int EffectEngine::get_timer_fd() const {
+        return m_timer_fd;
+    }
+
+    void EffectEngine::on_timer() {
+        drain(m_timer_fd);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_running) {
+            this->apply_due_steps();
+        }
+    }
+
+    bool EffectEngine::start(const lighting_effect& effect, std::optional<lamp_mask> restore_leds) {
+        if (effect.empty()) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running) {
+            return false;
+        }
+        if (m_active) {
+            // the replaced effect is not restored, the new one returns to the state before both of them
+            m_metrics.effects_preempted.increment();
+        } else {
+            m_restore_leds = restore_leds;
+        }
+        m_suspended = false;
+        m_effect = effect;
+        m_next_step = 0;
+        m_start = std::chrono::steady_clock::now();
+        m_active = true;
+        m_metrics.effects_started.increment();
+        this->arm_timer();
+        return true;
+    }
+
+    bool EffectEngine::preempt(command_priority priority) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_suspended) {
+            // the status command that suspended it already defines the LED state
+            m_suspended = false;
+            return true;
+        }
+        if (!m_active) {
+            return false;
+        }
+        // under the lock, so no step of the effect can be handed over after the restore
+        m_metrics.effects_preempted.increment();
+        this->finish_effect(priority);
+        return true;
+    }
+
+    bool EffectEngine::suspend() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_active) {
+            return m_suspended;
+        }
+        m_metrics.effects_preempted.increment();
+        m_active = false;
+        m_suspended = true;
+        m_suspended_at = std::chrono::steady_clock::now();
+        this->arm_timer();
+        return true;
+    }
+
+    bool EffectEngine::resume(std::optional<lamp_mask> restore_leds) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_suspended || !m_running) {
+            return false;
+        }
+        // the remaining steps are shifted by the suspended time, so they keep their spacing
+        m_start += std::chrono::steady_clock::now() - m_suspended_at;
+        m_restore_leds = restore_leds;
+        m_suspended = false;
+        m_active = true;
+        m_metrics.effects_resumed.increment();
+        this->arm_timer();
+        return true;
+    }
+
+    bool EffectEngine::is_running() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_active;
+    }
+
+    bool EffectEngine::is_suspended() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_suspended;
+    }
+
+    // expects m_mutex to be held
+    void EffectEngine::arm_timer() {
+        itimerspec deadline {}; // all zero disarms the timer
+        if (m_active && m_next_step < m_effect.size()) {
+            deadline.it_value = to_timespec(m_start + m_effect[m_next_step].offset);
+            if (deadline.it_value.tv_sec == 0 && deadline.it_value.tv_nsec == 0) {
+                deadline.it_value.tv_nsec = 1;
+            }
+        }
+        if (timerfd_settime(m_timer_fd, TFD_TIMER_ABSTIME, &deadline, nullptr) != 0) {
+            LAMP_LOG_ERROR("Could not arm the effect timer");
+        }
+    }
+
+    // expects m_mutex to be held
+    void EffectEngine::finish_effect(command_priority priority) {
+        m_active = false;
+        this->arm_timer();
+        if (!m_restore_leds) {
+            return;
+        }
+        m_step_commands.clear();
+        for (int led_idx = 0; led_idx < NUM_LEDS; led_idx++) {
+            m_step_commands.push_back((*m_restore_leds & (1u << led_idx)) ? led_on_command(led_idx) : led_off_command(led_idx));
+        }
+        if (!m_sink(m_step_commands, priority)) {
+            LAMP_LOG_WARNING("Could not restore the lamp state after the effect");
+        }
+    }
+
+    // expects m_mutex to be held
+    void EffectEngine::apply_due_steps() {
+        const auto now = std::chrono::steady_clock::now();
+        while (m_active && m_next_step < m_effect.size()) {
+            const auto deadline = m_start + m_effect[m_next_step].offset;
+            if (deadline > now) {
+                break;
+            }
+            // all steps with the same deadline are handed over together
+            m_step_commands.clear();
+            const auto offset = m_effect[m_next_step].offset;
+            while (m_next_step < m_effect.size() && m_effect[m_next_step].offset == offset) {
+                m_step_commands.push_back(m_effect[m_next_step].command);
+                m_next_step++;
+            }
+            m_metrics.effect_jitter.record(std::chrono::steady_clock::now() - deadline);
+            m_metrics.effect_steps.increment();
+            if (!m_sink(m_step_commands, command_priority::effect)) {
+                m_metrics.effect_steps_rejected.increment();
+            }
+        }
+        if (m_active && m_next_step >= m_effect.size()) {
+            this->finish_effect(command_priority::effect);
+            return;
+        }
+        this->arm_timer();
+    }
+
+} /* namespace printer_lamp */
@@ -0,0 +1,172 @@
+#include "event_loop.hpp"
+
+#include <chrono>
+#include <stdexcept>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+#include "logger.hpp"
+
+namespace printer_lamp {
+
+    namespace {
+        constexpr int MAX_EVENTS = 16;
+
+        void drain(int fd) {
+            std::uint64_t value = 0;
+            while (::read(fd, &value, sizeof(value)) < 0 && errno == EINTR) {}
+        }
+    } /* anonymous namespace */
+
+    EventLoop::EventLoop(LatencyHistogram& iteration_latency) :
+        m_epoll_fd{epoll_create1(EPOLL_CLOEXEC)},
+        m_wakeup_fd{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)},
+        m_iteration_latency{iteration_latency},
+        m_running{true}
+    {
+        if (m_epoll_fd < 0 || m_wakeup_fd < 0) {
+            throw std::runtime_error("could not create the event loop");
+        }
+        this->add_fd(m_wakeup_fd, EPOLLIN, [this](std::uint32_t) { drain(m_wakeup_fd); });
+    }
+
+    EventLoop::~EventLoop() {
+        ::close(m_wakeup_fd);
+        ::close(m_epoll_fd);
+    }
+
+    void EventLoop::add_fd(int fd, std::uint32_t events, fd_callback on_ready) {
+        auto callback = std::make_unique<registration>(registration{std::move(on_ready), true});
+        epoll_event event {};
+        event.events = events;
+        event.data.ptr = callback.get();
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            throw std::runtime_error("could not add a file descriptor to the event loop");
+        }
+        m_callbacks[fd] = std::move(callback);
+    }
+
+    void EventLoop::modify_fd(int fd, std::uint32_t events) {
+        const auto callback = m_callbacks.find(fd);
+        if (callback == m_callbacks.end()) {
+            return;
+        }
+        epoll_event event {};
+        event.events = events;
+        event.data.ptr = callback->second.get();
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &event);
+    }
+
+    void EventLoop::remove_fd(int fd) {
+        // the callback may be running or referenced by the events of the current iteration, so it is disabled and only freed after it
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        const auto callback = m_callbacks.find(fd);
+        if (callback != m_callbacks.end()) {
+            callback->second->active = false;
+            m_retired_callbacks.push_back(std::move(callback->second));
+            m_callbacks.erase(callback);
+        }
+    }
+
+    void EventLoop::add_prepare(prepare_callback prepare) {
+        m_prepare_callbacks.push_back(std::move(prepare));
+    }
+
+    void EventLoop::run() {
+        epoll_event events[MAX_EVENTS];
+        bool woken_up = false;
+        std::chrono::steady_clock::time_point wakeup_time;
+        while (m_running.load()) {
+            // the prepare callbacks flush what the dispatched events left behind, so they count to the iteration
+            int timeout_ms = -1;
+            for (const prepare_callback& prepare : m_prepare_callbacks) {
+                const int max_sleep_ms = prepare();
+                if (max_sleep_ms >= 0 && (timeout_ms < 0 || max_sleep_ms < timeout_ms)) {
+                    timeout_ms = max_sleep_ms;
+                }
+            }
+            if (woken_up) {
+                m_iteration_latency.record(std::chrono::steady_clock::now() - wakeup_time);
+            }
+            if (!m_running.load()) {
+                return;
+            }
+
+            const int num_events = epoll_wait(m_epoll_fd, events, MAX_EVENTS, timeout_ms);
+            wakeup_time = std::chrono::steady_clock::now();
+            woken_up = true;
+            if (num_events < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                LAMP_LOG_ERROR("Waiting for events failed, leaving the event loop");
+                return;
+            }
+            for (int idx = 0; idx < num_events; idx++) {
+                registration& callback = *static_cast<registration*>(events[idx].data.ptr);
+                if (callback.active) {
+                    callback.on_ready(events[idx].events);
+                }
+            }
+            m_retired_callbacks.clear();
+        }
+    }
+
+    void EventLoop::stop() {
+        m_running.store(false);
+        this->wakeup();
+    }
+
+    void EventLoop::wakeup() {
+        const std::uint64_t value = 1;
+        if (::write(m_wakeup_fd, &value, sizeof(value)) != sizeof(value)) {
+            LAMP_LOG_ERROR("Could not wake up the event loop");
+        }
+    }
+
+    DeviceWatch::DeviceWatch(EventLoop& loop, std::string device_path, change_callback on_change, bool watch_writes) :
+        m_loop{loop},
+        m_device_path{std::move(device_path)},
+        m_on_change{std::move(on_change)},
+        m_inotify_fd{inotify_init1(IN_NONBLOCK | IN_CLOEXEC)}
+    {
+        const std::size_t separator = m_device_path.find_last_of('/');
+        const std::string directory = (separator == std::string::npos) ? "." : (separator == 0 ? "/" : m_device_path.substr(0, separator));
+        m_file_name = (separator == std::string::npos) ? m_device_path : m_device_path.substr(separator + 1);
+        const std::uint32_t events = IN_CREATE | IN_DELETE | IN_ATTRIB | IN_MOVED_TO | IN_MOVED_FROM | (watch_writes ? IN_CLOSE_WRITE : 0);
+        if (m_inotify_fd < 0 || inotify_add_watch(m_inotify_fd, directory.c_str(), events) < 0) {
+            throw std::runtime_error("could not watch the device directory " + directory);
+        }
+        m_loop.add_fd(m_inotify_fd, EPOLLIN, [this](std::uint32_t) { this->on_events(); });
+    }
+
+    DeviceWatch::~DeviceWatch() {
+        m_loop.remove_fd(m_inotify_fd);
+        ::close(m_inotify_fd);
+    }
+
+    void DeviceWatch::on_events() {
+        alignas(inotify_event) char buffer[4096];
+        bool changed = false;
+        while (true) {
+            const ssize_t length = ::read(m_inotify_fd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                break;
+            }
+            for (ssize_t offset = 0; offset < length;) {
+                const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                if (event->len > 0 && m_file_name == event->name) {
+                    changed = true;
+                }
+                offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+            }
+        }
+        if (changed) {
+            m_on_change(::access(m_device_path.c_str(), F_OK) == 0);
+        }
+    }
+
+} /* namespace printer_lamp */
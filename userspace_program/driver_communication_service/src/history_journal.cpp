@@ -0,0 +1,150 @@
+#include "history_journal.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace printer_lamp {
+
+    namespace {
+        constexpr char MAGIC[8] = {'L', 'A', 'M', 'P', 'H', 'I', 'S', 'T'};
+        constexpr std::uint32_t VERSION = 1;
+    }
+
+    // first 64 bytes of the file
+    struct HistoryJournal::file_header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t record_size;
+        std::uint64_t capacity;
+        std::atomic<std::uint64_t> next_index; // records ever appended
+        char reserved[32];
+    };
+
+    HistoryJournal::HistoryJournal(const std::string& path, std::size_t max_bytes) :
+        m_fd{::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)},
+        m_mapping{MAP_FAILED},
+        m_mapping_size{0},
+        m_header{nullptr},
+        m_records{nullptr},
+        m_capacity{std::max<std::size_t>(max_bytes > sizeof(file_header) ? (max_bytes - sizeof(file_header)) / sizeof(history_record) : 0, 1)}
+    {
+        static_assert(sizeof(file_header) == 64, "the header layout is part of the file format");
+        if (m_fd < 0) {
+            throw std::runtime_error("could not open the history journal " + path);
+        }
+        m_mapping_size = sizeof(file_header) + m_capacity * sizeof(history_record);
+
+        // an existing journal is only continued if it has the same layout, otherwise it starts over
+        struct stat file_stat {};
+        file_header existing {};
+        const bool reusable = ::fstat(m_fd, &file_stat) == 0 && static_cast<std::size_t>(file_stat.st_size) == m_mapping_size &&
+            ::pread(m_fd, &existing, sizeof(existing), 0) == static_cast<ssize_t>(sizeof(existing)) &&
+            std::memcmp(existing.magic, MAGIC, sizeof(MAGIC)) == 0 && existing.version == VERSION &&
+            existing.record_size == sizeof(history_record) && existing.capacity == m_capacity;
+        if (!reusable && (::ftruncate(m_fd, 0) != 0 || ::ftruncate(m_fd, static_cast<off_t>(m_mapping_size)) != 0)) {
+            ::close(m_fd);
+            throw std::runtime_error("could not size the history journal " + path);
+        }
+
+        m_mapping = ::mmap(nullptr, m_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        if (m_mapping == MAP_FAILED) {
+            ::close(m_fd);
+            throw std::runtime_error("could not map the history journal " + path);
+        }
+        m_header = static_cast<file_header*>(m_mapping);
+        m_records = reinterpret_cast<history_record*>(static_cast<char*>(m_mapping) + sizeof(file_header));
+        if (!reusable) {
+            // the truncated file reads as zeros, so all records are already marked as incomplete
+            std::memcpy(m_header->magic, MAGIC, sizeof(MAGIC));
+            m_header->version = VERSION;
+            m_header->record_size = sizeof(history_record);
+            m_header->capacity = m_capacity;
+            m_header->next_index.store(0, std::memory_order_release);
+        }
+    }
+
+    HistoryJournal::~HistoryJournal() {
+        ::munmap(m_mapping, m_mapping_size);
+        ::close(m_fd);
+    }
+
+    history_record& HistoryJournal::slot(std::uint64_t index) const {
+        return m_records[index % m_capacity];
+    }
+
+    void HistoryJournal::append(int command, std::uint8_t mask, const char* caller, std::chrono::nanoseconds write_latency, std::uint32_t retries) {
+        const std::uint64_t index = m_header->next_index.fetch_add(1, std::memory_order_relaxed);
+        history_record& record = this->slot(index);
+
+        // mark the slot as incomplete before its fields change, readers skip it until the sequence is set again
+        record.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        record.write_latency_us = static_cast<std::uint32_t>(std::min<std::int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(write_latency).count(), UINT32_MAX));
+        record.command = command;
+        record.retries = static_cast<std::uint16_t>(std::min<std::uint32_t>(retries, UINT16_MAX));
+        record.mask = mask;
+        record.reserved = 0;
+        std::strncpy(record.caller, caller != nullptr ? caller : "", history_record::MAX_CALLER - 1);
+        record.caller[history_record::MAX_CALLER - 1] = '\0';
+        record.sequence.store(index + 1, std::memory_order_release);
+    }
+
+    std::vector<history_entry> HistoryJournal::read_since(std::chrono::system_clock::time_point since, std::size_t max_records) const {
+        const std::int64_t since_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(since.time_since_epoch()).count();
+        const std::uint64_t end = m_header->next_index.load(std::memory_order_acquire);
+        const std::uint64_t begin = end > m_capacity ? end - m_capacity : 0;
+
+        // walk back to the first record of the period, the timestamps only go backwards if the clock was set
+        std::uint64_t first = end;
+        while (first > begin) {
+            const history_record& record = this->slot(first - 1);
+            if (record.sequence.load(std::memory_order_acquire) == first && record.timestamp_ns < since_ns) {
+                break;
+            }
+            first--;
+        }
+
+        std::vector<history_entry> entries;
+        for (std::uint64_t index = first; index < end && entries.size() < max_records; index++) {
+            const history_record& record = this->slot(index);
+            const std::uint64_t sequence = record.sequence.load(std::memory_order_acquire);
+            if (sequence != index + 1) {
+                continue; // written right now or already overwritten
+            }
+            history_entry entry;
+            entry.sequence = sequence;
+            entry.timestamp_ns = record.timestamp_ns;
+            entry.write_latency_us = record.write_latency_us;
+            entry.command = record.command;
+            entry.mask = record.mask;
+            entry.retries = record.retries;
+            char caller[history_record::MAX_CALLER];
+            std::memcpy(caller, record.caller, sizeof(caller));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (record.sequence.load(std::memory_order_relaxed) != sequence) {
+                continue; // overwritten while it was copied
+            }
+            caller[sizeof(caller) - 1] = '\0';
+            entry.caller = caller;
+            if (entry.timestamp_ns >= since_ns) {
+                entries.push_back(std::move(entry));
+            }
+        }
+        return entries;
+    }
+
+    std::uint64_t HistoryJournal::get_appended() const {
+        return m_header->next_index.load(std::memory_order_acquire);
+    }
+
+    std::size_t HistoryJournal::get_capacity() const {
+        return m_capacity;
+    }
+
+} /* namespace printer_lamp */
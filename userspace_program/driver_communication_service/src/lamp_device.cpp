@@ -0,0 +1,158 @@
+#include "lamp_device.hpp"
+
+#include <chrono>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "device_handle.hpp"
+#include "logger.hpp"
+
+namespace printer_lamp {
+
+    namespace {
+        std::array<char, 3> mask_to_lamp_state(lamp_mask mask) {
+            std::array<char, 3> lamp_state {};
+            for (int idx = 0; idx < NUM_LEDS; idx++) {
+                lamp_state[idx] = (mask & (1u << idx)) ? 1 : 0;
+            }
+            return lamp_state;
+        }
+    } /* anonymous namespace */
+
+    bool MemoryDevice::write_command(int command) {
+        if (!is_valid_command(command)) {
+            return false;
+        }
+        m_mask = apply_command(m_mask, command);
+        m_write_count++;
+        return true;
+    }
+
+    bool MemoryDevice::read_state(std::array<char, 3>& lamp_state) {
+        lamp_state = mask_to_lamp_state(m_mask);
+        return true;
+    }
+
+    lamp_mask MemoryDevice::get_mask() const {
+        return m_mask;
+    }
+
+    std::uint64_t MemoryDevice::get_write_count() const {
+        return m_write_count;
+    }
+
+    EmulatedDevice::EmulatedDevice(std::string path) : m_path{std::move(path)}, m_state_path{m_path + ".state"}, m_fd{-1}, m_mask{0} {}
+
+    EmulatedDevice::~EmulatedDevice() {
+        this->close();
+    }
+
+    bool EmulatedDevice::ensure_open() {
+        if (m_fd >= 0) {
+            struct stat file_stat;
+            if (::fstat(m_fd, &file_stat) == 0 && file_stat.st_nlink > 0) {
+                return true;
+            }
+            this->close(); // the file was removed like the device file on the shutdown IRQ
+        }
+        // a FIFO without reader fails with ENXIO here, which counts as an absent device
+        m_fd = ::open(m_path.c_str(), O_WRONLY | O_APPEND | O_NONBLOCK | O_CLOEXEC);
+        return m_fd >= 0;
+    }
+
+    bool EmulatedDevice::write_command(int command) {
+        if (!is_valid_command(command) || !this->ensure_open()) {
+            return false;
+        }
+        const char message[] = {static_cast<char>('0' + command), '\n'};
+        ssize_t written = -1;
+        do {
+            written = ::write(m_fd, message, sizeof(message));
+        } while (written < 0 && errno == EINTR);
+
+        if (written != static_cast<ssize_t>(sizeof(message))) {
+            // EPIPE: the reader of the FIFO went away
+            this->close();
+            return false;
+        }
+        m_mask = apply_command(m_mask, command);
+        return true;
+    }
+
+    bool EmulatedDevice::read_state(std::array<char, 3>& lamp_state) {
+        if (!this->ensure_open()) {
+            return false;
+        }
+        // a simulator of the kernel driver publishes its lamp_state next to the device file
+        const int state_fd = ::open(m_state_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (state_fd >= 0) {
+            std::array<char, 3> reported {};
+            const ssize_t received = ::read(state_fd, reported.data(), reported.size());
+            ::close(state_fd);
+            if (received == static_cast<ssize_t>(reported.size())) {
+                lamp_state = reported;
+                return true;
+            }
+        }
+        lamp_state = mask_to_lamp_state(m_mask);
+        return true;
+    }
+
+    void EmulatedDevice::close() {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    FaultInjectingDevice::FaultInjectingDevice(std::unique_ptr<LampDevice> device, long latency_us, double failure_rate) :
+        m_device{std::move(device)},
+        m_latency_us{latency_us},
+        m_failure{failure_rate},
+        m_random{std::random_device{}()}
+    {}
+
+    bool FaultInjectingDevice::inject() {
+        if (m_latency_us > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(m_latency_us));
+        }
+        return !m_failure(m_random);
+    }
+
+    bool FaultInjectingDevice::write_command(int command) {
+        return this->inject() && m_device->write_command(command);
+    }
+
+    bool FaultInjectingDevice::read_state(std::array<char, 3>& lamp_state) {
+        return this->inject() && m_device->read_state(lamp_state);
+    }
+
+    void FaultInjectingDevice::close() {
+        m_device->close();
+    }
+
+    std::unique_ptr<LampDevice> create_lamp_device(const device_config& config) {
+        std::unique_ptr<LampDevice> device;
+        if (config.backend == "chardev") {
+            device = std::make_unique<DeviceHandle>(config.path);
+        } else if (config.backend == "memory") {
+            device = std::make_unique<MemoryDevice>();
+        } else if (config.backend == "emulated") {
+            device = std::make_unique<EmulatedDevice>(config.path);
+        } else {
+            LAMP_LOG_ERROR("Unknown device backend " << config.backend);
+            return nullptr;
+        }
+
+        if (config.latency_us > 0 || config.failure_rate > 0.0) {
+            LAMP_LOG_INFO("Injecting " << config.latency_us << " us latency and a failure rate of " << config.failure_rate << " into the " << config.backend << " device");
+            device = std::make_unique<FaultInjectingDevice>(std::move(device), config.latency_us, config.failure_rate);
+        }
+        return device;
+    }
+
+} /* namespace printer_lamp */
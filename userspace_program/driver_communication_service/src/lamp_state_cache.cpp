@@ -0,0 +1,50 @@
+#include "lamp_state_cache.hpp"
+
+#include "logger.hpp"
+
+namespace printer_lamp {
+
+    void LampStateCache::update(lamp_mask mask) {
+        m_state.store(VALID_FLAG | (mask & ALL_LEDS), std::memory_order_release);
+    }
+
+    void LampStateCache::invalidate() {
+        m_state.store(0, std::memory_order_release);
+    }
+
+    bool LampStateCache::reconcile(lamp_mask device_mask) {
+        m_reconciliations.fetch_add(1, std::memory_order_relaxed);
+        const std::uint16_t cached = m_state.exchange(VALID_FLAG | (device_mask & ALL_LEDS), std::memory_order_acq_rel);
+        if ((cached & VALID_FLAG) && static_cast<lamp_mask>(cached & ALL_LEDS) != (device_mask & ALL_LEDS)) {
+            m_mismatches.fetch_add(1, std::memory_order_relaxed);
+            LAMP_LOG_WARNING("Cached lamp state " << (cached & ALL_LEDS) << " differed from the driver state " << static_cast<int>(device_mask));
+            return false;
+        }
+        return true;
+    }
+
+    bool LampStateCache::is_valid() const {
+        return (m_state.load(std::memory_order_acquire) & VALID_FLAG) != 0;
+    }
+
+    lamp_mask LampStateCache::get_mask() const {
+        return static_cast<lamp_mask>(m_state.load(std::memory_order_acquire) & ALL_LEDS);
+    }
+
+    int LampStateCache::get_int_state() const {
+        const std::uint16_t state = m_state.load(std::memory_order_acquire);
+        if (!(state & VALID_FLAG)) {
+            return -1;
+        }
+        return mask_to_int_state(static_cast<lamp_mask>(state & ALL_LEDS));
+    }
+
+    std::uint64_t LampStateCache::get_reconciliations() const {
+        return m_reconciliations.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t LampStateCache::get_mismatches() const {
+        return m_mismatches.load(std::memory_order_relaxed);
+    }
+
+} /* namespace printer_lamp */
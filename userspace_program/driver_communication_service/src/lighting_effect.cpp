@@ -0,0 +1,149 @@
+#include "lighting_effect.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace printer_lamp {
+
+    namespace {
+        std::string trim(const std::string& value) {
+            const std::size_t begin = value.find_first_not_of(" \t");
+            const std::size_t end = value.find_last_not_of(" \t");
+            return (begin == std::string::npos) ? "" : value.substr(begin, end - begin + 1);
+        }
+
+        std::vector<std::string> split(const std::string& value, char separator) {
+            std::vector<std::string> tokens;
+            std::stringstream stream(value);
+            std::string token;
+            while (std::getline(stream, token, separator)) {
+                tokens.push_back(trim(token));
+            }
+            return tokens;
+        }
+
+        long parse_number(const std::string& token, long min_value) {
+            std::size_t parsed_chars = 0;
+            long number = -1;
+            try {
+                number = std::stol(token, &parsed_chars);
+            } catch (const std::exception&) {
+                parsed_chars = 0;
+            }
+            if (parsed_chars == 0 || parsed_chars != token.size() || number < min_value) {
+                throw std::invalid_argument("invalid number '" + token + "'");
+            }
+            return number;
+        }
+
+        lamp_mask parse_leds(const std::string& token) {
+            const long leds = parse_number(token, 1);
+            if (leds > ALL_LEDS) {
+                throw std::invalid_argument("invalid LED mask '" + token + "'");
+            }
+            return static_cast<lamp_mask>(leds);
+        }
+
+        void expect_arguments(const std::vector<std::string>& tokens, std::size_t count) {
+            if (tokens.size() != count + 1) {
+                throw std::invalid_argument(tokens[0] + " expects " + std::to_string(count) + " arguments");
+            }
+        }
+
+        void add_leds(lighting_effect& effect, std::chrono::milliseconds offset, lamp_mask leds, bool turn_on) {
+            for (int led_idx = 0; led_idx < NUM_LEDS; led_idx++) {
+                if (leds & (1u << led_idx)) {
+                    effect.push_back({offset, turn_on ? led_on_command(led_idx) : led_off_command(led_idx)});
+                }
+            }
+        }
+
+        lighting_effect parse_timeline(const std::vector<std::string>& tokens) {
+            lighting_effect effect;
+            for (std::size_t idx = 1; idx < tokens.size(); idx++) {
+                const std::size_t separator = tokens[idx].find(':');
+                if (separator == std::string::npos) {
+                    throw std::invalid_argument("timeline step '" + tokens[idx] + "' is not <offset ms>:<command>");
+                }
+                const long offset = parse_number(trim(tokens[idx].substr(0, separator)), 0);
+                const long command = parse_number(trim(tokens[idx].substr(separator + 1)), 0);
+                if (!is_valid_command(static_cast<int>(command)) || is_effect_command(static_cast<int>(command))) {
+                    throw std::invalid_argument("timeline command " + std::to_string(command) + " is not an on/off command or the reset");
+                }
+                effect.push_back({std::chrono::milliseconds(offset), static_cast<int>(command)});
+            }
+            // the config may list the steps in any order, equal offsets keep their order
+            std::stable_sort(effect.begin(), effect.end(), [](const effect_step& lhs, const effect_step& rhs) {
+                return lhs.offset < rhs.offset;
+            });
+            return effect;
+        }
+    } /* anonymous namespace */
+
+    lighting_effect make_blink_effect(lamp_mask leds, std::chrono::milliseconds on_time, std::chrono::milliseconds off_time, int repeats) {
+        lighting_effect effect;
+        std::chrono::milliseconds offset {0};
+        for (int repeat = 0; repeat < repeats; repeat++) {
+            add_leds(effect, offset, leds, true);
+            add_leds(effect, offset + on_time, leds, false);
+            offset += on_time + off_time;
+        }
+        return effect;
+    }
+
+    lighting_effect make_chase_effect(std::chrono::milliseconds step_time, int rounds) {
+        lighting_effect effect;
+        std::chrono::milliseconds offset {0};
+        for (int round = 0; round < rounds; round++) {
+            for (int led_idx = 0; led_idx < NUM_LEDS; led_idx++) {
+                effect.push_back({offset, led_on_command(led_idx)});
+                offset += step_time;
+                effect.push_back({offset, led_off_command(led_idx)});
+            }
+        }
+        return effect;
+    }
+
+    lighting_effect make_pulse_train_effect(lamp_mask leds, std::chrono::milliseconds pulse_time, std::chrono::milliseconds gap_time, int pulses, std::chrono::milliseconds pause_time, int trains) {
+        lighting_effect effect;
+        std::chrono::milliseconds offset {0};
+        for (int train = 0; train < trains; train++) {
+            for (int pulse = 0; pulse < pulses; pulse++) {
+                add_leds(effect, offset, leds, true);
+                add_leds(effect, offset + pulse_time, leds, false);
+                offset += pulse_time + ((pulse + 1 < pulses) ? gap_time : pause_time);
+            }
+        }
+        return effect;
+    }
+
+    lighting_effect parse_lighting_effect(const std::string& definition) {
+        const std::vector<std::string> tokens = split(definition, ',');
+        if (tokens.empty() || tokens[0].empty()) {
+            throw std::invalid_argument("empty effect definition");
+        }
+        const std::string& type = tokens[0];
+        lighting_effect effect;
+        if (type == "blink") {
+            expect_arguments(tokens, 4);
+            effect = make_blink_effect(parse_leds(tokens[1]), std::chrono::milliseconds(parse_number(tokens[2], 1)), std::chrono::milliseconds(parse_number(tokens[3], 1)), static_cast<int>(parse_number(tokens[4], 1)));
+        } else if (type == "chase") {
+            expect_arguments(tokens, 2);
+            effect = make_chase_effect(std::chrono::milliseconds(parse_number(tokens[1], 1)), static_cast<int>(parse_number(tokens[2], 1)));
+        } else if (type == "pulse_train") {
+            expect_arguments(tokens, 6);
+            effect = make_pulse_train_effect(parse_leds(tokens[1]), std::chrono::milliseconds(parse_number(tokens[2], 1)), std::chrono::milliseconds(parse_number(tokens[3], 1)),
+                static_cast<int>(parse_number(tokens[4], 1)), std::chrono::milliseconds(parse_number(tokens[5], 1)), static_cast<int>(parse_number(tokens[6], 1)));
+        } else if (type == "timeline") {
+            effect = parse_timeline(tokens);
+        } else {
+            throw std::invalid_argument("unknown effect type '" + type + "'");
+        }
+        if (effect.empty()) {
+            throw std::invalid_argument("effect without any step");
+        }
+        return effect;
+    }
+
+} /* namespace printer_lamp */
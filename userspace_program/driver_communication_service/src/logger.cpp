@@ -0,0 +1,380 @@
+#include "logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+namespace printer_lamp {
+
+    namespace {
+        constexpr std::chrono::milliseconds FLUSH_INTERVAL {50};
+        constexpr std::size_t MAX_BATCH = 128;
+        constexpr const char* JOURNAL_SOCKET = "/run/systemd/journal/socket";
+        constexpr const char* SYSLOG_IDENTIFIER = "driver_interaction";
+
+        std::atomic<std::uint64_t> next_logger_id {1};
+
+        std::size_t round_up_to_power_of_two(std::size_t value) {
+            std::size_t power = 1;
+            while (power < value) {
+                power <<= 1;
+            }
+            return power;
+        }
+
+        // syslog priorities of the journal
+        int journal_priority(log_level level) {
+            switch (level) {
+                case log_level::debug:
+                    return 7;
+                case log_level::info:
+                    return 6;
+                case log_level::warning:
+                    return 4;
+                default:
+                    return 3;
+            }
+        }
+    } /* anonymous namespace */
+
+    log_level parse_log_level(const std::string& name) {
+        if (name == "debug") {
+            return log_level::debug;
+        } else if (name == "info") {
+            return log_level::info;
+        } else if (name == "warning") {
+            return log_level::warning;
+        } else if (name == "error") {
+            return log_level::error;
+        } else if (name == "off") {
+            return log_level::off;
+        }
+        throw std::invalid_argument("unknown log level " + name);
+    }
+
+    log_target parse_log_target(const std::string& name) {
+        if (name == "stdout") {
+            return log_target::stdout_lines;
+        } else if (name == "journal") {
+            return log_target::journal;
+        }
+        throw std::invalid_argument("unknown log target " + name);
+    }
+
+    const char* log_level_name(log_level level) {
+        switch (level) {
+            case log_level::debug:
+                return "debug";
+            case log_level::info:
+                return "info";
+            case log_level::warning:
+                return "warning";
+            case log_level::error:
+                return "error";
+            default:
+                return "off";
+        }
+    }
+
+    LogRing::LogRing(std::size_t capacity) :
+        m_entries(round_up_to_power_of_two(std::max<std::size_t>(capacity, 2))),
+        m_mask{m_entries.size() - 1}
+    {}
+
+    log_entry* LogRing::try_claim() {
+        const std::size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_cached_tail >= m_entries.size()) {
+            m_cached_tail = m_tail.load(std::memory_order_acquire);
+            if (head - m_cached_tail >= m_entries.size()) {
+                return nullptr;
+            }
+        }
+        return &m_entries[head & m_mask];
+    }
+
+    void LogRing::commit() {
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    std::size_t LogRing::size() const {
+        return m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_relaxed);
+    }
+
+    std::size_t LogRing::readable() const {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_relaxed);
+    }
+
+    const log_entry& LogRing::peek(std::size_t idx) const {
+        return m_entries[(m_tail.load(std::memory_order_relaxed) + idx) & m_mask];
+    }
+
+    void LogRing::pop(std::size_t count) {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    void LogRing::close() {
+        m_closed.store(true, std::memory_order_release);
+    }
+
+    bool LogRing::is_closed() const {
+        return m_closed.load(std::memory_order_acquire);
+    }
+
+    std::size_t LogRing::capacity() const {
+        return m_entries.size();
+    }
+
+    // the ring of a thread, closed when the thread exits
+    struct Logger::thread_ring {
+        std::uint64_t logger_id {0};
+        std::shared_ptr<LogRing> ring;
+
+        ~thread_ring() {
+            if (ring) {
+                ring->close();
+            }
+        }
+    };
+
+    Logger::Logger(log_target target, std::size_t ring_capacity, int output_fd) :
+        m_id{next_logger_id.fetch_add(1, std::memory_order_relaxed)},
+        m_ring_capacity{ring_capacity},
+        m_output_fd{output_fd},
+        m_target{target}
+    {
+        m_pending.reserve(MAX_BATCH);
+        m_thread = std::thread(&Logger::run, this);
+    }
+
+    Logger::~Logger() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = false;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        if (m_journal_fd >= 0) {
+            ::close(m_journal_fd);
+        }
+    }
+
+    Logger& Logger::get() {
+        static Logger logger;
+        return logger;
+    }
+
+    void Logger::set_level(log_level level) {
+        m_level.store(static_cast<int>(level), std::memory_order_relaxed);
+    }
+
+    log_level Logger::get_level() const {
+        return static_cast<log_level>(m_level.load(std::memory_order_relaxed));
+    }
+
+    void Logger::set_target(log_target target) {
+        m_target.store(target);
+    }
+
+    LogRing& Logger::ring_of_this_thread() {
+        thread_local thread_ring current;
+        if (current.logger_id != m_id) {
+            // first record of this thread (or the thread switched to another logger)
+            if (current.ring) {
+                current.ring->close();
+            }
+            current.ring = std::make_shared<LogRing>(m_ring_capacity);
+            current.logger_id = m_id;
+            std::lock_guard<std::mutex> lock(m_rings_mutex);
+            m_rings.push_back(current.ring);
+        }
+        return *current.ring;
+    }
+
+    log_entry* Logger::claim() {
+        log_entry* entry = this->ring_of_this_thread().try_claim();
+        if (entry == nullptr) {
+            m_dropped.increment();
+        }
+        return entry;
+    }
+
+    void Logger::commit(const log_entry& entry) {
+        LogRing& ring = this->ring_of_this_thread();
+        ring.commit();
+        // the writer wakes up on its own every FLUSH_INTERVAL, it is only woken early for errors and a filling ring
+        if (entry.level >= log_level::error || ring.size() >= ring.capacity() / 2) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_wakeup_requested = true;
+            }
+            m_cv.notify_one();
+        }
+    }
+
+    void Logger::flush() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const std::uint64_t flush_request = ++m_flush_requests;
+        m_cv.notify_one();
+        m_flushed_cv.wait(lock, [this, flush_request] { return m_flushes_done >= flush_request; });
+    }
+
+    std::uint64_t Logger::get_dropped() const {
+        return m_dropped.get();
+    }
+
+    void Logger::run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_cv.wait_for(lock, FLUSH_INTERVAL, [this] { return !m_running || m_wakeup_requested || m_flush_requests != m_flushes_done; });
+            m_wakeup_requested = false;
+            const bool running = m_running;
+            const std::uint64_t flush_requests = m_flush_requests;
+            lock.unlock();
+
+            while (this->write_pending() > 0) {}
+
+            lock.lock();
+            m_flushes_done = flush_requests;
+            m_flushed_cv.notify_all();
+            if (!running) {
+                return;
+            }
+        }
+    }
+
+    std::size_t Logger::write_pending() {
+        {
+            // rings of exited threads are dropped once they have been written
+            std::lock_guard<std::mutex> lock(m_rings_mutex);
+            m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(), [](const std::shared_ptr<LogRing>& ring) {
+                return ring->is_closed() && ring->readable() == 0;
+            }), m_rings.end());
+            m_pending_rings = m_rings;
+        }
+
+        std::size_t written = 0;
+        for (const std::shared_ptr<LogRing>& ring : m_pending_rings) {
+            // the records of one thread keep their order, the ones of different threads are written ring by ring
+            std::size_t readable = ring->readable();
+            while (readable > 0) {
+                const std::size_t count = std::min(readable, MAX_BATCH);
+                m_pending.clear();
+                for (std::size_t idx = 0; idx < count; idx++) {
+                    m_pending.push_back(&ring->peek(idx));
+                }
+                this->write_batch();
+                ring->pop(count);
+                written += count;
+                readable -= count;
+            }
+        }
+        m_pending_rings.clear();
+        return written;
+    }
+
+    void Logger::write_batch() {
+        if (m_target.load() == log_target::journal && (m_journal_fd >= 0 || this->connect_journal())) {
+            this->write_journal();
+        } else {
+            this->write_lines();
+        }
+    }
+
+    void Logger::write_lines() {
+        m_batch.clear();
+        for (const log_entry* entry : m_pending) {
+            m_batch += '[';
+            m_batch += log_level_name(entry->level);
+            m_batch += "] ";
+            m_batch.append(entry->text, entry->length);
+            m_batch += '\n';
+        }
+        std::size_t offset = 0;
+        while (offset < m_batch.size()) {
+            const ssize_t written = ::write(m_output_fd, m_batch.data() + offset, m_batch.size() - offset);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return; // nowhere to log to
+            }
+            offset += static_cast<std::size_t>(written);
+        }
+    }
+
+    void Logger::write_journal() {
+        // one datagram per record, all of them sent with a single sendmmsg
+        m_batch.clear();
+        std::size_t offsets[MAX_BATCH + 1];
+        for (std::size_t idx = 0; idx < m_pending.size(); idx++) {
+            const log_entry& entry = *m_pending[idx];
+            offsets[idx] = m_batch.size();
+            m_batch += "PRIORITY=";
+            m_batch += static_cast<char>('0' + journal_priority(entry.level));
+            m_batch += "\nSYSLOG_IDENTIFIER=";
+            m_batch += SYSLOG_IDENTIFIER;
+            m_batch += "\nMESSAGE=";
+            const std::size_t message_start = m_batch.size();
+            m_batch.append(entry.text, entry.length);
+            // the simple field format ends at a newline
+            std::replace(m_batch.begin() + static_cast<std::ptrdiff_t>(message_start), m_batch.end(), '\n', ' ');
+            m_batch += '\n';
+        }
+        offsets[m_pending.size()] = m_batch.size();
+
+        iovec vectors[MAX_BATCH];
+        mmsghdr messages[MAX_BATCH];
+        for (std::size_t idx = 0; idx < m_pending.size(); idx++) {
+            vectors[idx].iov_base = &m_batch[offsets[idx]];
+            vectors[idx].iov_len = offsets[idx + 1] - offsets[idx];
+            std::memset(&messages[idx], 0, sizeof(mmsghdr));
+            messages[idx].msg_hdr.msg_iov = &vectors[idx];
+            messages[idx].msg_hdr.msg_iovlen = 1;
+        }
+        std::size_t sent = 0;
+        while (sent < m_pending.size()) {
+            const int result = ::sendmmsg(m_journal_fd, messages + sent, static_cast<unsigned int>(m_pending.size() - sent), MSG_NOSIGNAL);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                // journald went away, the remaining records go to stdout
+                ::close(m_journal_fd);
+                m_journal_fd = -1;
+                m_pending.erase(m_pending.begin(), m_pending.begin() + static_cast<std::ptrdiff_t>(sent));
+                this->write_lines();
+                return;
+            }
+            sent += static_cast<std::size_t>(result);
+        }
+    }
+
+    bool Logger::connect_journal() {
+        const int fd = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        sockaddr_un address {};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, JOURNAL_SOCKET, sizeof(address.sun_path) - 1);
+        if (fd < 0 || ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return false;
+        }
+        m_journal_fd = fd;
+        return true;
+    }
+
+    LogRecord& LogRecord::operator<<(double value) {
+        char buffer[32];
+        const int length = std::snprintf(buffer, sizeof(buffer), "%g", value);
+        return *this << std::string_view(buffer, length > 0 ? static_cast<std::size_t>(length) : 0);
+    }
+
+} /* namespace printer_lamp */
@@ -1,26 +1,89 @@
-#include <iostream>
+#include <csignal>
 #include <boost/asio.hpp>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
 
 
 #include "dbus_interaction.hpp"
 #include "config_parser.hpp"
+#include "config_store.hpp"
+#include "driver_service.hpp"
+#include "event_loop.hpp"
+#include "logger.hpp"
 #include "utils.hpp" 
 
 static inline const std::string SERVICE_NAME = "jens.printerlamp.driver_interaction";
 
+static void configure_logger(const printer_lamp::bridge_config& config) {
+    printer_lamp::Logger::get().set_level(config.minimum_log_level);
+    printer_lamp::Logger::get().set_target(config.log_output);
+}
+
 int main(int argc, const char * argv []) {
     printer_lamp::CommandLineParser command_line_parser(argc, argv);
-    const printer_lamp::bridge_config configuration = command_line_parser.get_config();
+    // immutable snapshots - a reload publishes a new one and the lamps switch over on the event loop
+    printer_lamp::ConfigStore config_store(command_line_parser.get_config());
+    const printer_lamp::config_snapshot configuration = config_store.get();
+    configure_logger(*configuration);
     
-    if (configuration.interface_name == "UNKNOWN" || configuration.object_path == "UNKNOWN") {
-        std::cout << "Invalid config file received. Program is unable to start\n";
+    std::signal(SIGPIPE, SIG_IGN); // the emulated device backend reports a FIFO without reader as an absent device instead
+
+    // blocked before the bridge starts its threads, so SIGINT/SIGTERM/SIGHUP only reach the signalfd of the event loop
+    sigset_t handled_signals;
+    sigemptyset(&handled_signals);
+    sigaddset(&handled_signals, SIGINT);
+    sigaddset(&handled_signals, SIGTERM);
+    sigaddset(&handled_signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &handled_signals, nullptr);
+    const int signal_fd = signalfd(-1, &handled_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        LAMP_LOG_ERROR("Could not create the signalfd. Program is unable to start");
         exit(1);
     }
-    
-    auto connection = sdbus::createSystemBusConnection(SERVICE_NAME);
-    printer_lamp::DriverDbusBridge dbus_driver_brige_obj(connection, configuration);
 
-    std::cout << "Initialization finished. Starting dbus event loop...\n";
-    connection->enterEventLoop();
+    auto connection = command_line_parser.use_session_bus() ? sdbus::createSessionBusConnection(SERVICE_NAME) : sdbus::createSystemBusConnection(SERVICE_NAME);
+    // one dbus object with its own device and driver I/O worker per lamp, all on the one connection
+    printer_lamp::DriverService driver_service(connection, configuration);
+    {
+        // dbus, the effect timers, the device watches, the config reloads and the signals are all handled on this thread
+        printer_lamp::EventLoop event_loop(driver_service.get_service_metrics().event_loop_iteration);
+        printer_lamp::DbusConnectionDispatcher dbus_dispatcher(*connection, event_loop);
+        driver_service.attach_to(event_loop);
+
+        // SIGHUP and changes of the config file are read and validated on the reloader thread
+        printer_lamp::ConfigReloader config_reloader(command_line_parser.get_config_path(), config_store, driver_service.get_service_metrics(), [&driver_service](const printer_lamp::config_snapshot& config) {
+            configure_logger(*config);
+            driver_service.apply(config);
+        });
+        event_loop.add_fd(config_reloader.get_event_fd(), EPOLLIN, [&config_reloader](std::uint32_t) { config_reloader.on_event(); });
+        printer_lamp::DeviceWatch config_watch(event_loop, command_line_parser.get_config_path(), [&config_reloader](bool present) {
+            if (present) {
+                config_reloader.request();
+            }
+        }, true);
+
+        event_loop.add_fd(signal_fd, EPOLLIN, [&event_loop, &config_reloader, signal_fd](std::uint32_t) {
+            signalfd_siginfo info;
+            if (::read(signal_fd, &info, sizeof(info)) != sizeof(info)) {
+                return;
+            }
+            if (info.ssi_signo == SIGHUP) {
+                LAMP_LOG_INFO("Received SIGHUP. Reloading the config...");
+                config_reloader.request();
+                return;
+            }
+            LAMP_LOG_INFO("Received signal " << info.ssi_signo << ". Stopping the event loop...");
+            event_loop.stop();
+        });
+
+        LAMP_LOG_INFO("Initialization finished. Starting the event loop...");
+        event_loop.run();
+        config_reloader.stop();
+        event_loop.remove_fd(config_reloader.get_event_fd());
+        driver_service.detach();
+        event_loop.remove_fd(signal_fd);
+    }
+    ::close(signal_fd);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,230 @@
+#include "metrics.hpp"
+
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+
+#include "logger.hpp"
+
+namespace printer_lamp {
+
+    namespace {
+        void add_histogram(std::map<std::string, std::uint64_t>& values, const std::string& prefix, const LatencyHistogram& histogram) {
+            values[prefix + ".count"] = histogram.get_count();
+            values[prefix + ".sum_ns"] = histogram.get_sum_ns();
+            values[prefix + ".max_ns"] = histogram.get_max_ns();
+            values[prefix + ".p50_ns"] = histogram.get_quantile_ns(0.5);
+            values[prefix + ".p99_ns"] = histogram.get_quantile_ns(0.99);
+            values[prefix + ".p999_ns"] = histogram.get_quantile_ns(0.999);
+        }
+
+        void write_histogram(std::ostream& out, const std::string& name, const std::string& labels, const LatencyHistogram& histogram) {
+            const std::string separator = labels.empty() ? "" : ",";
+            std::uint64_t cumulative = 0;
+            for (std::size_t idx = 0; idx + 1 < LatencyHistogram::NUM_BUCKETS; idx++) {
+                cumulative += histogram.get_bucket(idx);
+                out << name << "_bucket{" << labels << separator << "le=\"" << LatencyHistogram::bucket_upper_bound_ns(idx) * 1e-9 << "\"} " << cumulative << "\n";
+            }
+            cumulative += histogram.get_bucket(LatencyHistogram::NUM_BUCKETS - 1);
+            out << name << "_bucket{" << labels << separator << "le=\"+Inf\"} " << cumulative << "\n";
+            const std::string plain_labels = labels.empty() ? "" : "{" + labels + "}";
+            out << name << "_sum" << plain_labels << " " << histogram.get_sum_ns() * 1e-9 << "\n";
+            out << name << "_count" << plain_labels << " " << cumulative << "\n";
+        }
+
+        std::string join_labels(const std::string& labels, const std::string& more_labels) {
+            return labels.empty() ? more_labels : labels + "," + more_labels;
+        }
+
+        void write_header(std::ostream& out, const std::string& name, const std::string& type, const std::string& help) {
+            out << "# HELP " << name << " " << help << "\n";
+            out << "# TYPE " << name << " " << type << "\n";
+        }
+    } /* anonymous namespace */
+
+    std::uint64_t LatencyHistogram::get_count() const {
+        std::uint64_t count = 0;
+        for (const auto& bucket : m_buckets) {
+            count += bucket.load(std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+    std::uint64_t LatencyHistogram::get_sum_ns() const {
+        return m_sum_ns.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t LatencyHistogram::get_max_ns() const {
+        return m_max_ns.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t LatencyHistogram::get_bucket(std::size_t idx) const {
+        return m_buckets[idx].load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t LatencyHistogram::get_quantile_ns(double quantile) const {
+        const std::uint64_t count = this->get_count();
+        if (count == 0) {
+            return 0;
+        }
+        const double rank = quantile * count;
+        std::uint64_t cumulative = 0;
+        for (std::size_t idx = 0; idx < NUM_BUCKETS; idx++) {
+            cumulative += m_buckets[idx].load(std::memory_order_relaxed);
+            if (cumulative >= rank && cumulative > 0) {
+                // the open last bucket is best described by the largest recorded value
+                return (idx + 1 < NUM_BUCKETS) ? bucket_upper_bound_ns(idx) : this->get_max_ns();
+            }
+        }
+        return this->get_max_ns();
+    }
+
+    std::map<std::string, std::uint64_t> ServiceMetrics::snapshot() const {
+        std::map<std::string, std::uint64_t> values;
+        for (std::size_t idx = 0; idx < dbus_methods.size(); idx++) {
+            add_histogram(values, std::string("dbus.") + DBUS_METHOD_NAMES[idx], dbus_methods[idx]);
+        }
+        add_histogram(values, "device.write", device_write);
+        add_histogram(values, "device.read", device_read);
+        values["device.write_failures"] = device_write_failures.get();
+        values["device.write_retries"] = write_retries.get();
+        values["device.absent_ns"] = device_absent_ns.get();
+        values["device.absent"] = device_absent.load(std::memory_order_relaxed) ? 1 : 0;
+        values["device.health"] = device_health.load(std::memory_order_relaxed);
+        values["signals.emitted"] = signals_emitted.get();
+        values["signals.suppressed"] = signals_suppressed.get();
+        values["replies.committed"] = replies_committed.get();
+        values["replies.expired"] = replies_expired.get();
+        add_histogram(values, "effects.jitter", effect_jitter);
+        values["effects.started"] = effects_started.get();
+        values["effects.preempted"] = effects_preempted.get();
+        values["effects.steps"] = effect_steps.get();
+        values["effects.steps_rejected"] = effect_steps_rejected.get();
+        values["effects.resumed"] = effects_resumed.get();
+        for (std::size_t idx = 0; idx < command_apply.size(); idx++) {
+            add_histogram(values, std::string("commands.apply.") + COMMAND_PRIORITY_NAMES[idx], command_apply[idx]);
+        }
+        values["commands.cancelled"] = commands_cancelled.get();
+        add_histogram(values, "event_loop.iteration", event_loop_iteration);
+        add_histogram(values, "config.reload", config_reload);
+        values["config.reloads"] = config_reloads.get();
+        values["config.reloads_rejected"] = config_reloads_rejected.get();
+        values["log.dropped"] = Logger::get().get_dropped(); // of the whole process
+        return values;
+    }
+
+    std::string ServiceMetrics::to_prometheus(const std::string& labels) const {
+        std::ostringstream out;
+        out << std::setprecision(12);
+        const std::string plain_labels = labels.empty() ? "" : "{" + labels + "}";
+        write_header(out, "printer_lamp_dbus_method_duration_seconds", "histogram", "Time spent within the dbus method handlers");
+        for (std::size_t idx = 0; idx < dbus_methods.size(); idx++) {
+            write_histogram(out, "printer_lamp_dbus_method_duration_seconds", join_labels(labels, std::string("method=\"") + DBUS_METHOD_NAMES[idx] + "\""), dbus_methods[idx]);
+        }
+        write_header(out, "printer_lamp_device_write_duration_seconds", "histogram", "Duration of the lamp device writes");
+        write_histogram(out, "printer_lamp_device_write_duration_seconds", labels, device_write);
+        write_header(out, "printer_lamp_device_read_duration_seconds", "histogram", "Duration of the lamp device state reads");
+        write_histogram(out, "printer_lamp_device_read_duration_seconds", labels, device_read);
+
+        write_header(out, "printer_lamp_device_write_failures_total", "counter", "Failed lamp device writes");
+        out << "printer_lamp_device_write_failures_total" << plain_labels << " " << device_write_failures.get() << "\n";
+        write_header(out, "printer_lamp_device_write_retries_total", "counter", "Retries of lamp device writes");
+        out << "printer_lamp_device_write_retries_total" << plain_labels << " " << write_retries.get() << "\n";
+        write_header(out, "printer_lamp_device_absent_seconds_total", "counter", "Time the lamp device could not be written to");
+        out << "printer_lamp_device_absent_seconds_total" << plain_labels << " " << device_absent_ns.get() * 1e-9 << "\n";
+        write_header(out, "printer_lamp_device_absent", "gauge", "1 while the lamp device can not be written to");
+        out << "printer_lamp_device_absent" << plain_labels << " " << (device_absent.load(std::memory_order_relaxed) ? 1 : 0) << "\n";
+        write_header(out, "printer_lamp_device_health", "gauge", "Health of the lamp device: 0 healthy, 1 degraded, 2 absent");
+        out << "printer_lamp_device_health" << plain_labels << " " << static_cast<unsigned>(device_health.load(std::memory_order_relaxed)) << "\n";
+        write_header(out, "printer_lamp_signals_emitted_total", "counter", "Emitted current_lamp_state signals");
+        out << "printer_lamp_signals_emitted_total" << plain_labels << " " << signals_emitted.get() << "\n";
+        write_header(out, "printer_lamp_signals_suppressed_total", "counter", "Intermediate lamp states that were not signalled because of the signal rate limit");
+        out << "printer_lamp_signals_suppressed_total" << plain_labels << " " << signals_suppressed.get() << "\n";
+        write_header(out, "printer_lamp_replies_total", "counter", "Deferred set_lamp_state replies by outcome");
+        out << "printer_lamp_replies_total{" << join_labels(labels, "result=\"committed\"") << "} " << replies_committed.get() << "\n";
+        out << "printer_lamp_replies_total{" << join_labels(labels, "result=\"expired\"") << "} " << replies_expired.get() << "\n";
+        write_header(out, "printer_lamp_effect_jitter_seconds", "histogram", "Delay of the lighting effect steps behind their deadlines");
+        write_histogram(out, "printer_lamp_effect_jitter_seconds", labels, effect_jitter);
+        write_header(out, "printer_lamp_effects_started_total", "counter", "Started lighting effects");
+        out << "printer_lamp_effects_started_total" << plain_labels << " " << effects_started.get() << "\n";
+        write_header(out, "printer_lamp_effects_preempted_total", "counter", "Lighting effects that were stopped before their last step");
+        out << "printer_lamp_effects_preempted_total" << plain_labels << " " << effects_preempted.get() << "\n";
+        write_header(out, "printer_lamp_effect_steps_total", "counter", "Lighting effect steps by outcome");
+        out << "printer_lamp_effect_steps_total{" << join_labels(labels, "result=\"queued\"") << "} " << effect_steps.get() - effect_steps_rejected.get() << "\n";
+        out << "printer_lamp_effect_steps_total{" << join_labels(labels, "result=\"rejected\"") << "} " << effect_steps_rejected.get() << "\n";
+        write_header(out, "printer_lamp_effects_resumed_total", "counter", "Lighting effects that continued after a status command suspended them");
+        out << "printer_lamp_effects_resumed_total" << plain_labels << " " << effects_resumed.get() << "\n";
+        write_header(out, "printer_lamp_command_apply_seconds", "histogram", "Time from queueing a lamp command until it was written, by priority");
+        for (std::size_t idx = 0; idx < command_apply.size(); idx++) {
+            write_histogram(out, "printer_lamp_command_apply_seconds", join_labels(labels, std::string("priority=\"") + COMMAND_PRIORITY_NAMES[idx] + "\""), command_apply[idx]);
+        }
+        write_header(out, "printer_lamp_commands_cancelled_total", "counter", "Lamp commands dropped for a command of a higher priority");
+        out << "printer_lamp_commands_cancelled_total" << plain_labels << " " << commands_cancelled.get() << "\n";
+        write_header(out, "printer_lamp_event_loop_iteration_seconds", "histogram", "Time the event loop spends handling the events of one wakeup");
+        write_histogram(out, "printer_lamp_event_loop_iteration_seconds", labels, event_loop_iteration);
+        write_header(out, "printer_lamp_config_reload_seconds", "histogram", "Time from a config reload request until the new config was applied");
+        write_histogram(out, "printer_lamp_config_reload_seconds", labels, config_reload);
+        write_header(out, "printer_lamp_config_reloads_total", "counter", "Config reloads by outcome");
+        out << "printer_lamp_config_reloads_total{" << join_labels(labels, "result=\"applied\"") << "} " << config_reloads.get() << "\n";
+        out << "printer_lamp_config_reloads_total{" << join_labels(labels, "result=\"rejected\"") << "} " << config_reloads_rejected.get() << "\n";
+        write_header(out, "printer_lamp_log_records_dropped_total", "counter", "Log records of the whole service that were dropped because a log ring was full");
+        out << "printer_lamp_log_records_dropped_total" << plain_labels << " " << Logger::get().get_dropped() << "\n";
+        return out.str();
+    }
+
+    PrometheusTextfileWriter::PrometheusTextfileWriter(const ServiceMetrics& metrics, std::string path, std::chrono::milliseconds interval, std::string labels) :
+        m_metrics{metrics},
+        m_path{std::move(path)},
+        m_interval{interval},
+        m_labels{std::move(labels)},
+        m_running{true}
+    {
+        m_thread = std::thread(&PrometheusTextfileWriter::run, this);
+    }
+
+    PrometheusTextfileWriter::~PrometheusTextfileWriter() {
+        this->stop();
+    }
+
+    void PrometheusTextfileWriter::stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = false;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    bool PrometheusTextfileWriter::write_once() const {
+        const std::string content = m_metrics.to_prometheus(m_labels);
+        const std::string tmp_path = m_path + ".tmp";
+        FILE* file = std::fopen(tmp_path.c_str(), "w");
+        if (file == nullptr) {
+            return false;
+        }
+        const bool written = std::fwrite(content.data(), 1, content.size(), file) == content.size();
+        if (std::fclose(file) != 0 || !written) {
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+        return std::rename(tmp_path.c_str(), m_path.c_str()) == 0;
+    }
+
+    void PrometheusTextfileWriter::run() {
+        bool last_write_failed = false;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_running) {
+            lock.unlock();
+            const bool written = this->write_once();
+            if (!written && !last_write_failed) {
+                LAMP_LOG_ERROR("Could not write the metrics textfile " << m_path);
+            }
+            last_write_failed = !written;
+            lock.lock();
+            m_cv.wait_for(lock, m_interval, [this] { return !m_running; });
+        }
+    }
+
+} /* namespace printer_lamp */
@@ -0,0 +1,83 @@
+#include "signal_throttle.hpp"
+
+namespace printer_lamp {
+
+    SignalThrottle::SignalThrottle(std::chrono::milliseconds min_interval, Counter& suppressed, emit_callback emit) :
+        m_min_interval{min_interval},
+        m_suppressed{suppressed},
+        m_emit{std::move(emit)},
+        m_has_pending{false},
+        m_next_allowed{},
+        m_running{true},
+        m_last_emitted_sequence{0}
+    {
+        m_thread = std::thread(&SignalThrottle::run, this);
+    }
+
+    SignalThrottle::~SignalThrottle() {
+        this->stop();
+    }
+
+    void SignalThrottle::stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = false;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    void SignalThrottle::publish(const lamp_state_update& update) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            const auto now = std::chrono::steady_clock::now();
+            if (m_has_pending) {
+                m_suppressed.increment(); // the previous pending update is replaced before anybody saw it
+            }
+            m_latest = update;
+            if (now < m_next_allowed || !m_running) {
+                m_has_pending = true;
+                m_cv.notify_one();
+                return;
+            }
+            m_has_pending = false;
+            m_next_allowed = now + m_min_interval;
+        }
+        // leading edge - emitted from the calling thread without a thread hop
+        this->emit(update);
+    }
+
+    void SignalThrottle::emit(const lamp_state_update& update) {
+        std::lock_guard<std::mutex> lock(m_emit_mutex);
+        if (update.sequence <= m_last_emitted_sequence) {
+            return;
+        }
+        m_last_emitted_sequence = update.sequence;
+        m_emit(update);
+    }
+
+    void SignalThrottle::run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_cv.wait(lock, [this] { return !m_running || m_has_pending; });
+            if (m_running && std::chrono::steady_clock::now() < m_next_allowed) {
+                m_cv.wait_until(lock, m_next_allowed, [this] { return !m_running; });
+            }
+            if (m_has_pending) {
+                // trailing edge - the final state of a burst
+                const lamp_state_update update = m_latest;
+                m_has_pending = false;
+                m_next_allowed = std::chrono::steady_clock::now() + m_min_interval;
+                lock.unlock();
+                this->emit(update);
+                lock.lock();
+            }
+            if (!m_running) {
+                return;
+            }
+        }
+    }
+
+} /* namespace printer_lamp */
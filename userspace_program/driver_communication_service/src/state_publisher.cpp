@@ -0,0 +1,96 @@
+#include "state_publisher.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace printer_lamp {
+
+    namespace {
+        std::int64_t realtime_ns() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+    } /* anonymous namespace */
+
+    StatePublisher::StatePublisher(const std::string& path) :
+        m_fd{::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)},
+        m_state{nullptr}
+    {
+        if (m_fd < 0) {
+            throw std::runtime_error("could not open the shared lamp state " + path);
+        }
+        struct stat file_stat {};
+        if (::fstat(m_fd, &file_stat) != 0 || (static_cast<std::size_t>(file_stat.st_size) != sizeof(shared_lamp_state) && ::ftruncate(m_fd, sizeof(shared_lamp_state)) != 0)) {
+            ::close(m_fd);
+            throw std::runtime_error("could not size the shared lamp state " + path);
+        }
+        void* mapping = ::mmap(nullptr, sizeof(shared_lamp_state), PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(m_fd);
+            throw std::runtime_error("could not map the shared lamp state " + path);
+        }
+        m_state = static_cast<shared_lamp_state*>(mapping);
+
+        // the seqlock and the state sequence of a segment from a previous run continue, so readers never see them go backwards - the seqlock may even be odd if that run died within an update
+        std::uint64_t sequence = 0;
+        if (std::memcmp(m_state->magic, LAMP_STATE_SNAPSHOT_MAGIC, sizeof(LAMP_STATE_SNAPSHOT_MAGIC)) != 0 || m_state->version != LAMP_STATE_SNAPSHOT_VERSION) {
+            m_state->seqlock.store(0, std::memory_order_relaxed);
+        } else {
+            if (m_state->seqlock.load(std::memory_order_relaxed) & 1) {
+                m_state->seqlock.fetch_add(1, std::memory_order_relaxed);
+            }
+            sequence = m_state->sequence.load(std::memory_order_relaxed);
+        }
+        this->begin_write();
+        std::memcpy(m_state->magic, LAMP_STATE_SNAPSHOT_MAGIC, sizeof(LAMP_STATE_SNAPSHOT_MAGIC));
+        m_state->version = LAMP_STATE_SNAPSHOT_VERSION;
+        m_state->reserved_header = 0;
+        m_state->sequence.store(sequence, std::memory_order_relaxed);
+        m_state->changed_ns.store(realtime_ns(), std::memory_order_relaxed);
+        m_state->command.store(-1, std::memory_order_relaxed);
+        m_state->mask.store(0xFF, std::memory_order_relaxed);
+        m_state->health.store(static_cast<std::uint8_t>(device_health::healthy), std::memory_order_relaxed);
+        std::memset(m_state->reserved, 0, sizeof(m_state->reserved));
+        this->end_write();
+    }
+
+    StatePublisher::~StatePublisher() {
+        ::munmap(m_state, sizeof(shared_lamp_state));
+        ::close(m_fd);
+    }
+
+    std::uint64_t StatePublisher::get_sequence() const {
+        return m_state->sequence.load(std::memory_order_relaxed);
+    }
+
+    void StatePublisher::publish(const lamp_state_update& update) {
+        this->begin_write();
+        m_state->sequence.store(update.sequence, std::memory_order_relaxed);
+        m_state->changed_ns.store(realtime_ns(), std::memory_order_relaxed);
+        m_state->command.store(update.state, std::memory_order_relaxed);
+        m_state->mask.store(update.mask, std::memory_order_relaxed);
+        this->end_write();
+    }
+
+    void StatePublisher::publish_health(device_health health) {
+        this->begin_write();
+        m_state->changed_ns.store(realtime_ns(), std::memory_order_relaxed);
+        m_state->health.store(static_cast<std::uint8_t>(health), std::memory_order_relaxed);
+        this->end_write();
+    }
+
+    void StatePublisher::begin_write() {
+        // odd - readers retry until the update is complete
+        m_state->seqlock.store(m_state->seqlock.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void StatePublisher::end_write() {
+        m_state->seqlock.store(m_state->seqlock.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+} /* namespace printer_lamp */
@@ -0,0 +1,200 @@
+/*
+Counts the heap allocations of the steady-state request path: the work behind set_lamp_state
+(validation, effect preemption, hand over to the driver I/O worker, the write, the history
+record, the state signal and the deferred reply) and behind get_lamp_state (state cache read),
+with the same components the dbus bridge uses. The messages of sd-bus itself are not part of it.
+
+The global operator new of this executable counts every allocation. CppUTest replaces it for
+its memory leak detection, so this check is a separate executable without CppUTest. It fails
+with exit code 1 as soon as a request allocates after the warm-up.
+
+    $ ./build/bin/allocation_tests
+*/
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unistd.h>
+
+#include "driver_io_worker.hpp"
+#include "effect_engine.hpp"
+#include "history_journal.hpp"
+#include "lamp_device.hpp"
+#include "lamp_state.hpp"
+#include "lamp_state_cache.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "pending_replies.hpp"
+#include "signal_throttle.hpp"
+
+namespace {
+    std::atomic<std::uint64_t> allocations {0};
+
+    void* counted_allocation(std::size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        if (void* memory = std::malloc(size > 0 ? size : 1)) {
+            return memory;
+        }
+        throw std::bad_alloc();
+    }
+}
+
+void* operator new(std::size_t size) {
+    return counted_allocation(size);
+}
+
+void* operator new[](std::size_t size) {
+    return counted_allocation(size);
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+namespace {
+    constexpr int WARMUP_REQUESTS = 200;
+    constexpr int MEASURED_REQUESTS = 2000;
+
+    // stands in for the method call the bridge answers once the command was written
+    struct deferred_reply {
+        int request {0};
+    };
+
+    // lets the request thread wait for its reply like a client waits for the set_lamp_state reply
+    class ReplyWaiter {
+        public:
+            void on_reply(deferred_reply& reply, bool committed) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_answered = reply.request;
+                m_committed = committed;
+                m_cv.notify_all();
+            }
+
+            bool wait(int request) {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                return m_cv.wait_for(lock, std::chrono::seconds(5), [this, request] { return m_answered >= request; }) && m_committed;
+            }
+
+        private:
+            std::mutex m_mutex;
+            std::condition_variable m_cv;
+            int m_answered {-1};
+            bool m_committed {false};
+    };
+
+    // the components of one lamp of the bridge, wired the same way
+    struct request_path {
+        printer_lamp::MemoryDevice device;
+        printer_lamp::LampStateCache cache;
+        printer_lamp::ServiceMetrics metrics;
+        printer_lamp::HistoryJournal history;
+        ReplyWaiter waiter;
+        printer_lamp::PendingReplies<deferred_reply> pending_replies;
+        std::atomic<std::uint64_t> signals {0};
+        printer_lamp::SignalThrottle signal_throttle;
+        printer_lamp::lamp_state_update last_update;
+        printer_lamp::DeviceHealth health;
+        printer_lamp::DriverIoWorker worker;
+        printer_lamp::EffectEngine effect_engine;
+
+        explicit request_path(const std::string& history_path) :
+            history{history_path, 64 * 1024},
+            pending_replies{std::chrono::seconds(5), 64, [this](deferred_reply& reply, bool committed) { waiter.on_reply(reply, committed); }},
+            signal_throttle{std::chrono::milliseconds(0), metrics.signals_suppressed, [this](const printer_lamp::lamp_state_update&) { signals.fetch_add(1); }},
+            health{std::chrono::milliseconds(10), std::chrono::milliseconds(10), 3},
+            worker{device, cache, metrics, 64, health, std::chrono::seconds(60), [this](int state, std::uint64_t committed_sequence) { on_state_written(state, committed_sequence); },
+                [this](std::uint64_t sequence) { pending_replies.cancel(sequence); }, &history},
+            effect_engine{[this](const std::vector<int>& commands, printer_lamp::command_priority priority) { return worker.enqueue_batch(commands, "effect", priority); }, metrics}
+        {}
+
+        void on_state_written(int state, std::uint64_t committed_sequence) {
+            last_update.state = state;
+            last_update.sequence++;
+            last_update.mask = cache.is_valid() ? cache.get_mask() : 0xFF;
+            signal_throttle.publish(last_update);
+            pending_replies.commit(committed_sequence);
+        }
+
+        bool set_lamp_state(int request) {
+            printer_lamp::ScopedLatency latency(metrics.method(printer_lamp::dbus_method::set_lamp_state));
+            // toggling a single LED makes every command a real device write
+            const int command = (request % 2 == 0) ? printer_lamp::led_on_command(0) : printer_lamp::led_off_command(0);
+            if (!printer_lamp::is_valid_command(command)) {
+                return false;
+            }
+            effect_engine.preempt(printer_lamp::default_priority(command));
+            std::uint64_t sequence = 0;
+            if (!worker.enqueue(command, sequence, ":1.42", printer_lamp::default_priority(command))) {
+                return false;
+            }
+            pending_replies.add(sequence, deferred_reply{request});
+            LAMP_LOG_DEBUG("Queued state " << command << " of request " << request);
+            return waiter.wait(request);
+        }
+
+        int get_lamp_state() {
+            printer_lamp::ScopedLatency latency(metrics.method(printer_lamp::dbus_method::get_lamp_state));
+            const int state = cache.get_int_state();
+            LAMP_LOG_DEBUG("Answered the lamp state " << state);
+            return state;
+        }
+    };
+
+    bool check_requests(request_path& path, int first_request, int requests) {
+        for (int request = first_request; request < first_request + requests; request++) {
+            if (!path.set_lamp_state(request) || path.get_lamp_state() < 0) {
+                std::printf("Request %d was not answered\n", request);
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main() {
+    char history_template[] = "/tmp/printer_lamp_allocation_XXXXXX";
+    const int history_fd = mkstemp(history_template);
+    if (history_fd < 0) {
+        std::printf("Could not create the history journal\n");
+        return 1;
+    }
+    close(history_fd);
+
+    bool success = false;
+    std::uint64_t allocated = 0;
+    {
+        request_path path(history_template);
+        // the first requests size the buffers of the path, e.g. the vector of the first reply
+        success = check_requests(path, 0, WARMUP_REQUESTS);
+
+        const std::uint64_t before = allocations.load();
+        success = success && check_requests(path, WARMUP_REQUESTS, MEASURED_REQUESTS);
+        allocated = allocations.load() - before;
+        path.worker.stop();
+    }
+    unlink(history_template);
+
+    std::printf("%d set_lamp_state and get_lamp_state requests after the warm-up: %llu heap allocations\n", MEASURED_REQUESTS, static_cast<unsigned long long>(allocated));
+    if (!success || allocated != 0) {
+        std::printf("FAILED\n");
+        return 1;
+    }
+    std::printf("OK\n");
+    return 0;
+}
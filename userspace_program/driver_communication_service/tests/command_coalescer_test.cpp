@@ -0,0 +1,104 @@
+#include "command_coalescer.hpp"
+
+#include <vector>
+
+#include "CppUTest/TestHarness.h"
+
+using printer_lamp::known_lamp_state;
+
+namespace {
+    const known_lamp_state ALL_OFF {0b000, printer_lamp::ALL_LEDS};
+    const known_lamp_state ALL_ON {0b111, printer_lamp::ALL_LEDS};
+    const known_lamp_state UNKNOWN {0b000, 0b000};
+
+    std::vector<int> coalesce(const std::vector<int>& burst, known_lamp_state current, known_lamp_state* result = nullptr) {
+        std::vector<int> writes;
+        known_lamp_state state = printer_lamp::coalesce_commands(burst, current, writes);
+        if (result != nullptr) {
+            *result = state;
+        }
+        return writes;
+    }
+}
+
+TEST_GROUP(CommandCoalescerTest) {
+};
+
+// number of device writes per burst pattern
+
+TEST(CommandCoalescerTest, OnThenOffOfTheSameLedNeedsNoWrite) {
+    known_lamp_state result;
+    CHECK_TRUE(coalesce({0, 3}, ALL_OFF, &result).empty());
+    CHECK_TRUE(result == ALL_OFF);
+}
+
+TEST(CommandCoalescerTest, AlternatingBurstCollapsesToOneWrite) {
+    std::vector<int> burst;
+    for (int idx = 0; idx < 20; idx++) {
+        burst.push_back(idx % 2 == 0 ? 0 : 3);
+    }
+    burst.push_back(0);
+    const std::vector<int> writes = coalesce(burst, ALL_OFF);
+    UNSIGNED_LONGS_EQUAL(1, writes.size());
+    LONGS_EQUAL(0, writes[0]);
+}
+
+TEST(CommandCoalescerTest, CommandsAlreadyInEffectAreSkipped) {
+    CHECK_TRUE(coalesce({0, 1, 2}, ALL_ON).empty());
+    CHECK_TRUE(coalesce({8, 3, 4}, ALL_OFF).empty());
+}
+
+TEST(CommandCoalescerTest, ResetFollowedByOnesCollapsesToTheDifference) {
+    // job restart: reset everything and switch the heating LED back on
+    const std::vector<int> writes = coalesce({8, 1}, known_lamp_state {0b010, printer_lamp::ALL_LEDS});
+    CHECK_TRUE(writes.empty());
+
+    const std::vector<int> restart = coalesce({8, 1}, known_lamp_state {0b001, printer_lamp::ALL_LEDS});
+    UNSIGNED_LONGS_EQUAL(2, restart.size());
+    LONGS_EQUAL(3, restart[0]);
+    LONGS_EQUAL(1, restart[1]);
+}
+
+TEST(CommandCoalescerTest, UsesSingleResetWhenSeveralLedsGoOff) {
+    const std::vector<int> writes = coalesce({3, 4, 5}, ALL_ON);
+    UNSIGNED_LONGS_EQUAL(1, writes.size());
+    LONGS_EQUAL(8, writes[0]);
+}
+
+TEST(CommandCoalescerTest, LightplaysKeepTheirPosition) {
+    known_lamp_state result;
+    const std::vector<int> writes = coalesce({0, 3, 1, 6, 4, 2, 5, 7}, ALL_OFF, &result);
+    UNSIGNED_LONGS_EQUAL(4, writes.size());
+    LONGS_EQUAL(1, writes[0]); // LED 1 has to be on while lightplay 1 runs and restores the state
+    LONGS_EQUAL(6, writes[1]);
+    LONGS_EQUAL(4, writes[2]);
+    LONGS_EQUAL(7, writes[3]);
+    CHECK_TRUE(result == ALL_OFF);
+}
+
+TEST(CommandCoalescerTest, ConsecutiveLightplaysAreAllForwarded) {
+    const std::vector<int> writes = coalesce({6, 6, 7}, ALL_OFF);
+    UNSIGNED_LONGS_EQUAL(3, writes.size());
+}
+
+TEST(CommandCoalescerTest, UnknownStateOnlyWritesTouchedLeds) {
+    known_lamp_state result;
+    const std::vector<int> writes = coalesce({0, 3, 1}, UNKNOWN, &result);
+    UNSIGNED_LONGS_EQUAL(2, writes.size());
+    LONGS_EQUAL(3, writes[0]);
+    LONGS_EQUAL(1, writes[1]);
+    UNSIGNED_LONGS_EQUAL(0b011, result.known);
+    UNSIGNED_LONGS_EQUAL(0b010, result.value);
+}
+
+TEST(CommandCoalescerTest, ResetMakesUnknownStateKnown) {
+    known_lamp_state result;
+    const std::vector<int> writes = coalesce({1, 8}, UNKNOWN, &result);
+    UNSIGNED_LONGS_EQUAL(1, writes.size());
+    LONGS_EQUAL(8, writes[0]);
+    CHECK_TRUE(result == ALL_OFF);
+}
+
+TEST(CommandCoalescerTest, InvalidCommandsAreIgnored) {
+    CHECK_TRUE(coalesce({-1, 9, 42}, ALL_OFF).empty());
+}
@@ -0,0 +1,168 @@
+#include "config_parser.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+#include "CppUTest/TestHarness.h"
+
+namespace {
+    std::string write_config(const char* content) {
+        char path_template[] = "/tmp/driver_service_test_XXXXXX";
+        int fd = mkstemp(path_template);
+        write(fd, content, std::char_traits<char>::length(content));
+        close(fd);
+        return path_template;
+    }
+
+    printer_lamp::bridge_config parse(const std::string& path) {
+        const std::string argument = "--config_path=" + path;
+        const char* argv[] = {"driver_interaction", argument.c_str()};
+        int argc = 2;
+        printer_lamp::CommandLineParser parser(argc, argv);
+        return parser.get_config();
+    }
+}
+
+TEST_GROUP(ConfigParserTest) {
+    std::string config_path;
+
+    void teardown() {
+        unlink(config_path.c_str());
+    }
+};
+
+TEST(ConfigParserTest, ReadsScenesAsCommandSequences) {
+    config_path = write_config(
+        "[DRIVERSERVICE]\n"
+        "object_path = /3DP/printerlamp\n"
+        "interface_name = jens.printerlamp\n"
+        "device_backend = emulated\n"
+        "device_path = /tmp/printer_lamp\n"
+        "device_latency_us = 250\n"
+        "[SCENES]\n"
+        "heating = 6, 8, 1\n"
+        "off = 8\n");
+    const printer_lamp::bridge_config config = parse(config_path);
+
+    STRCMP_EQUAL("emulated", config.device.backend.c_str());
+    STRCMP_EQUAL("/tmp/printer_lamp", config.device.path.c_str());
+    LONGS_EQUAL(250, config.device.latency_us);
+    UNSIGNED_LONGS_EQUAL(2, config.scenes.size());
+    const std::vector<int>& heating = config.scenes.at("heating");
+    UNSIGNED_LONGS_EQUAL(3, heating.size());
+    LONGS_EQUAL(6, heating[0]);
+    LONGS_EQUAL(8, heating[1]);
+    LONGS_EQUAL(1, heating[2]);
+    UNSIGNED_LONGS_EQUAL(1, config.scenes.at("off").size());
+}
+
+TEST(ConfigParserTest, DefaultsWithoutOptionalKeys) {
+    config_path = write_config(
+        "[DRIVERSERVICE]\n"
+        "object_path = /3DP/printerlamp\n"
+        "interface_name = jens.printerlamp\n");
+    const printer_lamp::bridge_config config = parse(config_path);
+
+    STRCMP_EQUAL("chardev", config.device.backend.c_str());
+    STRCMP_EQUAL("/dev/printer_lamp", config.device.path.c_str());
+    UNSIGNED_LONGS_EQUAL(64, config.queue_capacity);
+    CHECK_TRUE(config.scenes.empty());
+    CHECK_TRUE(config.minimum_log_level == printer_lamp::log_level::info);
+    CHECK_TRUE(config.log_output == printer_lamp::log_target::stdout_lines);
+}
+
+TEST(ConfigParserTest, ReadsTheLoggingOptions) {
+    config_path = write_config(
+        "[DRIVERSERVICE]\n"
+        "object_path = /3DP/printerlamp\n"
+        "interface_name = jens.printerlamp\n"
+        "log_level = warning\n"
+        "log_target = journal\n");
+    const printer_lamp::bridge_config config = printer_lamp::read_config_file(config_path);
+
+    CHECK_TRUE(config.minimum_log_level == printer_lamp::log_level::warning);
+    CHECK_TRUE(config.log_output == printer_lamp::log_target::journal);
+}
+
+TEST(ConfigParserTest, RejectsUnknownLogLevels) {
+    config_path = write_config(
+        "[DRIVERSERVICE]\n"
+        "object_path = /3DP/printerlamp\n"
+        "interface_name = jens.printerlamp\n"
+        "log_level = verbose\n");
+    bool rejected = false;
+    try {
+        printer_lamp::read_config_file(config_path);
+    } catch (const std::invalid_argument&) {
+        rejected = true;
+    }
+    CHECK_TRUE(rejected);
+}
+
+TEST(ConfigParserTest, ReadsEffects) {
+    config_path = write_config(
+        "[DRIVERSERVICE]\n"
+        "object_path = /3DP/printerlamp\n"
+        "interface_name = jens.printerlamp\n"
+        "[EFFECTS]\n"
+        "attention = blink, 7, 200, 200, 2\n"
+        "custom = timeline, 100:3, 0:0\n");
+    const printer_lamp::bridge_config config = parse(config_path);
+
+    UNSIGNED_LONGS_EQUAL(2, config.effects.size());
+    UNSIGNED_LONGS_EQUAL(12, config.effects.at("attention").size());
+    const printer_lamp::lighting_effect& custom = config.effects.at("custom");
+    LONGS_EQUAL(0, custom[0].command);
+    LONGS_EQUAL(100, custom[1].offset.count());
+}
+
+TEST(ConfigParserTest, ServiceSectionIsTheOnlyLampWithoutLampSections) {
+    config_path = write_config(
+        "[DRIVERSERVICE]\n"
+        "object_path = /3DP/printerlamp\n"
+        "interface_name = jens.printerlamp\n"
+        "device_path = /dev/printer_lamp\n");
+    const printer_lamp::bridge_config config = parse(config_path);
+
+    UNSIGNED_LONGS_EQUAL(1, config.lamps.size());
+    STRCMP_EQUAL("", config.lamps[0].name.c_str());
+    STRCMP_EQUAL("/3DP/printerlamp", config.lamps[0].object_path.c_str());
+    STRCMP_EQUAL("/dev/printer_lamp", config.lamps[0].device.path.c_str());
+}
+
+TEST(ConfigParserTest, ReadsLampSectionsInFileOrder) {
+    config_path = write_config(
+        "[DRIVERSERVICE]\n"
+        "interface_name = jens.printerlamp\n"
+        "device_backend = emulated\n"
+        "device_latency_us = 100\n"
+        "[LAMP.prusa]\n"
+        "object_path = /3DP/printerlamp/prusa\n"
+        "device_path = /tmp/printer_lamp_prusa\n"
+        "[LAMP.ender]\n"
+        "object_path = /3DP/printerlamp/ender\n"
+        "device_backend = chardev\n"
+        "device_path = /dev/printer_lamp1\n"
+        "device_latency_us = 0\n"
+        "metrics_textfile_path = /tmp/ender.prom\n");
+    const printer_lamp::bridge_config config = parse(config_path);
+
+    UNSIGNED_LONGS_EQUAL(2, config.lamps.size());
+    const printer_lamp::lamp_config& prusa = config.lamps[0];
+    STRCMP_EQUAL("prusa", prusa.name.c_str());
+    STRCMP_EQUAL("/3DP/printerlamp/prusa", prusa.object_path.c_str());
+    STRCMP_EQUAL("emulated", prusa.device.backend.c_str()); // from [DRIVERSERVICE]
+    STRCMP_EQUAL("/tmp/printer_lamp_prusa", prusa.device.path.c_str());
+    LONGS_EQUAL(100, prusa.device.latency_us);
+    STRCMP_EQUAL("", prusa.metrics_textfile_path.c_str());
+
+    const printer_lamp::lamp_config& ender = config.lamps[1];
+    STRCMP_EQUAL("ender", ender.name.c_str());
+    STRCMP_EQUAL("chardev", ender.device.backend.c_str());
+    STRCMP_EQUAL("/dev/printer_lamp1", ender.device.path.c_str());
+    LONGS_EQUAL(0, ender.device.latency_us);
+    STRCMP_EQUAL("/tmp/ender.prom", ender.metrics_textfile_path.c_str());
+}
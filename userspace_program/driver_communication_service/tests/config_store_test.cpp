@@ -0,0 +1,136 @@
+#include "config_store.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+
+#include "CppUTest/TestHarness.h"
+
+namespace {
+    const char* VALID_CONFIG =
+        "[DRIVERSERVICE]\n"
+        "object_path = /3DP/printerlamp\n"
+        "interface_name = jens.printerlamp\n"
+        "[SCENES]\n"
+        "off = 8\n";
+
+    void write_file(const std::string& path, const char* content) {
+        std::FILE* file = std::fopen(path.c_str(), "w");
+        std::fputs(content, file);
+        std::fclose(file);
+    }
+
+    printer_lamp::bridge_config config_with_scene(const std::string& scene_name) {
+        printer_lamp::bridge_config config;
+        config.scenes[scene_name] = {8};
+        return config;
+    }
+
+    bool wait_readable(int fd) {
+        pollfd poll_fd {fd, POLLIN, 0};
+        return ::poll(&poll_fd, 1, 2000) == 1;
+    }
+
+    template <typename Predicate>
+    bool wait_for(Predicate predicate) {
+        for (int idx = 0; idx < 400 && !predicate(); idx++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return predicate();
+    }
+}
+
+TEST_GROUP(ConfigStoreTest) {
+    std::string config_path;
+    printer_lamp::ServiceMetrics metrics;
+
+    void setup() {
+        char path_template[] = "/tmp/driver_service_reload_XXXXXX";
+        ::close(mkstemp(path_template));
+        config_path = path_template;
+    }
+
+    void teardown() {
+        unlink(config_path.c_str());
+    }
+};
+
+TEST(ConfigStoreTest, PublishedSnapshotsStayValid) {
+    printer_lamp::ConfigStore store(config_with_scene("first"));
+    const printer_lamp::config_snapshot first = store.get();
+    store.publish(config_with_scene("second"));
+
+    UNSIGNED_LONGS_EQUAL(2, store.get_version());
+    CHECK_TRUE(store.get()->scenes.count("second") == 1);
+    CHECK_TRUE(first->scenes.count("first") == 1); // a reader can keep the snapshot it got
+}
+
+TEST(ConfigStoreTest, ReplacedSnapshotsAreFreed) {
+    printer_lamp::ConfigStore store(config_with_scene("initial"));
+    const printer_lamp::config_snapshot held = store.get();
+    std::vector<std::weak_ptr<const printer_lamp::bridge_config>> published;
+    for (int idx = 0; idx < 100; idx++) {
+        published.push_back(store.publish(config_with_scene("reload" + std::to_string(idx))));
+    }
+
+    const auto retained = std::count_if(published.begin(), published.end(), [](const std::weak_ptr<const printer_lamp::bridge_config>& snapshot) {
+        return !snapshot.expired();
+    });
+    LONGS_EQUAL(1, retained); // only the current one
+    UNSIGNED_LONGS_EQUAL(101, store.get_version());
+    CHECK_TRUE(held->scenes.count("initial") == 1); // a snapshot in use is not freed
+}
+
+TEST(ConfigStoreTest, ValidReloadIsAppliedOnTheOwnerThread) {
+    write_file(config_path, VALID_CONFIG);
+    printer_lamp::ConfigStore store(config_with_scene("initial"));
+    printer_lamp::config_snapshot applied;
+    printer_lamp::ConfigReloader reloader(config_path, store, metrics, [&applied](const printer_lamp::config_snapshot& config) { applied = config; });
+
+    reloader.request();
+    CHECK_TRUE(wait_readable(reloader.get_event_fd()));
+    POINTERS_EQUAL(nullptr, applied.get()); // only published, not applied yet
+    CHECK_TRUE(store.get()->scenes.count("off") == 1);
+
+    reloader.on_event();
+    POINTERS_EQUAL(store.get().get(), applied.get());
+    UNSIGNED_LONGS_EQUAL(1, metrics.config_reloads.get());
+    UNSIGNED_LONGS_EQUAL(1, metrics.config_reload.get_count());
+    UNSIGNED_LONGS_EQUAL(0, metrics.config_reloads_rejected.get());
+}
+
+TEST(ConfigStoreTest, InvalidReloadKeepsTheRunningConfig) {
+    write_file(config_path,
+        "[DRIVERSERVICE]\n"
+        "object_path = /3DP/printerlamp\n"
+        "interface_name = jens.printerlamp\n"
+        "[SCENES]\n"
+        "broken = 6, 9\n");
+    printer_lamp::ConfigStore store(config_with_scene("initial"));
+    int applied = 0;
+    printer_lamp::ConfigReloader reloader(config_path, store, metrics, [&applied](const printer_lamp::config_snapshot&) { applied++; });
+
+    reloader.request();
+    CHECK_TRUE(wait_for([&] { return metrics.config_reloads_rejected.get() == 1; }));
+    UNSIGNED_LONGS_EQUAL(1, store.get_version());
+    CHECK_TRUE(store.get()->scenes.count("initial") == 1);
+
+    // a missing file and an invalid object path are rejected the same way
+    unlink(config_path.c_str());
+    reloader.request();
+    CHECK_TRUE(wait_for([&] { return metrics.config_reloads_rejected.get() == 2; }));
+    write_file(config_path,
+        "[DRIVERSERVICE]\n"
+        "object_path = /3DP/printer lamp\n"
+        "interface_name = jens.printerlamp\n");
+    reloader.request();
+    CHECK_TRUE(wait_for([&] { return metrics.config_reloads_rejected.get() == 3; }));
+    UNSIGNED_LONGS_EQUAL(1, store.get_version());
+    LONGS_EQUAL(0, applied);
+}
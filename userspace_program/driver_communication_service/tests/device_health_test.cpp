@@ -0,0 +1,58 @@
+#include "device_health.hpp"
+
+#include <vector>
+
+#include "CppUTest/TestHarness.h"
+
+TEST_GROUP(DeviceHealthTest) {
+};
+
+TEST(DeviceHealthTest, BecomesAbsentAfterConsecutiveFailures) {
+    std::vector<printer_lamp::device_health> changes;
+    printer_lamp::DeviceHealth health(std::chrono::milliseconds(10), std::chrono::milliseconds(100), 3, [&changes](printer_lamp::device_health state) {
+        changes.push_back(state);
+    });
+    CHECK(health.get() == printer_lamp::device_health::healthy);
+
+    health.on_access_failed();
+    CHECK(health.get() == printer_lamp::device_health::degraded);
+    health.on_access_failed();
+    CHECK(health.get() == printer_lamp::device_health::degraded);
+    health.on_access_failed();
+    CHECK(health.get() == printer_lamp::device_health::absent);
+    UNSIGNED_LONGS_EQUAL(3, health.get_consecutive_failures());
+
+    health.on_access_succeeded();
+    CHECK(health.get() == printer_lamp::device_health::healthy);
+    UNSIGNED_LONGS_EQUAL(0, health.get_consecutive_failures());
+
+    // only changes are reported
+    UNSIGNED_LONGS_EQUAL(3, changes.size());
+    CHECK(changes[0] == printer_lamp::device_health::degraded);
+    CHECK(changes[1] == printer_lamp::device_health::absent);
+    CHECK(changes[2] == printer_lamp::device_health::healthy);
+}
+
+TEST(DeviceHealthTest, BackoffDoublesUpToTheMaximumWithJitter) {
+    printer_lamp::DeviceHealth health(std::chrono::milliseconds(10), std::chrono::milliseconds(100), 3);
+    const long expected_backoffs[] = {10, 20, 40, 80, 100, 100, 100};
+    for (const long backoff : expected_backoffs) {
+        const long delay = health.on_access_failed().count();
+        CHECK_TRUE(delay >= backoff / 2);
+        CHECK_TRUE(delay <= backoff);
+    }
+}
+
+TEST(DeviceHealthTest, SuccessAndDeviceChangesRestartTheBackoff) {
+    printer_lamp::DeviceHealth health(std::chrono::milliseconds(10), std::chrono::milliseconds(1000), 3);
+    for (int idx = 0; idx < 5; idx++) {
+        health.on_access_failed();
+    }
+    health.reset_backoff();
+    CHECK_TRUE(health.on_access_failed().count() <= 10);
+    CHECK(health.get() == printer_lamp::device_health::absent); // a device change alone does not make it healthy
+
+    health.on_access_failed();
+    health.on_access_succeeded();
+    CHECK_TRUE(health.on_access_failed().count() <= 10);
+}
@@ -0,0 +1,369 @@
+#include "driver_io_worker.hpp"
+#include "device_handle.hpp"
+#include "lamp_device.hpp"
+#include "pending_replies.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+#include "CppUTest/TestHarness.h"
+
+namespace {
+    std::string make_device_path() {
+        char path_template[] = "/tmp/printer_lamp_test_XXXXXX";
+        int fd = mkstemp(path_template);
+        close(fd);
+        unlink(path_template); // the device starts absent
+        return path_template;
+    }
+
+    void create_device_file(const std::string& path, const char* content = "", std::size_t size = 0) {
+        FILE* file = fopen(path.c_str(), "w");
+        fwrite(content, 1, size, file);
+        fclose(file);
+    }
+
+    bool wait_for_writes(const printer_lamp::DriverIoWorker& worker, std::uint64_t writes) {
+        for (int idx = 0; idx < 200; idx++) {
+            if (worker.get_stats().writes >= writes) {
+                return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return false;
+    }
+
+    // in-memory device whose write of one command blocks until open(), so a test can act while the worker is inside it
+    class GatedDevice : public printer_lamp::LampDevice {
+        public:
+            explicit GatedDevice(int gated_command) : m_gated_command{gated_command} {}
+
+            bool write_command(int command) override {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (command == m_gated_command) {
+                    m_blocked = true;
+                    m_cv.notify_all();
+                    m_cv.wait(lock, [this] { return m_open; });
+                }
+                return m_device.write_command(command);
+            }
+
+            bool read_state(std::array<char, 3>& lamp_state) override {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                return m_device.read_state(lamp_state);
+            }
+
+            void close() override {}
+
+            bool wait_until_blocked() {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                return m_cv.wait_for(lock, std::chrono::seconds(2), [this] { return m_blocked; });
+            }
+
+            void open() {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_open = true;
+                m_cv.notify_all();
+            }
+
+        private:
+            printer_lamp::MemoryDevice m_device;
+            std::mutex m_mutex;
+            std::condition_variable m_cv;
+            const int m_gated_command;
+            bool m_blocked {false};
+            bool m_open {false};
+    };
+}
+
+TEST_GROUP(DriverIoWorkerTest) {
+    std::string device_path;
+
+    void setup() {
+        device_path = make_device_path();
+    }
+
+    void teardown() {
+        unlink(device_path.c_str());
+    }
+};
+
+TEST(DriverIoWorkerTest, RejectsCommandsWhenQueueIsFull) {
+    printer_lamp::DeviceHandle device(device_path);
+    printer_lamp::LampStateCache cache;
+    printer_lamp::ServiceMetrics metrics;
+    printer_lamp::DeviceHealth health(std::chrono::seconds(10), std::chrono::seconds(10), 3);
+    printer_lamp::DriverIoWorker worker(device, cache, metrics, 2, health, std::chrono::seconds(10), [](int, std::uint64_t) {});
+
+    CHECK_TRUE(worker.enqueue(0)); // picked up by the worker, which waits for its next retry since the device is absent
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    CHECK_TRUE(worker.enqueue(1));
+    CHECK_TRUE(worker.enqueue(2));
+    CHECK_FALSE(worker.enqueue(3));
+
+    const printer_lamp::io_stats stats = worker.get_stats();
+    UNSIGNED_LONGS_EQUAL(2, stats.queue_depth);
+    UNSIGNED_LONGS_EQUAL(1, stats.rejected);
+    CHECK_TRUE(stats.write_retries > 0);
+    worker.stop();
+}
+
+TEST(DriverIoWorkerTest, AppliesQueuedCommandsOnceTheDeviceAppears) {
+    printer_lamp::DeviceHandle device(device_path);
+    printer_lamp::LampStateCache cache;
+    printer_lamp::ServiceMetrics metrics;
+    int last_written = -1;
+    std::uint64_t committed_sequence = 0;
+    printer_lamp::DeviceHealth health(std::chrono::milliseconds(10), std::chrono::milliseconds(10), 3);
+    printer_lamp::DriverIoWorker worker(device, cache, metrics, 8, health, std::chrono::seconds(10), [&last_written, &committed_sequence](int state, std::uint64_t sequence) {
+        last_written = state;
+        committed_sequence = sequence;
+    });
+
+    std::uint64_t sequence = 0;
+    CHECK_TRUE(worker.enqueue(0, sequence));
+    UNSIGNED_LONGS_EQUAL(1, sequence);
+    CHECK_TRUE(worker.enqueue(4, sequence));
+    UNSIGNED_LONGS_EQUAL(2, sequence);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30)); // let the worker run into the absent device
+    create_device_file(device_path);
+
+    CHECK_TRUE(wait_for_writes(worker, 2));
+    worker.stop();
+    LONGS_EQUAL(4, last_written);
+    UNSIGNED_LONGS_EQUAL(2, committed_sequence);
+    UNSIGNED_LONGS_EQUAL(0, worker.get_stats().queue_depth);
+    CHECK_TRUE(metrics.device_write_failures.get() > 0);
+    CHECK_FALSE(metrics.device_absent.load());
+    CHECK_TRUE(metrics.device_absent_ns.get() > 0);
+    UNSIGNED_LONGS_EQUAL(2, metrics.device_write.get_count() - metrics.device_write_failures.get());
+}
+
+TEST(DriverIoWorkerTest, RecordsAppliedBurstsInTheHistory) {
+    const std::string history_path = device_path + ".history";
+    printer_lamp::DeviceHandle device(device_path);
+    printer_lamp::LampStateCache cache;
+    printer_lamp::ServiceMetrics metrics;
+    {
+        printer_lamp::HistoryJournal history(history_path, 4096);
+        printer_lamp::DeviceHealth health(std::chrono::milliseconds(10), std::chrono::milliseconds(10), 3);
+        printer_lamp::DriverIoWorker worker(device, cache, metrics, 8, health, std::chrono::seconds(10), [](int, std::uint64_t) {}, nullptr, &history);
+
+        CHECK_TRUE(worker.enqueue_batch({0, 4}, ":1.42"));
+        std::this_thread::sleep_for(std::chrono::milliseconds(30)); // retried while the device is absent
+        create_device_file(device_path);
+        CHECK_TRUE(wait_for_writes(worker, 2));
+        worker.stop();
+
+        const std::vector<printer_lamp::history_entry> entries = history.read_since(std::chrono::system_clock::time_point(), 10);
+        UNSIGNED_LONGS_EQUAL(1, entries.size());
+        UNSIGNED_LONGS_EQUAL(1, entries[0].sequence);
+        LONGS_EQUAL(4, entries[0].command);
+        STRCMP_EQUAL(":1.42", entries[0].caller.c_str());
+        CHECK_TRUE(entries[0].retries > 0);
+        CHECK_TRUE(entries[0].write_latency_us >= 20000);
+    }
+    unlink(history_path.c_str());
+}
+
+TEST(DriverIoWorkerTest, DeviceChangeCutsTheRetryIntervalShort) {
+    printer_lamp::DeviceHandle device(device_path);
+    printer_lamp::LampStateCache cache;
+    printer_lamp::ServiceMetrics metrics;
+    printer_lamp::DeviceHealth health(std::chrono::seconds(10), std::chrono::seconds(10), 3);
+    printer_lamp::DriverIoWorker worker(device, cache, metrics, 8, health, std::chrono::seconds(10), [](int, std::uint64_t) {});
+
+    CHECK_TRUE(worker.enqueue(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(30)); // the worker waits 10 s for its next retry
+    create_device_file(device_path);
+    worker.notify_device_change();
+
+    CHECK_TRUE(wait_for_writes(worker, 1));
+    worker.stop();
+}
+
+TEST(DriverIoWorkerTest, KeepsOnlyTheLatestTargetWhileTheDeviceIsAbsent) {
+    printer_lamp::DeviceHandle device(device_path);
+    printer_lamp::LampStateCache cache;
+    printer_lamp::ServiceMetrics metrics;
+    int last_written = -1;
+    std::uint64_t committed_sequence = 0;
+    printer_lamp::DeviceHealth health(std::chrono::seconds(10), std::chrono::seconds(10), 1);
+    printer_lamp::DriverIoWorker worker(device, cache, metrics, 2, health, std::chrono::seconds(10), [&last_written, &committed_sequence](int state, std::uint64_t sequence) {
+        last_written = state;
+        committed_sequence = sequence;
+    });
+
+    CHECK_TRUE(worker.enqueue(0));
+    std::this_thread::sleep_for(std::chrono::milliseconds(30)); // the first failure makes the device absent
+    CHECK(health.get() == printer_lamp::device_health::absent);
+    UNSIGNED_LONGS_EQUAL(2, metrics.device_health.load());
+    // more commands than the queue holds - they are folded into the pending writes as they arrive
+    for (const int command : {6, 1, 2, 7, 3}) {
+        CHECK_TRUE(worker.enqueue(command));
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    UNSIGNED_LONGS_EQUAL(0, worker.get_stats().queue_depth);
+    create_device_file(device_path);
+    worker.notify_device_change();
+
+    CHECK_TRUE(wait_for_writes(worker, 1));
+    worker.stop();
+    const printer_lamp::io_stats stats = worker.get_stats();
+    UNSIGNED_LONGS_EQUAL(0, stats.rejected);
+    UNSIGNED_LONGS_EQUAL(2, stats.cancelled); // both lightplays
+    UNSIGNED_LONGS_EQUAL(1, stats.write_retries);
+    LONGS_EQUAL(3, last_written);
+    UNSIGNED_LONGS_EQUAL(6, committed_sequence);
+    CHECK(health.get() == printer_lamp::device_health::healthy);
+    UNSIGNED_LONGS_EQUAL(0, metrics.device_health.load());
+}
+
+TEST(DriverIoWorkerTest, KeepsTheStateCacheInSyncWithTheDriver) {
+    // regular file standing in for the driver: the first 3 bytes are its lamp_state array
+    const char lamp_state[] = {1, 0, 1};
+    create_device_file(device_path, lamp_state, sizeof(lamp_state));
+    printer_lamp::DeviceHandle device(device_path);
+    printer_lamp::LampStateCache cache;
+    printer_lamp::ServiceMetrics metrics;
+    printer_lamp::DeviceHealth health(std::chrono::milliseconds(10), std::chrono::milliseconds(10), 3);
+    printer_lamp::DriverIoWorker worker(device, cache, metrics, 8, health, std::chrono::milliseconds(20), [](int, std::uint64_t) {});
+
+    for (int idx = 0; idx < 200 && cache.get_reconciliations() == 0; idx++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    worker.stop();
+    CHECK_TRUE(cache.is_valid());
+    LONGS_EQUAL(7, cache.get_int_state());
+}
+
+TEST(DriverIoWorkerTest, StatusCommandCancelsTheEffectCommandsBeforeIt) {
+    printer_lamp::DeviceHandle device(device_path);
+    printer_lamp::LampStateCache cache;
+    printer_lamp::ServiceMetrics metrics;
+    int last_written = -1;
+    std::uint64_t committed_sequence = 0;
+    printer_lamp::DeviceHealth health(std::chrono::seconds(10), std::chrono::seconds(10), 3);
+    printer_lamp::DriverIoWorker worker(device, cache, metrics, 8, health, std::chrono::seconds(10), [&last_written, &committed_sequence](int state, std::uint64_t sequence) {
+        last_written = state;
+        committed_sequence = sequence;
+    });
+
+    CHECK_TRUE(worker.enqueue_batch({0, 1}, "effect", printer_lamp::command_priority::effect));
+    std::this_thread::sleep_for(std::chrono::milliseconds(30)); // the effect burst waits for its next retry
+    CHECK_TRUE(worker.enqueue_batch({3}, "effect", printer_lamp::command_priority::effect));
+    std::uint64_t sequence = 0;
+    CHECK_TRUE(worker.enqueue(2, sequence, ":1.42", printer_lamp::command_priority::status));
+    UNSIGNED_LONGS_EQUAL(4, sequence);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    create_device_file(device_path);
+    worker.notify_device_change();
+
+    CHECK_TRUE(wait_for_writes(worker, 1));
+    worker.stop();
+    const printer_lamp::io_stats stats = worker.get_stats();
+    UNSIGNED_LONGS_EQUAL(1, stats.writes);
+    UNSIGNED_LONGS_EQUAL(3, stats.cancelled); // one queued, two in flight
+    UNSIGNED_LONGS_EQUAL(1, stats.preempted_batches);
+    LONGS_EQUAL(2, last_written);
+    UNSIGNED_LONGS_EQUAL(4, committed_sequence);
+    UNSIGNED_LONGS_EQUAL(1, metrics.apply_latency(printer_lamp::command_priority::status).get_count());
+    UNSIGNED_LONGS_EQUAL(0, metrics.apply_latency(printer_lamp::command_priority::effect).get_count());
+}
+
+TEST(DriverIoWorkerTest, StatusCommandAnswersTheCommandsItCancelledWithFalse) {
+    printer_lamp::DeviceHandle device(device_path);
+    printer_lamp::LampStateCache cache;
+    printer_lamp::ServiceMetrics metrics;
+    std::mutex replies_mutex;
+    std::vector<std::pair<int, bool>> replies;
+    printer_lamp::PendingReplies<int> pending(std::chrono::seconds(10), 8, [&replies_mutex, &replies](int& command, bool committed) {
+        std::lock_guard<std::mutex> lock(replies_mutex);
+        replies.emplace_back(command, committed);
+    });
+    printer_lamp::DeviceHealth health(std::chrono::seconds(10), std::chrono::seconds(10), 3);
+    printer_lamp::DriverIoWorker worker(device, cache, metrics, 8, health, std::chrono::seconds(10), [&pending](int, std::uint64_t sequence) {
+        pending.commit(sequence);
+    }, [&pending](std::uint64_t sequence) {
+        pending.cancel(sequence);
+    });
+
+    std::uint64_t sequence = 0;
+    CHECK_TRUE(worker.enqueue(0, sequence, ":1.40", printer_lamp::command_priority::effect));
+    pending.add(sequence, 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30)); // the burst waits for its next retry
+    CHECK_TRUE(worker.enqueue(6, sequence, ":1.41", printer_lamp::command_priority::effect));
+    pending.add(sequence, 6);
+    CHECK_TRUE(worker.enqueue(2, sequence, ":1.42", printer_lamp::command_priority::status));
+    pending.add(sequence, 2);
+    create_device_file(device_path);
+    worker.notify_device_change();
+
+    CHECK_TRUE(wait_for_writes(worker, 1));
+    worker.stop();
+    UNSIGNED_LONGS_EQUAL(0, pending.size());
+    std::lock_guard<std::mutex> lock(replies_mutex);
+    UNSIGNED_LONGS_EQUAL(3, replies.size());
+    // the cut off burst and the queued lightplay are answered before the status command that replaced them
+    CHECK_TRUE(replies[0] == std::make_pair(0, false));
+    CHECK_TRUE(replies[1] == std::make_pair(6, false));
+    CHECK_TRUE(replies[2] == std::make_pair(2, true));
+}
+
+TEST(DriverIoWorkerTest, StatusCommandCommitsTheSegmentsOfACutBurstThatWereWritten) {
+    GatedDevice device(1);
+    printer_lamp::LampStateCache cache;
+    printer_lamp::ServiceMetrics metrics;
+    std::mutex replies_mutex;
+    std::vector<std::pair<int, bool>> replies;
+    printer_lamp::PendingReplies<int> pending(std::chrono::seconds(10), 8, [&replies_mutex, &replies](int& command, bool committed) {
+        std::lock_guard<std::mutex> lock(replies_mutex);
+        replies.emplace_back(command, committed);
+    });
+    printer_lamp::DeviceHealth health(std::chrono::seconds(10), std::chrono::seconds(10), 3);
+    printer_lamp::DriverIoWorker worker(device, cache, metrics, 8, health, std::chrono::seconds(10), [&pending](int, std::uint64_t sequence) {
+        pending.commit(sequence);
+    }, [&pending](std::uint64_t sequence) {
+        pending.cancel(sequence);
+    });
+
+    // two on writes, the lightplay and two off writes - the status command arrives during the second write
+    std::uint64_t sequence = 0;
+    CHECK_TRUE(worker.enqueue_batch({0, 1, 6, 3, 4}, sequence, ":1.40", printer_lamp::command_priority::effect));
+    pending.add(sequence - 3, 1);
+    pending.add(sequence, 4);
+    CHECK_TRUE(device.wait_until_blocked());
+    CHECK_TRUE(worker.enqueue(2, sequence, ":1.41", printer_lamp::command_priority::status));
+    pending.add(sequence, 2);
+    device.open();
+
+    CHECK_TRUE(wait_for_writes(worker, 3));
+    worker.stop();
+    UNSIGNED_LONGS_EQUAL(0, pending.size());
+    UNSIGNED_LONGS_EQUAL(2, worker.get_stats().cancelled); // the lightplay and the reset the off writes were coalesced into
+    UNSIGNED_LONGS_EQUAL(printer_lamp::ALL_LEDS, cache.get_mask()); // LEDs 0 and 1 of the first segment and LED 2 of the status command
+    std::lock_guard<std::mutex> lock(replies_mutex);
+    UNSIGNED_LONGS_EQUAL(3, replies.size());
+    // the first segment reached the lamp, the lightplay and the segment behind it did not
+    CHECK_TRUE(replies[0] == std::make_pair(4, false));
+    CHECK_TRUE(replies[1] == std::make_pair(1, true));
+    CHECK_TRUE(replies[2] == std::make_pair(2, true));
+}
+
+TEST(DriverIoWorkerTest, ParsesCommandPriorities) {
+    printer_lamp::command_priority priority = printer_lamp::command_priority::status;
+    CHECK_TRUE(printer_lamp::parse_command_priority("maintenance", priority));
+    CHECK(priority == printer_lamp::command_priority::maintenance);
+    CHECK_TRUE(printer_lamp::parse_command_priority("effect", priority));
+    CHECK(priority == printer_lamp::command_priority::effect);
+    CHECK_FALSE(printer_lamp::parse_command_priority("urgent", priority));
+    CHECK(priority == printer_lamp::command_priority::effect);
+}
@@ -0,0 +1,174 @@
+#include "effect_engine.hpp"
+#include "event_loop.hpp"
+
+#include <chrono>
+#include <mutex>
+#include <sys/epoll.h>
+#include <thread>
+#include <vector>
+
+#include "CppUTest/TestHarness.h"
+
+namespace {
+    struct command_log {
+        std::mutex mutex;
+        std::vector<std::vector<int>> steps;
+        std::vector<printer_lamp::command_priority> priorities;
+        bool accept {true};
+
+        printer_lamp::EffectEngine::command_sink sink() {
+            return [this](const std::vector<int>& commands, printer_lamp::command_priority priority) {
+                std::lock_guard<std::mutex> lock(mutex);
+                steps.push_back(commands);
+                priorities.push_back(priority);
+                return accept;
+            };
+        }
+
+        std::vector<std::vector<int>> get() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return steps;
+        }
+    };
+
+    // plays the effects on an event loop in its own thread, like the service does on its main thread
+    struct engine_loop {
+        printer_lamp::EventLoop loop;
+        std::thread thread;
+
+        engine_loop(printer_lamp::EffectEngine& engine, printer_lamp::ServiceMetrics& metrics) : loop{metrics.event_loop_iteration} {
+            loop.add_fd(engine.get_timer_fd(), EPOLLIN, [&engine](std::uint32_t) { engine.on_timer(); });
+            thread = std::thread(&printer_lamp::EventLoop::run, &loop);
+        }
+
+        ~engine_loop() {
+            loop.stop();
+            thread.join();
+        }
+    };
+
+    bool wait_until_finished(const printer_lamp::EffectEngine& engine) {
+        for (int idx = 0; idx < 400 && engine.is_running(); idx++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return !engine.is_running();
+    }
+}
+
+TEST_GROUP(EffectEngineTest) {
+};
+
+TEST(EffectEngineTest, PlaysTheStepsAndRestoresTheLeds) {
+    command_log log;
+    printer_lamp::ServiceMetrics metrics;
+    printer_lamp::EffectEngine engine(log.sink(), metrics);
+    engine_loop loop(engine, metrics);
+    const auto start = std::chrono::steady_clock::now();
+    CHECK_TRUE(engine.start(printer_lamp::parse_lighting_effect("blink, 3, 20, 20, 2"), printer_lamp::lamp_mask{0b100}));
+    CHECK_TRUE(wait_until_finished(engine));
+    CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(60)); // the last step is due after 60 ms
+
+    const auto steps = log.get();
+    UNSIGNED_LONGS_EQUAL(5, steps.size());
+    CHECK(steps[0] == std::vector<int>({0, 1})); // both LEDs of a deadline in one hand over
+    CHECK(steps[1] == std::vector<int>({3, 4}));
+    CHECK(steps[4] == std::vector<int>({3, 4, 2})); // restore: white and green off, blue on
+    UNSIGNED_LONGS_EQUAL(4, metrics.effect_steps.get());
+    UNSIGNED_LONGS_EQUAL(4, metrics.effect_jitter.get_count());
+    UNSIGNED_LONGS_EQUAL(1, metrics.effects_started.get());
+    UNSIGNED_LONGS_EQUAL(0, metrics.effects_preempted.get());
+}
+
+TEST(EffectEngineTest, PreemptStopsTheEffectRightAway) {
+    command_log log;
+    printer_lamp::ServiceMetrics metrics;
+    printer_lamp::EffectEngine engine(log.sink(), metrics);
+    engine_loop loop(engine, metrics);
+    CHECK_TRUE(engine.start(printer_lamp::parse_lighting_effect("timeline, 0:0, 5000:3"), printer_lamp::lamp_mask{0}));
+    for (int idx = 0; idx < 200 && log.get().empty(); idx++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    CHECK_TRUE(engine.preempt());
+    CHECK_FALSE(engine.is_running());
+    CHECK_FALSE(engine.preempt());
+
+    const auto steps = log.get();
+    UNSIGNED_LONGS_EQUAL(2, steps.size());
+    CHECK(steps[1] == std::vector<int>({3, 4, 5}));
+    UNSIGNED_LONGS_EQUAL(1, metrics.effects_preempted.get());
+}
+
+TEST(EffectEngineTest, RestoresWithThePriorityOfThePreemptingCommand) {
+    command_log log;
+    printer_lamp::ServiceMetrics metrics;
+    printer_lamp::EffectEngine engine(log.sink(), metrics);
+    engine_loop loop(engine, metrics);
+    CHECK_TRUE(engine.start(printer_lamp::parse_lighting_effect("timeline, 0:0, 5000:3"), printer_lamp::lamp_mask{0}));
+    for (int idx = 0; idx < 200 && log.get().empty(); idx++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    CHECK_TRUE(engine.preempt(printer_lamp::command_priority::status));
+
+    std::lock_guard<std::mutex> lock(log.mutex);
+    UNSIGNED_LONGS_EQUAL(2, log.priorities.size());
+    CHECK(log.priorities[0] == printer_lamp::command_priority::effect);
+    CHECK(log.priorities[1] == printer_lamp::command_priority::status);
+}
+
+TEST(EffectEngineTest, SuspendedEffectContinuesWithTheRemainingSteps) {
+    command_log log;
+    printer_lamp::ServiceMetrics metrics;
+    printer_lamp::EffectEngine engine(log.sink(), metrics);
+    engine_loop loop(engine, metrics);
+    CHECK_TRUE(engine.start(printer_lamp::parse_lighting_effect("timeline, 0:0, 50:3"), printer_lamp::lamp_mask{0}));
+    for (int idx = 0; idx < 200 && log.get().empty(); idx++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    CHECK_TRUE(engine.suspend());
+    CHECK_FALSE(engine.is_running());
+    CHECK_TRUE(engine.is_suspended());
+    std::this_thread::sleep_for(std::chrono::milliseconds(100)); // past the deadline of the second step
+    UNSIGNED_LONGS_EQUAL(1, log.get().size());
+
+    // the status command switched green on, the effect returns to that state
+    CHECK_TRUE(engine.resume(printer_lamp::lamp_mask{0b010}));
+    CHECK_TRUE(wait_until_finished(engine));
+
+    const auto steps = log.get();
+    UNSIGNED_LONGS_EQUAL(3, steps.size());
+    CHECK(steps[1] == std::vector<int>({3}));
+    CHECK(steps[2] == std::vector<int>({3, 1, 5}));
+    UNSIGNED_LONGS_EQUAL(1, metrics.effects_preempted.get());
+    UNSIGNED_LONGS_EQUAL(1, metrics.effects_resumed.get());
+    CHECK_FALSE(engine.resume(printer_lamp::lamp_mask{0}));
+}
+
+TEST(EffectEngineTest, ReplacedEffectRestoresTheStateBeforeTheFirstEffect) {
+    command_log log;
+    printer_lamp::ServiceMetrics metrics;
+    printer_lamp::EffectEngine engine(log.sink(), metrics);
+    engine_loop loop(engine, metrics);
+    CHECK_TRUE(engine.start(printer_lamp::parse_lighting_effect("timeline, 5000:0"), printer_lamp::lamp_mask{0b001}));
+    CHECK_TRUE(engine.start(printer_lamp::parse_lighting_effect("timeline, 0:1"), printer_lamp::lamp_mask{0b010}));
+    CHECK_TRUE(wait_until_finished(engine));
+
+    const auto steps = log.get();
+    UNSIGNED_LONGS_EQUAL(2, steps.size());
+    CHECK(steps[0] == std::vector<int>({1}));
+    CHECK(steps[1] == std::vector<int>({0, 4, 5}));
+    UNSIGNED_LONGS_EQUAL(2, metrics.effects_started.get());
+    UNSIGNED_LONGS_EQUAL(1, metrics.effects_preempted.get());
+}
+
+TEST(EffectEngineTest, WithoutKnownStateNothingIsRestored) {
+    command_log log;
+    log.accept = false;
+    printer_lamp::ServiceMetrics metrics;
+    printer_lamp::EffectEngine engine(log.sink(), metrics);
+    engine_loop loop(engine, metrics);
+    CHECK_TRUE(engine.start(printer_lamp::parse_lighting_effect("timeline, 0:0, 10:3"), std::nullopt));
+    CHECK_TRUE(wait_until_finished(engine));
+
+    UNSIGNED_LONGS_EQUAL(2, log.get().size());
+    UNSIGNED_LONGS_EQUAL(2, metrics.effect_steps_rejected.get());
+}
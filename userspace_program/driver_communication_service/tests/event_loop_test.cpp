@@ -0,0 +1,154 @@
+#include "event_loop.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+
+#include "CppUTest/TestHarness.h"
+
+namespace {
+    template <typename Predicate>
+    bool wait_for(Predicate predicate) {
+        for (int idx = 0; idx < 400 && !predicate(); idx++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return predicate();
+    }
+}
+
+TEST_GROUP(EventLoopTest) {
+    printer_lamp::ServiceMetrics metrics;
+    int pipe_fds[2];
+
+    void setup() {
+        CHECK_EQUAL(0, ::pipe(pipe_fds));
+    }
+
+    void teardown() {
+        ::close(pipe_fds[0]);
+        ::close(pipe_fds[1]);
+    }
+};
+
+TEST(EventLoopTest, DispatchesReadyFileDescriptors) {
+    printer_lamp::EventLoop loop(metrics.event_loop_iteration);
+    std::atomic<int> received {0};
+    loop.add_fd(pipe_fds[0], EPOLLIN, [&](std::uint32_t events) {
+        char value = 0;
+        if ((events & EPOLLIN) && ::read(pipe_fds[0], &value, 1) == 1) {
+            received.fetch_add(value);
+        }
+    });
+    std::thread thread(&printer_lamp::EventLoop::run, &loop);
+
+    CHECK_EQUAL(1, ::write(pipe_fds[1], "\x02", 1));
+    CHECK_EQUAL(1, ::write(pipe_fds[1], "\x03", 1));
+    CHECK_TRUE(wait_for([&] { return received.load() == 5; }));
+
+    loop.stop();
+    thread.join();
+    CHECK(metrics.event_loop_iteration.get_count() > 0);
+}
+
+TEST(EventLoopTest, PrepareCallbacksLimitTheWait) {
+    printer_lamp::EventLoop loop(metrics.event_loop_iteration);
+    int prepared = 0;
+    loop.add_prepare([&]() {
+        if (++prepared == 5) {
+            loop.stop();
+        }
+        return 1; // nothing is ready, so every wait ends after 1 ms
+    });
+    const auto start = std::chrono::steady_clock::now();
+    loop.run();
+    CHECK_EQUAL(5, prepared);
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+}
+
+TEST(EventLoopTest, WakeupRunsThePrepareCallbacksAgain) {
+    printer_lamp::EventLoop loop(metrics.event_loop_iteration);
+    std::atomic<int> prepared {0};
+    loop.add_prepare([&]() {
+        prepared.fetch_add(1);
+        return -1;
+    });
+    std::thread thread(&printer_lamp::EventLoop::run, &loop);
+    CHECK_TRUE(wait_for([&] { return prepared.load() == 1; }));
+
+    loop.wakeup();
+    CHECK_TRUE(wait_for([&] { return prepared.load() == 2; }));
+    loop.stop();
+    thread.join();
+}
+
+TEST(EventLoopTest, RemovedFileDescriptorsAreNotDispatched) {
+    printer_lamp::EventLoop loop(metrics.event_loop_iteration);
+    int dispatched = 0;
+    loop.add_fd(pipe_fds[0], EPOLLIN, [&](std::uint32_t) { dispatched++; });
+    loop.remove_fd(pipe_fds[0]);
+    CHECK_EQUAL(1, ::write(pipe_fds[1], "x", 1));
+    loop.add_prepare([&]() {
+        loop.stop();
+        return 0;
+    });
+    loop.run();
+    CHECK_EQUAL(0, dispatched);
+}
+
+TEST(EventLoopTest, RemovedFileDescriptorsCanBeRegisteredAgainFromACallback) {
+    printer_lamp::EventLoop loop(metrics.event_loop_iteration);
+    int replaced = 0;
+    int dispatched = 0;
+    // like a recreated lamp whose new timerfd gets the number of the closed one
+    loop.add_fd(pipe_fds[0], EPOLLIN, [&](std::uint32_t) {
+        loop.remove_fd(pipe_fds[0]);
+        loop.add_fd(pipe_fds[0], EPOLLIN, [&](std::uint32_t) {
+            dispatched++;
+            loop.stop();
+        });
+        replaced++;
+    });
+    CHECK_EQUAL(1, ::write(pipe_fds[1], "x", 1));
+    loop.run();
+    CHECK_EQUAL(1, replaced);
+    CHECK_EQUAL(1, dispatched);
+}
+
+TEST(EventLoopTest, DeviceWatchReportsTheDeviceFile) {
+    char directory[] = "/tmp/event_loop_test_XXXXXX";
+    CHECK(::mkdtemp(directory) != nullptr);
+    const std::string device_path = std::string(directory) + "/printer_lamp";
+
+    printer_lamp::EventLoop loop(metrics.event_loop_iteration);
+    std::vector<bool> changes;
+    std::atomic<std::size_t> num_changes {0};
+    {
+        printer_lamp::DeviceWatch watch(loop, device_path, [&](bool present) {
+            changes.push_back(present);
+            num_changes.store(changes.size());
+        });
+        std::thread thread(&printer_lamp::EventLoop::run, &loop);
+
+        const int fd = ::open((std::string(directory) + "/other_file").c_str(), O_WRONLY | O_CREAT, 0644); // not the device
+        ::close(fd);
+        CHECK_EQUAL(0, ::mkfifo(device_path.c_str(), 0666));
+        CHECK_TRUE(wait_for([&] { return num_changes.load() >= 1; }));
+        CHECK_EQUAL(0, ::unlink(device_path.c_str()));
+        CHECK_TRUE(wait_for([&] { return num_changes.load() >= 2; }));
+
+        loop.stop();
+        thread.join();
+    }
+    CHECK_TRUE(changes.front());
+    CHECK_FALSE(changes.back());
+
+    ::unlink((std::string(directory) + "/other_file").c_str());
+    ::rmdir(directory);
+}
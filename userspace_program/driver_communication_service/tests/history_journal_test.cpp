@@ -0,0 +1,100 @@
+#include "history_journal.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+#include "CppUTest/TestHarness.h"
+
+namespace {
+    // header and four records
+    constexpr std::size_t FOUR_RECORDS = 64 + 4 * sizeof(printer_lamp::history_record);
+
+    const std::chrono::system_clock::time_point EPOCH {};
+}
+
+TEST_GROUP(HistoryJournalTest) {
+    std::string journal_path;
+
+    void setup() {
+        char path_template[] = "/tmp/printer_lamp_history_XXXXXX";
+        ::close(mkstemp(path_template));
+        journal_path = path_template;
+    }
+
+    void teardown() {
+        unlink(journal_path.c_str());
+    }
+};
+
+TEST(HistoryJournalTest, ReadsTheAppendedRecordsOldestFirst) {
+    printer_lamp::HistoryJournal journal(journal_path, FOUR_RECORDS);
+    UNSIGNED_LONGS_EQUAL(4, journal.get_capacity());
+    journal.append(1, 0b001, ":1.7", std::chrono::microseconds(250), 0);
+    journal.append(8, 0xFF, "effect", std::chrono::milliseconds(3), 2);
+
+    const std::vector<printer_lamp::history_entry> entries = journal.read_since(EPOCH, 10);
+    UNSIGNED_LONGS_EQUAL(2, entries.size());
+    UNSIGNED_LONGS_EQUAL(1, entries[0].sequence);
+    LONGS_EQUAL(1, entries[0].command);
+    UNSIGNED_LONGS_EQUAL(0b001, entries[0].mask);
+    STRCMP_EQUAL(":1.7", entries[0].caller.c_str());
+    UNSIGNED_LONGS_EQUAL(250, entries[0].write_latency_us);
+    UNSIGNED_LONGS_EQUAL(0, entries[0].retries);
+    UNSIGNED_LONGS_EQUAL(2, entries[1].sequence);
+    UNSIGNED_LONGS_EQUAL(0xFF, entries[1].mask);
+    STRCMP_EQUAL("effect", entries[1].caller.c_str());
+    UNSIGNED_LONGS_EQUAL(3000, entries[1].write_latency_us);
+    UNSIGNED_LONGS_EQUAL(2, entries[1].retries);
+    CHECK_TRUE(entries[0].timestamp_ns <= entries[1].timestamp_ns);
+}
+
+TEST(HistoryJournalTest, RollsOverOnceTheFileIsFull) {
+    printer_lamp::HistoryJournal journal(journal_path, FOUR_RECORDS);
+    for (int command = 0; command < 6; command++) {
+        journal.append(command, 0, "", std::chrono::nanoseconds(0), 0);
+    }
+    UNSIGNED_LONGS_EQUAL(6, journal.get_appended());
+
+    const std::vector<printer_lamp::history_entry> entries = journal.read_since(EPOCH, 10);
+    UNSIGNED_LONGS_EQUAL(4, entries.size());
+    UNSIGNED_LONGS_EQUAL(3, entries[0].sequence); // the first two were overwritten
+    LONGS_EQUAL(2, entries[0].command);
+    LONGS_EQUAL(5, entries[3].command);
+}
+
+TEST(HistoryJournalTest, ReadsOnlyThePeriodAndNumberThatWereAskedFor) {
+    printer_lamp::HistoryJournal journal(journal_path, FOUR_RECORDS);
+    journal.append(0, 0, "", std::chrono::nanoseconds(0), 0);
+    const auto since = std::chrono::system_clock::now();
+    journal.append(1, 0, "", std::chrono::nanoseconds(0), 0);
+    journal.append(2, 0, "", std::chrono::nanoseconds(0), 0);
+
+    std::vector<printer_lamp::history_entry> entries = journal.read_since(since, 10);
+    UNSIGNED_LONGS_EQUAL(2, entries.size());
+    LONGS_EQUAL(1, entries[0].command);
+    entries = journal.read_since(EPOCH, 1);
+    UNSIGNED_LONGS_EQUAL(1, entries.size());
+    LONGS_EQUAL(0, entries[0].command);
+    CHECK_TRUE(journal.read_since(std::chrono::system_clock::now() + std::chrono::hours(1), 10).empty());
+}
+
+TEST(HistoryJournalTest, ContinuesAnExistingJournalWithTheSameLayout) {
+    {
+        printer_lamp::HistoryJournal journal(journal_path, FOUR_RECORDS);
+        journal.append(3, 0, ":1.1", std::chrono::nanoseconds(0), 0);
+    }
+    {
+        printer_lamp::HistoryJournal journal(journal_path, FOUR_RECORDS);
+        UNSIGNED_LONGS_EQUAL(1, journal.get_appended());
+        journal.append(4, 0, ":1.2", std::chrono::nanoseconds(0), 0);
+        const std::vector<printer_lamp::history_entry> entries = journal.read_since(EPOCH, 10);
+        UNSIGNED_LONGS_EQUAL(2, entries.size());
+        STRCMP_EQUAL(":1.1", entries[0].caller.c_str());
+    }
+    // another size is another layout - the journal starts over
+    printer_lamp::HistoryJournal journal(journal_path, 2 * FOUR_RECORDS);
+    UNSIGNED_LONGS_EQUAL(0, journal.get_appended());
+    CHECK_TRUE(journal.read_since(EPOCH, 10).empty());
+}
@@ -0,0 +1,118 @@
+#include "lamp_device.hpp"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "CppUTest/TestHarness.h"
+
+namespace {
+    std::string make_temp_path() {
+        char path_template[] = "/tmp/printer_lamp_device_test_XXXXXX";
+        close(mkstemp(path_template));
+        return path_template;
+    }
+
+    std::string read_file(const std::string& path) {
+        std::ifstream file(path);
+        std::stringstream content;
+        content << file.rdbuf();
+        return content.str();
+    }
+
+    printer_lamp::lamp_mask read_mask(printer_lamp::LampDevice& device) {
+        std::array<char, 3> lamp_state {};
+        CHECK_TRUE(device.read_state(lamp_state));
+        return printer_lamp::mask_from_lamp_state(lamp_state);
+    }
+}
+
+TEST_GROUP(LampDeviceTest) {
+    std::string path;
+
+    void setup() {
+        path = make_temp_path();
+    }
+
+    void teardown() {
+        unlink(path.c_str());
+    }
+};
+
+TEST(LampDeviceTest, MemoryBackendFollowsTheDriverSemantics) {
+    printer_lamp::MemoryDevice device;
+    CHECK_TRUE(device.write_command(0));
+    CHECK_TRUE(device.write_command(2));
+    CHECK_TRUE(device.write_command(6)); // the lightplay restores the state
+    UNSIGNED_LONGS_EQUAL(0b101, read_mask(device));
+    CHECK_TRUE(device.write_command(8));
+    UNSIGNED_LONGS_EQUAL(0b000, read_mask(device));
+    CHECK_FALSE(device.write_command(9));
+    UNSIGNED_LONGS_EQUAL(4, device.get_write_count());
+}
+
+TEST(LampDeviceTest, EmulatedBackendWritesTheTextProtocolToAFile) {
+    printer_lamp::EmulatedDevice device(path);
+    CHECK_TRUE(device.write_command(1));
+    CHECK_TRUE(device.write_command(0));
+    CHECK_TRUE(device.write_command(4));
+    STRCMP_EQUAL("1\n0\n4\n", read_file(path).c_str());
+    UNSIGNED_LONGS_EQUAL(0b001, read_mask(device));
+}
+
+TEST(LampDeviceTest, EmulatedBackendIsAbsentWithoutTheFile) {
+    printer_lamp::EmulatedDevice device(path);
+    CHECK_TRUE(device.write_command(0));
+    unlink(path.c_str()); // like device_destroy() on the shutdown IRQ
+    CHECK_FALSE(device.write_command(1));
+
+    std::ofstream recreated(path);
+    recreated.close();
+    CHECK_TRUE(device.write_command(1));
+    STRCMP_EQUAL("1\n", read_file(path).c_str());
+}
+
+TEST(LampDeviceTest, EmulatedBackendTreatsAFifoWithoutReaderAsAbsent) {
+    unlink(path.c_str());
+    CHECK_EQUAL(0, mkfifo(path.c_str(), 0600));
+    printer_lamp::EmulatedDevice device(path);
+    CHECK_FALSE(device.write_command(0));
+
+    const int reader = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+    CHECK_TRUE(device.write_command(2));
+    char received[3] = {};
+    CHECK_EQUAL(2, read(reader, received, sizeof(received)));
+    STRCMP_EQUAL("2\n", received);
+    close(reader);
+}
+
+TEST(LampDeviceTest, FaultInjectionFailsEveryAccess) {
+    printer_lamp::FaultInjectingDevice device(std::make_unique<printer_lamp::MemoryDevice>(), 0, 1.0);
+    CHECK_FALSE(device.write_command(0));
+    std::array<char, 3> lamp_state {};
+    CHECK_FALSE(device.read_state(lamp_state));
+}
+
+TEST(LampDeviceTest, FaultInjectionAddsLatency) {
+    printer_lamp::FaultInjectingDevice device(std::make_unique<printer_lamp::MemoryDevice>(), 2000, 0.0);
+    const auto start = std::chrono::steady_clock::now();
+    CHECK_TRUE(device.write_command(0));
+    CHECK_TRUE(std::chrono::steady_clock::now() - start >= std::chrono::microseconds(2000));
+}
+
+TEST(LampDeviceTest, FactorySelectsTheConfiguredBackend) {
+    printer_lamp::device_config config;
+    config.backend = "memory";
+    CHECK_TRUE(dynamic_cast<printer_lamp::MemoryDevice*>(printer_lamp::create_lamp_device(config).get()) != nullptr);
+    config.failure_rate = 0.5;
+    CHECK_TRUE(dynamic_cast<printer_lamp::FaultInjectingDevice*>(printer_lamp::create_lamp_device(config).get()) != nullptr);
+    config.backend = "gpio";
+    CHECK_TRUE(printer_lamp::create_lamp_device(config) == nullptr);
+}
@@ -0,0 +1,131 @@
+#include "lamp_simulator.hpp"
+
+#include <array>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "CppUTest/TestHarness.h"
+
+namespace {
+    constexpr std::uint32_t PIN_16 = 1u << 16;
+    constexpr std::uint32_t PIN_20 = 1u << 20;
+    constexpr std::uint32_t PIN_21 = 1u << 21;
+
+    std::array<char, 3> lamp_state(char first, char second, char third) {
+        return {first, second, third};
+    }
+
+    std::vector<std::string> events_of(const printer_lamp::GpioTimeline& timeline) {
+        std::vector<std::string> events;
+        for (const auto& entry : timeline.get_entries()) {
+            events.push_back(entry.event);
+        }
+        return events;
+    }
+}
+
+TEST_GROUP(LampSimulatorTest) {
+    printer_lamp::GpioTimeline* timeline;
+    printer_lamp::SimulatedLampDriver* driver;
+    std::vector<bool> device_changes;
+
+    void setup() {
+        timeline = new printer_lamp::GpioTimeline(nullptr);
+        driver = new printer_lamp::SimulatedLampDriver(*timeline, std::chrono::milliseconds(0), [this](bool present) {
+            device_changes.push_back(present);
+        });
+    }
+
+    void teardown() {
+        delete driver;
+        delete timeline;
+    }
+};
+
+TEST(LampSimulatorTest, InitConfiguresTheLampPinsAsClearedOutputs) {
+    const auto entries = timeline->get_entries();
+    UNSIGNED_LONGS_EQUAL(4, entries.size());
+    STRCMP_EQUAL("GPFSEL1", entries[0].event.c_str());
+    UNSIGNED_LONGS_EQUAL(1u << 18, entries[0].value); // pin 16: bits 18-20 = 001
+    STRCMP_EQUAL("GPFSEL2", entries[2].event.c_str());
+    UNSIGNED_LONGS_EQUAL(1u | (1u << 3), entries[2].value); // pins 20 and 21
+    STRCMP_EQUAL("GPCLR0", entries[3].event.c_str()); // all pins with one write
+    UNSIGNED_LONGS_EQUAL(PIN_16 | PIN_20 | PIN_21, entries[3].value);
+    UNSIGNED_LONGS_EQUAL(0, driver->get_gpio_level());
+}
+
+TEST(LampSimulatorTest, CommandsSetAndClearTheLampPins) {
+    CHECK_TRUE(driver->write("0\n"));
+    CHECK_TRUE(driver->write("2"));
+    UNSIGNED_LONGS_EQUAL(PIN_16 | PIN_21, driver->get_gpio_level());
+    CHECK(lamp_state(1, 0, 1) == driver->read());
+
+    CHECK_TRUE(driver->write("3\n"));
+    UNSIGNED_LONGS_EQUAL(PIN_21, driver->get_gpio_level());
+    CHECK(lamp_state(0, 0, 1) == driver->read());
+
+    const auto entries = timeline->get_entries();
+    STRCMP_EQUAL("GPCLR0", entries.back().event.c_str());
+    UNSIGNED_LONGS_EQUAL(PIN_16, entries.back().value);
+}
+
+TEST(LampSimulatorTest, InvalidWritesAreIgnored) {
+    CHECK_TRUE(driver->write("1\n"));
+    CHECK_FALSE(driver->write("on\n"));
+    CHECK_FALSE(driver->write("9\n"));
+    CHECK_FALSE(driver->write("-1\n"));
+    CHECK(lamp_state(0, 1, 0) == driver->read());
+
+    const auto events = events_of(*timeline);
+    STRCMP_EQUAL("INVALID_FORMAT", events[events.size() - 3].c_str());
+    STRCMP_EQUAL("INVALID_COMMAND", events[events.size() - 2].c_str());
+}
+
+TEST(LampSimulatorTest, LightplayRestoresTheLedState) {
+    driver->write("1\n");
+    const std::size_t before = timeline->get_entries().size();
+    CHECK_TRUE(driver->write("7\n"));
+    UNSIGNED_LONGS_EQUAL(PIN_20, driver->get_gpio_level());
+    CHECK(lamp_state(0, 1, 0) == driver->read());
+
+    // COMMAND, 3x on/off from pin 21 to 16, one clear of all pins and the restored pin 20
+    const auto entries = timeline->get_entries();
+    UNSIGNED_LONGS_EQUAL(before + 1 + 6 + 1 + 1, entries.size());
+    UNSIGNED_LONGS_EQUAL(PIN_21, entries[before + 1].value);
+    UNSIGNED_LONGS_EQUAL(PIN_16, entries[before + 5].value);
+    STRCMP_EQUAL("GPSET0", entries.back().event.c_str());
+    UNSIGNED_LONGS_EQUAL(PIN_20, entries.back().value);
+}
+
+TEST(LampSimulatorTest, ResetClearsPinsAndState) {
+    driver->write("0\n");
+    driver->write("1\n");
+    const std::size_t before = timeline->get_entries().size();
+    CHECK_TRUE(driver->write("8\n"));
+    UNSIGNED_LONGS_EQUAL(before + 2, timeline->get_entries().size()); // COMMAND and a single GPCLR0
+    UNSIGNED_LONGS_EQUAL(0, driver->get_gpio_level());
+    CHECK(lamp_state(0, 0, 0) == driver->read());
+}
+
+TEST(LampSimulatorTest, IrqsCreateAndRemoveTheDeviceFile) {
+    CHECK_FALSE(driver->is_activated());
+    const auto start = std::chrono::steady_clock::now();
+    driver->detection_irq();
+    CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(100)); // debounce of the module
+    CHECK_TRUE(driver->is_activated());
+    driver->detection_irq(); // already active
+    UNSIGNED_LONGS_EQUAL(1, device_changes.size());
+    CHECK_TRUE(device_changes[0]);
+
+    driver->write("2\n");
+    driver->shutdown_irq();
+    CHECK_FALSE(driver->is_activated());
+    UNSIGNED_LONGS_EQUAL(2, device_changes.size());
+    CHECK_FALSE(device_changes[1]);
+
+    // the lightplay of the shutdown clears the pin but lamp_state survives like in the module
+    UNSIGNED_LONGS_EQUAL(0, driver->get_gpio_level());
+    CHECK(lamp_state(0, 0, 1) == driver->read());
+    STRCMP_EQUAL("DEVICE_REMOVED", events_of(*timeline).back().c_str());
+}
@@ -0,0 +1,43 @@
+#include "lamp_state_cache.hpp"
+
+#include "CppUTest/TestHarness.h"
+
+TEST_GROUP(LampStateCacheTest) {
+};
+
+TEST(LampStateCacheTest, DecodesTheDocumentedEncoding) {
+    LONGS_EQUAL(0, printer_lamp::mask_to_int_state(0b000));
+    LONGS_EQUAL(1, printer_lamp::mask_to_int_state(0b001));
+    LONGS_EQUAL(2, printer_lamp::mask_to_int_state(0b011));
+    LONGS_EQUAL(3, printer_lamp::mask_to_int_state(0b111));
+    LONGS_EQUAL(4, printer_lamp::mask_to_int_state(0b110));
+    LONGS_EQUAL(5, printer_lamp::mask_to_int_state(0b100));
+    LONGS_EQUAL(6, printer_lamp::mask_to_int_state(0b010));
+    LONGS_EQUAL(7, printer_lamp::mask_to_int_state(0b101));
+}
+
+TEST(LampStateCacheTest, DecodesTheDriverRead) {
+    const std::array<char, 3> lamp_state = {1, 1, 0};
+    LONGS_EQUAL(2, printer_lamp::mask_to_int_state(printer_lamp::mask_from_lamp_state(lamp_state)));
+}
+
+TEST(LampStateCacheTest, IsInvalidUntilTheFirstUpdate) {
+    printer_lamp::LampStateCache cache;
+    CHECK_FALSE(cache.is_valid());
+    LONGS_EQUAL(-1, cache.get_int_state());
+
+    cache.update(0b100);
+    CHECK_TRUE(cache.is_valid());
+    LONGS_EQUAL(5, cache.get_int_state());
+}
+
+TEST(LampStateCacheTest, CountsMismatchesOnReconciliation) {
+    printer_lamp::LampStateCache cache;
+    CHECK_TRUE(cache.reconcile(0b001)); // nothing cached yet - no mismatch
+    CHECK_TRUE(cache.reconcile(0b001));
+    CHECK_FALSE(cache.reconcile(0b011));
+
+    UNSIGNED_LONGS_EQUAL(3, cache.get_reconciliations());
+    UNSIGNED_LONGS_EQUAL(1, cache.get_mismatches());
+    UNSIGNED_LONGS_EQUAL(0b011, cache.get_mask());
+}
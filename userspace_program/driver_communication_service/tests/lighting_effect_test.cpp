@@ -0,0 +1,72 @@
+#include "lighting_effect.hpp"
+
+#include <stdexcept>
+
+#include "CppUTest/TestHarness.h"
+
+namespace {
+    void check_step(const printer_lamp::effect_step& step, long offset_ms, int command) {
+        LONGS_EQUAL(offset_ms, step.offset.count());
+        LONGS_EQUAL(command, step.command);
+    }
+
+    bool is_rejected(const char* definition) {
+        try {
+            printer_lamp::parse_lighting_effect(definition);
+        } catch (const std::invalid_argument&) {
+            return true;
+        }
+        return false;
+    }
+}
+
+TEST_GROUP(LightingEffectTest) {
+};
+
+TEST(LightingEffectTest, BlinkSwitchesAllLedsOfTheMask) {
+    const printer_lamp::lighting_effect effect = printer_lamp::parse_lighting_effect("blink, 5, 100, 50, 2");
+    UNSIGNED_LONGS_EQUAL(8, effect.size());
+    check_step(effect[0], 0, 0);
+    check_step(effect[1], 0, 2);
+    check_step(effect[2], 100, 3);
+    check_step(effect[3], 100, 5);
+    check_step(effect[4], 150, 0);
+    check_step(effect[7], 250, 5);
+}
+
+TEST(LightingEffectTest, ChaseRunsOneLedAfterTheOther) {
+    const printer_lamp::lighting_effect effect = printer_lamp::parse_lighting_effect("chase, 100, 1");
+    UNSIGNED_LONGS_EQUAL(6, effect.size());
+    check_step(effect[0], 0, 0);
+    check_step(effect[1], 100, 3);
+    check_step(effect[2], 100, 1); // the next LED goes on when the previous one goes off
+    check_step(effect[5], 300, 5);
+}
+
+TEST(LightingEffectTest, PulseTrainPausesBetweenTrains) {
+    const printer_lamp::lighting_effect effect = printer_lamp::parse_lighting_effect("pulse_train, 2, 10, 20, 2, 500, 2");
+    UNSIGNED_LONGS_EQUAL(8, effect.size());
+    check_step(effect[2], 30, 1);
+    check_step(effect[3], 40, 4);
+    check_step(effect[4], 540, 1); // 30 + 10 pulse + 500 pause
+}
+
+TEST(LightingEffectTest, TimelineIsSortedByOffset) {
+    const printer_lamp::lighting_effect effect = printer_lamp::parse_lighting_effect("timeline, 200:8, 0:1, 100:4, 100:2");
+    UNSIGNED_LONGS_EQUAL(4, effect.size());
+    check_step(effect[0], 0, 1);
+    check_step(effect[1], 100, 4);
+    check_step(effect[2], 100, 2);
+    check_step(effect[3], 200, 8);
+}
+
+TEST(LightingEffectTest, InvalidDefinitionsAreRejected) {
+    CHECK_TRUE(is_rejected(""));
+    CHECK_TRUE(is_rejected("sparkle, 100"));
+    CHECK_TRUE(is_rejected("blink, 8, 100, 100, 1"));
+    CHECK_TRUE(is_rejected("blink, 7, 100, 1"));
+    CHECK_TRUE(is_rejected("chase, 0, 1"));
+    CHECK_TRUE(is_rejected("timeline, 0:6"));
+    CHECK_TRUE(is_rejected("timeline, 100"));
+    CHECK_TRUE(is_rejected("timeline"));
+}
@@ -0,0 +1,100 @@
+#include "latency_histogram.hpp"
+#include "load_profile.hpp"
+
+#include <chrono>
+#include <stdexcept>
+
+#include "CppUTest/TestHarness.h"
+
+TEST_GROUP(LoadGeneratorTest) {
+};
+
+TEST(LoadGeneratorTest, HistogramKeepsTwoSignificantDigits) {
+    printer_lamp::HdrLatencyHistogram histogram;
+    for (std::uint64_t value = 1; value <= 1000000; value = value * 3 + 1) {
+        const std::uint64_t reported = printer_lamp::HdrLatencyHistogram::highest_equivalent(printer_lamp::HdrLatencyHistogram::bucket_of(value));
+        CHECK_TRUE(reported >= value);
+        CHECK_TRUE(reported - value <= value / 64);
+    }
+    UNSIGNED_LONGS_EQUAL(printer_lamp::HdrLatencyHistogram::BUCKETS - 1, printer_lamp::HdrLatencyHistogram::bucket_of(UINT64_MAX));
+    UNSIGNED_LONGS_EQUAL(0, histogram.value_at_quantile(0.5));
+}
+
+TEST(LoadGeneratorTest, HistogramReportsPercentilesOfMergedThreads) {
+    printer_lamp::HdrLatencyHistogram first;
+    printer_lamp::HdrLatencyHistogram second;
+    for (std::uint64_t value = 1; value <= 100; value++) {
+        first.record(value);
+    }
+    second.record(50000);
+    first.merge(second);
+    UNSIGNED_LONGS_EQUAL(101, first.count());
+    UNSIGNED_LONGS_EQUAL(1, first.min());
+    UNSIGNED_LONGS_EQUAL(50000, first.max());
+    UNSIGNED_LONGS_EQUAL(51, first.value_at_quantile(0.5));
+    UNSIGNED_LONGS_EQUAL(100, first.value_at_quantile(0.99));
+    UNSIGNED_LONGS_EQUAL(50000, first.value_at_quantile(1.0));
+    DOUBLES_EQUAL((5050.0 + 50000.0) / 101.0, first.mean(), 0.001);
+}
+
+TEST(LoadGeneratorTest, SchedulesBurstsWithTheMeanRate) {
+    printer_lamp::ArrivalSchedule constant(printer_lamp::arrival_shape::constant, 1000.0, 1, 1);
+    LONGS_EQUAL(0, constant.next().count());
+    LONGS_EQUAL(1000000, constant.next().count());
+
+    printer_lamp::ArrivalSchedule burst(printer_lamp::arrival_shape::burst, 1000.0, 4, 1);
+    for (int idx = 0; idx < 4; idx++) {
+        LONGS_EQUAL(0, burst.next().count());
+    }
+    LONGS_EQUAL(4000000, burst.next().count());
+
+    printer_lamp::ArrivalSchedule poisson(printer_lamp::arrival_shape::poisson, 1000.0, 1, 7);
+    std::chrono::nanoseconds last {0};
+    for (int idx = 0; idx < 10000; idx++) {
+        const std::chrono::nanoseconds offset = poisson.next();
+        CHECK_TRUE(offset >= last);
+        last = offset;
+    }
+    // 10000 calls at 1000/s take about 10 s
+    DOUBLES_EQUAL(10.0, std::chrono::duration<double>(last).count(), 0.5);
+}
+
+TEST(LoadGeneratorTest, ParsesAndRejectsOptions) {
+    const char* argv[] = {"lamp_load_generator", "--connections=8", "--mix=3:1", "--loop=open", "--rate=500", "--shape=burst", "--commands=1,4", "--session-bus"};
+    const printer_lamp::load_options options = printer_lamp::parse_load_options(8, argv);
+    UNSIGNED_LONGS_EQUAL(8, options.connections);
+    UNSIGNED_LONGS_EQUAL(3, options.set_weight);
+    UNSIGNED_LONGS_EQUAL(1, options.get_weight);
+    CHECK_TRUE(options.loop == printer_lamp::load_loop::open);
+    CHECK_TRUE(options.shape == printer_lamp::arrival_shape::burst);
+    DOUBLES_EQUAL(500.0, options.rate_per_s, 0.0);
+    UNSIGNED_LONGS_EQUAL(2, options.commands.size());
+    CHECK_TRUE(options.session_bus);
+
+    const char* invalid[][2] = {{"", "--mix=0:0"}, {"", "--commands=9"}, {"", "--connections=0"}, {"", "--verbose"}};
+    for (const auto& arguments : invalid) {
+        bool rejected = false;
+        try {
+            printer_lamp::parse_load_options(2, arguments);
+        } catch (const std::invalid_argument&) {
+            rejected = true;
+        }
+        CHECK_TRUE(rejected);
+    }
+}
+
+TEST(LoadGeneratorTest, SignalAnswersTheOlderCalls) {
+    using clock_type = printer_lamp::SignalLatencyTracker::clock_type;
+    printer_lamp::SignalLatencyTracker tracker;
+    const clock_type::time_point start = clock_type::now();
+    tracker.sent(0, start);
+    tracker.sent(1, start + std::chrono::milliseconds(1));
+    tracker.sent(1, start + std::chrono::milliseconds(2)); // only the oldest call per command is tracked
+
+    // the throttled signal only reports the last command, the first call is superseded
+    std::chrono::nanoseconds latency {0};
+    CHECK_TRUE(tracker.on_signal(1, start + std::chrono::milliseconds(5), latency));
+    LONGS_EQUAL(4, std::chrono::duration_cast<std::chrono::milliseconds>(latency).count());
+    UNSIGNED_LONGS_EQUAL(1, tracker.get_superseded());
+    CHECK_FALSE(tracker.on_signal(0, start + std::chrono::milliseconds(6), latency));
+}
@@ -0,0 +1,148 @@
+#include "logger.hpp"
+
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "CppUTest/TestHarness.h"
+
+namespace {
+    int evaluated = 0;
+
+    int count_evaluation() {
+        return ++evaluated;
+    }
+
+    // reads the pipe until its write end is closed
+    std::string read_all(int fd) {
+        std::string content;
+        char buffer[4096];
+        ssize_t length;
+        while ((length = ::read(fd, buffer, sizeof(buffer))) > 0) {
+            content.append(buffer, static_cast<std::size_t>(length));
+        }
+        return content;
+    }
+}
+
+TEST_GROUP(LoggerTest) {
+    int pipe_fds[2];
+
+    void setup() {
+        CHECK_EQUAL(0, ::pipe(pipe_fds));
+    }
+
+    void teardown() {
+        ::close(pipe_fds[0]);
+        if (pipe_fds[1] >= 0) {
+            ::close(pipe_fds[1]);
+        }
+    }
+
+    std::string close_and_read() {
+        ::close(pipe_fds[1]);
+        pipe_fds[1] = -1;
+        return read_all(pipe_fds[0]);
+    }
+};
+
+TEST(LoggerTest, RingHandsOutItsSlotsInOrder) {
+    printer_lamp::LogRing ring(3); // rounded up to 4
+    UNSIGNED_LONGS_EQUAL(4, ring.capacity());
+    for (int idx = 0; idx < 4; idx++) {
+        printer_lamp::log_entry* entry = ring.try_claim();
+        CHECK_TRUE(entry != nullptr);
+        entry->length = static_cast<std::uint16_t>(idx);
+        ring.commit();
+    }
+    CHECK_TRUE(ring.try_claim() == nullptr);
+
+    UNSIGNED_LONGS_EQUAL(4, ring.readable());
+    UNSIGNED_LONGS_EQUAL(0, ring.peek(0).length);
+    UNSIGNED_LONGS_EQUAL(1, ring.peek(1).length);
+    ring.pop(2);
+    UNSIGNED_LONGS_EQUAL(2, ring.peek(0).length);
+    CHECK_TRUE(ring.try_claim() != nullptr); // the consumer freed two slots
+}
+
+TEST(LoggerTest, RecordsAreWrittenAsLines) {
+    {
+        printer_lamp::Logger logger(printer_lamp::log_target::stdout_lines, 16, pipe_fds[1]);
+        printer_lamp::LogRecord(logger, printer_lamp::log_level::info) << "state " << 42 << ' ' << std::string("of") << ' ' << 1.5 << ' ' << -7L;
+        printer_lamp::LogRecord(logger, printer_lamp::log_level::error) << "device gone";
+        logger.flush();
+    }
+    STRCMP_EQUAL("[info] state 42 of 1.5 -7\n[error] device gone\n", close_and_read().c_str());
+}
+
+TEST(LoggerTest, LongRecordsAreTruncated) {
+    {
+        printer_lamp::Logger logger(printer_lamp::log_target::stdout_lines, 16, pipe_fds[1]);
+        printer_lamp::LogRecord(logger, printer_lamp::log_level::warning) << std::string(1000, 'x');
+        logger.flush();
+    }
+    const std::string expected = "[warning] " + std::string(printer_lamp::log_entry::MAX_TEXT, 'x') + "\n";
+    STRCMP_EQUAL(expected.c_str(), close_and_read().c_str());
+}
+
+TEST(LoggerTest, FullRingDropsRecordsInsteadOfBlocking) {
+    // a full pipe blocks the writer thread, so the ring can not be emptied
+    CHECK_EQUAL(0, ::fcntl(pipe_fds[1], F_SETFL, O_NONBLOCK));
+    const std::string filler(4096, '.');
+    std::size_t filled = 0;
+    while (::write(pipe_fds[1], filler.data(), filler.size()) > 0) {
+        filled += filler.size();
+    }
+    CHECK_EQUAL(EAGAIN, errno);
+    CHECK_EQUAL(0, ::fcntl(pipe_fds[1], F_SETFL, 0));
+
+    std::string output;
+    {
+        printer_lamp::Logger logger(printer_lamp::log_target::stdout_lines, 4, pipe_fds[1]);
+        for (int idx = 0; idx < 10; idx++) {
+            printer_lamp::LogRecord(logger, printer_lamp::log_level::error) << "record " << idx;
+        }
+        UNSIGNED_LONGS_EQUAL(6, logger.get_dropped());
+
+        std::thread reader([this, &output] { output = read_all(pipe_fds[0]); });
+        logger.flush();
+        ::close(pipe_fds[1]);
+        pipe_fds[1] = -1;
+        reader.join();
+    }
+    STRCMP_EQUAL("[error] record 0\n[error] record 1\n[error] record 2\n[error] record 3\n", output.substr(filled).c_str());
+}
+
+TEST(LoggerTest, DisabledLevelsAreNotFormatted) {
+    printer_lamp::Logger& logger = printer_lamp::Logger::get();
+    const printer_lamp::log_level level = logger.get_level();
+    logger.set_level(printer_lamp::log_level::warning);
+    CHECK_FALSE(logger.is_enabled(printer_lamp::log_level::info));
+    CHECK_TRUE(logger.is_enabled(printer_lamp::log_level::error));
+
+    evaluated = 0;
+    LAMP_LOG_DEBUG("not formatted " << count_evaluation());
+    LAMP_LOG_INFO("not formatted " << count_evaluation());
+    LONGS_EQUAL(0, evaluated);
+    logger.set_level(printer_lamp::log_level::off);
+    LAMP_LOG_ERROR("not formatted " << count_evaluation());
+    LONGS_EQUAL(0, evaluated);
+    logger.set_level(level);
+}
+
+TEST(LoggerTest, ParsesLevelsAndTargets) {
+    CHECK_TRUE(printer_lamp::parse_log_level("debug") == printer_lamp::log_level::debug);
+    CHECK_TRUE(printer_lamp::parse_log_level("off") == printer_lamp::log_level::off);
+    CHECK_TRUE(printer_lamp::parse_log_target("journal") == printer_lamp::log_target::journal);
+    STRCMP_EQUAL("warning", printer_lamp::log_level_name(printer_lamp::log_level::warning));
+    bool rejected = false;
+    try {
+        printer_lamp::parse_log_level("verbose");
+    } catch (const std::invalid_argument&) {
+        rejected = true;
+    }
+    CHECK_TRUE(rejected);
+}
@@ -0,0 +1,100 @@
+#include "metrics.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+#include "CppUTest/TestHarness.h"
+
+TEST_GROUP(MetricsTest) {
+};
+
+TEST(MetricsTest, HistogramSortsDurationsIntoPowerOfTwoBuckets) {
+    printer_lamp::LatencyHistogram histogram;
+    histogram.record(std::chrono::nanoseconds(0));
+    histogram.record(std::chrono::nanoseconds(1));
+    histogram.record(std::chrono::nanoseconds(1000)); // [512, 1024)
+    histogram.record(std::chrono::nanoseconds(1024)); // [1024, 2048)
+
+    UNSIGNED_LONGS_EQUAL(4, histogram.get_count());
+    UNSIGNED_LONGS_EQUAL(2025, histogram.get_sum_ns());
+    UNSIGNED_LONGS_EQUAL(1024, histogram.get_max_ns());
+    UNSIGNED_LONGS_EQUAL(1, histogram.get_bucket(0));
+    UNSIGNED_LONGS_EQUAL(1, histogram.get_bucket(1));
+    UNSIGNED_LONGS_EQUAL(1, histogram.get_bucket(10));
+    UNSIGNED_LONGS_EQUAL(1, histogram.get_bucket(11));
+}
+
+TEST(MetricsTest, QuantilesReportTheBucketUpperBound) {
+    printer_lamp::LatencyHistogram histogram;
+    UNSIGNED_LONGS_EQUAL(0, histogram.get_quantile_ns(0.5));
+    for (int idx = 0; idx < 99; idx++) {
+        histogram.record(std::chrono::nanoseconds(100));
+    }
+    histogram.record(std::chrono::microseconds(50));
+
+    UNSIGNED_LONGS_EQUAL(128, histogram.get_quantile_ns(0.5));
+    UNSIGNED_LONGS_EQUAL(128, histogram.get_quantile_ns(0.99));
+    UNSIGNED_LONGS_EQUAL(65536, histogram.get_quantile_ns(0.999));
+}
+
+TEST(MetricsTest, OverlongDurationsEndUpInTheLastBucket) {
+    printer_lamp::LatencyHistogram histogram;
+    histogram.record(std::chrono::hours(1));
+    UNSIGNED_LONGS_EQUAL(1, histogram.get_bucket(printer_lamp::LatencyHistogram::NUM_BUCKETS - 1));
+    UNSIGNED_LONGS_EQUAL(histogram.get_max_ns(), histogram.get_quantile_ns(0.5));
+}
+
+TEST(MetricsTest, SnapshotContainsEveryMetric) {
+    printer_lamp::ServiceMetrics metrics;
+    metrics.method(printer_lamp::dbus_method::set_lamp_state).record(std::chrono::microseconds(3));
+    metrics.signals_emitted.increment();
+    metrics.write_retries.increment(2);
+
+    const auto values = metrics.snapshot();
+    UNSIGNED_LONGS_EQUAL(1, values.at("dbus.set_lamp_state.count"));
+    UNSIGNED_LONGS_EQUAL(0, values.at("dbus.get_metrics.count"));
+    UNSIGNED_LONGS_EQUAL(4096, values.at("dbus.set_lamp_state.p99_ns"));
+    UNSIGNED_LONGS_EQUAL(0, values.at("device.write.count"));
+    UNSIGNED_LONGS_EQUAL(2, values.at("device.write_retries"));
+    UNSIGNED_LONGS_EQUAL(1, values.at("signals.emitted"));
+    UNSIGNED_LONGS_EQUAL(0, values.at("device.absent"));
+}
+
+TEST(MetricsTest, PrometheusTextfileIsReplacedAtomically) {
+    char path_template[] = "/tmp/printer_lamp_metrics_XXXXXX";
+    close(mkstemp(path_template));
+    printer_lamp::ServiceMetrics metrics;
+    metrics.method(printer_lamp::dbus_method::get_lamp_state).record(std::chrono::nanoseconds(300));
+    metrics.signals_emitted.increment(3);
+
+    {
+        printer_lamp::PrometheusTextfileWriter writer(metrics, path_template, std::chrono::seconds(60));
+        CHECK_TRUE(writer.write_once());
+    }
+    std::ifstream file(path_template);
+    std::stringstream content;
+    content << file.rdbuf();
+    const std::string text = content.str();
+    unlink(path_template);
+
+    CHECK_TRUE(text.find("# TYPE printer_lamp_dbus_method_duration_seconds histogram\n") != std::string::npos);
+    CHECK_TRUE(text.find("printer_lamp_dbus_method_duration_seconds_bucket{method=\"get_lamp_state\",le=\"+Inf\"} 1\n") != std::string::npos);
+    CHECK_TRUE(text.find("printer_lamp_dbus_method_duration_seconds_count{method=\"get_lamp_state\"} 1\n") != std::string::npos);
+    CHECK_TRUE(text.find("printer_lamp_signals_emitted_total 3\n") != std::string::npos);
+    CHECK_TRUE(access((std::string(path_template) + ".tmp").c_str(), F_OK) != 0);
+}
+
+TEST(MetricsTest, PrometheusLabelsAreAddedToEverySample) {
+    printer_lamp::ServiceMetrics metrics;
+    metrics.replies_committed.increment();
+    const std::string text = metrics.to_prometheus("lamp=\"bed\"");
+
+    CHECK_TRUE(text.find("printer_lamp_dbus_method_duration_seconds_bucket{lamp=\"bed\",method=\"get_lamp_state\",le=\"+Inf\"} 0\n") != std::string::npos);
+    CHECK_TRUE(text.find("printer_lamp_device_write_duration_seconds_count{lamp=\"bed\"} 0\n") != std::string::npos);
+    CHECK_TRUE(text.find("printer_lamp_signals_emitted_total{lamp=\"bed\"} 0\n") != std::string::npos);
+    CHECK_TRUE(text.find("printer_lamp_replies_total{lamp=\"bed\",result=\"committed\"} 1\n") != std::string::npos);
+}
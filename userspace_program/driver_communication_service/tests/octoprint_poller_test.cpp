@@ -0,0 +1,313 @@
+#include "octoprint_poller.hpp"
+#include "printer_status.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "CppUTest/TestHarness.h"
+
+namespace {
+    // recorded /api/printer responses of OctoPrint
+    const std::string HEATING_RESPONSE = R"({
+  "sd": {"ready": true},
+  "state": {
+    "error": "",
+    "flags": {"cancelling": false, "closedOrError": false, "error": false, "finishing": false, "operational": true, "paused": false,
+              "pausing": false, "printing": false, "ready": true, "resuming": false, "sdReady": true},
+    "text": "Operational"
+  },
+  "temperature": {
+    "bed": {"actual": 22.48, "offset": 0, "target": 70},
+    "tool0": {"actual": 14.56, "offset": 0, "target": 0}
+  }
+})";
+    const std::string PRINTING_RESPONSE = R"({"sd":{"ready":true},"state":{"error":"","flags":{"operational":true,"printing":true,"ready":false},"text":"Printing"},)"
+        R"("temperature":{"bed":{"actual":60.1,"offset":0,"target":60.0},"tool0":{"actual":209.8,"offset":0,"target":210.0}}})";
+    const std::string ERROR_RESPONSE = R"({"error": "Printer is not operational"})";
+
+    std::string http_response(const std::string& body, int status = 200, bool chunked = false) {
+        std::string response = "HTTP/1.1 " + std::to_string(status) + " OK\r\nContent-Type: application/json\r\n";
+        if (!chunked) {
+            return response + "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+        }
+        response += "Transfer-Encoding: chunked\r\n\r\n";
+        for (std::size_t offset = 0; offset < body.size(); offset += 17) {
+            const std::string chunk = body.substr(offset, 17);
+            char size[16];
+            std::snprintf(size, sizeof(size), "%zx", chunk.size());
+            response += std::string(size) + "\r\n" + chunk + "\r\n";
+        }
+        return response + "0\r\n\r\n";
+    }
+
+    // local HTTP server that answers the n-th request with the n-th response (the last one repeats)
+    class OctoPrintStub {
+        public:
+            OctoPrintStub(std::vector<std::string> responses, bool close_after_response) :
+                m_responses{std::move(responses)},
+                m_close_after_response{close_after_response}
+            {
+                m_listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                sockaddr_in address {};
+                address.sin_family = AF_INET;
+                address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                socklen_t length = sizeof(address);
+                ::bind(m_listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+                ::listen(m_listen_fd, 4);
+                ::getsockname(m_listen_fd, reinterpret_cast<sockaddr*>(&address), &length);
+                m_port = std::to_string(ntohs(address.sin_port));
+                m_thread = std::thread(&OctoPrintStub::run, this);
+            }
+
+            ~OctoPrintStub() {
+                m_running.store(false);
+                m_thread.join();
+                ::close(m_listen_fd);
+            }
+
+            const std::string& get_port() const {
+                return m_port;
+            }
+
+            int get_accepted() const {
+                return m_accepted.load();
+            }
+
+            std::vector<std::string> get_requests() {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                return m_requests;
+            }
+
+        private:
+            void run() {
+                int client_fd = -1;
+                std::string received;
+                while (m_running.load()) {
+                    pollfd poll_fd {client_fd >= 0 ? client_fd : m_listen_fd, POLLIN, 0};
+                    if (::poll(&poll_fd, 1, 10) <= 0) {
+                        continue;
+                    }
+                    if (client_fd < 0) {
+                        client_fd = ::accept4(m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                        m_accepted.fetch_add(1);
+                        received.clear();
+                        continue;
+                    }
+                    char buffer[1024];
+                    const ssize_t length = ::recv(client_fd, buffer, sizeof(buffer), 0);
+                    if (length <= 0) {
+                        ::close(client_fd);
+                        client_fd = -1;
+                        continue;
+                    }
+                    received.append(buffer, static_cast<std::size_t>(length));
+                    std::size_t head_end = 0;
+                    while (client_fd >= 0 && (head_end = received.find("\r\n\r\n")) != std::string::npos) {
+                        std::size_t index = 0;
+                        {
+                            std::lock_guard<std::mutex> lock(m_mutex);
+                            m_requests.push_back(received.substr(0, head_end));
+                            index = std::min(m_requests.size() - 1, m_responses.size() - 1);
+                        }
+                        received.erase(0, head_end + 4);
+                        const std::string& response = m_responses[index];
+                        if (::send(client_fd, response.data(), response.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(response.size()) || m_close_after_response) {
+                            ::close(client_fd);
+                            client_fd = -1;
+                        }
+                    }
+                }
+                if (client_fd >= 0) {
+                    ::close(client_fd);
+                }
+            }
+
+            const std::vector<std::string> m_responses;
+            const bool m_close_after_response;
+            int m_listen_fd;
+            std::string m_port;
+            std::atomic<bool> m_running {true};
+            std::atomic<int> m_accepted {0};
+            std::mutex m_mutex;
+            std::vector<std::string> m_requests;
+            std::thread m_thread;
+    };
+
+    printer_lamp::poller_config stub_config(const std::string& port) {
+        printer_lamp::poller_config config;
+        config.host = "127.0.0.1";
+        config.port = port;
+        config.api_key = "TopSecret";
+        config.request_timeout_ms = 500;
+        return config;
+    }
+
+    bool extract(printer_lamp::PrinterStatusExtractor& extractor, const std::string& json) {
+        extractor.reset();
+        return extractor.feed(json.data(), json.size()) && extractor.finish();
+    }
+}
+
+TEST_GROUP(OctoPrintPollerTest) {
+};
+
+TEST(OctoPrintPollerTest, ExtractsTheStatusFields) {
+    printer_lamp::PrinterStatusExtractor extractor;
+    CHECK_TRUE(extract(extractor, HEATING_RESPONSE));
+    const printer_lamp::printer_status& status = extractor.get_status();
+    CHECK_TRUE(status.is_complete());
+    DOUBLES_EQUAL(22.48, *status.bed_actual, 1e-9);
+    DOUBLES_EQUAL(70.0, *status.bed_target, 1e-9);
+    DOUBLES_EQUAL(14.56, *status.tool_actual, 1e-9);
+    DOUBLES_EQUAL(0.0, *status.tool_target, 1e-9);
+    CHECK_FALSE(*status.printing);
+    CHECK_FALSE(status.error); // state.error is not the top-level error
+}
+
+TEST(OctoPrintPollerTest, ExtractsTheStatusFieldsFromSingleBytes) {
+    printer_lamp::PrinterStatusExtractor extractor;
+    for (char c : PRINTING_RESPONSE) {
+        CHECK_TRUE(extractor.feed(&c, 1));
+    }
+    CHECK_TRUE(extractor.finish());
+    DOUBLES_EQUAL(60.1, *extractor.get_status().bed_actual, 1e-9);
+    DOUBLES_EQUAL(210.0, *extractor.get_status().tool_target, 1e-9);
+    CHECK_TRUE(*extractor.get_status().printing);
+}
+
+TEST(OctoPrintPollerTest, IgnoresFieldsOutsideTheirPath) {
+    printer_lamp::PrinterStatusExtractor extractor;
+    const std::string json = R"({"history":[{"bed":{"actual":99}},[1,2,{}]],"bed":{"actual":98},"text":"say \"temperature\" \\",)"
+        R"("temperature":{"bed":{"actual":21.5e0,"target":null,"nested":{"actual":97}},"tool1":{"actual":96}},"state":{"flags":{"printing":true}}})";
+    CHECK_TRUE(extract(extractor, json));
+    const printer_lamp::printer_status& status = extractor.get_status();
+    DOUBLES_EQUAL(21.5, *status.bed_actual, 1e-9);
+    CHECK_FALSE(status.bed_target.has_value()); // null
+    CHECK_FALSE(status.tool_actual.has_value());
+    CHECK_TRUE(*status.printing);
+    CHECK_FALSE(status.is_complete());
+}
+
+TEST(OctoPrintPollerTest, RejectsMalformedJson) {
+    printer_lamp::PrinterStatusExtractor extractor;
+    CHECK_FALSE(extract(extractor, R"({"temperature": {"bed": {"actual": 22.4)"));
+    CHECK_FALSE(extract(extractor, R"({"temperature" 1})"));
+    CHECK_FALSE(extract(extractor, R"({"a": [1, 2}})"));
+    CHECK_FALSE(extract(extractor, R"({"a": 1.2.3})"));
+    CHECK_FALSE(extract(extractor, R"({"a": 1} {)"));
+    CHECK_FALSE(extract(extractor, R"(<html>Bad Gateway</html>)"));
+    CHECK_TRUE(extract(extractor, R"( {"a": [], "b": {}, "c": [[]]} )"));
+}
+
+TEST(OctoPrintPollerTest, DetectsErrorResponses) {
+    printer_lamp::PrinterStatusExtractor extractor;
+    CHECK_TRUE(extract(extractor, ERROR_RESPONSE));
+    CHECK_TRUE(extractor.get_status().error);
+    CHECK_TRUE(extract(extractor, HEATING_RESPONSE));
+    CHECK_FALSE(extractor.get_status().error); // reset clears it
+}
+
+TEST(OctoPrintPollerTest, AppliesTheLampStateRules) {
+    printer_lamp::PrinterStateRules rules(5.0, 5.0, 5.0);
+    printer_lamp::printer_status status;
+    status.bed_actual = 60.0;
+    status.bed_target = 60.0;
+    status.tool_actual = 212.0;
+    status.tool_target = 210.0;
+    status.printing = false;
+    CHECK(printer_lamp::printer_state::standby == rules.apply(status)); // at temperature, but not printing
+
+    status.printing = true;
+    CHECK(printer_lamp::printer_state::printing == rules.apply(status)); // within the heating threshold
+
+    status.bed_target = 80.0;
+    CHECK(printer_lamp::printer_state::heating == rules.apply(status)); // a temperature difference beats printing
+
+    status.bed_target = 0.0;
+    status.tool_target = 0.0;
+    status.printing = false;
+    CHECK(printer_lamp::printer_state::standby == rules.apply(status)); // cooling down without a target
+}
+
+TEST(OctoPrintPollerTest, MovingAverageUsesTheMinimumWhileRamping) {
+    printer_lamp::TemperatureAverage average(5.0);
+    average.add(20.0);
+    DOUBLES_EQUAL(20.0, average.get(), 1e-9);
+    average.add(30.0);
+    DOUBLES_EQUAL(25.0, average.get(), 1e-9); // not full yet, no clipping
+    average.add(40.0);
+    DOUBLES_EQUAL(20.0, average.get(), 1e-9);
+    average.add(41.0);
+    average.add(42.0);
+    DOUBLES_EQUAL(41.0, average.get(), 1e-9);
+    average.clear();
+    average.add(7.0);
+    DOUBLES_EQUAL(7.0, average.get(), 1e-9);
+}
+
+TEST(OctoPrintPollerTest, SendsStateChangesOverOnePersistentConnection) {
+    OctoPrintStub stub({
+        http_response(HEATING_RESPONSE),
+        http_response(PRINTING_RESPONSE, 200, true),
+        http_response(PRINTING_RESPONSE),
+        http_response(PRINTING_RESPONSE, 200, true),
+        http_response(ERROR_RESPONSE, 409),
+        http_response(ERROR_RESPONSE, 409),
+        http_response(PRINTING_RESPONSE)
+    }, false);
+    printer_lamp::OctoPrintPoller poller(stub_config(stub.get_port()));
+
+    CHECK(std::vector<int>({6, 8, 1}) == poller.poll());
+    CHECK(poller.poll().empty()); // the moving average still holds the bed at room temperature
+    CHECK(poller.poll().empty());
+    CHECK(std::vector<int>({6, 8, 2}) == poller.poll());
+    CHECK(std::vector<int>({8}) == poller.poll());
+    CHECK(poller.poll().empty()); // the reset is only sent once
+    CHECK(std::vector<int>({6, 8, 2}) == poller.poll()); // sent again after the error
+
+    LONGS_EQUAL(1, stub.get_accepted());
+    UNSIGNED_LONGS_EQUAL(1, poller.get_connection().get_connects());
+    const auto requests = stub.get_requests();
+    UNSIGNED_LONGS_EQUAL(7, requests.size());
+    CHECK(requests[0].find("GET /api/printer HTTP/1.1\r\n") == 0);
+    CHECK(requests[0].find("\r\nX-Api-Key: TopSecret") != std::string::npos);
+}
+
+TEST(OctoPrintPollerTest, ReconnectsOnceTheServerClosedTheConnection) {
+    OctoPrintStub stub({http_response(HEATING_RESPONSE)}, true);
+    printer_lamp::OctoPrintPoller poller(stub_config(stub.get_port()));
+
+    CHECK(std::vector<int>({6, 8, 1}) == poller.poll());
+    CHECK(poller.poll().empty());
+    CHECK(poller.poll().empty());
+    UNSIGNED_LONGS_EQUAL(3, stub.get_requests().size());
+    LONGS_EQUAL(3, stub.get_accepted());
+}
+
+TEST(OctoPrintPollerTest, ForgottenStateIsSentAgain) {
+    OctoPrintStub stub({http_response(HEATING_RESPONSE)}, false);
+    printer_lamp::OctoPrintPoller poller(stub_config(stub.get_port()));
+
+    CHECK(std::vector<int>({6, 8, 1}) == poller.poll());
+    poller.forget_state(); // e.g. the driver service was not reachable
+    CHECK(std::vector<int>({6, 8, 1}) == poller.poll());
+}
+
+TEST(OctoPrintPollerTest, UnreachableServerSendsNothing) {
+    std::string port;
+    {
+        OctoPrintStub stub({http_response(HEATING_RESPONSE)}, false);
+        port = stub.get_port();
+    }
+    printer_lamp::OctoPrintPoller poller(stub_config(port));
+    CHECK(poller.poll().empty());
+    CHECK_FALSE(poller.get_state().has_value());
+}
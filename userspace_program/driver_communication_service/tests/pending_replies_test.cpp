@@ -0,0 +1,98 @@
+#include "pending_replies.hpp"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "CppUTest/TestHarness.h"
+
+namespace {
+    struct reply_log {
+        std::vector<std::pair<int, bool>> replies;
+
+        printer_lamp::PendingReplies<int>::completion_callback callback() {
+            return [this](int& id, bool committed) { replies.emplace_back(id, committed); };
+        }
+    };
+}
+
+TEST_GROUP(PendingRepliesTest) {
+};
+
+TEST(PendingRepliesTest, CommitCompletesAllRepliesUpToTheSequence) {
+    reply_log log;
+    printer_lamp::PendingReplies<int> pending(std::chrono::seconds(10), 8, log.callback());
+    pending.add(1, 1);
+    pending.add(2, 2);
+    pending.add(4, 4);
+
+    pending.commit(3);
+    UNSIGNED_LONGS_EQUAL(2, log.replies.size());
+    CHECK_TRUE(log.replies[0] == std::make_pair(1, true));
+    CHECK_TRUE(log.replies[1] == std::make_pair(2, true));
+    UNSIGNED_LONGS_EQUAL(1, pending.size());
+}
+
+TEST(PendingRepliesTest, AlreadyCommittedSequenceIsAnsweredImmediately) {
+    reply_log log;
+    printer_lamp::PendingReplies<int> pending(std::chrono::seconds(10), 8, log.callback());
+    pending.commit(5);
+    pending.add(5, 5);
+    UNSIGNED_LONGS_EQUAL(1, log.replies.size());
+    CHECK_TRUE(log.replies[0].second);
+    UNSIGNED_LONGS_EQUAL(0, pending.size());
+}
+
+TEST(PendingRepliesTest, ExpiredRepliesAreCompletedWithFalse) {
+    reply_log log;
+    printer_lamp::PendingReplies<int> pending(std::chrono::milliseconds(20), 8, log.callback());
+    pending.add(1, 1);
+    for (int idx = 0; idx < 200 && pending.size() > 0; idx++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    UNSIGNED_LONGS_EQUAL(0, pending.size());
+    pending.commit(1); // too late, must not answer twice
+    pending.stop();
+    UNSIGNED_LONGS_EQUAL(1, log.replies.size());
+    CHECK_FALSE(log.replies[0].second);
+}
+
+TEST(PendingRepliesTest, StopFailsThePendingReplies) {
+    reply_log log;
+    printer_lamp::PendingReplies<int> pending(std::chrono::seconds(10), 8, log.callback());
+    pending.add(1, 1);
+    pending.stop();
+    pending.add(2, 2);
+    UNSIGNED_LONGS_EQUAL(2, log.replies.size());
+    CHECK_FALSE(log.replies[0].second);
+    CHECK_FALSE(log.replies[1].second);
+}
+
+TEST(PendingRepliesTest, CancelCompletesOnlyThatReplyWithFalse) {
+    reply_log log;
+    printer_lamp::PendingReplies<int> pending(std::chrono::seconds(10), 8, log.callback());
+    pending.add(1, 1);
+    pending.add(2, 2);
+    pending.add(3, 3);
+
+    pending.cancel(2);
+    pending.commit(3);
+    UNSIGNED_LONGS_EQUAL(3, log.replies.size());
+    CHECK_TRUE(log.replies[0] == std::make_pair(2, false));
+    CHECK_TRUE(log.replies[1] == std::make_pair(1, true));
+    CHECK_TRUE(log.replies[2] == std::make_pair(3, true));
+}
+
+TEST(PendingRepliesTest, CancelBeforeTheReplyIsAddedIsRemembered) {
+    reply_log log;
+    printer_lamp::PendingReplies<int> pending(std::chrono::seconds(10), 8, log.callback());
+    // the worker may drop a command and commit the one behind it before the request is added
+    pending.cancel(1);
+    pending.commit(2);
+    pending.add(1, 1);
+    pending.add(2, 2);
+    UNSIGNED_LONGS_EQUAL(2, log.replies.size());
+    CHECK_TRUE(log.replies[0] == std::make_pair(1, false));
+    CHECK_TRUE(log.replies[1] == std::make_pair(2, true));
+    UNSIGNED_LONGS_EQUAL(0, pending.size());
+}
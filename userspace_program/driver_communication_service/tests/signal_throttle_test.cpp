@@ -0,0 +1,89 @@
+#include "signal_throttle.hpp"
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CppUTest/TestHarness.h"
+
+namespace {
+    struct signal_log {
+        std::mutex mutex;
+        std::vector<printer_lamp::lamp_state_update> emitted;
+
+        printer_lamp::SignalThrottle::emit_callback callback() {
+            return [this](const printer_lamp::lamp_state_update& update) {
+                std::lock_guard<std::mutex> lock(mutex);
+                emitted.push_back(update);
+            };
+        }
+
+        std::size_t size() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return emitted.size();
+        }
+    };
+
+    printer_lamp::lamp_state_update make_update(int state, std::uint64_t sequence) {
+        return {state, sequence, 0b001};
+    }
+}
+
+TEST_GROUP(SignalThrottleTest) {
+};
+
+TEST(SignalThrottleTest, WithoutIntervalEveryUpdateIsEmitted) {
+    signal_log log;
+    printer_lamp::Counter suppressed;
+    printer_lamp::SignalThrottle throttle(std::chrono::milliseconds(0), suppressed, log.callback());
+    for (std::uint64_t sequence = 1; sequence <= 5; sequence++) {
+        throttle.publish(make_update(0, sequence));
+    }
+    throttle.stop();
+    UNSIGNED_LONGS_EQUAL(5, log.size());
+    UNSIGNED_LONGS_EQUAL(0, suppressed.get());
+}
+
+TEST(SignalThrottleTest, BurstEmitsFirstAndFinalState) {
+    signal_log log;
+    printer_lamp::Counter suppressed;
+    printer_lamp::SignalThrottle throttle(std::chrono::milliseconds(30), suppressed, log.callback());
+    throttle.publish(make_update(8, 1));
+    throttle.publish(make_update(0, 2));
+    throttle.publish(make_update(4, 3));
+    throttle.publish(make_update(2, 4));
+    UNSIGNED_LONGS_EQUAL(1, log.size()); // the leading edge goes out right away
+
+    for (int idx = 0; idx < 200 && log.size() < 2; idx++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    throttle.stop();
+    UNSIGNED_LONGS_EQUAL(2, log.size());
+    LONGS_EQUAL(8, log.emitted[0].state);
+    LONGS_EQUAL(2, log.emitted[1].state);
+    UNSIGNED_LONGS_EQUAL(4, log.emitted[1].sequence);
+    UNSIGNED_LONGS_EQUAL(2, suppressed.get());
+}
+
+TEST(SignalThrottleTest, StopDeliversThePendingUpdate) {
+    signal_log log;
+    printer_lamp::Counter suppressed;
+    printer_lamp::SignalThrottle throttle(std::chrono::seconds(10), suppressed, log.callback());
+    throttle.publish(make_update(0, 1));
+    throttle.publish(make_update(3, 2));
+    throttle.stop();
+    UNSIGNED_LONGS_EQUAL(2, log.size());
+    UNSIGNED_LONGS_EQUAL(2, log.emitted[1].sequence);
+}
+
+TEST(SignalThrottleTest, NeverEmitsAnOlderSequence) {
+    signal_log log;
+    printer_lamp::Counter suppressed;
+    printer_lamp::SignalThrottle throttle(std::chrono::milliseconds(0), suppressed, log.callback());
+    throttle.publish(make_update(1, 2));
+    throttle.publish(make_update(0, 1));
+    throttle.stop();
+    UNSIGNED_LONGS_EQUAL(1, log.size());
+    UNSIGNED_LONGS_EQUAL(2, log.emitted[0].sequence);
+}
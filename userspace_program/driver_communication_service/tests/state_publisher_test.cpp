@@ -0,0 +1,125 @@
+#include "state_publisher.hpp"
+#include "lamp_state_snapshot.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "CppUTest/TestHarness.h"
+
+TEST_GROUP(StatePublisherTest) {
+    std::string path;
+
+    void setup() {
+        char path_template[] = "/tmp/printer_lamp_state_XXXXXX";
+        int fd = mkstemp(path_template);
+        close(fd);
+        unlink(path_template);
+        path = path_template;
+    }
+
+    void teardown() {
+        unlink(path.c_str());
+    }
+};
+
+TEST(StatePublisherTest, ReadersSeeThePublishedState) {
+    printer_lamp::StatePublisher publisher(path);
+    printer_lamp::LampStateSnapshotReader reader(path);
+    printer_lamp::lamp_state_snapshot snapshot;
+    CHECK_TRUE(reader.read(snapshot));
+    UNSIGNED_LONGS_EQUAL(0, snapshot.sequence);
+    LONGS_EQUAL(-1, snapshot.command);
+    UNSIGNED_LONGS_EQUAL(0xFF, snapshot.mask);
+    CHECK_TRUE(snapshot.changed_ns > 0);
+
+    publisher.publish(printer_lamp::lamp_state_update{4, 7, 0b110});
+    publisher.publish_health(printer_lamp::device_health::degraded);
+    CHECK_TRUE(reader.read(snapshot));
+    UNSIGNED_LONGS_EQUAL(7, snapshot.sequence);
+    LONGS_EQUAL(4, snapshot.command);
+    UNSIGNED_LONGS_EQUAL(0b110, snapshot.mask);
+    UNSIGNED_LONGS_EQUAL(1, snapshot.health);
+    UNSIGNED_LONGS_EQUAL(3, reader.get_version());
+}
+
+TEST(StatePublisherTest, ReadersNeverSeeAHalfWrittenUpdate) {
+    printer_lamp::StatePublisher publisher(path);
+    std::atomic<bool> running {true};
+    std::atomic<int> torn {0};
+    std::atomic<int> reads {0};
+    std::vector<std::thread> readers;
+    for (int idx = 0; idx < 3; idx++) {
+        readers.emplace_back([this, &running, &torn, &reads] {
+            printer_lamp::LampStateSnapshotReader reader(path);
+            printer_lamp::lamp_state_snapshot snapshot;
+            while (running.load()) {
+                if (!reader.read(snapshot)) {
+                    continue;
+                }
+                // every update derives the command and the mask from its sequence number
+                if (snapshot.sequence > 0 && (snapshot.command != static_cast<int>(snapshot.sequence % 9) || snapshot.mask != (snapshot.sequence & 0x7))) {
+                    torn.fetch_add(1);
+                }
+                reads.fetch_add(1);
+            }
+        });
+    }
+    for (std::uint64_t sequence = 1; sequence <= 200000; sequence++) {
+        publisher.publish(printer_lamp::lamp_state_update{static_cast<int>(sequence % 9), sequence, static_cast<std::uint8_t>(sequence & 0x7)});
+    }
+    running.store(false);
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    LONGS_EQUAL(0, torn.load());
+    CHECK_TRUE(reads.load() > 0);
+}
+
+TEST(StatePublisherTest, ReadersKeepTheirMappingAcrossARestart) {
+    std::unique_ptr<printer_lamp::StatePublisher> publisher = std::make_unique<printer_lamp::StatePublisher>(path);
+    publisher->publish(printer_lamp::lamp_state_update{1, 1, 0b001});
+    printer_lamp::LampStateSnapshotReader reader(path);
+    const std::uint64_t version = reader.get_version();
+
+    publisher.reset();
+    publisher = std::make_unique<printer_lamp::StatePublisher>(path);
+    publisher->publish(printer_lamp::lamp_state_update{3, 2, 0b111});
+    printer_lamp::lamp_state_snapshot snapshot;
+    CHECK_TRUE(reader.read(snapshot));
+    LONGS_EQUAL(3, snapshot.command);
+    CHECK_TRUE(reader.get_version() > version);
+}
+
+TEST(StatePublisherTest, SequenceCarriesOverARestart) {
+    std::unique_ptr<printer_lamp::StatePublisher> publisher = std::make_unique<printer_lamp::StatePublisher>(path);
+    UNSIGNED_LONGS_EQUAL(0, publisher->get_sequence());
+    publisher->publish(printer_lamp::lamp_state_update{1, 5, 0b001});
+
+    publisher.reset();
+    publisher = std::make_unique<printer_lamp::StatePublisher>(path);
+    UNSIGNED_LONGS_EQUAL(5, publisher->get_sequence());
+    printer_lamp::LampStateSnapshotReader reader(path);
+    printer_lamp::lamp_state_snapshot snapshot;
+    CHECK_TRUE(reader.read(snapshot));
+    UNSIGNED_LONGS_EQUAL(5, snapshot.sequence);
+    LONGS_EQUAL(-1, snapshot.command);
+}
+
+TEST(StatePublisherTest, RejectsFilesThatAreNoLampState) {
+    FILE* file = fopen(path.c_str(), "w");
+    fputs("no lamp state, but long enough to be mapped like one ..............", file);
+    fclose(file);
+    bool rejected = false;
+    try {
+        printer_lamp::LampStateSnapshotReader reader(path);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    CHECK_TRUE(rejected);
+}
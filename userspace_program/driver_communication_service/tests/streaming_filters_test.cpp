@@ -0,0 +1,128 @@
+#include "streaming_filters.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+
+#include "CppUTest/TestHarness.h"
+
+namespace {
+    // deterministic noise in [-0.5, 0.5)
+    double noise(std::uint64_t& state) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<double>(state >> 11) / 9007199254740992.0 - 0.5;
+    }
+}
+
+TEST_GROUP(StreamingFiltersTest) {
+};
+
+TEST(StreamingFiltersTest, RingBufferOverwritesTheOldestValue) {
+    printer_lamp::RingBuffer<int, 3> buffer;
+    CHECK_TRUE(buffer.empty());
+    int evicted = -1;
+    CHECK_FALSE(buffer.push(1, evicted));
+    buffer.push(2);
+    buffer.push(3);
+    CHECK_TRUE(buffer.full());
+    CHECK_TRUE(buffer.push(4, evicted));
+    LONGS_EQUAL(1, evicted);
+    LONGS_EQUAL(2, buffer.oldest());
+    LONGS_EQUAL(3, buffer[1]);
+    LONGS_EQUAL(4, buffer.newest());
+    UNSIGNED_LONGS_EQUAL(3, buffer.size());
+    buffer.clear();
+    UNSIGNED_LONGS_EQUAL(0, buffer.size());
+}
+
+TEST(StreamingFiltersTest, RunningMeanDoesNotDrift) {
+    printer_lamp::RunningMean<double, 8> mean;
+    std::deque<double> window;
+    std::uint64_t state = 42;
+    for (int idx = 0; idx < 1000000; idx++) {
+        // large offsets in between small values are the worst case of an uncompensated sum
+        const double value = (idx % 1000 == 0) ? 1e9 : 20.0 + noise(state);
+        mean.add(value);
+        window.push_back(value);
+        if (window.size() > 8) {
+            window.pop_front();
+        }
+    }
+    double expected = 0.0;
+    for (double value : window) {
+        expected += value;
+    }
+    DOUBLES_EQUAL(expected / 8.0, mean.mean(), 1e-12);
+}
+
+TEST(StreamingFiltersTest, RunningMeanOfIntegersIsExact) {
+    printer_lamp::RunningMean<std::int64_t, 4> mean;
+    LONGS_EQUAL(0, mean.mean());
+    for (std::int64_t value = 1; value <= 10; value++) {
+        mean.add(value);
+    }
+    LONGS_EQUAL(7 + 8 + 9 + 10, mean.sum());
+}
+
+TEST(StreamingFiltersTest, SlidingMinMaxFollowTheWindow) {
+    printer_lamp::SlidingMin<int, 4> sliding_min;
+    printer_lamp::SlidingMax<int, 4> sliding_max;
+    std::deque<int> window;
+    std::uint64_t state = 7;
+    for (int idx = 0; idx < 10000; idx++) {
+        const int value = static_cast<int>(noise(state) * 100);
+        sliding_min.add(value);
+        sliding_max.add(value);
+        window.push_back(value);
+        if (window.size() > 4) {
+            window.pop_front();
+        }
+        LONGS_EQUAL(*std::min_element(window.begin(), window.end()), sliding_min.get());
+        LONGS_EQUAL(*std::max_element(window.begin(), window.end()), sliding_max.get());
+    }
+}
+
+TEST(StreamingFiltersTest, SlidingMinKeepsEqualValues) {
+    printer_lamp::SlidingMin<int, 2> sliding_min;
+    sliding_min.add(5);
+    sliding_min.add(5);
+    sliding_min.add(9);
+    LONGS_EQUAL(5, sliding_min.get());
+    sliding_min.add(9);
+    LONGS_EQUAL(9, sliding_min.get());
+}
+
+TEST(StreamingFiltersTest, ExponentialMovingAverageStartsAtTheFirstValue) {
+    printer_lamp::ExponentialMovingAverage<double> average(0.5);
+    CHECK_TRUE(average.empty());
+    average.add(20.0);
+    DOUBLES_EQUAL(20.0, average.get(), 1e-12);
+    average.add(30.0);
+    DOUBLES_EQUAL(25.0, average.get(), 1e-12);
+    average.add(30.0);
+    DOUBLES_EQUAL(27.5, average.get(), 1e-12);
+}
+
+TEST(StreamingFiltersTest, HysteresisIgnoresNoiseBetweenTheThresholds) {
+    printer_lamp::Hysteresis<double> heating(5.0, 2.0);
+    CHECK_FALSE(heating.update(4.9));
+    CHECK_TRUE(heating.update(5.1));
+    CHECK_TRUE(heating.update(3.0));
+    CHECK_TRUE(heating.update(4.5));
+    CHECK_FALSE(heating.update(1.9));
+    CHECK_FALSE(heating.update(4.0));
+}
+
+TEST(StreamingFiltersTest, ClippedMovingAverageUsesTheMinimumWhileRamping) {
+    printer_lamp::ClippedMovingAverage<double, 3> average(5.0);
+    average.add(20.0);
+    average.add(21.0);
+    DOUBLES_EQUAL(20.5, average.get(), 1e-12);
+    average.add(60.0);
+    DOUBLES_EQUAL(20.0, average.get(), 1e-12); // ramping up
+    average.add(61.0);
+    average.add(62.0);
+    DOUBLES_EQUAL(61.0, average.get(), 1e-12);
+    average.add(30.0);
+    DOUBLES_EQUAL(30.0, average.get(), 1e-12); // cooling down
+}
@@ -35,4 +35,8 @@ class DBusLampBridge:
         return self.printer_lamp_interface.get_lamp_state()
 
     def set_state(self, state):
-        self.printer_lamp_interface.set_lamp_state(state)
+        # the service replies once the command was written to the lamp driver
+        written = self.printer_lamp_interface.set_lamp_state(state)
+        if not written:
+            logging.warning("Lamp state " + str(state) + " was not written to the driver in time")
+        return bool(written)